@@ -18,6 +18,9 @@ fn main() {
         ..Default::default()
     };
 
+    // Make the header usable from C++ (extern "C" block, enums with a fixed underlying type)
+    cbindgen_config.cpp_compat = true;
+
     // Avoid conflicts between enumeration values
     cbindgen_config.enumeration.prefix_with_name = true;
 
@@ -7,6 +7,12 @@
 #include <stdlib.h>
 #define PLUGIN_API __attribute__((visibility("default")))
 
+/**
+ * Length of a buffer that can hold any numeric resource or consumer id,
+ * see [`mpoint_resource_id_ref`] and [`mpoint_consumer_id_ref`].
+ */
+#define FFI_ID_BUFFER_LEN 16
+
 /**
  * Enum of the possible measurement types.
  */
@@ -15,6 +21,29 @@ typedef enum WrappedMeasurementType {
   WrappedMeasurementType_U64,
 } WrappedMeasurementType;
 
+/**
+ * Outcome of a call to a source, transform or output implemented in C.
+ */
+typedef enum FfiStatusCode {
+  /**
+   * The call succeeded.
+   */
+  FfiStatusCode_Ok,
+  /**
+   * The error is temporary, calling the element again may work.
+   *
+   * For a source or an output, this is [`PollError::CanRetry`](pipeline::PollError::CanRetry)
+   * or [`WriteError::CanRetry`](pipeline::WriteError::CanRetry): Alumet keeps the element.
+   * For a transform, this is [`TransformError::UnexpectedInput`](pipeline::TransformError::UnexpectedInput):
+   * the measurements are invalid but the transform can be used on other measurements.
+   */
+  FfiStatusCode_Retry,
+  /**
+   * The element cannot recover from the error, Alumet stops using it.
+   */
+  FfiStatusCode_Fatal,
+} FfiStatusCode;
+
 /**
  * Structure passed to plugins for the start-up phase.
  *
@@ -59,6 +88,11 @@ typedef struct ConfigArray ConfigArray;
  */
 typedef struct ConfigTable ConfigTable;
 
+/**
+ * Error message of a [`FfiStatus`], owned by Alumet.
+ */
+typedef struct FfiErrorMessage FfiErrorMessage;
+
 /**
  * An accumulator stores measured data points.
  * Unlike a [`MeasurementBuffer`], the accumulator only allows to [`push`](MeasurementAccumulator::push) new points, not to modify them.
@@ -142,6 +176,103 @@ typedef struct FfiMeasurementValue {
   };
 } FfiMeasurementValue;
 
+/**
+ * Shared, reference-counted handle to a [`Resource`].
+ *
+ * This is not a plain identifier, but a pointer that owns a reference to the resource, like an [`Arc`].
+ * A handle is as small as a pointer and cloning it does not copy the resource, which makes it cheap to attach
+ * the same resource to many measurement points. Cloning and dropping a handle are atomic operations on
+ * the reference count: borrow it when possible. The resource is freed when its last handle is dropped,
+ * for instance when the source that measures it has been removed and its points have been written.
+ *
+ * [`Resource::LocalMachine`] is not allocated at all, see [`ResourceId::LOCAL_MACHINE`].
+ */
+typedef struct ResourceId {
+  const void *_0;
+} ResourceId;
+
+/**
+ * Shared, reference-counted handle to a [`ResourceConsumer`].
+ *
+ * See [`ResourceId`].
+ */
+typedef struct ConsumerId {
+  const void *_0;
+} ConsumerId;
+
+/**
+ * A measurement point in a batch, without boxing.
+ *
+ * The resource and the consumer must be interned beforehand, with [`resource_intern`](super::resources::resource_intern)
+ * and [`consumer_intern`](super::resources::consumer_intern). The record borrows them: the plugin keeps its handles,
+ * and releases them when it no longer needs them.
+ * The attributes of the point are `attributes[attributes_start..attributes_start+attributes_len]`, in the attribute block
+ * of the batch. Several points can share the same attributes.
+ */
+typedef struct FfiPointRecord {
+  struct FfiMeasurementValue value;
+  struct RawMetricId metric;
+  struct ResourceId resource;
+  struct ConsumerId consumer;
+  uint32_t attributes_start;
+  uint32_t attributes_len;
+} FfiPointRecord;
+
+/**
+ * The key of an attribute.
+ *
+ * Attribute keys are interned in a process-wide table: each distinct key is stored once,
+ * and the measurement points only store its small identifier.
+ * Plugins should register their keys at startup with [`AlumetStart::create_attribute_key`](crate::plugin::AlumetStart::create_attribute_key)
+ * (or [`AttributeKey::new`]), instead of giving a string to [`MeasurementPoint::with_attr`] for each point.
+ * The keys are never freed: keys that come from untrusted data, for instance from the network,
+ * must be created with [`AttributeKey::try_new`], which bounds the size of the table.
+ *
+ * The keys are ordered by registration, not by name. This gives a stable order to the attributes of every point.
+ */
+typedef struct AttributeKey {
+  uint32_t _0;
+} AttributeKey;
+
+/**
+ * Value of an attribute, in a batch of points or read from a point.
+ */
+typedef enum FfiAttributeValue_Tag {
+  FfiAttributeValue_U64,
+  FfiAttributeValue_F64,
+  FfiAttributeValue_Boolean,
+  /**
+   * A string attribute: copied when the points are pushed, borrowed from the point when it is read.
+   */
+  FfiAttributeValue_Str,
+} FfiAttributeValue_Tag;
+
+typedef struct FfiAttributeValue {
+  FfiAttributeValue_Tag tag;
+  union {
+    struct {
+      uint64_t u64;
+    };
+    struct {
+      double f64;
+    };
+    struct {
+      bool boolean;
+    };
+    struct {
+      struct AStr str;
+    };
+  };
+} FfiAttributeValue;
+
+/**
+ * An attribute in the attribute block of a batch of points.
+ */
+typedef struct FfiAttribute {
+  struct AttributeKey key;
+  struct FfiAttributeValue value;
+} FfiAttribute;
+
 /**
  * FFI equivalent to [`String`].
  *
@@ -153,9 +284,53 @@ typedef struct AString {
   char *ptr;
 } AString;
 
+/**
+ * A read-only view of the points of a [`MeasurementBuffer`], which are stored contiguously.
+ *
+ * The point `i` (with `i < len`) is at the address `(const char*)points + i*stride`.
+ * The view is valid as long as the buffer is not modified.
+ */
+typedef struct FfiBufferView {
+  const struct MeasurementPoint *points;
+  uintptr_t len;
+  /**
+   * Distance between two points, in bytes.
+   */
+  uintptr_t stride;
+} FfiBufferView;
+
 typedef void (*ForeachPointFn)(void*, const struct MeasurementPoint*);
 
-enum FfiUnit_Tag {
+/**
+ * A view of the points of a [`MeasurementBuffer`] that allows to modify them in place.
+ *
+ * The point `i` (with `i < len`) is at the address `(char*)points + i*stride`.
+ * The view is valid as long as no point is added to or removed from the buffer.
+ */
+typedef struct FfiBufferViewMut {
+  struct MeasurementPoint *points;
+  uintptr_t len;
+  /**
+   * Distance between two points, in bytes.
+   */
+  uintptr_t stride;
+} FfiBufferViewMut;
+
+typedef bool (*RetainPointFn)(void*, const struct MeasurementPoint*);
+
+/**
+ * The bits of a measurement value, whose type is given separately.
+ */
+typedef union FfiRawValue {
+  uint64_t u64;
+  double f64;
+} FfiRawValue;
+
+enum FfiUnit_Tag
+#ifdef __cplusplus
+  : uint8_t
+#endif // __cplusplus
+ {
   /**
    * Indicates a dimensionless value. This is suitable for counters.
    */
@@ -201,7 +376,9 @@ enum FfiUnit_Tag {
    */
   FfiUnit_Custom,
 };
+#ifndef __cplusplus
 typedef uint8_t FfiUnit_Tag;
+#endif // __cplusplus
 
 typedef struct FfiUnit_Custom_Body {
   FfiUnit_Tag tag;
@@ -224,17 +401,34 @@ typedef struct TimeDuration {
   struct Timestamp t;
 } TimeDuration;
 
-typedef void (*SourcePollFn)(void *instance,
-                             struct MeasurementAccumulator *buffer,
-                             struct Timestamp timestamp);
+/**
+ * Status returned by the sources, transforms and outputs that are implemented in C.
+ *
+ * Use [`status_ok`], [`status_retry`] or [`status_fatal`] to create it.
+ */
+typedef struct FfiStatus {
+  enum FfiStatusCode code;
+  /**
+   * Optional error message, null if there is none.
+   */
+  struct FfiErrorMessage *message;
+} FfiStatus;
+
+typedef struct FfiStatus (*SourcePollFn)(void *instance,
+                                         struct MeasurementAccumulator *buffer,
+                                         struct Timestamp timestamp);
 
 typedef void (*NullableDropFn)(void *instance);
 
-typedef void (*TransformApplyFn)(void *instance, struct MeasurementBuffer *buffer);
+typedef struct FfiStatus (*TransformApplyFn)(void *instance, struct MeasurementBuffer *buffer);
 
-typedef void (*OutputWriteFn)(void *instance,
-                              const struct MeasurementBuffer *buffer,
-                              const struct FfiOutputContext *ctx);
+typedef struct FfiStatus (*OutputWriteFn)(void *instance,
+                                          const struct MeasurementBuffer *buffer,
+                                          const struct FfiOutputContext *ctx);
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
 
 struct NullableAStr config_string_in(const ConfigTable *table, struct AStr key);
 
@@ -302,20 +496,107 @@ struct Timestamp mpoint_timestamp(const struct MeasurementPoint *point);
 
 struct FfiResourceId mpoint_resource(const struct MeasurementPoint *point);
 
+/**
+ * Returns the kind of the resource, as a new string that must be freed with [`astring_free`](super::string::astring_free).
+ *
+ * Prefer [`mpoint_resource_kind_ref`], which does not allocate.
+ */
 struct AString mpoint_resource_kind(const struct MeasurementPoint *point);
 
+/**
+ * Returns the id of the resource, as a new string that must be freed with [`astring_free`](super::string::astring_free).
+ *
+ * Prefer [`mpoint_resource_id_ref`], which does not allocate.
+ */
 struct AString mpoint_resource_id(const struct MeasurementPoint *point);
 
 struct FfiConsumerId mpoint_consumer(const struct MeasurementPoint *point);
 
+/**
+ * Returns the kind of the consumer, as a new string that must be freed with [`astring_free`](super::string::astring_free).
+ *
+ * Prefer [`mpoint_consumer_kind_ref`], which does not allocate.
+ */
 struct AString mpoint_consumer_kind(const struct MeasurementPoint *point);
 
+/**
+ * Returns the id of the consumer, as a new string that must be freed with [`astring_free`](super::string::astring_free).
+ *
+ * Prefer [`mpoint_consumer_id_ref`], which does not allocate.
+ */
 struct AString mpoint_consumer_id(const struct MeasurementPoint *point);
 
+/**
+ * Returns the kind of the resource. The string is borrowed and must **not** be freed.
+ */
+struct AStr mpoint_resource_kind_ref(const struct MeasurementPoint *point);
+
+/**
+ * Returns the id of the resource, without allocating. The string is borrowed and must **not** be freed.
+ *
+ * The textual ids are borrowed from the point. The numeric ids are formatted into `buf`,
+ * which must be at least [`FFI_ID_BUFFER_LEN`] bytes long (if it is shorter, an empty string is returned).
+ * The string is valid as long as the point and the buffer are.
+ *
+ * # Safety
+ * `buf` must be null or point to `buf_len` writable bytes.
+ */
+struct AStr mpoint_resource_id_ref(const struct MeasurementPoint *point,
+                                   char *buf,
+                                   uintptr_t buf_len);
+
+/**
+ * Returns the kind of the consumer. The string is borrowed and must **not** be freed.
+ */
+struct AStr mpoint_consumer_kind_ref(const struct MeasurementPoint *point);
+
+/**
+ * Returns the id of the consumer, without allocating. The string is borrowed and must **not** be freed.
+ *
+ * See [`mpoint_resource_id_ref`].
+ *
+ * # Safety
+ * `buf` must be null or point to `buf_len` writable bytes.
+ */
+struct AStr mpoint_consumer_id_ref(const struct MeasurementPoint *point,
+                                   char *buf,
+                                   uintptr_t buf_len);
+
+/**
+ * Returns the number of attributes attached to the point.
+ */
+uintptr_t mpoint_attributes_len(const struct MeasurementPoint *point);
+
+/**
+ * Reads the attribute at `index` into `attribute`.
+ *
+ * Returns `false`, without modifying `attribute`, if `index` is not lower than [`mpoint_attributes_len`].
+ *
+ * The attributes are sorted by key id, that is, in the order in which the keys have been registered (not by name).
+ * A string value is borrowed from the point: it is valid as long as the point is.
+ *
+ * # Safety
+ * `attribute` must be a valid pointer.
+ */
+bool mpoint_attribute_at(const struct MeasurementPoint *point,
+                         uintptr_t index,
+                         struct FfiAttribute *attribute);
+
+/**
+ * Returns the name of an attribute key. The string is borrowed and must **not** be freed.
+ */
+struct AStr attribute_key_name(struct AttributeKey key);
+
 uintptr_t mbuffer_len(const struct MeasurementBuffer *buf);
 
 void mbuffer_reserve(struct MeasurementBuffer *buf, uintptr_t additional);
 
+/**
+ * Returns a read-only view of the points of the buffer, which allows to iterate on them with a simple loop,
+ * instead of [`mbuffer_foreach`].
+ */
+struct FfiBufferView mbuffer_view(const struct MeasurementBuffer *buf);
+
 /**
  * Iterates on a [`MeasurementBuffer`] by calling `f(data, point)` for each point of the buffer.
  */
@@ -333,6 +614,129 @@ void mbuffer_push(struct MeasurementBuffer *buf, struct MeasurementPoint *point)
  */
 void maccumulator_push(struct MeasurementAccumulator *buf, struct MeasurementPoint *point);
 
+/**
+ * Registers an attribute key, or returns the existing key with the same name.
+ *
+ * Register the keys once (for instance in the start function of the plugin), then use them in [`FfiAttribute`]s.
+ * The keys are never freed.
+ */
+struct AttributeKey attribute_key(struct AStr name);
+
+/**
+ * Adds a batch of `len` measurement points to the accumulator, with a single call.
+ *
+ * All the points have the same `timestamp`. Their attributes are taken from the block
+ * `attributes` of length `attributes_len`, see [`FfiPointRecord`].
+ * The records and the attributes are copied, they can be reused after the call.
+ *
+ * Returns the number of points that have been added: the points with invalid attributes are ignored.
+ */
+uintptr_t maccumulator_push_batch(struct MeasurementAccumulator *buf,
+                                  struct Timestamp timestamp,
+                                  const struct FfiPointRecord *points,
+                                  uintptr_t len,
+                                  const struct FfiAttribute *attributes,
+                                  uintptr_t attributes_len);
+
+/**
+ * Adds a batch of `len` measurement points to the buffer, with a single call.
+ *
+ * See [`maccumulator_push_batch`].
+ */
+uintptr_t mbuffer_push_batch(struct MeasurementBuffer *buf,
+                             struct Timestamp timestamp,
+                             const struct FfiPointRecord *points,
+                             uintptr_t len,
+                             const struct FfiAttribute *attributes,
+                             uintptr_t attributes_len);
+
+/**
+ * Sets the value of a point. The new value must have the same type as the values of the metric.
+ *
+ * Returns `false` if the type is wrong, in which case the point is not modified.
+ * In a transform, the type is checked against the metric registry. Elsewhere, the new value
+ * must have the same type as the current value of the point.
+ */
+bool mpoint_set_value(struct MeasurementPoint *point, struct FfiMeasurementValue value);
+
+/**
+ * Sets an attribute of a point, replacing the existing value if there is one.
+ * A string value is copied.
+ */
+void mpoint_set_attr(struct MeasurementPoint *point,
+                     struct AttributeKey key,
+                     struct FfiAttributeValue value);
+
+/**
+ * Removes an attribute of a point. Returns `true` if the point had this attribute.
+ */
+bool mpoint_remove_attr(struct MeasurementPoint *point, struct AttributeKey key);
+
+/**
+ * Returns a view of the points of the buffer, which can be modified with [`mpoint_set_value`],
+ * [`mpoint_set_attr`] and [`mpoint_remove_attr`].
+ */
+struct FfiBufferViewMut mbuffer_view_mut(struct MeasurementBuffer *buf);
+
+/**
+ * Keeps the points for which `f(data, point)` returns `true`, and removes the others.
+ * The order of the remaining points is preserved.
+ *
+ * Returns the number of points that have been removed.
+ */
+uintptr_t mbuffer_retain(struct MeasurementBuffer *buf, void *data, RetainPointFn f);
+
+/**
+ * Keeps the point `i` if `keep[i]` is `true`, and removes it otherwise.
+ * `len` must be the length of the buffer. The order of the remaining points is preserved.
+ *
+ * Returns the number of points that have been removed.
+ * If `len` is not the length of the buffer, no point is removed and 0 is returned.
+ */
+uintptr_t mbuffer_retain_mask(struct MeasurementBuffer *buf, const bool *keep, uintptr_t len);
+
+/**
+ * Copies the values of the first `len` points into the array `values`, and their types into the array `types`
+ * (if it is not null). Both arrays must have room for `len` elements.
+ *
+ * Together with [`mbuffer_set_values`], this allows to process all the values of the buffer at once,
+ * for instance with SIMD instructions. Returns the number of values that have been copied.
+ */
+uintptr_t mbuffer_get_values(const struct MeasurementBuffer *buf,
+                             union FfiRawValue *values,
+                             enum WrappedMeasurementType *types,
+                             uintptr_t len);
+
+/**
+ * Sets the values of the first `len` points from the array `values`.
+ *
+ * The type of each point is kept: the bits of `values[i]` are read as a `u64` or as a `f64`,
+ * depending on the current type of the value of the point `i`.
+ * Returns the number of values that have been set.
+ */
+uintptr_t mbuffer_set_values(struct MeasurementBuffer *buf,
+                             const union FfiRawValue *values,
+                             uintptr_t len);
+
+/**
+ * Returns a successful status.
+ */
+struct FfiStatus status_ok(void);
+
+/**
+ * Returns a status that indicates a temporary error, see [`FfiStatusCode::Retry`].
+ *
+ * `message` is a null-terminated string, which is copied, or null.
+ */
+struct FfiStatus status_retry(const char *message);
+
+/**
+ * Returns a status that indicates a fatal error, see [`FfiStatusCode::Fatal`].
+ *
+ * `message` is a null-terminated string, which is copied, or null.
+ */
+struct FfiStatus status_fatal(const char *message);
+
 struct RawMetricId alumet_create_metric(struct AlumetStart *alumet,
                                         struct AStr name,
                                         enum WrappedMeasurementType value_type,
@@ -352,6 +756,22 @@ void alumet_add_source(struct AlumetStart *alumet,
                        SourcePollFn source_poll_fn,
                        NullableDropFn source_drop_fn);
 
+/**
+ * Adds a source that is polled when the file descriptor `fd` becomes readable,
+ * at most once every `min_interval`.
+ *
+ * The file descriptor must stay open as long as the source exists.
+ *
+ * Returns false if `fd` is not an open file descriptor. In that case, the source is not added
+ * and `source_drop_fn` is not called: `source_data` still belongs to the caller.
+ */
+bool alumet_add_source_fd(struct AlumetStart *alumet,
+                          void *source_data,
+                          int fd,
+                          struct TimeDuration min_interval,
+                          SourcePollFn source_poll_fn,
+                          NullableDropFn source_drop_fn);
+
 void alumet_add_transform(struct AlumetStart *alumet,
                           void *transform_data,
                           TransformApplyFn transform_apply_fn,
@@ -370,6 +790,38 @@ struct FfiConsumerId consumer_new_local_machine(void);
 
 struct FfiConsumerId consumer_new_process(uint32_t pid);
 
+/**
+ * Interns a resource in the registry of the pipeline and returns a handle to it,
+ * which is much smaller than the resource itself.
+ *
+ * Intern the resources once, for instance when creating the source, and use the handles
+ * in [`FfiPointRecord`](super::metrics::FfiPointRecord)s.
+ * The handle is reference-counted: release it with [`resource_id_release`] when it is no longer needed.
+ */
+struct ResourceId resource_intern(struct FfiResourceId resource);
+
+/**
+ * Interns a consumer in the registry of the pipeline and returns a handle to it,
+ * which is much smaller than the consumer itself.
+ *
+ * See [`resource_intern`]. Release the handle with [`consumer_id_release`].
+ */
+struct ConsumerId consumer_intern(struct FfiConsumerId consumer);
+
+/**
+ * Releases a handle returned by [`resource_intern`]. The handle must not be used after this call.
+ *
+ * The measurement points that use the resource hold their own reference to it.
+ */
+void resource_id_release(struct ResourceId id);
+
+/**
+ * Releases a handle returned by [`consumer_intern`]. The handle must not be used after this call.
+ *
+ * The measurement points that use the consumer hold their own reference to it.
+ */
+void consumer_id_release(struct ConsumerId id);
+
 /**
  * Creates a new `AString` from a C string `chars`, which must be null-terminated.
  *
@@ -391,4 +843,8 @@ struct AStr astring_ref(struct AString string);
  */
 void astring_free(struct AString string);
 
+#ifdef __cplusplus
+}  // extern "C"
+#endif  // __cplusplus
+
 #endif
@@ -0,0 +1,893 @@
+/**
+ * C++ API for Alumet plugins.
+ *
+ * This header-only library wraps the C API (`alumet-api.h`) in C++20 types:
+ * - `alumet::String` and `alumet::Point` own an `AString` or a `MeasurementPoint*` and free it automatically (RAII),
+ * - `alumet::TypedMetric<T>` checks the type of the values at compile time and calls the right `mpoint_new_*` function,
+ * - `alumet::Accumulator` and `alumet::Buffer` push whole `std::span`s of points with a single call,
+ * - `alumet::BufferView` and `alumet::PointRef` iterate on the points and their attributes without any allocation,
+ * - `alumet::BufferViewMut`, `alumet::PointMut` and `alumet::Buffer` modify the points of a transform in place,
+ * - `alumet::add_source`, `alumet::add_transform` and `alumet::add_output` register C++ objects without `void*` casts.
+ *
+ * Everything is inline and most wrappers are a single pointer: with optimizations enabled,
+ * the generated code is the same as the code that calls the C API directly.
+ *
+ * The C++ exceptions must not reach Alumet: the callbacks that are registered by this header catch them
+ * and turn them into a status. `alumet::RetryError` is a temporary error (Alumet calls the element again),
+ * any other exception is fatal (Alumet stops using the element).
+ */
+#ifndef __ALUMET_HPP
+#define __ALUMET_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "../generated/alumet-api.h"
+
+namespace alumet {
+
+namespace detail {
+
+template <typename>
+inline constexpr bool always_false = false;
+
+/**
+ * Non-null address for the empty strings and for the `_marker` of `AStr`,
+ * which is a reference to a zero-sized type on the Rust side.
+ */
+inline constexpr char empty_str[1] = {0};
+
+}  // namespace detail
+
+// ====== Strings ======
+
+/**
+ * Borrows a string as an `AStr`, without copying it.
+ * The string must outlive the `AStr`.
+ */
+inline AStr as_astr(std::string_view s) noexcept {
+    const char *ptr = s.empty() ? detail::empty_str : s.data();
+    return AStr{s.size(), const_cast<char *>(ptr), detail::empty_str};
+}
+
+/**
+ * Borrows an `AStr` as a `std::string_view`.
+ */
+inline std::string_view as_view(AStr s) noexcept {
+    return std::string_view(s.ptr, s.len);
+}
+
+/**
+ * A string that has been allocated by Alumet, freed when the `String` is destroyed.
+ */
+class String {
+public:
+    /** Takes the ownership of `s`. */
+    explicit String(AString s) noexcept : inner_(s), owned_(true) {}
+
+    /** Copies `s` into a new `AString`. */
+    explicit String(std::string_view s) : String(astr_copy(as_astr(s))) {}
+
+    String(String &&other) noexcept : inner_(other.inner_), owned_(std::exchange(other.owned_, false)) {}
+
+    String &operator=(String &&other) noexcept {
+        if (this != &other) {
+            reset();
+            inner_ = other.inner_;
+            owned_ = std::exchange(other.owned_, false);
+        }
+        return *this;
+    }
+
+    String(const String &) = delete;
+    String &operator=(const String &) = delete;
+
+    ~String() {
+        reset();
+    }
+
+    std::string_view view() const noexcept {
+        return owned_ ? std::string_view(inner_.ptr, inner_.len) : std::string_view();
+    }
+
+    AStr astr() const noexcept {
+        return as_astr(view());
+    }
+
+    /** Gives the ownership of the `AString` back to the caller, who must free it. */
+    AString release() noexcept {
+        owned_ = false;
+        return inner_;
+    }
+
+private:
+    void reset() noexcept {
+        if (owned_) {
+            astring_free(inner_);
+            owned_ = false;
+        }
+    }
+
+    AString inner_;
+    bool owned_;
+};
+
+// ====== Configuration ======
+
+/**
+ * Returns the string at `key` in the configuration of the plugin, if there is one.
+ * The string is borrowed from the configuration.
+ */
+inline std::optional<std::string_view> config_string(const ConfigTable *config, std::string_view key) {
+    NullableAStr s = config_string_in(config, as_astr(key));
+    if (s.ptr == nullptr) {
+        return std::nullopt;
+    }
+    return std::string_view(s.ptr, s.len);
+}
+
+// ====== Time ======
+
+inline TimeDuration duration(std::chrono::nanoseconds d) noexcept {
+    auto secs = std::chrono::duration_cast<std::chrono::seconds>(d);
+    auto nanos = d - secs;
+    return TimeDuration{Timestamp{static_cast<uint64_t>(secs.count()), static_cast<uint32_t>(nanos.count())}};
+}
+
+// ====== Values and attributes ======
+
+namespace detail {
+
+template <typename T>
+inline constexpr bool is_measurement_type = std::is_same_v<T, uint64_t> || std::is_same_v<T, double>;
+
+template <typename V>
+inline void add_attr(MeasurementPoint *point, AStr key, V value) {
+    if constexpr (std::is_same_v<V, bool>) {
+        mpoint_attr_bool(point, key, value);
+    } else if constexpr (std::is_integral_v<V>) {
+        mpoint_attr_u64(point, key, static_cast<uint64_t>(value));
+    } else if constexpr (std::is_floating_point_v<V>) {
+        mpoint_attr_f64(point, key, static_cast<double>(value));
+    } else if constexpr (std::is_convertible_v<V, std::string_view>) {
+        mpoint_attr_str(point, key, as_astr(std::string_view(value)));
+    } else {
+        static_assert(always_false<V>, "unsupported attribute type");
+    }
+}
+
+}  // namespace detail
+
+template <typename T>
+inline FfiMeasurementValue measurement_value(T value) noexcept {
+    static_assert(detail::is_measurement_type<T>, "the measured values must be uint64_t or double");
+    FfiMeasurementValue res;
+    if constexpr (std::is_same_v<T, uint64_t>) {
+        res.tag = FfiMeasurementValue_U64;
+        res.u64 = value;
+    } else {
+        res.tag = FfiMeasurementValue_F64;
+        res.f64 = value;
+    }
+    return res;
+}
+
+/**
+ * Registers an attribute key, or returns the existing key with the same name.
+ * Register the keys once, then use them in the attributes of the batches of points.
+ */
+inline AttributeKey attribute_key(std::string_view name) {
+    return ::attribute_key(as_astr(name));
+}
+
+/** Returns the name of an attribute key. */
+inline std::string_view attribute_name(AttributeKey key) {
+    return as_view(attribute_key_name(key));
+}
+
+/**
+ * Creates an attribute for a batch of points.
+ * A string value is borrowed: it must outlive the call to `push_batch`, which copies it.
+ */
+template <typename V>
+inline FfiAttribute attribute(AttributeKey key, V value) noexcept {
+    FfiAttribute res;
+    res.key = key;
+    if constexpr (std::is_same_v<V, bool>) {
+        res.value.tag = FfiAttributeValue_Boolean;
+        res.value.boolean = value;
+    } else if constexpr (std::is_integral_v<V>) {
+        res.value.tag = FfiAttributeValue_U64;
+        res.value.u64 = static_cast<uint64_t>(value);
+    } else if constexpr (std::is_floating_point_v<V>) {
+        res.value.tag = FfiAttributeValue_F64;
+        res.value.f64 = static_cast<double>(value);
+    } else if constexpr (std::is_convertible_v<V, std::string_view>) {
+        res.value.tag = FfiAttributeValue_Str;
+        res.value.str = as_astr(std::string_view(value));
+    } else {
+        static_assert(detail::always_false<V>, "unsupported attribute type");
+    }
+    return res;
+}
+
+// ====== Resources and consumers ======
+
+namespace detail {
+
+/** A handle returned by `resource_intern` or `consumer_intern`, released when this object is destroyed. */
+template <typename Id, void (*Release)(Id)>
+class InternedId {
+public:
+    /** Takes the ownership of `id`. */
+    explicit InternedId(Id id) noexcept : id_(id), owned_(true) {}
+
+    InternedId(InternedId &&other) noexcept : id_(other.id_), owned_(std::exchange(other.owned_, false)) {}
+
+    InternedId &operator=(InternedId &&other) noexcept {
+        if (this != &other) {
+            reset();
+            id_ = other.id_;
+            owned_ = std::exchange(other.owned_, false);
+        }
+        return *this;
+    }
+
+    InternedId(const InternedId &) = delete;
+    InternedId &operator=(const InternedId &) = delete;
+
+    ~InternedId() {
+        reset();
+    }
+
+    /** Borrows the handle, for instance to build a `FfiPointRecord`. */
+    Id get() const noexcept {
+        return id_;
+    }
+
+private:
+    void reset() noexcept {
+        if (owned_) {
+            Release(id_);
+            owned_ = false;
+        }
+    }
+
+    Id id_;
+    bool owned_;
+};
+
+}  // namespace detail
+
+/** A resource interned with `resource_intern`, released when it is destroyed. */
+using Resource = detail::InternedId<ResourceId, resource_id_release>;
+
+/** A consumer interned with `consumer_intern`, released when it is destroyed. */
+using Consumer = detail::InternedId<ConsumerId, consumer_id_release>;
+
+/** Interns a resource, see `resource_intern`. */
+inline Resource intern(FfiResourceId resource) {
+    return Resource(resource_intern(resource));
+}
+
+/** Interns a consumer, see `consumer_intern`. */
+inline Consumer intern(FfiConsumerId consumer) {
+    return Consumer(consumer_intern(consumer));
+}
+
+// ====== Points ======
+
+/**
+ * A measurement point that has not been pushed yet.
+ * If it is never pushed, it is freed when the `Point` is destroyed.
+ */
+class Point {
+public:
+    /** Takes the ownership of `point`. */
+    explicit Point(MeasurementPoint *point) noexcept : ptr_(point) {}
+
+    Point(Point &&other) noexcept : ptr_(std::exchange(other.ptr_, nullptr)) {}
+
+    Point &operator=(Point &&other) noexcept {
+        if (this != &other) {
+            reset();
+            ptr_ = std::exchange(other.ptr_, nullptr);
+        }
+        return *this;
+    }
+
+    Point(const Point &) = delete;
+    Point &operator=(const Point &) = delete;
+
+    ~Point() {
+        reset();
+    }
+
+    /** Adds an attribute to the point. The value can be an integer, a floating-point number, a boolean or a string. */
+    template <typename V>
+    Point &attr(std::string_view key, V value) & {
+        detail::add_attr(ptr_, as_astr(key), value);
+        return *this;
+    }
+
+    template <typename V>
+    Point &&attr(std::string_view key, V value) && {
+        detail::add_attr(ptr_, as_astr(key), value);
+        return std::move(*this);
+    }
+
+    const MeasurementPoint *get() const noexcept {
+        return ptr_;
+    }
+
+    /** Gives the ownership of the point back to the caller. */
+    MeasurementPoint *release() noexcept {
+        return std::exchange(ptr_, nullptr);
+    }
+
+private:
+    void reset() noexcept {
+        if (ptr_ != nullptr) {
+            mpoint_free(std::exchange(ptr_, nullptr));
+        }
+    }
+
+    MeasurementPoint *ptr_;
+};
+
+/**
+ * A metric whose values have the type `T`, which must be `uint64_t` or `double`.
+ */
+template <typename T>
+class TypedMetric {
+    static_assert(detail::is_measurement_type<T>, "the values of a metric must be uint64_t or double");
+
+public:
+    static constexpr WrappedMeasurementType value_type =
+        std::is_same_v<T, uint64_t> ? WrappedMeasurementType_U64 : WrappedMeasurementType_F64;
+
+    constexpr explicit TypedMetric(RawMetricId id) noexcept : id_(id) {}
+
+    constexpr RawMetricId id() const noexcept {
+        return id_;
+    }
+
+    /** Creates a new measurement point for this metric. */
+    Point point(Timestamp timestamp, FfiResourceId resource, FfiConsumerId consumer, T value) const {
+        if constexpr (std::is_same_v<T, uint64_t>) {
+            return Point(mpoint_new_u64(timestamp, id_, resource, consumer, value));
+        } else {
+            return Point(mpoint_new_f64(timestamp, id_, resource, consumer, value));
+        }
+    }
+
+    /**
+     * Creates a point record for a batch, see `Accumulator::push_batch`.
+     * The attributes of the point are `attributes[attributes_start, attributes_start+attributes_len)` in the batch.
+     */
+    FfiPointRecord record(T value, ResourceId resource, ConsumerId consumer, uint32_t attributes_start = 0,
+                          uint32_t attributes_len = 0) const noexcept {
+        return FfiPointRecord{measurement_value(value), id_, resource, consumer, attributes_start, attributes_len};
+    }
+
+private:
+    RawMetricId id_;
+};
+
+/**
+ * Creates a new metric. `T` gives the type of the measured values.
+ */
+template <typename T>
+inline TypedMetric<T> create_metric(AlumetStart *alumet, std::string_view name, FfiUnit_Tag unit,
+                                    std::string_view description) {
+    FfiUnit u;
+    u.tag = unit;
+    return TypedMetric<T>(
+        alumet_create_metric(alumet, as_astr(name), TypedMetric<T>::value_type, u, as_astr(description)));
+}
+
+// ====== Reading the points ======
+
+/**
+ * Iterates on the attributes of a point, which are sorted by key id (the order in which the keys have been registered).
+ * The string values are borrowed from the point.
+ */
+class Attributes {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = FfiAttribute;
+        using difference_type = std::ptrdiff_t;
+
+        iterator() noexcept = default;
+        iterator(const MeasurementPoint *point, size_t index) noexcept : point_(point), index_(index) {}
+
+        FfiAttribute operator*() const {
+            FfiAttribute attr;
+            if (!mpoint_attribute_at(point_, index_, &attr)) {
+                throw std::out_of_range("attribute index out of range");
+            }
+            return attr;
+        }
+        iterator &operator++() noexcept {
+            ++index_;
+            return *this;
+        }
+        iterator operator++(int) noexcept {
+            iterator res = *this;
+            ++index_;
+            return res;
+        }
+        bool operator==(const iterator &other) const noexcept {
+            return index_ == other.index_;
+        }
+
+    private:
+        const MeasurementPoint *point_ = nullptr;
+        size_t index_ = 0;
+    };
+
+    explicit Attributes(const MeasurementPoint *point) noexcept : point_(point), len_(mpoint_attributes_len(point)) {}
+
+    size_t size() const noexcept {
+        return len_;
+    }
+    iterator begin() const noexcept {
+        return iterator(point_, 0);
+    }
+    iterator end() const noexcept {
+        return iterator(point_, len_);
+    }
+
+private:
+    const MeasurementPoint *point_;
+    size_t len_;
+};
+
+/**
+ * Buffer in which the numeric resource and consumer ids are formatted, see `PointRef::resource_id`.
+ */
+using IdBuffer = std::array<char, FFI_ID_BUFFER_LEN>;
+
+/**
+ * A borrowed, read-only measurement point.
+ * The strings returned by its methods are borrowed and must not be freed.
+ */
+class PointRef {
+public:
+    explicit PointRef(const MeasurementPoint *point) noexcept : ptr_(point) {}
+
+    RawMetricId metric() const {
+        return mpoint_metric(ptr_);
+    }
+    Timestamp timestamp() const {
+        return mpoint_timestamp(ptr_);
+    }
+    FfiMeasurementValue value() const {
+        return mpoint_value(ptr_);
+    }
+    std::string_view resource_kind() const {
+        return as_view(mpoint_resource_kind_ref(ptr_));
+    }
+    /**
+     * Returns the id of the resource, which may be formatted into `buf`:
+     * the view is valid as long as the point and the buffer are.
+     */
+    std::string_view resource_id(IdBuffer &buf) const {
+        return as_view(mpoint_resource_id_ref(ptr_, buf.data(), buf.size()));
+    }
+    std::string_view consumer_kind() const {
+        return as_view(mpoint_consumer_kind_ref(ptr_));
+    }
+    /**
+     * Returns the id of the consumer, which may be formatted into `buf`, see `resource_id`.
+     */
+    std::string_view consumer_id(IdBuffer &buf) const {
+        return as_view(mpoint_consumer_id_ref(ptr_, buf.data(), buf.size()));
+    }
+    Attributes attributes() const {
+        return Attributes(ptr_);
+    }
+    const MeasurementPoint *get() const noexcept {
+        return ptr_;
+    }
+
+private:
+    const MeasurementPoint *ptr_;
+};
+
+namespace detail {
+
+/** Returns the point that is `bytes` bytes after `point`. */
+template <typename P>
+inline P *offset_point(P *point, size_t bytes) noexcept {
+    using Byte = std::conditional_t<std::is_const_v<P>, const char, char>;
+    return reinterpret_cast<P *>(reinterpret_cast<Byte *>(point) + bytes);
+}
+
+/** Iterator on points that are `stride` bytes apart, which yields `Ref(P*)`. */
+template <typename Ref, typename P>
+class StridedIterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Ref;
+    using difference_type = std::ptrdiff_t;
+
+    StridedIterator() noexcept = default;
+    StridedIterator(P *ptr, size_t stride) noexcept : ptr_(ptr), stride_(stride) {}
+
+    Ref operator*() const noexcept {
+        return Ref(ptr_);
+    }
+    StridedIterator &operator++() noexcept {
+        ptr_ = offset_point(ptr_, stride_);
+        return *this;
+    }
+    StridedIterator operator++(int) noexcept {
+        StridedIterator res = *this;
+        ptr_ = offset_point(ptr_, stride_);
+        return res;
+    }
+    bool operator==(const StridedIterator &other) const noexcept {
+        return ptr_ == other.ptr_;
+    }
+
+private:
+    P *ptr_ = nullptr;
+    size_t stride_ = 0;
+};
+
+}  // namespace detail
+
+/**
+ * A read-only view of the points of a buffer.
+ *
+ * The points are stored contiguously, but their layout is private to Alumet: the view is a strided range
+ * of `PointRef` rather than a `std::span`. It is valid as long as the buffer is not modified.
+ */
+class BufferView {
+public:
+    using iterator = detail::StridedIterator<PointRef, const MeasurementPoint>;
+
+    explicit BufferView(const MeasurementBuffer *buffer) noexcept : view_(mbuffer_view(buffer)) {}
+
+    size_t size() const noexcept {
+        return view_.len;
+    }
+    bool empty() const noexcept {
+        return view_.len == 0;
+    }
+    PointRef operator[](size_t i) const noexcept {
+        return PointRef(detail::offset_point(view_.points, i * view_.stride));
+    }
+    iterator begin() const noexcept {
+        return iterator(view_.points, view_.stride);
+    }
+    iterator end() const noexcept {
+        return iterator(detail::offset_point(view_.points, view_.len * view_.stride), view_.stride);
+    }
+
+private:
+    FfiBufferView view_;
+};
+
+/** Returns the name of a metric. */
+inline std::string_view metric_name(RawMetricId metric, const FfiOutputContext &ctx) {
+    return as_view(::metric_name(metric, &ctx));
+}
+
+// ====== Modifying the points ======
+
+/**
+ * A borrowed measurement point that can be modified in place.
+ */
+class PointMut : public PointRef {
+public:
+    explicit PointMut(MeasurementPoint *point) noexcept : PointRef(point), ptr_(point) {}
+
+    /**
+     * Sets the value of the point. `T` must be the type of the values of the metric.
+     * Throws `std::invalid_argument` if it is not, in which case the point is not modified.
+     */
+    template <typename T>
+    void set_value(T value) {
+        if (!mpoint_set_value(ptr_, measurement_value(value))) {
+            throw std::invalid_argument("the value does not have the type of the metric");
+        }
+    }
+
+    /** Sets an attribute, replacing the existing value if there is one. A string value is copied. */
+    template <typename V>
+    void set_attr(AttributeKey key, V value) {
+        mpoint_set_attr(ptr_, key, attribute(key, value).value);
+    }
+
+    /** Removes an attribute. Returns `true` if the point had this attribute. */
+    bool remove_attr(AttributeKey key) {
+        return mpoint_remove_attr(ptr_, key);
+    }
+
+    MeasurementPoint *get() const noexcept {
+        return ptr_;
+    }
+
+private:
+    MeasurementPoint *ptr_;
+};
+
+/**
+ * A view of the points of a buffer that allows to modify them in place.
+ * It is valid as long as no point is added to or removed from the buffer.
+ */
+class BufferViewMut {
+public:
+    using iterator = detail::StridedIterator<PointMut, MeasurementPoint>;
+
+    explicit BufferViewMut(MeasurementBuffer *buffer) noexcept : view_(mbuffer_view_mut(buffer)) {}
+
+    size_t size() const noexcept {
+        return view_.len;
+    }
+    bool empty() const noexcept {
+        return view_.len == 0;
+    }
+    PointMut operator[](size_t i) const noexcept {
+        return PointMut(detail::offset_point(view_.points, i * view_.stride));
+    }
+    iterator begin() const noexcept {
+        return iterator(view_.points, view_.stride);
+    }
+    iterator end() const noexcept {
+        return iterator(detail::offset_point(view_.points, view_.len * view_.stride), view_.stride);
+    }
+
+private:
+    FfiBufferViewMut view_;
+};
+
+// ====== Pushing the points ======
+
+/**
+ * Non-owning handle to the accumulator that is given to the sources.
+ */
+class Accumulator {
+public:
+    explicit Accumulator(MeasurementAccumulator *inner) noexcept : inner_(inner) {}
+
+    void push(Point &&point) {
+        maccumulator_push(inner_, point.release());
+    }
+
+    /**
+     * Pushes a batch of points with a single call. See `TypedMetric::record` and `alumet::attribute`.
+     * Returns the number of points that have been pushed.
+     */
+    size_t push_batch(Timestamp timestamp, std::span<const FfiPointRecord> points,
+                      std::span<const FfiAttribute> attributes = {}) {
+        return maccumulator_push_batch(inner_, timestamp, points.data(), points.size(), attributes.data(),
+                                       attributes.size());
+    }
+
+    MeasurementAccumulator *get() const noexcept {
+        return inner_;
+    }
+
+private:
+    MeasurementAccumulator *inner_;
+};
+
+/**
+ * Non-owning handle to the buffer that is given to the transforms.
+ */
+class Buffer {
+public:
+    explicit Buffer(MeasurementBuffer *inner) noexcept : inner_(inner) {}
+
+    size_t size() const {
+        return mbuffer_len(inner_);
+    }
+
+    void reserve(size_t additional) {
+        mbuffer_reserve(inner_, additional);
+    }
+
+    void push(Point &&point) {
+        mbuffer_push(inner_, point.release());
+    }
+
+    /** See `Accumulator::push_batch`. */
+    size_t push_batch(Timestamp timestamp, std::span<const FfiPointRecord> points,
+                      std::span<const FfiAttribute> attributes = {}) {
+        return mbuffer_push_batch(inner_, timestamp, points.data(), points.size(), attributes.data(),
+                                  attributes.size());
+    }
+
+    BufferView view() const noexcept {
+        return BufferView(inner_);
+    }
+
+    BufferViewMut view_mut() noexcept {
+        return BufferViewMut(inner_);
+    }
+
+    /**
+     * Keeps the points for which `pred(alumet::PointRef)` returns `true`, and removes the others.
+     * If `pred` throws, the remaining points are kept and the exception is rethrown.
+     * Returns the number of points that have been removed.
+     */
+    template <typename Pred>
+    size_t retain(Pred &&pred) {
+        struct State {
+            Pred &pred;
+            std::exception_ptr error;
+        } state{pred, nullptr};
+        RetainPointFn f = [](void *data, const MeasurementPoint *point) -> bool {
+            auto &state = *static_cast<State *>(data);
+            if (state.error) {
+                return true;
+            }
+            try {
+                return static_cast<bool>(state.pred(PointRef(point)));
+            } catch (...) {
+                state.error = std::current_exception();
+                return true;
+            }
+        };
+        size_t removed = mbuffer_retain(inner_, &state, f);
+        if (state.error) {
+            std::rethrow_exception(state.error);
+        }
+        return removed;
+    }
+
+    /**
+     * Keeps the point `i` if `keep[i]` is `true`, and removes it otherwise.
+     * `keep` must have one element per point, otherwise `std::invalid_argument` is thrown.
+     * Returns the number of points that have been removed.
+     */
+    size_t retain_mask(std::span<const bool> keep) {
+        if (keep.size() != size()) {
+            throw std::invalid_argument("the mask must have one element per point");
+        }
+        return mbuffer_retain_mask(inner_, keep.data(), keep.size());
+    }
+
+    /**
+     * Copies the values of the first points into `values`, and their types into `types` (if not empty).
+     * Returns the number of values that have been copied.
+     */
+    size_t get_values(std::span<FfiRawValue> values, std::span<WrappedMeasurementType> types = {}) const {
+        if (types.empty()) {
+            return mbuffer_get_values(inner_, values.data(), nullptr, values.size());
+        }
+        return mbuffer_get_values(inner_, values.data(), types.data(), std::min(values.size(), types.size()));
+    }
+
+    /**
+     * Sets the values of the first points. The type of each point is kept.
+     * Returns the number of values that have been set.
+     */
+    size_t set_values(std::span<const FfiRawValue> values) {
+        return mbuffer_set_values(inner_, values.data(), values.size());
+    }
+
+    MeasurementBuffer *get() const noexcept {
+        return inner_;
+    }
+
+private:
+    MeasurementBuffer *inner_;
+};
+
+// ====== Registration of the pipeline elements ======
+
+/**
+ * A temporary error: throw it from `poll`, `apply` or `write` to tell Alumet to call the element again later.
+ * For a transform, it means that the measurements are invalid but that the transform can be used on other ones.
+ */
+class RetryError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+namespace detail {
+
+/** Converts the exception that is being handled to a status. */
+inline FfiStatus exception_status(const char *element) noexcept {
+    try {
+        throw;
+    } catch (const RetryError &e) {
+        return status_retry(e.what());
+    } catch (const std::exception &e) {
+        return status_fatal(e.what());
+    } catch (...) {
+        std::fprintf(stderr, "alumet: unknown exception in %s\n", element);
+        return status_fatal(nullptr);
+    }
+}
+
+template <typename T>
+void drop(void *instance) noexcept {
+    delete static_cast<T *>(instance);
+}
+
+template <typename S>
+FfiStatus source_poll(void *instance, MeasurementAccumulator *acc, Timestamp timestamp) noexcept {
+    try {
+        Accumulator accumulator(acc);
+        static_cast<S *>(instance)->poll(accumulator, timestamp);
+        return status_ok();
+    } catch (...) {
+        return exception_status("Source::poll");
+    }
+}
+
+template <typename T>
+FfiStatus transform_apply(void *instance, MeasurementBuffer *buf) noexcept {
+    try {
+        Buffer buffer(buf);
+        static_cast<T *>(instance)->apply(buffer);
+        return status_ok();
+    } catch (...) {
+        return exception_status("Transform::apply");
+    }
+}
+
+template <typename O>
+FfiStatus output_write(void *instance, const MeasurementBuffer *buf, const FfiOutputContext *ctx) noexcept {
+    try {
+        static_cast<O *>(instance)->write(BufferView(buf), *ctx);
+        return status_ok();
+    } catch (...) {
+        return exception_status("Output::write");
+    }
+}
+
+}  // namespace detail
+
+/**
+ * Adds a source to the pipeline. `S` must have a method `void poll(alumet::Accumulator &acc, Timestamp timestamp)`,
+ * which reports errors with exceptions (see `alumet::RetryError`).
+ * Alumet takes the ownership of the source and deletes it when the source is removed.
+ */
+template <typename S>
+inline void add_source(AlumetStart *alumet, std::unique_ptr<S> source, TimeDuration poll_interval,
+                       TimeDuration flush_interval) {
+    alumet_add_source(alumet, source.release(), poll_interval, flush_interval, &detail::source_poll<S>,
+                      &detail::drop<S>);
+}
+
+/**
+ * Adds a transform to the pipeline. `T` must have a method `void apply(alumet::Buffer &buffer)`.
+ */
+template <typename T>
+inline void add_transform(AlumetStart *alumet, std::unique_ptr<T> transform) {
+    alumet_add_transform(alumet, transform.release(), &detail::transform_apply<T>, &detail::drop<T>);
+}
+
+/**
+ * Adds an output to the pipeline.
+ * `O` must have a method `void write(alumet::BufferView points, const FfiOutputContext &ctx)`.
+ */
+template <typename O>
+inline void add_output(AlumetStart *alumet, std::unique_ptr<O> output) {
+    alumet_add_output(alumet, output.release(), &detail::output_write<O>, &detail::drop<O>);
+}
+
+}  // namespace alumet
+
+#endif
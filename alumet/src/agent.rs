@@ -9,6 +9,11 @@ use crate::{
     pipeline::{
         self,
         builder::PipelineBuilder,
+        batch::BatchConfig,
+        overload::OverloadPolicy,
+        placement::PlacementConfig,
+        telemetry::TelemetryConfig,
+        worker::OutputWorkerConfig,
         runtime::{IdlePipeline, RunningPipeline},
         trigger::TriggerConstraints,
     },
@@ -78,6 +83,11 @@ pub struct AgentBuilder {
     f_after_operation_begin: fn(&mut RunningPipeline),
     allow_no_metrics: bool,
     source_constraints: TriggerConstraints,
+    overload_policy: OverloadPolicy,
+    batching: BatchConfig,
+    output_workers: OutputWorkerConfig,
+    telemetry: TelemetryConfig,
+    placement: PlacementConfig,
 }
 
 enum AgentConfigSource {
@@ -203,6 +213,11 @@ impl Agent {
         log::info!("Starting the plugins...");
         let mut pipeline_builder = pipeline::builder::PipelineBuilder::new();
         pipeline_builder.source_constraints = self.settings.source_constraints;
+        pipeline_builder.overload_policy = self.settings.overload_policy;
+        pipeline_builder.batching = self.settings.batching;
+        pipeline_builder.output_workers = self.settings.output_workers;
+        pipeline_builder.telemetry = self.settings.telemetry;
+        pipeline_builder.placement = self.settings.placement;
         pipeline_builder.allow_no_metrics = self.settings.allow_no_metrics;
 
         for plugin in initialized_plugins.iter_mut() {
@@ -290,6 +305,35 @@ impl Agent {
     pub fn sources_max_update_interval(&mut self, max_update_interval: Duration) {
         self.settings.source_constraints.max_update_interval = max_update_interval;
     }
+
+    /// Sets how the measurement [`Source`](crate::pipeline::Source)s react when they cannot
+    /// flush their measurements because the pipeline is overloaded.
+    ///
+    /// This only applies to the sources that are managed by Alumet.
+    pub fn sources_overload_policy(&mut self, policy: OverloadPolicy) {
+        self.settings.overload_policy = policy;
+    }
+
+    /// Sets how the transform step merges the measurements of the sources before
+    /// applying the transforms and sending them to the outputs.
+    pub fn transforms_batching(&mut self, batching: BatchConfig) {
+        self.settings.batching = batching;
+    }
+
+    /// Sets the size of the queue of each output, and the CPUs on which the outputs run.
+    pub fn output_workers(&mut self, config: OutputWorkerConfig) {
+        self.settings.output_workers = config;
+    }
+
+    /// Enables or disables the measurement of the pipeline itself.
+    pub fn pipeline_telemetry(&mut self, config: TelemetryConfig) {
+        self.settings.telemetry = config;
+    }
+
+    /// Sets the CPUs on which the sources and transforms run.
+    pub fn pipeline_placement(&mut self, config: PlacementConfig) {
+        self.settings.placement = config;
+    }
 }
 
 impl RunningAgent {
@@ -450,6 +494,11 @@ impl AgentBuilder {
             f_after_operation_begin: |_| (),
             allow_no_metrics: false,
             source_constraints: TriggerConstraints::default(),
+            overload_policy: OverloadPolicy::default(),
+            batching: BatchConfig::default(),
+            output_workers: OutputWorkerConfig::default(),
+            telemetry: TelemetryConfig::default(),
+            placement: PlacementConfig::default(),
         }
     }
 
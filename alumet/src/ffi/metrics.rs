@@ -1,17 +1,22 @@
-use std::{borrow::Cow, time::SystemTime};
+use std::cell::RefCell;
+use std::fmt::Display;
+use std::io::Write;
+use std::sync::Arc;
+use std::time::SystemTime;
 
-use libc::c_void;
+use libc::{c_char, c_void};
 
 use crate::{
     measurement::{
-        AttributeValue, MeasurementAccumulator, MeasurementBuffer, MeasurementPoint, WrappedMeasurementValue,
+        AttributeKey, AttributeValue, MeasurementAccumulator, MeasurementBuffer, MeasurementPoint,
+        WrappedMeasurementType, WrappedMeasurementValue,
     },
-    metrics::RawMetricId,
-    resources::{ResourceConsumer, Resource},
+    metrics::{MetricRegistry, RawMetricId},
+    resources::{ConsumerId, Resource, ResourceConsumer, ResourceId},
 };
 
 use super::{
-    resources::{FfiConsumerId, FfiResourceId},
+    resources::{intern_consumer, intern_resource, FfiConsumerId, FfiResourceId},
     string::{AStr, AString},
     time::Timestamp,
     FfiOutputContext,
@@ -34,6 +39,9 @@ pub extern "C" fn system_time_now() -> *mut Timestamp {
 }
 
 /// Internal: C binding to [`MeasurementPoint::new`].
+///
+/// When called from a source, the resource and the consumer are interned in the registry of the pipeline,
+/// so that the points of the same resource share their handle.
 fn mpoint_new(
     timestamp: Timestamp,
     metric: RawMetricId,
@@ -41,8 +49,8 @@ fn mpoint_new(
     consumer: FfiConsumerId,
     value: WrappedMeasurementValue,
 ) -> *mut MeasurementPoint {
-    let resource = Resource::from(resource);
-    let consumer = ResourceConsumer::from(consumer);
+    let resource = intern_resource(resource.into());
+    let consumer = intern_consumer(consumer.into());
     let p = MeasurementPoint::new_untyped(timestamp.into(), metric, resource, consumer, value);
     Box::into_raw(Box::new(p)) // box and turn the box into a pointer, it now needs to be dropped manually
 }
@@ -80,8 +88,11 @@ pub extern "C" fn mpoint_free(point: *mut MeasurementPoint) {
 /// Internal: C binding to [`MeasurementPoint::add_attr`].
 fn mpoint_attr(point: *mut MeasurementPoint, key: AStr, value: AttributeValue) {
     let point = unsafe { &mut *point }; // not Box::from_raw because we don't want to take ownership of the point
-    let key = Cow::Owned(key.to_string());
-    point.add_attr(key, value);
+    // The key may not be known in advance, don't let the table of keys grow without bounds.
+    match AttributeKey::try_new(key.as_str()) {
+        Some(key) => point.add_attr(key, value),
+        None => log::error!("Too many attribute keys, the attribute {} is ignored.", key.as_str()),
+    }
 }
 
 /// Generates a C-compatible function around mpoint_attr, for a specific type of attribute.
@@ -118,32 +129,165 @@ pub extern "C" fn mpoint_timestamp(point: &MeasurementPoint) -> Timestamp {
 
 #[no_mangle]
 pub extern "C" fn mpoint_resource(point: &MeasurementPoint) -> FfiResourceId {
-    FfiResourceId::from(point.resource.to_owned())
+    FfiResourceId::from(point.resource.resolve().to_owned())
 }
 
+/// Returns the kind of the resource, as a new string that must be freed with [`astring_free`](super::string::astring_free).
+///
+/// Prefer [`mpoint_resource_kind_ref`], which does not allocate.
 #[no_mangle]
 pub extern "C" fn mpoint_resource_kind(point: &MeasurementPoint) -> AString {
-    point.resource.kind().into()
+    point.resource.resolve().kind().into()
 }
 
+/// Returns the id of the resource, as a new string that must be freed with [`astring_free`](super::string::astring_free).
+///
+/// Prefer [`mpoint_resource_id_ref`], which does not allocate.
 #[no_mangle]
 pub extern "C" fn mpoint_resource_id(point: &MeasurementPoint) -> AString {
-    point.resource.id_display().to_string().into()
+    point.resource.resolve().id_display().to_string().into()
 }
 
 #[no_mangle]
 pub extern "C" fn mpoint_consumer(point: &MeasurementPoint) -> FfiConsumerId {
-    FfiConsumerId::from(point.consumer.to_owned())
+    FfiConsumerId::from(point.consumer.resolve().to_owned())
 }
 
+/// Returns the kind of the consumer, as a new string that must be freed with [`astring_free`](super::string::astring_free).
+///
+/// Prefer [`mpoint_consumer_kind_ref`], which does not allocate.
 #[no_mangle]
 pub extern "C" fn mpoint_consumer_kind(point: &MeasurementPoint) -> AString {
-    point.consumer.kind().into()
+    point.consumer.resolve().kind().into()
 }
 
+/// Returns the id of the consumer, as a new string that must be freed with [`astring_free`](super::string::astring_free).
+///
+/// Prefer [`mpoint_consumer_id_ref`], which does not allocate.
 #[no_mangle]
 pub extern "C" fn mpoint_consumer_id(point: &MeasurementPoint) -> AString {
-    point.consumer.id_display().to_string().into()
+    point.consumer.resolve().id_display().to_string().into()
+}
+
+// borrowed getters: the strings of the resources and consumers are valid as long as the point is,
+// they can be handed out without copying them, and must not be freed.
+
+/// Length of a buffer that can hold any numeric resource or consumer id,
+/// see [`mpoint_resource_id_ref`] and [`mpoint_consumer_id_ref`].
+pub const FFI_ID_BUFFER_LEN: usize = 16;
+
+// the numeric ids are u32
+const _: () = assert!(FFI_ID_BUFFER_LEN >= u32::MAX.ilog10() as usize + 1);
+
+/// Returns the kind of the resource. The string is borrowed and must **not** be freed.
+#[no_mangle]
+pub extern "C" fn mpoint_resource_kind_ref(point: &MeasurementPoint) -> AStr<'_> {
+    AStr::from(point.resource.resolve().kind())
+}
+
+/// Returns the id of the resource, without allocating. The string is borrowed and must **not** be freed.
+///
+/// The textual ids are borrowed from the point. The numeric ids are formatted into `buf`,
+/// which must be at least [`FFI_ID_BUFFER_LEN`] bytes long (if it is shorter, an empty string is returned).
+/// The string is valid as long as the point and the buffer are.
+///
+/// # Safety
+/// `buf` must be null or point to `buf_len` writable bytes.
+#[no_mangle]
+pub unsafe extern "C" fn mpoint_resource_id_ref<'a>(
+    point: &'a MeasurementPoint,
+    buf: *mut c_char,
+    buf_len: usize,
+) -> AStr<'a> {
+    match point.resource.resolve() {
+        Resource::LocalMachine => AStr::from(""),
+        Resource::Gpu { bus_id } => AStr::from(bus_id.as_ref()),
+        Resource::Custom { kind: _, id } => AStr::from(id.as_ref()),
+        r => format_id(r.id_display(), buf, buf_len),
+    }
+}
+
+/// Returns the kind of the consumer. The string is borrowed and must **not** be freed.
+#[no_mangle]
+pub extern "C" fn mpoint_consumer_kind_ref(point: &MeasurementPoint) -> AStr<'_> {
+    AStr::from(point.consumer.resolve().kind())
+}
+
+/// Returns the id of the consumer, without allocating. The string is borrowed and must **not** be freed.
+///
+/// See [`mpoint_resource_id_ref`].
+///
+/// # Safety
+/// `buf` must be null or point to `buf_len` writable bytes.
+#[no_mangle]
+pub unsafe extern "C" fn mpoint_consumer_id_ref<'a>(
+    point: &'a MeasurementPoint,
+    buf: *mut c_char,
+    buf_len: usize,
+) -> AStr<'a> {
+    match point.consumer.resolve() {
+        ResourceConsumer::LocalMachine => AStr::from(""),
+        ResourceConsumer::ControlGroup { path } => AStr::from(path.as_ref()),
+        ResourceConsumer::Custom { kind: _, id } => AStr::from(id.as_ref()),
+        c => format_id(c.id_display(), buf, buf_len),
+    }
+}
+
+/// Formats `id` into the buffer of the caller, and returns the part of the buffer that has been written.
+unsafe fn format_id<'a>(id: impl Display, buf: *mut c_char, buf_len: usize) -> AStr<'a> {
+    if buf.is_null() {
+        return AStr::from("");
+    }
+    let buf = std::slice::from_raw_parts_mut(buf as *mut u8, buf_len);
+    let mut cursor = std::io::Cursor::new(&mut *buf);
+    match write!(cursor, "{id}") {
+        Ok(()) => {
+            let len = cursor.position() as usize;
+            AStr::from(std::str::from_utf8_unchecked(&buf[..len]))
+        }
+        Err(_) => AStr::from(""),
+    }
+}
+
+// attributes
+
+/// Returns the number of attributes attached to the point.
+#[no_mangle]
+pub extern "C" fn mpoint_attributes_len(point: &MeasurementPoint) -> usize {
+    point.attributes_len()
+}
+
+/// Reads the attribute at `index` into `attribute`.
+///
+/// Returns `false`, without modifying `attribute`, if `index` is not lower than [`mpoint_attributes_len`].
+///
+/// The attributes are sorted by key id, that is, in the order in which the keys have been registered (not by name).
+/// A string value is borrowed from the point: it is valid as long as the point is.
+///
+/// # Safety
+/// `attribute` must be a valid pointer.
+#[no_mangle]
+pub unsafe extern "C" fn mpoint_attribute_at<'a>(
+    point: &'a MeasurementPoint,
+    index: usize,
+    attribute: *mut FfiAttribute<'a>,
+) -> bool {
+    match point.attributes_by_key().nth(index) {
+        Some((key, value)) => {
+            attribute.write(FfiAttribute {
+                key,
+                value: value.into(),
+            });
+            true
+        }
+        None => false,
+    }
+}
+
+/// Returns the name of an attribute key. The string is borrowed and must **not** be freed.
+#[no_mangle]
+pub extern "C" fn attribute_key_name(key: AttributeKey) -> AStr<'static> {
+    AStr::from(key.name())
 }
 
 #[repr(C)]
@@ -159,6 +303,14 @@ impl From<&WrappedMeasurementValue> for FfiMeasurementValue {
         }
     }
 }
+impl From<&FfiMeasurementValue> for WrappedMeasurementValue {
+    fn from(value: &FfiMeasurementValue) -> Self {
+        match value {
+            FfiMeasurementValue::F64(x) => WrappedMeasurementValue::F64(*x),
+            FfiMeasurementValue::U64(x) => WrappedMeasurementValue::U64(*x),
+        }
+    }
+}
 
 // ====== MeasurementBuffer ffi ======
 #[no_mangle]
@@ -170,6 +322,30 @@ pub extern "C" fn mbuffer_reserve(buf: &mut MeasurementBuffer, additional: usize
     buf.reserve(additional);
 }
 
+/// A read-only view of the points of a [`MeasurementBuffer`], which are stored contiguously.
+///
+/// The point `i` (with `i < len`) is at the address `(const char*)points + i*stride`.
+/// The view is valid as long as the buffer is not modified.
+#[repr(C)]
+pub struct FfiBufferView {
+    pub points: *const MeasurementPoint,
+    pub len: usize,
+    /// Distance between two points, in bytes.
+    pub stride: usize,
+}
+
+/// Returns a read-only view of the points of the buffer, which allows to iterate on them with a simple loop,
+/// instead of [`mbuffer_foreach`].
+#[no_mangle]
+pub extern "C" fn mbuffer_view(buf: &MeasurementBuffer) -> FfiBufferView {
+    let points = buf.as_slice();
+    FfiBufferView {
+        points: points.as_ptr(),
+        len: points.len(),
+        stride: std::mem::size_of::<MeasurementPoint>(),
+    }
+}
+
 pub type ForeachPointFn = unsafe extern "C" fn(*mut c_void, *const MeasurementPoint);
 
 /// Iterates on a [`MeasurementBuffer`] by calling `f(data, point)` for each point of the buffer.
@@ -194,3 +370,614 @@ pub extern "C" fn maccumulator_push(buf: &mut MeasurementAccumulator, point: *mu
     let boxed = unsafe { Box::from_raw(point) };
     buf.push(*boxed);
 }
+
+// ====== Batch construction ======
+
+/// Registers an attribute key, or returns the existing key with the same name.
+///
+/// Register the keys once (for instance in the start function of the plugin), then use them in [`FfiAttribute`]s.
+/// The keys are never freed.
+#[no_mangle]
+pub extern "C" fn attribute_key(name: AStr) -> AttributeKey {
+    AttributeKey::lookup(name.as_str()).unwrap_or_else(|| AttributeKey::new(name.to_string()))
+}
+
+/// Value of an attribute, in a batch of points or read from a point.
+#[repr(C)]
+pub enum FfiAttributeValue<'a> {
+    U64(u64),
+    F64(f64),
+    Boolean(bool),
+    /// A string attribute: copied when the points are pushed, borrowed from the point when it is read.
+    Str(AStr<'a>),
+}
+
+impl<'a> From<&'a AttributeValue> for FfiAttributeValue<'a> {
+    fn from(value: &'a AttributeValue) -> Self {
+        match value {
+            AttributeValue::U64(x) => FfiAttributeValue::U64(*x),
+            AttributeValue::F64(x) => FfiAttributeValue::F64(*x),
+            AttributeValue::Bool(x) => FfiAttributeValue::Boolean(*x),
+            AttributeValue::Str(x) => FfiAttributeValue::Str(AStr::from(*x)),
+            AttributeValue::String(x) => FfiAttributeValue::Str(AStr::from(x.as_str())),
+        }
+    }
+}
+
+impl From<&FfiAttributeValue<'_>> for AttributeValue {
+    /// Converts the value, copying the string if there is one.
+    fn from(value: &FfiAttributeValue) -> Self {
+        match value {
+            FfiAttributeValue::U64(x) => AttributeValue::U64(*x),
+            FfiAttributeValue::F64(x) => AttributeValue::F64(*x),
+            FfiAttributeValue::Boolean(x) => AttributeValue::Bool(*x),
+            FfiAttributeValue::Str(x) => AttributeValue::String(x.to_string()),
+        }
+    }
+}
+
+/// An attribute in the attribute block of a batch of points.
+#[repr(C)]
+pub struct FfiAttribute<'a> {
+    pub key: AttributeKey,
+    pub value: FfiAttributeValue<'a>,
+}
+
+/// A measurement point in a batch, without boxing.
+///
+/// The resource and the consumer must be interned beforehand, with [`resource_intern`](super::resources::resource_intern)
+/// and [`consumer_intern`](super::resources::consumer_intern). The record borrows them: the plugin keeps its handles,
+/// and releases them when it no longer needs them.
+/// The attributes of the point are `attributes[attributes_start..attributes_start+attributes_len]`, in the attribute block
+/// of the batch. Several points can share the same attributes.
+#[repr(C)]
+pub struct FfiPointRecord {
+    pub value: FfiMeasurementValue,
+    pub metric: RawMetricId,
+    pub resource: ResourceId,
+    pub consumer: ConsumerId,
+    pub attributes_start: u32,
+    pub attributes_len: u32,
+}
+
+/// Internal: converts a batch of records to measurement points, and gives them to `push`.
+///
+/// Returns the number of points that have been pushed.
+fn push_batch(
+    timestamp: Timestamp,
+    points: *const FfiPointRecord,
+    len: usize,
+    attributes: *const FfiAttribute,
+    attributes_len: usize,
+    mut push: impl FnMut(MeasurementPoint),
+) -> usize {
+    // from_raw_parts requires a non-null pointer, even for an empty slice
+    let points = match len {
+        0 => &[],
+        _ => unsafe { std::slice::from_raw_parts(points, len) },
+    };
+    let attributes = match attributes_len {
+        0 => &[],
+        _ => unsafe { std::slice::from_raw_parts(attributes, attributes_len) },
+    };
+    let timestamp = crate::measurement::Timestamp::from(timestamp);
+
+    let mut pushed = 0;
+    for record in points {
+        let start = record.attributes_start as usize;
+        let Some(point_attributes) = attributes.get(start..start + record.attributes_len as usize) else {
+            log::error!(
+                "Invalid point record: attributes {start}..{} are out of the attribute block (length {attributes_len}), the point is ignored.",
+                start + record.attributes_len as usize
+            );
+            continue;
+        };
+        let value = WrappedMeasurementValue::from(&record.value);
+        // the points share the handles of the records, which stay owned by the plugin
+        let mut point = MeasurementPoint::new_untyped(
+            timestamp,
+            record.metric,
+            record.resource.clone(),
+            record.consumer.clone(),
+            value,
+        );
+        for attr in point_attributes {
+            point.add_attr(attr.key, AttributeValue::from(&attr.value));
+        }
+        push(point);
+        pushed += 1;
+    }
+    pushed
+}
+
+/// Adds a batch of `len` measurement points to the accumulator, with a single call.
+///
+/// All the points have the same `timestamp`. Their attributes are taken from the block
+/// `attributes` of length `attributes_len`, see [`FfiPointRecord`].
+/// The records and the attributes are copied, they can be reused after the call.
+///
+/// Returns the number of points that have been added: the points with invalid attributes are ignored.
+#[no_mangle]
+pub extern "C" fn maccumulator_push_batch(
+    buf: &mut MeasurementAccumulator,
+    timestamp: Timestamp,
+    points: *const FfiPointRecord,
+    len: usize,
+    attributes: *const FfiAttribute,
+    attributes_len: usize,
+) -> usize {
+    buf.reserve(len);
+    push_batch(timestamp, points, len, attributes, attributes_len, |p| buf.push(p))
+}
+
+/// Adds a batch of `len` measurement points to the buffer, with a single call.
+///
+/// See [`maccumulator_push_batch`].
+#[no_mangle]
+pub extern "C" fn mbuffer_push_batch(
+    buf: &mut MeasurementBuffer,
+    timestamp: Timestamp,
+    points: *const FfiPointRecord,
+    len: usize,
+    attributes: *const FfiAttribute,
+    attributes_len: usize,
+) -> usize {
+    buf.reserve(len);
+    push_batch(timestamp, points, len, attributes, attributes_len, |p| buf.push(p))
+}
+
+// ====== In-place modification ======
+
+thread_local! {
+    /// The metrics of the pipeline, while a transform of a plugin runs on this thread.
+    static TRANSFORM_METRICS: RefCell<Option<Arc<MetricRegistry>>> = const { RefCell::new(None) };
+}
+
+/// Calls `f`, during which [`mpoint_set_value`] checks the values against the registry `metrics`.
+pub(crate) fn with_transform_metrics<R>(metrics: Arc<MetricRegistry>, f: impl FnOnce() -> R) -> R {
+    TRANSFORM_METRICS.set(Some(metrics));
+    let res = f();
+    TRANSFORM_METRICS.set(None);
+    res
+}
+
+/// Sets the value of a point. The new value must have the same type as the values of the metric.
+///
+/// Returns `false` if the type is wrong, in which case the point is not modified.
+/// In a transform, the type is checked against the metric registry. Elsewhere, the new value
+/// must have the same type as the current value of the point.
+#[no_mangle]
+pub extern "C" fn mpoint_set_value(point: &mut MeasurementPoint, value: FfiMeasurementValue) -> bool {
+    let value = WrappedMeasurementValue::from(&value);
+    let expected = TRANSFORM_METRICS.with_borrow(|metrics| {
+        metrics
+            .as_ref()
+            .and_then(|m| m.with_id(&point.metric))
+            .map(|m| m.value_type.clone())
+    });
+    let expected = expected.unwrap_or_else(|| point.value.measurement_type());
+    if value.measurement_type() != expected {
+        log::error!(
+            "Invalid value for metric {:?}: expected a value of type {expected}, got {}. The point is not modified.",
+            point.metric,
+            value.measurement_type()
+        );
+        return false;
+    }
+    point.value = value;
+    true
+}
+
+/// Sets an attribute of a point, replacing the existing value if there is one.
+/// A string value is copied.
+#[no_mangle]
+pub extern "C" fn mpoint_set_attr(point: &mut MeasurementPoint, key: AttributeKey, value: FfiAttributeValue) {
+    point.add_attr(key, AttributeValue::from(&value));
+}
+
+/// Removes an attribute of a point. Returns `true` if the point had this attribute.
+#[no_mangle]
+pub extern "C" fn mpoint_remove_attr(point: &mut MeasurementPoint, key: AttributeKey) -> bool {
+    point.remove_attr(key).is_some()
+}
+
+/// A view of the points of a [`MeasurementBuffer`] that allows to modify them in place.
+///
+/// The point `i` (with `i < len`) is at the address `(char*)points + i*stride`.
+/// The view is valid as long as no point is added to or removed from the buffer.
+#[repr(C)]
+pub struct FfiBufferViewMut {
+    pub points: *mut MeasurementPoint,
+    pub len: usize,
+    /// Distance between two points, in bytes.
+    pub stride: usize,
+}
+
+/// Returns a view of the points of the buffer, which can be modified with [`mpoint_set_value`],
+/// [`mpoint_set_attr`] and [`mpoint_remove_attr`].
+#[no_mangle]
+pub extern "C" fn mbuffer_view_mut(buf: &mut MeasurementBuffer) -> FfiBufferViewMut {
+    let points = buf.as_mut_slice();
+    FfiBufferViewMut {
+        points: points.as_mut_ptr(),
+        len: points.len(),
+        stride: std::mem::size_of::<MeasurementPoint>(),
+    }
+}
+
+pub type RetainPointFn = unsafe extern "C" fn(*mut c_void, *const MeasurementPoint) -> bool;
+
+/// Keeps the points for which `f(data, point)` returns `true`, and removes the others.
+/// The order of the remaining points is preserved.
+///
+/// Returns the number of points that have been removed.
+#[no_mangle]
+pub extern "C" fn mbuffer_retain(buf: &mut MeasurementBuffer, data: *mut c_void, f: RetainPointFn) -> usize {
+    let len = buf.len();
+    buf.retain(|point| unsafe { f(data, point) });
+    len - buf.len()
+}
+
+/// Keeps the point `i` if `keep[i]` is `true`, and removes it otherwise.
+/// `len` must be the length of the buffer. The order of the remaining points is preserved.
+///
+/// Returns the number of points that have been removed.
+/// If `len` is not the length of the buffer, no point is removed and 0 is returned.
+#[no_mangle]
+pub extern "C" fn mbuffer_retain_mask(buf: &mut MeasurementBuffer, keep: *const bool, len: usize) -> usize {
+    if len != buf.len() {
+        log::error!(
+            "Invalid mask: it has {len} entries but the buffer has {} points. No point is removed.",
+            buf.len()
+        );
+        return 0;
+    }
+    let keep = match len {
+        0 => &[],
+        _ => unsafe { std::slice::from_raw_parts(keep, len) },
+    };
+    let mut i = 0;
+    buf.retain(|_| {
+        i += 1;
+        keep[i - 1]
+    });
+    len - buf.len()
+}
+
+/// The bits of a measurement value, whose type is given separately.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub union FfiRawValue {
+    pub u64: u64,
+    pub f64: f64,
+}
+
+/// Copies the values of the first `len` points into the array `values`, and their types into the array `types`
+/// (if it is not null). Both arrays must have room for `len` elements.
+///
+/// Together with [`mbuffer_set_values`], this allows to process all the values of the buffer at once,
+/// for instance with SIMD instructions. Returns the number of values that have been copied.
+#[no_mangle]
+pub extern "C" fn mbuffer_get_values(
+    buf: &MeasurementBuffer,
+    values: *mut FfiRawValue,
+    types: *mut WrappedMeasurementType,
+    len: usize,
+) -> usize {
+    let points = &buf.as_slice()[..len.min(buf.len())];
+    if points.is_empty() {
+        return 0;
+    }
+    let values = unsafe { std::slice::from_raw_parts_mut(values, points.len()) };
+    for (point, v) in points.iter().zip(values) {
+        *v = match point.value {
+            WrappedMeasurementValue::F64(x) => FfiRawValue { f64: x },
+            WrappedMeasurementValue::U64(x) => FfiRawValue { u64: x },
+        };
+    }
+    if !types.is_null() {
+        let types = unsafe { std::slice::from_raw_parts_mut(types, points.len()) };
+        for (point, t) in points.iter().zip(types) {
+            *t = point.value.measurement_type();
+        }
+    }
+    points.len()
+}
+
+/// Sets the values of the first `len` points from the array `values`.
+///
+/// The type of each point is kept: the bits of `values[i]` are read as a `u64` or as a `f64`,
+/// depending on the current type of the value of the point `i`.
+/// Returns the number of values that have been set.
+#[no_mangle]
+pub extern "C" fn mbuffer_set_values(buf: &mut MeasurementBuffer, values: *const FfiRawValue, len: usize) -> usize {
+    let n = len.min(buf.len());
+    if n == 0 {
+        return 0;
+    }
+    let values = unsafe { std::slice::from_raw_parts(values, n) };
+    for (point, v) in buf.as_mut_slice().iter_mut().zip(values) {
+        // SAFETY: both fields of the union are plain 64-bit values, any bit pattern is valid
+        point.value = match point.value {
+            WrappedMeasurementValue::F64(_) => WrappedMeasurementValue::F64(unsafe { v.f64 }),
+            WrappedMeasurementValue::U64(_) => WrappedMeasurementValue::U64(unsafe { v.u64 }),
+        };
+    }
+    n
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::Arc;
+    use std::time::SystemTime;
+
+    use libc::c_char;
+
+    use crate::{
+        measurement::{AttributeKey, AttributeValue, MeasurementBuffer, MeasurementPoint, WrappedMeasurementValue},
+        metrics::RawMetricId,
+        resources::{ConsumerId, Resource, ResourceConsumer, ResourceId},
+    };
+
+    use super::{
+        attribute_key_name, mbuffer_get_values, mbuffer_push_batch, mbuffer_retain, mbuffer_retain_mask,
+        mbuffer_set_values, mbuffer_view, mbuffer_view_mut, mpoint_attribute_at, mpoint_attributes_len,
+        mpoint_consumer_id_ref, mpoint_consumer_kind_ref, mpoint_remove_attr, mpoint_resource_id_ref,
+        mpoint_resource_kind_ref, mpoint_set_attr, mpoint_set_value, with_transform_metrics, FfiAttribute,
+        FfiAttributeValue, FfiMeasurementValue, FfiPointRecord, FfiRawValue, FFI_ID_BUFFER_LEN,
+    };
+    use crate::ffi::{string::AStr, time::Timestamp};
+
+    #[test]
+    fn batch_of_points() {
+        let core = AttributeKey::new("test_ffi_batch_core");
+        let domain = AttributeKey::new("test_ffi_batch_domain");
+        let attributes = [
+            FfiAttribute {
+                key: domain,
+                value: FfiAttributeValue::Str(AStr::from("package")),
+            },
+            FfiAttribute {
+                key: core,
+                value: FfiAttributeValue::U64(0),
+            },
+            FfiAttribute {
+                key: core,
+                value: FfiAttributeValue::U64(1),
+            },
+        ];
+        let resource = ResourceId::from(Resource::CpuPackage { id: 0 });
+        let record = |value, attributes_start, attributes_len| FfiPointRecord {
+            value,
+            metric: RawMetricId(7),
+            resource: resource.clone(),
+            consumer: ConsumerId::LOCAL_MACHINE,
+            attributes_start,
+            attributes_len,
+        };
+        let points = [
+            record(FfiMeasurementValue::U64(10), 0, 2), // domain + core 0
+            record(FfiMeasurementValue::F64(0.5), 0, 0),
+            record(FfiMeasurementValue::U64(11), 2, 1), // core 1
+            record(FfiMeasurementValue::U64(12), 2, 5), // out of bounds
+        ];
+
+        let mut buf = MeasurementBuffer::new();
+        let n = mbuffer_push_batch(
+            &mut buf,
+            Timestamp::from(SystemTime::now()),
+            points.as_ptr(),
+            points.len(),
+            attributes.as_ptr(),
+            attributes.len(),
+        );
+        assert_eq!(3, n);
+        assert_eq!(3, buf.len());
+
+        let pushed: Vec<_> = buf.iter().collect();
+        assert_eq!(RawMetricId(7), pushed[0].metric);
+        assert_eq!(&Resource::CpuPackage { id: 0 }, pushed[0].resource.resolve());
+        assert_eq!(&ResourceConsumer::LocalMachine, pushed[0].consumer.resolve());
+        assert!(matches!(pushed[0].value, WrappedMeasurementValue::U64(10)));
+        assert!(matches!(pushed[0].attribute(core), Some(AttributeValue::U64(0))));
+        assert!(matches!(pushed[0].attribute(domain), Some(AttributeValue::String(s)) if s == "package"));
+        assert!(matches!(pushed[1].value, WrappedMeasurementValue::F64(x) if x == 0.5));
+        assert_eq!(0, pushed[1].attributes_len());
+        assert!(matches!(pushed[2].attribute(core), Some(AttributeValue::U64(1))));
+        assert_eq!(None, pushed[2].attribute(domain).map(|_| ()));
+
+        // empty batch, with null pointers
+        let n = mbuffer_push_batch(
+            &mut buf,
+            Timestamp::from(SystemTime::now()),
+            std::ptr::null(),
+            0,
+            std::ptr::null(),
+            0,
+        );
+        assert_eq!(0, n);
+        assert_eq!(3, buf.len());
+    }
+
+    #[test]
+    fn read_points_without_copies() {
+        let core = AttributeKey::new("test_ffi_read_core");
+        let domain = AttributeKey::new("test_ffi_read_domain");
+        let attributes = [
+            FfiAttribute {
+                key: core,
+                value: FfiAttributeValue::U64(3),
+            },
+            FfiAttribute {
+                key: domain,
+                value: FfiAttributeValue::Str(AStr::from("dram")),
+            },
+        ];
+        let record = |resource, consumer, attributes_len| FfiPointRecord {
+            value: FfiMeasurementValue::U64(1),
+            metric: RawMetricId(1),
+            resource,
+            consumer,
+            attributes_start: 0,
+            attributes_len,
+        };
+        let points = [
+            record(
+                ResourceId::from(Resource::Dram { pkg_id: 1 }),
+                ConsumerId::LOCAL_MACHINE,
+                2,
+            ),
+            record(
+                ResourceId::LOCAL_MACHINE,
+                ConsumerId::from(ResourceConsumer::Process { pid: 42 }),
+                0,
+            ),
+        ];
+        let mut buf = MeasurementBuffer::new();
+        let n = mbuffer_push_batch(
+            &mut buf,
+            Timestamp::from(SystemTime::now()),
+            points.as_ptr(),
+            points.len(),
+            attributes.as_ptr(),
+            attributes.len(),
+        );
+        assert_eq!(2, n);
+
+        // iterate like a C output would do
+        let view = mbuffer_view(&buf);
+        assert_eq!(2, view.len);
+        let point_at = |i: usize| unsafe { &*(view.points as *const u8).add(i * view.stride).cast() };
+        let (p0, p1) = (point_at(0), point_at(1));
+        assert!(std::ptr::eq(p0, buf.iter().next().unwrap()));
+
+        assert_eq!("dram", mpoint_resource_kind_ref(p0).as_str());
+        let mut id_buf = [0 as c_char; FFI_ID_BUFFER_LEN];
+        let id_buf_ptr = id_buf.as_mut_ptr();
+        unsafe {
+            assert_eq!("1", mpoint_resource_id_ref(p0, id_buf_ptr, FFI_ID_BUFFER_LEN).as_str());
+            assert_eq!("local_machine", mpoint_consumer_kind_ref(p0).as_str());
+            assert_eq!("", mpoint_consumer_id_ref(p0, id_buf_ptr, FFI_ID_BUFFER_LEN).as_str());
+            assert_eq!("process", mpoint_consumer_kind_ref(p1).as_str());
+            assert_eq!("42", mpoint_consumer_id_ref(p1, id_buf_ptr, FFI_ID_BUFFER_LEN).as_str());
+            // the buffer is too small, or missing
+            assert_eq!("", mpoint_consumer_id_ref(p1, id_buf_ptr, 1).as_str());
+            assert_eq!("", mpoint_consumer_id_ref(p1, std::ptr::null_mut(), 0).as_str());
+        }
+
+        assert_eq!(2, mpoint_attributes_len(p0));
+        assert_eq!(0, mpoint_attributes_len(p1));
+        let attribute_at = |point, i| unsafe {
+            let mut attr = std::mem::MaybeUninit::uninit();
+            mpoint_attribute_at(point, i, attr.as_mut_ptr()).then(|| attr.assume_init())
+        };
+        let names: Vec<String> = (0..2)
+            .map(|i| attribute_key_name(attribute_at(p0, i).unwrap().key).to_string())
+            .collect();
+        assert_eq!(vec!["test_ffi_read_core", "test_ffi_read_domain"], names);
+        assert!(matches!(attribute_at(p0, 0).unwrap().value, FfiAttributeValue::U64(3)));
+        assert!(matches!(attribute_at(p0, 1).unwrap().value, FfiAttributeValue::Str(s) if s.as_str() == "dram"));
+        // out of bounds
+        assert!(attribute_at(p0, 2).is_none());
+        assert!(attribute_at(p1, 0).is_none());
+    }
+
+    #[test]
+    fn modify_points_in_place() {
+        let core = AttributeKey::new("test_ffi_modify_core");
+        let attributes = [FfiAttribute {
+            key: core,
+            value: FfiAttributeValue::U64(0),
+        }];
+        let record = |value| FfiPointRecord {
+            value,
+            metric: RawMetricId(1),
+            resource: ResourceId::LOCAL_MACHINE,
+            consumer: ConsumerId::LOCAL_MACHINE,
+            attributes_start: 0,
+            attributes_len: 1,
+        };
+        let points = [
+            record(FfiMeasurementValue::U64(1)),
+            record(FfiMeasurementValue::F64(2.0)),
+            record(FfiMeasurementValue::U64(3)),
+            record(FfiMeasurementValue::U64(4)),
+        ];
+        let mut buf = MeasurementBuffer::new();
+        mbuffer_push_batch(
+            &mut buf,
+            Timestamp::from(SystemTime::now()),
+            points.as_ptr(),
+            points.len(),
+            attributes.as_ptr(),
+            attributes.len(),
+        );
+
+        // modify single points through the view
+        let view = mbuffer_view_mut(&mut buf);
+        assert_eq!(4, view.len);
+        let p0 = unsafe { &mut *view.points };
+        assert!(mpoint_set_value(p0, FfiMeasurementValue::U64(10)));
+        assert!(!mpoint_set_value(p0, FfiMeasurementValue::F64(10.0)));
+        mpoint_set_attr(p0, core, FfiAttributeValue::Str(AStr::from("zero")));
+        let p3 = unsafe { &mut *(view.points as *mut u8).add(3 * view.stride).cast() };
+        assert!(mpoint_remove_attr(p3, core));
+        assert!(!mpoint_remove_attr(p3, core));
+        let p = buf.as_slice();
+        assert!(matches!(p[0].value, WrappedMeasurementValue::U64(10)));
+        assert!(matches!(p[0].attribute(core), Some(AttributeValue::String(s)) if s == "zero"));
+        assert_eq!(0, p[3].attributes_len());
+
+        // process all the values at once
+        let mut values = [FfiRawValue { u64: 0 }; 4];
+        let n = mbuffer_get_values(&buf, values.as_mut_ptr(), std::ptr::null_mut(), 4);
+        assert_eq!(4, n);
+        unsafe {
+            assert_eq!(2.0, values[1].f64);
+            values[0].u64 *= 2;
+            values[1].f64 *= 2.0;
+            values[2].u64 *= 2;
+        }
+        assert_eq!(3, mbuffer_set_values(&mut buf, values.as_ptr(), 3));
+        let p = buf.as_slice();
+        assert!(matches!(p[0].value, WrappedMeasurementValue::U64(20)));
+        assert!(matches!(p[1].value, WrappedMeasurementValue::F64(x) if x == 4.0));
+        assert!(matches!(p[2].value, WrappedMeasurementValue::U64(6)));
+        assert!(matches!(p[3].value, WrappedMeasurementValue::U64(4)));
+
+        // remove points
+        let keep = [true, false, true, true];
+        assert_eq!(0, mbuffer_retain_mask(&mut buf, keep.as_ptr(), 3));
+        assert_eq!(4, buf.len());
+        assert_eq!(1, mbuffer_retain_mask(&mut buf, keep.as_ptr(), keep.len()));
+        unsafe extern "C" fn has_core(data: *mut libc::c_void, point: *const MeasurementPoint) -> bool {
+            *(data as *mut usize) += 1;
+            (*point).attribute(AttributeKey::new("test_ffi_modify_core")).is_some()
+        }
+        let mut calls = 0usize;
+        let removed = mbuffer_retain(&mut buf, &mut calls as *mut usize as *mut libc::c_void, has_core);
+        assert_eq!((1, 3), (removed, calls));
+        let values: Vec<_> = buf.iter().map(|p| p.value.clone()).collect();
+        assert!(matches!(
+            values[..],
+            [WrappedMeasurementValue::U64(20), WrappedMeasurementValue::U64(6)]
+        ));
+    }
+    #[test]
+    fn set_value_checks_metric_type() {
+        let (registry, metric) = crate::pipeline::testing::registry();
+        // the value has the wrong type, but the registry knows the type of the metric
+        let mut point = MeasurementPoint::new_untyped(
+            crate::measurement::Timestamp::now(),
+            metric,
+            Resource::LocalMachine,
+            ResourceConsumer::LocalMachine,
+            WrappedMeasurementValue::F64(1.0),
+        );
+        with_transform_metrics(Arc::new(registry), || {
+            assert!(!mpoint_set_value(&mut point, FfiMeasurementValue::F64(2.0)));
+            assert!(mpoint_set_value(&mut point, FfiMeasurementValue::U64(2)));
+        });
+        assert!(matches!(point.value, WrappedMeasurementValue::U64(2)));
+    }
+}
@@ -21,6 +21,7 @@ use libc::c_void;
 use crate::measurement::{MeasurementAccumulator, MeasurementBuffer};
 use crate::pipeline::OutputContext;
 use crate::plugin::AlumetStart;
+use pipeline::FfiStatus;
 use time::Timestamp;
 
 // Submodules
@@ -42,9 +43,9 @@ pub type PluginStopFn = extern "C" fn(instance: *mut c_void);
 pub type DropFn = unsafe extern "C" fn(instance: *mut c_void);
 pub type NullableDropFn = Option<unsafe extern "C" fn(instance: *mut c_void)>;
 
-pub type SourcePollFn = extern "C" fn(instance: *mut c_void, buffer: *mut MeasurementAccumulator, timestamp: Timestamp);
-pub type TransformApplyFn = extern "C" fn(instance: *mut c_void, buffer: *mut MeasurementBuffer);
-pub type OutputWriteFn = extern "C" fn(instance: *mut c_void, buffer: *const MeasurementBuffer, ctx: *const FfiOutputContext);
+pub type SourcePollFn = extern "C" fn(instance: *mut c_void, buffer: *mut MeasurementAccumulator, timestamp: Timestamp) -> FfiStatus;
+pub type TransformApplyFn = extern "C" fn(instance: *mut c_void, buffer: *mut MeasurementBuffer) -> FfiStatus;
+pub type OutputWriteFn = extern "C" fn(instance: *mut c_void, buffer: *const MeasurementBuffer, ctx: *const FfiOutputContext) -> FfiStatus;
 
 // ====== OutputContext ======
 
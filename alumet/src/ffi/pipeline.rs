@@ -1,20 +1,114 @@
+use std::ffi::{c_char, CStr};
+use std::sync::Arc;
+
+use anyhow::anyhow;
 use libc::c_void;
 
+use super::{metrics::with_transform_metrics, resources::with_pipeline_resources};
 use super::{DropFn, FfiOutputContext, OutputWriteFn, SourcePollFn, TransformApplyFn};
 use crate::{
     measurement::{MeasurementAccumulator, MeasurementBuffer},
+    metrics::SharedMetricRegistry,
     pipeline::{self, OutputContext},
+    resources::ResourceRegistry,
 };
 
+// ====== Status of the pipeline elements ======
+
+/// Outcome of a call to a source, transform or output implemented in C.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum FfiStatusCode {
+    /// The call succeeded.
+    Ok,
+    /// The error is temporary, calling the element again may work.
+    ///
+    /// For a source or an output, this is [`PollError::CanRetry`](pipeline::PollError::CanRetry)
+    /// or [`WriteError::CanRetry`](pipeline::WriteError::CanRetry): Alumet keeps the element.
+    /// For a transform, this is [`TransformError::UnexpectedInput`](pipeline::TransformError::UnexpectedInput):
+    /// the measurements are invalid but the transform can be used on other measurements.
+    Retry,
+    /// The element cannot recover from the error, Alumet stops using it.
+    Fatal,
+}
+
+/// Error message of a [`FfiStatus`], owned by Alumet.
+pub struct FfiErrorMessage(String);
+
+/// Status returned by the sources, transforms and outputs that are implemented in C.
+///
+/// Use [`status_ok`], [`status_retry`] or [`status_fatal`] to create it.
+#[repr(C)]
+pub struct FfiStatus {
+    pub code: FfiStatusCode,
+    /// Optional error message, null if there is none.
+    pub message: Option<Box<FfiErrorMessage>>,
+}
+
+impl FfiStatus {
+    /// Converts the status to a result. On error, returns whether the element can be called again.
+    fn into_result(self, element: &str) -> Result<(), (bool, anyhow::Error)> {
+        let error = || match self.message {
+            Some(msg) => anyhow::Error::msg(msg.0),
+            None => anyhow!("error in {element}"),
+        };
+        match self.code {
+            FfiStatusCode::Ok => Ok(()),
+            FfiStatusCode::Retry => Err((true, error())),
+            FfiStatusCode::Fatal => Err((false, error())),
+        }
+    }
+}
+
+fn status(code: FfiStatusCode, message: *const c_char) -> FfiStatus {
+    let message = match message.is_null() {
+        true => None,
+        // don't panic on invalid UTF-8, the message is only informative
+        false => Some(Box::new(FfiErrorMessage(
+            unsafe { CStr::from_ptr(message) }.to_string_lossy().into_owned(),
+        ))),
+    };
+    FfiStatus { code, message }
+}
+
+/// Returns a successful status.
+#[no_mangle]
+pub extern "C" fn status_ok() -> FfiStatus {
+    status(FfiStatusCode::Ok, std::ptr::null())
+}
+
+/// Returns a status that indicates a temporary error, see [`FfiStatusCode::Retry`].
+///
+/// `message` is a null-terminated string, which is copied, or null.
+#[no_mangle]
+pub extern "C" fn status_retry(message: *const c_char) -> FfiStatus {
+    status(FfiStatusCode::Retry, message)
+}
+
+/// Returns a status that indicates a fatal error, see [`FfiStatusCode::Fatal`].
+///
+/// `message` is a null-terminated string, which is copied, or null.
+#[no_mangle]
+pub extern "C" fn status_fatal(message: *const c_char) -> FfiStatus {
+    status(FfiStatusCode::Fatal, message)
+}
+
+// ====== Pipeline elements ======
+
 pub(crate) struct FfiSource {
     pub data: *mut c_void,
     pub poll_fn: SourcePollFn,
     pub drop_fn: Option<DropFn>,
+    /// The resources of the pipeline, to intern the resources of the points that the source creates.
+    pub resources: Option<Arc<ResourceRegistry>>,
 }
 pub(crate) struct FfiTransform {
     pub data: *mut c_void,
     pub apply_fn: TransformApplyFn,
     pub drop_fn: Option<DropFn>,
+    /// The metrics of the pipeline, to check the values that the transform sets.
+    /// Set when the pipeline is built.
+    pub metrics: Option<Arc<SharedMetricRegistry>>,
 }
 pub(crate) struct FfiOutput {
     pub data: *mut c_void,
@@ -30,21 +124,41 @@ unsafe impl Send for FfiOutput {}
 
 impl pipeline::Source for FfiSource {
     fn poll(&mut self, into: &mut MeasurementAccumulator, time: crate::measurement::Timestamp) -> Result<(), pipeline::PollError> {
-        (self.poll_fn)(self.data, into, time.into());
-        Ok(())
+        let status = match &self.resources {
+            Some(resources) => {
+                with_pipeline_resources(resources.clone(), || (self.poll_fn)(self.data, into, time.into()))
+            }
+            None => (self.poll_fn)(self.data, into, time.into()),
+        };
+        status.into_result("source").map_err(|(can_retry, e)| match can_retry {
+            true => pipeline::PollError::CanRetry(e),
+            false => pipeline::PollError::Fatal(e),
+        })
     }
 }
 impl pipeline::Transform for FfiTransform {
     fn apply(&mut self, on: &mut MeasurementBuffer) -> Result<(), pipeline::TransformError> {
-        (self.apply_fn)(self.data, on);
-        Ok(())
+        let status = match &self.metrics {
+            Some(metrics) => with_transform_metrics(metrics.snapshot(), || (self.apply_fn)(self.data, on)),
+            None => (self.apply_fn)(self.data, on),
+        };
+        status
+            .into_result("transform")
+            .map_err(|(can_retry, e)| match can_retry {
+                true => pipeline::TransformError::UnexpectedInput(e),
+                false => pipeline::TransformError::Fatal(e),
+            })
     }
 }
 impl pipeline::Output for FfiOutput {
     fn write(&mut self, measurements: &MeasurementBuffer, ctx: &OutputContext) -> Result<(), pipeline::WriteError> {
         let ffi_ctx = FfiOutputContext { inner: ctx };
-        (self.write_fn)(self.data, measurements, &ffi_ctx);
-        Ok(())
+        (self.write_fn)(self.data, measurements, &ffi_ctx)
+            .into_result("output")
+            .map_err(|(can_retry, e)| match can_retry {
+                true => pipeline::WriteError::CanRetry(e),
+                false => pipeline::WriteError::Fatal(e),
+            })
     }
 }
 
@@ -69,3 +183,50 @@ impl Drop for FfiOutput {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use std::ffi::CString;
+
+    use libc::c_void;
+
+    use super::{status_fatal, status_ok, status_retry, FfiSource, FfiStatus};
+    use crate::{
+        measurement::{MeasurementAccumulator, MeasurementBuffer, Timestamp},
+        pipeline::{PollError, Source},
+    };
+
+    extern "C" fn poll_status(
+        data: *mut c_void,
+        _acc: *mut MeasurementAccumulator,
+        _t: crate::ffi::time::Timestamp,
+    ) -> FfiStatus {
+        let message = CString::new("counter unavailable").unwrap();
+        match unsafe { *(data as *const u32) } {
+            0 => status_ok(),
+            1 => status_retry(message.as_ptr()),
+            2 => status_fatal(message.as_ptr()),
+            _ => status_fatal(std::ptr::null()),
+        }
+    }
+
+    #[test]
+    fn source_status() {
+        let mut outcome = 0u32;
+        let mut source = FfiSource {
+            data: &mut outcome as *mut u32 as *mut c_void,
+            poll_fn: poll_status,
+            drop_fn: None,
+            resources: None,
+        };
+        let mut buf = MeasurementBuffer::new();
+        let mut poll = |outcome: u32| {
+            unsafe { *(source.data as *mut u32) = outcome };
+            source.poll(&mut buf.as_accumulator(), Timestamp::now())
+        };
+        assert!(poll(0).is_ok());
+        assert!(matches!(poll(1), Err(PollError::CanRetry(e)) if e.to_string() == "counter unavailable"));
+        assert!(matches!(poll(2), Err(PollError::Fatal(e)) if e.to_string() == "counter unavailable"));
+        assert!(matches!(poll(3), Err(PollError::Fatal(e)) if e.to_string() == "error in source"));
+    }
+}
@@ -1,4 +1,4 @@
-use std::ffi::{c_char, CStr};
+use std::ffi::{c_char, c_int, CStr};
 
 use libc::c_void;
 
@@ -60,6 +60,7 @@ pub extern "C" fn alumet_add_source(
         data: source_data,
         poll_fn: source_poll_fn,
         drop_fn: source_drop_fn,
+        resources: Some(alumet.resources()),
     });
     alumet.add_source(
         source,
@@ -69,6 +70,55 @@ pub extern "C" fn alumet_add_source(
             .unwrap(),
     );
 }
+
+/// Adds a source that is polled when the file descriptor `fd` becomes readable,
+/// at most once every `min_interval`.
+///
+/// The file descriptor must stay open as long as the source exists.
+///
+/// Returns false if `fd` is not an open file descriptor. In that case, the source is not added
+/// and `source_drop_fn` is not called: `source_data` still belongs to the caller.
+#[no_mangle]
+pub extern "C" fn alumet_add_source_fd(
+    alumet: &mut AlumetStart,
+    source_data: *mut c_void,
+    fd: c_int,
+    min_interval: TimeDuration,
+    source_poll_fn: SourcePollFn,
+    source_drop_fn: NullableDropFn,
+) -> bool {
+    if !is_open_fd(fd) {
+        log::error!("Cannot add a source on file descriptor {fd}: it is not open.");
+        return false;
+    }
+    let trigger = match trigger::builder::fd_readable(fd).coalesce(min_interval.into()).build() {
+        Ok(trigger) => trigger,
+        Err(e) => {
+            log::error!("Cannot add a source on file descriptor {fd}: {e}");
+            return false;
+        }
+    };
+    let source = Box::new(FfiSource {
+        data: source_data,
+        poll_fn: source_poll_fn,
+        drop_fn: source_drop_fn,
+        resources: Some(alumet.resources()),
+    });
+    alumet.add_source(source, trigger);
+    true
+}
+
+#[cfg(unix)]
+fn is_open_fd(fd: c_int) -> bool {
+    // F_GETFD fails if the file descriptor is not open
+    fd >= 0 && unsafe { libc::fcntl(fd, libc::F_GETFD) } != -1
+}
+
+#[cfg(not(unix))]
+fn is_open_fd(fd: c_int) -> bool {
+    fd >= 0
+}
+
 #[no_mangle]
 pub extern "C" fn alumet_add_transform(
     alumet: &mut AlumetStart,
@@ -76,12 +126,16 @@ pub extern "C" fn alumet_add_transform(
     transform_apply_fn: TransformApplyFn,
     transform_drop_fn: NullableDropFn,
 ) {
-    let transform = Box::new(FfiTransform {
+    let mut transform = FfiTransform {
         data: transform_data,
         apply_fn: transform_apply_fn,
         drop_fn: transform_drop_fn,
+        metrics: None,
+    };
+    alumet.add_transform_builder(move |ctx| {
+        transform.metrics = Some(ctx.metrics().clone());
+        Box::new(transform)
     });
-    alumet.add_transform(transform);
 }
 #[no_mangle]
 pub extern "C" fn alumet_add_output(
@@ -1,4 +1,7 @@
-use crate::resources::{ResourceConsumer, Resource};
+use std::cell::RefCell;
+use std::sync::Arc;
+
+use crate::resources::{ConsumerId, Resource, ResourceConsumer, ResourceId, ResourceRegistry};
 
 // pub(crate) const RESOURCE_ID_SIZE: usize = std::mem::size_of::<ResourceId>();
 
@@ -68,15 +71,102 @@ pub extern "C" fn consumer_new_process(pid: u32) -> FfiConsumerId {
     ResourceConsumer::Process { pid }.into()
 }
 
+// ====== Interning ======
+
+thread_local! {
+    /// The registry of the pipeline, while a plugin is started or one of its sources is polled on this thread.
+    static PIPELINE_RESOURCES: RefCell<Option<Arc<ResourceRegistry>>> = const { RefCell::new(None) };
+}
+
+/// Calls `f`, during which the resources and consumers given by the plugin are interned in `registry`.
+pub(crate) fn with_pipeline_resources<R>(registry: Arc<ResourceRegistry>, f: impl FnOnce() -> R) -> R {
+    let previous = PIPELINE_RESOURCES.replace(Some(registry));
+    let res = f();
+    PIPELINE_RESOURCES.set(previous);
+    res
+}
+
+/// Returns a handle to the resource, shared with the equal resources of the pipeline if possible.
+pub(crate) fn intern_resource(resource: Resource) -> ResourceId {
+    PIPELINE_RESOURCES.with_borrow(|registry| match registry {
+        Some(registry) => registry.intern_resource(resource),
+        None => resource.into(),
+    })
+}
+
+/// Returns a handle to the consumer, shared with the equal consumers of the pipeline if possible.
+pub(crate) fn intern_consumer(consumer: ResourceConsumer) -> ConsumerId {
+    PIPELINE_RESOURCES.with_borrow(|registry| match registry {
+        Some(registry) => registry.intern_consumer(consumer),
+        None => consumer.into(),
+    })
+}
+
+/// Interns a resource in the registry of the pipeline and returns a handle to it,
+/// which is much smaller than the resource itself.
+///
+/// Intern the resources once, for instance when creating the source, and use the handles
+/// in [`FfiPointRecord`](super::metrics::FfiPointRecord)s.
+/// The handle is reference-counted: release it with [`resource_id_release`] when it is no longer needed.
+#[no_mangle]
+pub extern "C" fn resource_intern(resource: FfiResourceId) -> ResourceId {
+    intern_resource(resource.into())
+}
+
+/// Interns a consumer in the registry of the pipeline and returns a handle to it,
+/// which is much smaller than the consumer itself.
+///
+/// See [`resource_intern`]. Release the handle with [`consumer_id_release`].
+#[no_mangle]
+pub extern "C" fn consumer_intern(consumer: FfiConsumerId) -> ConsumerId {
+    intern_consumer(consumer.into())
+}
+
+/// Releases a handle returned by [`resource_intern`]. The handle must not be used after this call.
+///
+/// The measurement points that use the resource hold their own reference to it.
+#[no_mangle]
+pub extern "C" fn resource_id_release(id: ResourceId) {
+    drop(id)
+}
+
+/// Releases a handle returned by [`consumer_intern`]. The handle must not be used after this call.
+///
+/// The measurement points that use the consumer hold their own reference to it.
+#[no_mangle]
+pub extern "C" fn consumer_id_release(id: ConsumerId) {
+    drop(id)
+}
+
 // ====== Tests ======
 
 #[cfg(test)]
 mod tests {
-    use crate::resources::{ResourceConsumer, Resource};
+    use std::sync::Arc;
+
+    use super::{resource_intern, with_pipeline_resources};
+    use crate::resources::{Resource, ResourceConsumer, ResourceRegistry};
 
     #[test]
     fn test_memory_layout() {
         assert_eq!(56, std::mem::size_of::<Resource>());
         assert_eq!(56, std::mem::size_of::<ResourceConsumer>());
     }
+
+    #[test]
+    fn interned_in_the_pipeline_registry() {
+        let registry = Arc::new(ResourceRegistry::new());
+        let (a, b) = with_pipeline_resources(registry.clone(), || {
+            let a = resource_intern(Resource::CpuPackage { id: 0 }.into());
+            let b = resource_intern(Resource::CpuPackage { id: 0 }.into());
+            (a, b)
+        });
+        assert_eq!(a, b);
+        assert_eq!(1, registry.resources_len());
+
+        // outside of the pipeline, the resource gets its own handle
+        let c = resource_intern(Resource::CpuPackage { id: 1 }.into());
+        assert_eq!(&Resource::CpuPackage { id: 1 }, c.resolve());
+        assert_eq!(1, registry.resources_len());
+    }
 }
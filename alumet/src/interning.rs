@@ -0,0 +1,130 @@
+//! Process-wide interning of values that are shared by many measurement points.
+
+use std::{
+    borrow::Borrow,
+    collections::HashMap,
+    hash::Hash,
+    sync::{OnceLock, RwLock},
+};
+
+use fxhash::FxBuildHasher;
+
+/// Number of values in the first chunk of an [`Interner`]. Each chunk is twice as large as the previous one.
+const FIRST_CHUNK_LEN: usize = 64;
+
+/// Number of chunks that are needed to store `u32::MAX` values.
+const CHUNK_COUNT: usize = (u32::BITS - FIRST_CHUNK_LEN.trailing_zeros()) as usize + 1;
+
+/// Append-only set of values, indexed by a `u32`.
+///
+/// Interned values are never removed: they live until the end of the program.
+/// This allows the interner to hand out `&'static` references.
+///
+/// Interning a value takes a lock, but getting a value from its id does not: the values are stored
+/// in chunks that are allocated once and never move.
+pub(crate) struct Interner<T: ?Sized + 'static> {
+    ids: RwLock<HashMap<&'static T, u32, FxBuildHasher>>,
+    chunks: [OnceLock<Box<[OnceLock<&'static T>]>>; CHUNK_COUNT],
+}
+
+impl<T: ?Sized + Eq + Hash + 'static> Interner<T> {
+    pub fn new() -> Self {
+        Self {
+            ids: RwLock::new(HashMap::default()),
+            chunks: std::array::from_fn(|_| OnceLock::new()),
+        }
+    }
+
+    /// Returns the id of the value, interning it if needed.
+    ///
+    /// The value is only moved to the heap if it has not been interned yet.
+    pub fn intern<V: Borrow<T> + Into<Box<T>>>(&self, value: V) -> u32 {
+        self.try_intern(value, u32::MAX as usize)
+            .expect("too many interned values")
+    }
+
+    /// Returns the id of the value, interning it if the interner holds less than `limit` values.
+    ///
+    /// Returns `None` if the value is not interned and the limit has been reached.
+    pub fn try_intern<V: Borrow<T> + Into<Box<T>>>(&self, value: V, limit: usize) -> Option<u32> {
+        // fast path: the value is already known
+        if let Some(id) = self.lookup(value.borrow()) {
+            return Some(id);
+        }
+        let mut ids = self.ids.write().unwrap();
+        if let Some(id) = ids.get(value.borrow()) {
+            // interned by another thread in the meantime
+            return Some(*id);
+        }
+        if ids.len() >= limit.min(u32::MAX as usize) {
+            return None;
+        }
+        let id = ids.len() as u32;
+        let value: &'static T = Box::leak(value.into());
+        let (chunk, offset) = locate(id);
+        let chunk = self.chunks[chunk].get_or_init(|| (0..chunk_len(chunk)).map(|_| OnceLock::new()).collect());
+        // the write lock is held, nobody else can initialize this slot
+        let _ = chunk[offset].set(value);
+        ids.insert(value, id);
+        Some(id)
+    }
+
+    /// Returns the id of the value, if it has been interned.
+    pub fn lookup(&self, value: &T) -> Option<u32> {
+        self.ids.read().unwrap().get(value).copied()
+    }
+
+    /// Returns the value with the given id, without taking any lock.
+    ///
+    /// # Panics
+    /// Panics if the id has not been returned by this interner.
+    pub fn get(&self, id: u32) -> &'static T {
+        let (chunk, offset) = locate(id);
+        self.chunks[chunk]
+            .get()
+            .and_then(|values| values[offset].get())
+            .expect("unknown interned id")
+    }
+}
+
+/// Returns the number of values in the chunk at index `chunk`.
+fn chunk_len(chunk: usize) -> usize {
+    FIRST_CHUNK_LEN << chunk
+}
+
+/// Returns the index of the chunk that holds the value `id`, and the index of the value in this chunk.
+fn locate(id: u32) -> (usize, usize) {
+    let n = id as usize / FIRST_CHUNK_LEN + 1;
+    let chunk = (usize::BITS - 1 - n.leading_zeros()) as usize;
+    let offset = id as usize - FIRST_CHUNK_LEN * ((1 << chunk) - 1);
+    (chunk, offset)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::{chunk_len, locate, Interner, CHUNK_COUNT, FIRST_CHUNK_LEN};
+
+    #[test]
+    fn chunk_boundaries() {
+        assert_eq!((0, 0), locate(0));
+        assert_eq!((0, FIRST_CHUNK_LEN - 1), locate(FIRST_CHUNK_LEN as u32 - 1));
+        assert_eq!((1, 0), locate(FIRST_CHUNK_LEN as u32));
+        assert_eq!((1, chunk_len(1) - 1), locate(3 * FIRST_CHUNK_LEN as u32 - 1));
+        assert_eq!((2, 0), locate(3 * FIRST_CHUNK_LEN as u32));
+        let (chunk, offset) = locate(u32::MAX);
+        assert!(chunk < CHUNK_COUNT && offset < chunk_len(chunk));
+    }
+
+    #[test]
+    fn limit() {
+        let interner: Interner<str> = Interner::new();
+        let ids: Vec<u32> = (0..200).map(|i| interner.intern(format!("value {i}"))).collect();
+        assert_eq!((0..200).collect::<Vec<u32>>(), ids);
+        assert_eq!("value 150", interner.get(150));
+
+        assert_eq!(Some(3), interner.try_intern("value 3", 200));
+        assert_eq!(None, interner.try_intern("value 200", 200));
+        assert_eq!(Some(200), interner.try_intern("value 200", 201));
+        assert_eq!(None, interner.lookup("value 201"));
+    }
+}
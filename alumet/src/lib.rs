@@ -19,5 +19,7 @@ pub mod plugin;
 pub mod resources;
 pub mod units;
 
+mod interning;
+
 #[cfg(feature = "dynamic")]
 mod ffi;
@@ -29,12 +29,18 @@ use core::fmt;
 use std::borrow::Cow;
 use fxhash::FxBuildHasher;
 use smallvec::SmallVec;
-use std::{collections::HashMap, fmt::Display, time::SystemTime};
+use std::{
+    collections::HashMap,
+    fmt::Display,
+    sync::{Arc, OnceLock},
+    time::SystemTime,
+};
 
-use crate::resources::ResourceConsumer;
+use crate::interning::Interner;
+use crate::pipeline::pool::SourceBufferPool;
 
 use super::metrics::{RawMetricId, TypedMetricId};
-use super::resources::Resource;
+use super::resources::{ConsumerId, ResourceId};
 
 /// A value that has been measured at a given point in time.
 ///
@@ -54,20 +60,23 @@ pub struct MeasurementPoint {
     /// The resource this measurement is about: CPU socket, GPU, process, ...
     /// 
     /// The `resource` and the `consumer` specify which object has been measured.
-    pub resource: Resource,
+    /// They are shared handles, that can be interned in the [`ResourceRegistry`](crate::resources::ResourceRegistry)
+    /// of the pipeline. Use [`ResourceId::resolve`] to get the [`Resource`](crate::resources::Resource).
+    pub resource: ResourceId,
     
     /// The consumer of the resource: process, container, ...
     /// 
     /// This gives additional information about the perimeter of the measurement.
     /// For instance, we can measure the total CPU usage of the node,
     /// or the usage of the CPU by a particular process.
-    pub consumer: ResourceConsumer,
+    pub consumer: ConsumerId,
 
     /// Additional attributes on the measurement point.
     /// 
     /// Not public because we could change how they are stored later (in fact it has already changed multiple times).
     /// Uses  [`SmallVec`] to avoid allocations if the number of attributes is small.
-    attributes: SmallVec<[(Cow<'static, str>, AttributeValue); 4]>
+    /// The attributes are sorted by key id (not by name), and each key appears at most once.
+    attributes: SmallVec<[(AttributeKey, AttributeValue); 4]>
 }
 
 /// A measurement of a clock.
@@ -80,13 +89,15 @@ pub struct Timestamp(pub(crate) SystemTime);
 impl MeasurementPoint {
     /// Creates a new `MeasurementPoint` without attributes.
     ///
+    /// The resource and the consumer can be given as interned ids, or as values (which are moved to new handles here).
+    ///
     /// Use [`with_attr`](Self::with_attr) or [`with_attr_vec`](Self::with_attr_vec)
     /// to attach arbitrary attributes to the point.
     pub fn new<T: MeasurementType>(
         timestamp: Timestamp,
         metric: TypedMetricId<T>,
-        resource: Resource,
-        consumer: ResourceConsumer,
+        resource: impl Into<ResourceId>,
+        consumer: impl Into<ConsumerId>,
         value: T::T,
     ) -> MeasurementPoint {
         Self::new_untyped(timestamp, metric.0, resource, consumer, T::wrapped_value(value))
@@ -100,16 +111,16 @@ impl MeasurementPoint {
     pub fn new_untyped(
         timestamp: Timestamp,
         metric: RawMetricId,
-        resource: Resource,
-        consumer: ResourceConsumer,
+        resource: impl Into<ResourceId>,
+        consumer: impl Into<ConsumerId>,
         value: WrappedMeasurementValue,
     ) -> MeasurementPoint {
         MeasurementPoint {
             metric,
             timestamp,
             value,
-            resource,
-            consumer,
+            resource: resource.into(),
+            consumer: consumer.into(),
             attributes: SmallVec::new(),
         }
     }
@@ -120,41 +131,72 @@ impl MeasurementPoint {
     }
 
     /// Iterates on the attributes attached to the measurement point.
+    ///
+    /// The attributes are always given in the same order: the order of their [`AttributeKey`].
     pub fn attributes(&self) -> impl Iterator<Item = (&str, &AttributeValue)> {
-        self.attributes.iter().map(|(k, v)| (k.as_ref(), v))
+        self.attributes.iter().map(|(k, v)| (k.name(), v))
     }
 
     /// Iterates on the keys of the attributes that are attached to the point.
     pub fn attributes_keys(&self) -> impl Iterator<Item = &str> {
-        self.attributes.iter().map(|(k, _v)| k.as_ref())
+        self.attributes.iter().map(|(k, _v)| k.name())
+    }
+
+    /// Iterates on the attributes attached to the measurement point, without resolving the keys.
+    ///
+    /// The attributes are sorted by [`AttributeKey`], that is, in the order in which the keys have been registered.
+    pub fn attributes_by_key(&self) -> impl Iterator<Item = (AttributeKey, &AttributeValue)> {
+        self.attributes.iter().map(|(k, v)| (*k, v))
     }
 
-    pub(crate) fn add_attr(&mut self, key: Cow<'static, str>, value: AttributeValue) {
-        self.attributes.push((key, value));
+    /// Returns the value of the attribute with the given key, if it is attached to the point.
+    pub fn attribute(&self, key: AttributeKey) -> Option<&AttributeValue> {
+        self.attributes
+            .binary_search_by_key(&key, |(k, _)| *k)
+            .ok()
+            .map(|i| &self.attributes[i].1)
+    }
+
+    pub(crate) fn add_attr(&mut self, key: AttributeKey, value: AttributeValue) {
+        match self.attributes.binary_search_by_key(&key, |(k, _)| *k) {
+            Ok(i) => self.attributes[i].1 = value,
+            Err(i) => self.attributes.insert(i, (key, value)),
+        }
+    }
+
+    /// Removes an attribute from this measurement point, and returns its value (if the point had this attribute).
+    pub fn remove_attr(&mut self, key: AttributeKey) -> Option<AttributeValue> {
+        self.attributes
+            .binary_search_by_key(&key, |(k, _)| *k)
+            .ok()
+            .map(|i| self.attributes.remove(i).1)
     }
 
     /// Sets an attribute on this measurement point.
     /// If an attribute with the same key already exists, its value is replaced.
-    pub fn with_attr<K: Into<Cow<'static, str>>, V: Into<AttributeValue>>(mut self, key: K, value: V) -> Self {
+    ///
+    /// The key can be an [`AttributeKey`] registered in advance (preferred), or a static string.
+    pub fn with_attr<K: Into<AttributeKey>, V: Into<AttributeValue>>(mut self, key: K, value: V) -> Self {
         self.add_attr(key.into(), value.into());
         self
     }
 
     /// Attaches multiple attributes to this measurement point, from a [`Vec`].
     /// Existing attributes with conflicting keys are replaced.
-    pub fn with_attr_vec<K: Into<Cow<'static, str>>>(mut self, attributes: Vec<(K, AttributeValue)>) -> Self {
-        self.attributes.extend(attributes.into_iter().map(|(k, v)| (k.into(), v)));
+    pub fn with_attr_vec<K: Into<AttributeKey>>(mut self, attributes: Vec<(K, AttributeValue)>) -> Self {
+        self.attributes.reserve(attributes.len());
+        for (k, v) in attributes {
+            self.add_attr(k.into(), v);
+        }
         self
     }
 
     /// Attaches multiple attributes to this measurement point, from a [`HashMap`].
     /// Existing attributes with conflicting keys are replaced.
-    pub fn with_attr_map<K: Into<Cow<'static, str>>>(mut self, attributes: HashMap<K, AttributeValue, FxBuildHasher>) -> Self {
-        let converted = attributes.into_iter().map(|(k, v)| (k.into(), v));
-        if self.attributes.is_empty() {
-            self.attributes = converted.collect();
-        } else {
-            self.attributes.extend(converted);
+    pub fn with_attr_map<K: Into<AttributeKey>>(mut self, attributes: HashMap<K, AttributeValue, FxBuildHasher>) -> Self {
+        self.attributes.reserve(attributes.len());
+        for (k, v) in attributes {
+            self.add_attr(k.into(), v);
         }
         self
     }
@@ -244,6 +286,78 @@ impl WrappedMeasurementValue {
     }
 }
 
+/// The key of an attribute.
+///
+/// Attribute keys are interned in a process-wide table: each distinct key is stored once,
+/// and the measurement points only store its small identifier.
+/// Plugins should register their keys at startup with [`AlumetStart::create_attribute_key`](crate::plugin::AlumetStart::create_attribute_key)
+/// (or [`AttributeKey::new`]), instead of giving a string to [`MeasurementPoint::with_attr`] for each point.
+/// The keys are never freed: keys that come from untrusted data, for instance from the network,
+/// must be created with [`AttributeKey::try_new`], which bounds the size of the table.
+///
+/// The keys are ordered by registration, not by name. This gives a stable order to the attributes of every point.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash, PartialOrd, Ord)]
+#[repr(C)]
+pub struct AttributeKey(pub(crate) u32);
+
+static GLOBAL_ATTRIBUTE_KEYS: OnceLock<Interner<str>> = OnceLock::new();
+
+/// Number of keys above which [`AttributeKey::try_new`] does not register new keys.
+const MAX_RUNTIME_ATTRIBUTE_KEYS: usize = 1024;
+
+fn attribute_keys() -> &'static Interner<str> {
+    GLOBAL_ATTRIBUTE_KEYS.get_or_init(Interner::new)
+}
+
+impl AttributeKey {
+    /// Registers an attribute key, or returns the existing key with the same name.
+    ///
+    /// The key is never freed. Use this function for the keys that are known in advance, when the plugin starts,
+    /// and [`AttributeKey::try_new`] for the keys that are discovered while the pipeline is running.
+    pub fn new(name: impl Into<Cow<'static, str>>) -> AttributeKey {
+        match name.into() {
+            Cow::Borrowed(name) => AttributeKey(attribute_keys().intern(name)),
+            Cow::Owned(name) => AttributeKey(attribute_keys().intern(name)),
+        }
+    }
+
+    /// Returns the key with the given name, registering it if there are less than 1024 keys.
+    ///
+    /// Returns `None` if the key does not exist and the table of keys is full. Unlike [`AttributeKey::new`],
+    /// this is safe to call with names that come from untrusted data: the table cannot grow without bounds.
+    pub fn try_new(name: &str) -> Option<AttributeKey> {
+        attribute_keys()
+            .try_intern(name, MAX_RUNTIME_ATTRIBUTE_KEYS)
+            .map(AttributeKey)
+    }
+
+    /// Returns the key with the given name, if it has been registered.
+    ///
+    /// Unlike [`AttributeKey::new`], this never allocates.
+    pub fn lookup(name: &str) -> Option<AttributeKey> {
+        attribute_keys().lookup(name).map(AttributeKey)
+    }
+
+    /// Returns the name of the key.
+    ///
+    /// This does not take any lock.
+    pub fn name(self) -> &'static str {
+        attribute_keys().get(self.0)
+    }
+}
+
+impl From<&'static str> for AttributeKey {
+    fn from(value: &'static str) -> Self {
+        AttributeKey(attribute_keys().intern(value))
+    }
+}
+
+impl Display for AttributeKey {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        f.write_str(self.name())
+    }
+}
+
 /// An attribute value of any supported attribute type.
 #[derive(Debug, Clone)]
 pub enum AttributeValue {
@@ -302,23 +416,41 @@ impl From<&'static str> for AttributeValue {
 
 /// A `MeasurementBuffer` stores measured data points.
 /// Unlike a [`MeasurementAccumulator`], the buffer allows to modify the measurements.
-#[derive(Clone)]
 pub struct MeasurementBuffer {
     points: Vec<MeasurementPoint>,
+    /// The pool that gets the memory of the buffer back when it is dropped, if any.
+    recycler: Option<Arc<SourceBufferPool>>,
 }
 
 impl MeasurementBuffer {
     /// Constructs a new buffer.
     pub fn new() -> MeasurementBuffer {
-        MeasurementBuffer { points: Vec::new() }
+        MeasurementBuffer {
+            points: Vec::new(),
+            recycler: None,
+        }
     }
 
     /// Constructs a new buffer with at least the specified capacity (allocated on construction).
     pub fn with_capacity(capacity: usize) -> MeasurementBuffer {
         MeasurementBuffer {
             points: Vec::with_capacity(capacity),
+            recycler: None,
         }
     }
+
+    /// Constructs a buffer that gives its memory back to `recycler` when it is dropped.
+    pub(crate) fn recyclable(points: Vec<MeasurementPoint>, recycler: Arc<SourceBufferPool>) -> MeasurementBuffer {
+        MeasurementBuffer {
+            points,
+            recycler: Some(recycler),
+        }
+    }
+
+    /// Returns the number of measurement points that the buffer can hold without reallocating.
+    pub fn capacity(&self) -> usize {
+        self.points.capacity()
+    }
     
     /// Returns true if this buffer is empty.
     pub fn is_empty(&self) -> bool {
@@ -347,6 +479,49 @@ impl MeasurementBuffer {
         self.points.clear();
     }
 
+    /// Moves all the measurements of `other` to the end of this buffer, leaving `other` empty.
+    ///
+    /// The memory of `other` is not freed, which allows it to be reused.
+    ///
+    /// If this buffer comes from the pool of a source and is too small to hold the measurements of `other`,
+    /// the measurements are moved to a new allocation and the original memory goes back to the pool right away,
+    /// so that the pool of the source does not get a buffer inflated by the measurements of the other sources.
+    pub fn merge(&mut self, other: &mut MeasurementBuffer) {
+        if self.recycler.is_some() && self.points.capacity() - self.points.len() < other.points.len() {
+            let mut points = Vec::with_capacity(self.points.len() + other.points.len());
+            points.append(&mut self.points);
+            let original = std::mem::replace(&mut self.points, points);
+            if let Some(recycler) = self.recycler.take() {
+                recycler.recycle(original);
+            }
+        }
+        self.points.append(&mut other.points);
+    }
+
+    /// Removes the `n` measurements that have been pushed first.
+    ///
+    /// If the buffer contains less than `n` measurements, it is cleared.
+    pub fn remove_oldest(&mut self, n: usize) {
+        let n = n.min(self.points.len());
+        self.points.drain(..n);
+    }
+
+    /// Returns the measurements of the buffer, which are stored contiguously.
+    pub fn as_slice(&self) -> &[MeasurementPoint] {
+        &self.points
+    }
+
+    /// Returns the measurements of the buffer, which can be modified in place.
+    pub fn as_mut_slice(&mut self) -> &mut [MeasurementPoint] {
+        &mut self.points
+    }
+
+    /// Keeps the measurements for which `f` returns `true`, and removes the others.
+    /// The order of the remaining measurements is preserved.
+    pub fn retain(&mut self, f: impl FnMut(&MeasurementPoint) -> bool) {
+        self.points.retain(f);
+    }
+
     /// Creates an iterator on the buffer's content.
     pub fn iter(&self) -> impl Iterator<Item = &MeasurementPoint> {
         self.points.iter()
@@ -372,6 +547,24 @@ impl<'a> IntoIterator for &'a MeasurementBuffer {
     }
 }
 
+impl Clone for MeasurementBuffer {
+    fn clone(&self) -> Self {
+        // the clone is not attached to the pool: its memory has not been taken from it
+        MeasurementBuffer {
+            points: self.points.clone(),
+            recycler: None,
+        }
+    }
+}
+
+impl Drop for MeasurementBuffer {
+    fn drop(&mut self) {
+        if let Some(recycler) = self.recycler.take() {
+            recycler.recycle(std::mem::take(&mut self.points));
+        }
+    }
+}
+
 impl std::fmt::Debug for MeasurementBuffer {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
         f.debug_struct("MeasurementBuffer")
@@ -382,7 +575,10 @@ impl std::fmt::Debug for MeasurementBuffer {
 
 impl From<Vec<MeasurementPoint>> for MeasurementBuffer {
     fn from(value: Vec<MeasurementPoint>) -> Self {
-        MeasurementBuffer { points: value }
+        MeasurementBuffer {
+            points: value,
+            recycler: None,
+        }
     }
 }
 
@@ -396,4 +592,46 @@ impl<'a> MeasurementAccumulator<'a> {
     pub fn push(&mut self, point: MeasurementPoint) {
         self.0.push(point)
     }
+
+    /// Reserves capacity for at least `additional` more measurements.
+    pub fn reserve(&mut self, additional: usize) {
+        self.0.reserve(additional)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::{
+        metrics::RawMetricId,
+        resources::{Resource, ResourceConsumer},
+    };
+
+    use super::{AttributeKey, AttributeValue, MeasurementPoint, Timestamp, WrappedMeasurementValue};
+
+    #[test]
+    fn attributes_sorted_by_key() {
+        let first = AttributeKey::new("test_attr_first");
+        let second = AttributeKey::new(String::from("test_attr_second"));
+        assert_eq!(Some(first), AttributeKey::lookup("test_attr_first"));
+        assert_eq!(first, AttributeKey::from("test_attr_first"));
+        assert_eq!("test_attr_second", second.name());
+        assert_eq!(None, AttributeKey::lookup("test_attr_unknown"));
+
+        let point = MeasurementPoint::new_untyped(
+            Timestamp::now(),
+            RawMetricId(0),
+            Resource::LocalMachine,
+            ResourceConsumer::LocalMachine,
+            WrappedMeasurementValue::U64(0),
+        )
+        .with_attr(second, 2u64)
+        .with_attr("test_attr_first", "a")
+        .with_attr(second, 3u64);
+
+        // the attributes are sorted, and the duplicated key has been replaced
+        let keys: Vec<_> = point.attributes_keys().collect();
+        assert_eq!(vec!["test_attr_first", "test_attr_second"], keys);
+        assert!(matches!(point.attribute(second), Some(AttributeValue::U64(3))));
+        assert!(matches!(point.attribute(first), Some(AttributeValue::Str("a"))));
+    }
 }
@@ -43,6 +43,8 @@ use core::fmt;
 use std::collections::HashMap;
 use std::error::Error;
 use std::marker::PhantomData;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, RwLock};
 
 use crate::pipeline::OutputContext;
 
@@ -82,12 +84,26 @@ pub trait MetricId {
 /// A registry of metrics.
 ///
 /// New metrics are created by the plugins during their initialization.
+///
+/// The ids are allocated sequentially, therefore the metrics are stored in a dense vector,
+/// indexed by id: finding a metric by its id is a simple array access.
 #[derive(Clone)]
 pub struct MetricRegistry {
-    pub(crate) metrics_by_id: HashMap<RawMetricId, Metric>,
+    pub(crate) metrics_by_id: Vec<Metric>,
     pub(crate) metrics_by_name: HashMap<String, RawMetricId>,
 }
 
+/// A [`MetricRegistry`] shared by the elements of a running pipeline.
+///
+/// Readers get an immutable snapshot of the registry, which they can keep as long as they want.
+/// Registering new metrics (late registration) builds a new snapshot and publishes it atomically:
+/// a reader sees all the new metrics or none of them. The readers can check [`version`](Self::version)
+/// to know when they need to get a new snapshot.
+pub(crate) struct SharedMetricRegistry {
+    current: RwLock<Arc<MetricRegistry>>,
+    version: AtomicU64,
+}
+
 /// A metric id without a generic type information.
 ///
 /// In general, it is preferred to use [`TypedMetricId`] instead.
@@ -168,19 +184,24 @@ impl MetricRegistry {
     /// Creates a new registry, but does not make it "global" yet.
     pub(crate) fn new() -> MetricRegistry {
         MetricRegistry {
-            metrics_by_id: HashMap::new(),
+            metrics_by_id: Vec::new(),
             metrics_by_name: HashMap::new(),
         }
     }
 
     /// Finds the metric that has the given id.
     pub fn with_id<M: MetricId>(&self, id: &M) -> Option<&Metric> {
-        self.metrics_by_id.get(&id.untyped_id())
+        self.metrics_by_id.get(id.untyped_id().0)
     }
 
     /// Finds the metric that has the given name.
     pub fn with_name(&self, name: &str) -> Option<&Metric> {
-        self.metrics_by_name.get(name).and_then(|id| self.metrics_by_id.get(id))
+        self.metrics_by_name.get(name).and_then(|id| self.metrics_by_id.get(id.0))
+    }
+
+    /// Finds the id of the metric that has the given name.
+    pub fn id_with_name(&self, name: &str) -> Option<RawMetricId> {
+        self.metrics_by_name.get(name).copied()
     }
 
     /// The number of metrics in the registry.
@@ -192,11 +213,11 @@ impl MetricRegistry {
         self.metrics_by_id.is_empty()
     }
 
-    /// An iterator on the registered metrics.
+    /// An iterator on the registered metrics, in the order of their ids.
     pub fn iter(&self) -> MetricIter<'_> {
         // return new iterator
         MetricIter {
-            entries: self.metrics_by_id.iter(),
+            entries: self.metrics_by_id.iter().enumerate(),
         }
     }
 
@@ -210,9 +231,9 @@ impl MetricRegistry {
                 "A metric with this name already exist: {name}"
             )));
         }
-        let id = RawMetricId(self.metrics_by_name.len());
+        let id = RawMetricId(self.metrics_by_id.len());
         self.metrics_by_name.insert(name.clone(), id);
-        self.metrics_by_id.insert(id, m);
+        self.metrics_by_id.push(m);
         Ok(id)
     }
 
@@ -247,27 +268,58 @@ impl MetricRegistry {
                 metric.name = self.deduplicated_name(&metric.name, dedup_suffix);
                 let id = RawMetricId(base_id + i);
                 self.metrics_by_name.insert(metric.name.clone(), id);
-                self.metrics_by_id.insert(id, metric);
+                self.metrics_by_id.push(metric);
                 id
             })
             .collect()
     }
 }
 
+impl SharedMetricRegistry {
+    pub fn new(registry: MetricRegistry) -> Self {
+        Self {
+            current: RwLock::new(Arc::new(registry)),
+            version: AtomicU64::new(0),
+        }
+    }
+
+    /// Returns the current state of the registry.
+    pub fn snapshot(&self) -> Arc<MetricRegistry> {
+        self.current.read().unwrap().clone()
+    }
+
+    /// Returns the version of the registry, which changes every time new metrics are registered.
+    pub fn version(&self) -> u64 {
+        self.version.load(Ordering::Acquire)
+    }
+
+    /// Registers new metrics, renaming them if needed (see [`MetricRegistry::extend_infallible`]),
+    /// and publishes the new state of the registry.
+    pub fn extend_infallible(&self, metrics: Vec<Metric>, dedup_suffix: &str) -> Vec<RawMetricId> {
+        // Holding the write lock prevents concurrent registrations from overwriting each other.
+        let mut current = self.current.write().unwrap();
+        let mut registry = MetricRegistry::clone(&current);
+        let ids = registry.extend_infallible(metrics, dedup_suffix);
+        *current = Arc::new(registry);
+        self.version.fetch_add(1, Ordering::Release);
+        ids
+    }
+}
+
 /// An iterator over the metrics of a [`MetricRegistry`].
 pub struct MetricIter<'a> {
-    entries: std::collections::hash_map::Iter<'a, RawMetricId, Metric>,
+    entries: std::iter::Enumerate<std::slice::Iter<'a, Metric>>,
 }
 impl<'a> Iterator for MetricIter<'a> {
-    type Item = (&'a RawMetricId, &'a Metric);
+    type Item = (RawMetricId, &'a Metric);
 
     fn next(&mut self) -> Option<Self::Item> {
-        self.entries.next()
+        self.entries.next().map(|(i, m)| (RawMetricId(i), m))
     }
 }
 
 impl<'a> IntoIterator for &'a MetricRegistry {
-    type Item = (&'a RawMetricId, &'a Metric);
+    type Item = (RawMetricId, &'a Metric);
 
     type IntoIter = MetricIter<'a>;
 
@@ -305,7 +357,7 @@ impl fmt::Display for MetricCreationError {
 mod tests {
     use crate::{measurement::WrappedMeasurementType, metrics::Metric, units::Unit};
 
-    use super::MetricRegistry;
+    use super::{MetricRegistry, SharedMetricRegistry};
 
     #[test]
     fn no_duplicate_metrics() {
@@ -366,4 +418,33 @@ mod tests {
         names.sort();
         assert_eq!(vec!["metric", "metric2"], names);
     }
+
+    #[test]
+    fn shared_registry_snapshots() {
+        let metric = |name: &str| Metric {
+            name: name.to_owned(),
+            description: "".to_owned(),
+            value_type: WrappedMeasurementType::U64,
+            unit: Unit::Watt.into(),
+        };
+        let mut registry = MetricRegistry::new();
+        registry.register(metric("a")).unwrap();
+        let shared = SharedMetricRegistry::new(registry);
+
+        let before = shared.snapshot();
+        let version = shared.version();
+        let ids = shared.extend_infallible(vec![metric("a"), metric("b")], "late");
+        assert_ne!(version, shared.version());
+
+        // the old snapshot is not modified
+        assert_eq!(1, before.len());
+        assert!(before.with_id(&ids[0]).is_none());
+
+        // the new snapshot contains all the new metrics, with consecutive ids
+        let after = shared.snapshot();
+        assert_eq!(3, after.len());
+        assert_eq!(vec![1, 2], ids.iter().map(|id| id.as_u64()).collect::<Vec<_>>());
+        assert_eq!("a_late", after.with_id(&ids[0]).unwrap().name);
+        assert_eq!("b", after.with_id(&ids[1]).unwrap().name);
+    }
 }
@@ -0,0 +1,134 @@
+//! Batching of the measurements in the transform step.
+//!
+//! Each flush of a source produces a [`MeasurementBuffer`]. With many small sources, most of these
+//! buffers only contain a few points, and running the transforms and sending the buffer to the outputs
+//! for each of them is expensive. Instead, the transform step drains the buffers that are waiting in its
+//! queue and merges them into a single batch, which goes through the rest of the pipeline at once.
+
+use std::time::Duration;
+
+use tokio::sync::mpsc;
+use tokio::time::Instant;
+
+use crate::measurement::MeasurementBuffer;
+
+/// Default maximum number of points in a batch.
+pub const DEFAULT_MAX_BATCH_POINTS: usize = 8192;
+
+/// Configures how the transform step merges the measurements of the sources.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct BatchConfig {
+    /// Stop merging buffers when the batch contains at least this number of points.
+    ///
+    /// A batch can exceed this limit by the size of the last buffer that has been merged into it.
+    /// Set it to zero to disable batching.
+    pub max_points: usize,
+
+    /// Maximum time to wait for more measurements before processing an incomplete batch.
+    ///
+    /// With the default value (zero), the transform step only merges the buffers that are already waiting,
+    /// which adds no latency.
+    pub max_delay: Duration,
+}
+
+impl Default for BatchConfig {
+    fn default() -> Self {
+        Self {
+            max_points: DEFAULT_MAX_BATCH_POINTS,
+            max_delay: Duration::ZERO,
+        }
+    }
+}
+
+impl BatchConfig {
+    /// Merges the buffers received from `rx` into `batch`, until the batch is full
+    /// or until no more buffers can be received in time.
+    pub(crate) async fn fill(&self, batch: &mut MeasurementBuffer, rx: &mut mpsc::Receiver<MeasurementBuffer>) {
+        // Don't wait longer than max_delay after the first buffer.
+        let deadline = Instant::now() + self.max_delay;
+        while batch.len() < self.max_points {
+            let next = match rx.try_recv() {
+                Ok(buf) => Some(buf),
+                Err(mpsc::error::TryRecvError::Empty) if !self.max_delay.is_zero() => {
+                    tokio::time::timeout_at(deadline, rx.recv()).await.ok().flatten()
+                }
+                Err(_) => None,
+            };
+            match next {
+                Some(mut buf) => {
+                    // The memory of `buf` goes back to its source when it is dropped,
+                    // and so does the original memory of `batch` if the merge has to grow it.
+                    batch.merge(&mut buf);
+                }
+                None => break,
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::time::Duration;
+
+    use tokio::sync::mpsc;
+
+    use crate::{
+        measurement::{MeasurementBuffer, MeasurementPoint, Timestamp, WrappedMeasurementValue},
+        metrics::RawMetricId,
+        resources::{ResourceConsumer, ResourceId},
+    };
+
+    use super::BatchConfig;
+
+    fn buffer(n: usize) -> MeasurementBuffer {
+        let mut buf = MeasurementBuffer::with_capacity(n);
+        for i in 0..n {
+            buf.push(MeasurementPoint::new_untyped(
+                Timestamp::now(),
+                RawMetricId(0),
+                ResourceId::LOCAL_MACHINE,
+                ResourceConsumer::LocalMachine,
+                WrappedMeasurementValue::U64(i as u64),
+            ));
+        }
+        buf
+    }
+
+    #[tokio::test]
+    async fn merge_queued_buffers() {
+        let (tx, mut rx) = mpsc::channel(16);
+        for _ in 0..5 {
+            tx.send(buffer(2)).await.unwrap();
+        }
+        let config = BatchConfig {
+            max_points: 7,
+            max_delay: Duration::ZERO,
+        };
+
+        let mut batch = rx.recv().await.unwrap();
+        config.fill(&mut batch, &mut rx).await;
+        assert_eq!(8, batch.len(), "the batch should stop growing once it reaches the limit");
+
+        let mut batch = rx.recv().await.unwrap();
+        config.fill(&mut batch, &mut rx).await;
+        assert_eq!(2, batch.len(), "only the queued buffers should be merged");
+    }
+
+    #[tokio::test]
+    async fn wait_for_more() {
+        let (tx, mut rx) = mpsc::channel(16);
+        let config = BatchConfig {
+            max_points: 100,
+            max_delay: Duration::from_millis(200),
+        };
+        tx.send(buffer(1)).await.unwrap();
+        tokio::spawn(async move {
+            tokio::time::sleep(Duration::from_millis(20)).await;
+            tx.send(buffer(3)).await.unwrap();
+        });
+
+        let mut batch = rx.recv().await.unwrap();
+        config.fill(&mut batch, &mut rx).await;
+        assert_eq!(4, batch.len());
+    }
+}
@@ -1,25 +1,32 @@
 use core::fmt;
-use std::collections::HashMap;
+use std::collections::{BTreeMap, HashSet};
 use std::future::Future;
 use std::io::{self, ErrorKind};
 use std::path::PathBuf;
 use std::pin::Pin;
 use std::sync::atomic::{AtomicUsize, Ordering};
-use std::sync::Mutex;
-
-use anyhow::Context;
+use std::sync::{Arc, Mutex};
 
 use tokio::runtime::Runtime;
-use tokio::sync::{broadcast, mpsc};
+use tokio::sync::mpsc;
 use tokio_util::sync::CancellationToken;
 
-use crate::metrics::{Metric, MetricRegistry, RawMetricId};
+use crate::metrics::{Metric, MetricRegistry, RawMetricId, SharedMetricRegistry};
+use crate::resources::ResourceRegistry;
 use crate::{
     measurement::MeasurementBuffer,
-    pipeline::{Output, Source, Transform},
+    pipeline::{AsyncOutput, Output, Source, Transform},
 };
 
-use super::runtime::{self, IdlePipeline, OutputMsg};
+use super::batch::BatchConfig;
+use super::telemetry::{
+    ElementStats, PipelineStats, TelemetryConfig, TelemetryMetrics, TelemetrySource, TELEMETRY_SOURCE_NAME,
+};
+use super::worker::{OutputWorkerConfig, QueueDepth};
+use super::overload::{OverloadPolicy, OverloadState};
+use super::placement::{self, EffectivePlacement, PlacementConfig};
+use super::pool::BufferPool;
+use super::runtime::IdlePipeline;
 use super::trigger::{TriggerConstraints, TriggerSpec};
 
 /// A builder of measurement pipeline.
@@ -31,12 +38,18 @@ pub struct PipelineBuilder {
     pub(crate) autonomous_sources: Vec<AutonomousSourceBuilder>,
 
     pub(crate) source_constraints: TriggerConstraints,
+    pub(crate) overload_policy: OverloadPolicy,
+    pub(crate) batching: BatchConfig,
+    pub(crate) output_workers: OutputWorkerConfig,
+    pub(crate) telemetry: TelemetryConfig,
 
     pub(crate) metrics: MetricRegistry,
     pub(crate) allow_no_metrics: bool,
+    pub(crate) resources: Arc<ResourceRegistry>,
 
     pub(crate) normal_worker_threads: Option<usize>,
     pub(crate) priority_worker_threads: Option<usize>,
+    pub(crate) placement: PlacementConfig,
 }
 
 pub type SourceBuildFn = dyn FnOnce(&PendingPipelineContext) -> Box<dyn Source>;
@@ -68,34 +81,52 @@ pub struct TransformBuilder {
 pub struct OutputBuilder {
     pub name: String,
     pub plugin: String,
-    pub build: Box<dyn FnOnce(&PendingPipelineContext) -> anyhow::Result<Box<dyn Output>>>,
+    pub build: Box<dyn FnOnce(&PendingPipelineContext) -> anyhow::Result<OutputKind>>,
+}
+
+/// An output, blocking or async.
+pub enum OutputKind {
+    /// Runs on a dedicated thread.
+    Blocking(Box<dyn Output>),
+    /// Runs on the async runtime of the pipeline, with several writes in flight.
+    Async(Box<dyn AsyncOutput>),
 }
 
 /// Information about a pipeline that is being built.
 pub struct PendingPipelineContext<'a> {
-    to_output: &'a broadcast::Sender<runtime::OutputMsg>,
+    metrics: &'a Arc<SharedMetricRegistry>,
+    resources: &'a Arc<ResourceRegistry>,
     rt_handle: &'a tokio::runtime::Handle,
 }
 
 impl<'a> PendingPipelineContext<'a> {
     pub fn late_registration_handle(&self) -> LateRegistrationHandle {
-        let (reply_tx, reply_rx) = mpsc::channel::<Vec<RawMetricId>>(256);
         LateRegistrationHandle {
-            to_outputs: self.to_output.clone(),
-            reply_tx,
-            reply_rx,
+            metrics: self.metrics.clone(),
         }
     }
 
+    /// Returns the registry of the metrics, shared by the whole pipeline.
+    pub(crate) fn metrics(&self) -> &Arc<SharedMetricRegistry> {
+        self.metrics
+    }
+
     pub fn async_runtime_handle(&self) -> &tokio::runtime::Handle {
         self.rt_handle
     }
+
+    /// Returns the registry of the resources and consumers of the pipeline.
+    pub fn resources(&self) -> &Arc<ResourceRegistry> {
+        self.resources
+    }
 }
 
+/// Allows to register new metrics while the pipeline is running.
+///
+/// The metrics are registered once, in the registry shared by the whole pipeline.
+/// The outputs see the new metrics before they receive the first measurements that use them.
 pub struct LateRegistrationHandle {
-    to_outputs: broadcast::Sender<runtime::OutputMsg>,
-    reply_tx: mpsc::Sender<Vec<RawMetricId>>,
-    reply_rx: mpsc::Receiver<Vec<RawMetricId>>,
+    metrics: Arc<SharedMetricRegistry>,
 }
 
 impl LateRegistrationHandle {
@@ -104,19 +135,7 @@ impl LateRegistrationHandle {
         metrics: Vec<Metric>,
         source_name: String,
     ) -> anyhow::Result<Vec<RawMetricId>> {
-        self.to_outputs
-            .send(runtime::OutputMsg::RegisterMetrics {
-                metrics,
-                source_name,
-                reply_to: self.reply_tx.clone(),
-            })
-            .with_context(|| "error on send(OutputMsg::RegisterMetrics)")?;
-        match self.reply_rx.recv().await {
-            Some(metric_ids) => Ok(metric_ids),
-            None => {
-                todo!("reply channel closed")
-            }
-        }
+        Ok(self.metrics.extend_infallible(metrics, &source_name))
     }
 }
 
@@ -146,15 +165,21 @@ pub(super) struct ConfiguredTransform {
     pub name: String,
     /// Name of the plugin that registered the source.
     pub plugin_name: String,
+    /// Statistics of the transform, for the self-telemetry.
+    pub stats: Arc<ElementStats>,
 }
 /// An output that is ready to run.
 pub(super) struct ConfiguredOutput {
     /// The output.
-    pub output: Box<dyn Output>,
+    pub output: OutputKind,
     /// Name of the output.
     pub name: String,
     /// Name of the plugin that registered the source.
     pub plugin_name: String,
+    /// Number of measurement buffers waiting to be written by the output (or being written, for async outputs).
+    pub queue_depth: QueueDepth,
+    /// Statistics of the output, for the self-telemetry.
+    pub stats: Arc<ElementStats>,
 }
 
 #[derive(Debug)]
@@ -220,9 +245,15 @@ impl PipelineBuilder {
             autonomous_sources: Vec::new(),
             metrics: MetricRegistry::new(),
             allow_no_metrics: false,
+            resources: Arc::new(ResourceRegistry::new()),
             normal_worker_threads: None,
             priority_worker_threads: None,
+            placement: PlacementConfig::default(),
             source_constraints: TriggerConstraints::default(),
+            overload_policy: OverloadPolicy::default(),
+            batching: BatchConfig::default(),
+            output_workers: OutputWorkerConfig::default(),
+            telemetry: TelemetryConfig::default(),
         }
     }
 
@@ -246,7 +277,7 @@ impl PipelineBuilder {
         self.metrics.iter()
     }
 
-    pub fn build(self) -> Result<IdlePipeline, PipelineBuildError> {
+    pub fn build(mut self) -> Result<IdlePipeline, PipelineBuildError> {
         // Check some conditions.
         if self.metrics.is_empty() && !self.allow_no_metrics {
             log::warn!("No metrics have been registered, have you loaded the right plugins?")
@@ -259,37 +290,53 @@ impl PipelineBuilder {
             return Err(PipelineBuildError::Invalid(InvalidReason::NoSource));
         }
 
-        // Create the normal runtime, the priority one is initialized on demand.
-        let rt_normal: Runtime = self.build_normal_runtime()?;
-        let rt_priority: Option<Runtime> = self.build_priority_runtime()?;
+        // Find the CPUs that the process is allowed to use, to report the effective placement of the threads.
+        let allowed_cpus = super::threading::current_thread_affinity()
+            .map_err(|e| log::debug!("Unable to get the CPU affinity of the process: {e}"))
+            .ok();
+        let normal_placement = EffectivePlacement::resolve(&self.placement.normal_cpus, allowed_cpus.as_deref());
+        let priority_placement = EffectivePlacement::resolve(&self.placement.priority_cpus, allowed_cpus.as_deref());
+
+        // Create the normal runtime, the priority one and the ones of the CPU packages are initialized on demand.
+        let rt_normal: Runtime = self.build_normal_runtime(&normal_placement)?;
+        let rt_priority: Option<Runtime> = self.build_priority_runtime(&priority_placement)?;
+        let rt_packages: BTreeMap<u32, Runtime> = self.build_package_runtimes(allowed_cpus.as_deref())?;
 
         // Channel: source -> transforms.
         let (in_tx, in_rx) = mpsc::channel::<MeasurementBuffer>(256);
 
-        // Broadcast queue, used for two things:
-        // - transforms -> outputs
-        // - late metric registration -> outputs
-        let out_tx = broadcast::Sender::<OutputMsg>::new(256);
+        // Register the metrics of the self-telemetry, before the registry is shared.
+        let telemetry_metrics = match self.telemetry.enabled {
+            true => Some(TelemetryMetrics::register(&mut self.metrics)),
+            false => None,
+        };
+
+        // Collect the statistics of the elements, for the self-telemetry.
+        let stats = Arc::new(PipelineStats::new());
+
+        // Share the metrics with all the elements, it's needed for late registration.
+        let metrics = Arc::new(SharedMetricRegistry::new(self.metrics));
 
         // Create the pipeline elements.
-        let sources: Vec<ConfiguredSource> = self
+        let mut sources: Vec<ConfiguredSource> = self
             .sources
             .into_iter()
             .map(|builder| {
                 let name = builder.name;
                 let mut trigger = builder.trigger;
                 let pending = PendingPipelineContext {
-                    to_output: &out_tx,
-                    rt_handle: if trigger.realtime_priority {
-                        rt_priority
+                    metrics: &metrics,
+                    resources: &self.resources,
+                    rt_handle: match trigger.package.and_then(|p| rt_packages.get(&p)) {
+                        Some(rt_package) => rt_package.handle(),
+                        None if trigger.realtime_priority => rt_priority
                             .as_ref()
                             .unwrap_or_else(|| {
                                 log::warn!("Could not provide a \"realtime priority\" runtime for source {name}, using the normal runtime (see previous warnings).");
                                 &rt_normal
                             })
-                            .handle()
-                    } else {
-                        rt_normal.handle()
+                            .handle(),
+                        None => rt_normal.handle(),
                     },
                 };
                 let source = (builder.build)(&pending);
@@ -307,7 +354,8 @@ impl PipelineBuilder {
             .collect();
 
         let pending = PendingPipelineContext {
-            to_output: &out_tx,
+            metrics: &metrics,
+            resources: &self.resources,
             rt_handle: rt_normal.handle(),
         };
         let transforms: Vec<ConfiguredTransform> = self
@@ -317,6 +365,7 @@ impl PipelineBuilder {
                 let transform = (builder.build)(&pending);
                 ConfiguredTransform {
                     transform,
+                    stats: stats.transform(&builder.name),
                     name: builder.name,
                     plugin_name: builder.plugin,
                 }
@@ -329,15 +378,28 @@ impl PipelineBuilder {
                 let output = (builder.build)(&pending).map_err(|err| {
                     PipelineBuildError::ElementBuild(err, ElementType::Output, builder.plugin.clone())
                 })?;
+                let queue_depth = QueueDepth::default();
                 Ok(ConfiguredOutput {
                     output,
+                    stats: stats.output(&builder.name, queue_depth.clone()),
                     name: builder.name,
                     plugin_name: builder.plugin,
+                    queue_depth,
                 })
             })
             .collect();
         let outputs = outputs?;
 
+        // Create the self-telemetry source, if enabled.
+        if let Some(metrics) = telemetry_metrics {
+            sources.push(ConfiguredSource {
+                source: Box::new(TelemetrySource::new(metrics, stats.clone(), in_tx.downgrade())),
+                name: String::from(TELEMETRY_SOURCE_NAME),
+                plugin_name: String::from("alumet"),
+                trigger_provider: TriggerSpec::at_interval(self.telemetry.poll_interval),
+            });
+        }
+
         // Create the autonomous sources
         let autonomous_shutdown_token = CancellationToken::new();
         let autonomous_sources: Vec<_> = self
@@ -359,33 +421,47 @@ impl PipelineBuilder {
             transforms,
             outputs,
             autonomous_sources,
+            namegen: self.namegen,
             autonomous_shutdown_token,
-            metrics: self.metrics,
+            metrics,
+            resources: self.resources,
+            overload: Arc::new(OverloadState::new(self.overload_policy)),
+            batching: self.batching,
+            output_workers: self.output_workers,
+            buffer_pool: Arc::new(BufferPool::new()),
             from_sources: (in_tx, in_rx),
-            to_outputs: out_tx,
+            stats,
             rt_normal,
             rt_priority,
+            rt_packages,
         })
     }
 
-    fn build_normal_runtime(&self) -> io::Result<Runtime> {
+    fn build_normal_runtime(&self, placement: &EffectivePlacement) -> io::Result<Runtime> {
         let mut builder = tokio::runtime::Builder::new_multi_thread();
-        builder.enable_all().thread_name_fn(|| {
-            static ATOMIC_ID: AtomicUsize = AtomicUsize::new(0);
-            let id = ATOMIC_ID.fetch_add(1, Ordering::SeqCst);
-            format!("normal-worker-{id}")
-        });
+        let cpus = placement.cpus.clone();
+        builder
+            .enable_all()
+            .thread_name_fn(|| {
+                static ATOMIC_ID: AtomicUsize = AtomicUsize::new(0);
+                let id = ATOMIC_ID.fetch_add(1, Ordering::SeqCst);
+                format!("normal-worker-{id}")
+            })
+            .on_thread_start(move || placement::pin_worker_thread(&cpus));
         if let Some(n) = self.normal_worker_threads {
             builder.worker_threads(n);
         }
+        let n_threads = self
+            .normal_worker_threads
+            .unwrap_or_else(|| std::thread::available_parallelism().map_or(1, |n| n.get()));
+        log::info!(
+            "The normal runtime has {n_threads} worker threads, {}.",
+            placement.description
+        );
         builder.build()
     }
 
-    fn build_priority_runtime(&self) -> io::Result<Option<Runtime>> {
-        fn resolve_application_path() -> io::Result<PathBuf> {
-            std::env::current_exe()?.canonicalize()
-        }
-
+    fn build_priority_runtime(&self, placement: &EffectivePlacement) -> io::Result<Option<Runtime>> {
         // Count how many sources require a "realtime priority" runtime
         let n_rt_sources = self
             .sources
@@ -394,48 +470,14 @@ impl PipelineBuilder {
             .count();
 
         if n_rt_sources > 0 {
-            // If `on_thread_start` fails, `builder.build()` will still return a runtime,
-            // but it will be unusable. To avoid that, we store the error here and don't return Some(runtime).
-            static THREAD_START_FAILURE: Mutex<Option<io::Error>> = Mutex::new(None);
-
+            let cpus = placement.cpus.clone();
             let mut builder = tokio::runtime::Builder::new_multi_thread();
             builder
                 .enable_all()
                 .worker_threads(n_rt_sources)
-                .on_thread_start(|| {
-                    if let Err(e) = super::threading::increase_thread_priority() {
-                        let mut failure = THREAD_START_FAILURE.lock().unwrap();
-                        if failure.is_none() {
-                            let hint =
-                                if e.kind() == ErrorKind::PermissionDenied {
-                                    let app_path = resolve_application_path()
-                                        .ok()
-                                        .and_then(|p| p.to_str().map(|s| s.to_owned()))
-                                        .unwrap_or(String::from("path/to/agent"));
-
-                                    indoc::formatdoc! {"
-                                        This is probably caused by insufficient privileges.
-                                        
-                                        To fix this, you have two possibilities:
-                                        1. Grant the SYS_NICE capability to the agent binary.
-                                             sudo setcap cap_sys_nice+ep \"{app_path}\"
-                                        
-                                           Note: to grant multiple capabilities to the binary, you must put all the capabilities in the same command.
-                                             sudo setcap \"cap_sys_nice+ep cap_perfmon=ep\" \"{app_path}\"
-                                        
-                                        2. Run the agent as root (not recommended).
-                                    "}
-                                } else {
-                                    String::from("This does not seem to be caused by insufficient privileges. Please report an issue on the GitHub repository.")
-                                };
-                            log::error!("I tried to increase the scheduling priority of the thread in order to improve the accuracy of the measurement timing, but I failed: {e}\n{hint}");
-                            log::warn!("Alumet will still work, but the time between two measurements may differ from the configuration.");
-                            *failure = Some(e);
-                        }
-                        let current_thread = std::thread::current();
-                        let thread_name = current_thread.name().unwrap_or("<unnamed>");
-                        log::warn!("Unable to increase the scheduling priority of thread {thread_name}.");
-                    };
+                .on_thread_start(move || {
+                    increase_worker_priority();
+                    placement::pin_worker_thread(&cpus);
                 })
                 .thread_name_fn(|| {
                     static ATOMIC_ID: AtomicUsize = AtomicUsize::new(0);
@@ -447,54 +489,189 @@ impl PipelineBuilder {
 
             // Build the runtime.
             let runtime = builder.build()?;
-
-            // Try to spawn a task to ensure that the worker threads have started properly.
-            // Otherwise, builder.build() may return and the threads may fail after the failure check.
-            runtime.block_on(async {
-                let _ = runtime
-                    .spawn(tokio::time::sleep(tokio::time::Duration::from_millis(1)))
-                    .await;
-            });
+            wait_for_workers(&runtime);
 
             // If the worker threads failed to start, don't use this runtime.
             if THREAD_START_FAILURE.lock().unwrap().take().is_some() {
                 return Ok(None);
             }
+            log::info!(
+                "The \"realtime priority\" runtime has {n_threads} worker threads, {}.",
+                placement.description
+            );
             Ok(Some(runtime))
         } else {
             Ok(None)
         }
     }
+
+    /// Builds one single-threaded runtime for each CPU package that is measured by a source,
+    /// if the sources must run on the package they measure.
+    fn build_package_runtimes(&self, allowed_cpus: Option<&[usize]>) -> io::Result<BTreeMap<u32, Runtime>> {
+        let mut runtimes = BTreeMap::new();
+        if !self.placement.package_local_sources {
+            return Ok(runtimes);
+        }
+
+        // Find the packages to measure, and whether they need a high priority.
+        let mut measured_packages: BTreeMap<u32, bool> = BTreeMap::new();
+        for builder in &self.sources {
+            if let Some(package) = builder.trigger.package {
+                *measured_packages.entry(package).or_default() |= builder.trigger.realtime_priority;
+            }
+        }
+        if measured_packages.is_empty() {
+            log::info!(
+                "No source measures a specific CPU package, the sources run on the normal and priority runtimes."
+            );
+            return Ok(runtimes);
+        }
+        let topology = match placement::package_cpus() {
+            Ok(topology) => topology,
+            Err(e) => {
+                log::warn!(
+                    "Unable to read the CPU topology, the sources will not run on the package that they measure: {e:#}"
+                );
+                return Ok(runtimes);
+            }
+        };
+
+        for (package, realtime_priority) in measured_packages {
+            let Some(package_cpus) = topology.get(&package) else {
+                log::warn!("Some sources measure the CPU package {package}, but this package does not exist (or has no online CPU).");
+                continue;
+            };
+            let placement = EffectivePlacement::resolve(package_cpus, allowed_cpus);
+            if placement.cpus.is_empty() {
+                log::warn!(
+                    "The sources of CPU package {package} cannot run on it: {}.",
+                    placement.description
+                );
+                continue;
+            }
+
+            let cpus = placement.cpus.clone();
+            let mut builder = tokio::runtime::Builder::new_multi_thread();
+            builder
+                .enable_all()
+                .worker_threads(1)
+                .thread_name(format!("package{package}-worker"))
+                .on_thread_start(move || {
+                    if realtime_priority {
+                        increase_worker_priority();
+                    }
+                    placement::pin_worker_thread(&cpus);
+                });
+            let runtime = builder.build()?;
+            if realtime_priority {
+                // Unlike the priority runtime, keep the runtime even if its priority cannot be increased:
+                // the error has already been reported, and the placement still applies.
+                wait_for_workers(&runtime);
+                let _ = THREAD_START_FAILURE.lock().unwrap().take();
+            }
+            log::info!(
+                "The runtime of CPU package {package} has 1 worker thread, {}.",
+                placement.description
+            );
+            runtimes.insert(package, runtime);
+        }
+        Ok(runtimes)
+    }
+}
+
+/// Error that occured in `on_thread_start`, while increasing the priority of a worker thread.
+///
+/// If `on_thread_start` fails, `builder.build()` will still return a runtime,
+/// but it will be unusable. To avoid that, we store the error here and check it after building the runtime.
+static THREAD_START_FAILURE: Mutex<Option<io::Error>> = Mutex::new(None);
+
+/// Increases the priority of the current worker thread, and stores the first failure in [`THREAD_START_FAILURE`].
+fn increase_worker_priority() {
+    fn resolve_application_path() -> io::Result<PathBuf> {
+        std::env::current_exe()?.canonicalize()
+    }
+
+    if let Err(e) = super::threading::increase_thread_priority() {
+        let mut failure = THREAD_START_FAILURE.lock().unwrap();
+        if failure.is_none() {
+            let hint = if e.kind() == ErrorKind::PermissionDenied {
+                let app_path = resolve_application_path()
+                    .ok()
+                    .and_then(|p| p.to_str().map(|s| s.to_owned()))
+                    .unwrap_or(String::from("path/to/agent"));
+
+                indoc::formatdoc! {"
+                        This is probably caused by insufficient privileges.
+                        
+                        To fix this, you have two possibilities:
+                        1. Grant the SYS_NICE capability to the agent binary.
+                             sudo setcap cap_sys_nice+ep \"{app_path}\"
+                        
+                           Note: to grant multiple capabilities to the binary, you must put all the capabilities in the same command.
+                             sudo setcap \"cap_sys_nice+ep cap_perfmon=ep\" \"{app_path}\"
+                        
+                        2. Run the agent as root (not recommended).
+                    "}
+            } else {
+                String::from("This does not seem to be caused by insufficient privileges. Please report an issue on the GitHub repository.")
+            };
+            log::error!("I tried to increase the scheduling priority of the thread in order to improve the accuracy of the measurement timing, but I failed: {e}\n{hint}");
+            log::warn!(
+                "Alumet will still work, but the time between two measurements may differ from the configuration."
+            );
+            *failure = Some(e);
+        }
+        let current_thread = std::thread::current();
+        let thread_name = current_thread.name().unwrap_or("<unnamed>");
+        log::warn!("Unable to increase the scheduling priority of thread {thread_name}.");
+    };
 }
 
-/// Generates names for the pipeline elements.
+/// Spawns a task to ensure that the worker threads of the runtime have started properly.
+///
+/// Otherwise, builder.build() may return and the threads may fail after the failure check.
+fn wait_for_workers(runtime: &Runtime) {
+    runtime.block_on(async {
+        let _ = runtime
+            .spawn(tokio::time::sleep(tokio::time::Duration::from_millis(1)))
+            .await;
+    });
+}
+
+/// Generates unique names for the pipeline elements.
+///
+/// The names of the sources that are removed at runtime are released, and can be given again.
 pub(crate) struct ElementNameGenerator {
-    existing_names: HashMap<String, usize>,
+    existing_names: HashSet<String>,
 }
 
 impl ElementNameGenerator {
     pub fn new() -> Self {
         Self {
-            existing_names: HashMap::new(),
+            existing_names: HashSet::new(),
         }
     }
 
-    pub fn deduplicate(&mut self, mut name: String, always_suffix: bool) -> String {
-        use std::fmt::Write;
-
-        match self.existing_names.get_mut(&name) {
-            Some(n) => {
-                *n += 1;
-                write!(name, "-{n}").unwrap();
-            }
-            None => {
-                self.existing_names.insert(name.clone(), 0);
-                if always_suffix {
-                    write!(name, "-0").unwrap();
-                }
-            }
+    /// Returns `name` with the first suffix `-n` that makes it unique, and reserves it.
+    ///
+    /// If `always_suffix` is false, `name` is returned as is when it is not taken.
+    pub fn deduplicate(&mut self, name: String, always_suffix: bool) -> String {
+        let mut n = 0;
+        let mut unique = match always_suffix {
+            true => format!("{name}-0"),
+            false => name.clone(),
+        };
+        while self.existing_names.contains(&unique) {
+            n += 1;
+            unique = format!("{name}-{n}");
         }
-        name
+        self.existing_names.insert(unique.clone());
+        unique
+    }
+
+    /// Releases a name given by [`deduplicate`](Self::deduplicate), so that it can be given again.
+    pub fn release(&mut self, name: &str) {
+        self.existing_names.remove(name);
     }
 }
 
@@ -503,3 +680,87 @@ impl Default for ElementNameGenerator {
         Self::new()
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use std::sync::{Arc, Mutex};
+    use std::time::Duration;
+
+    use crate::measurement::{MeasurementAccumulator, MeasurementBuffer, Timestamp};
+    use crate::pipeline::placement::{self, PlacementConfig};
+    use crate::pipeline::{trigger, Output, OutputContext, PollError, Source, WriteError};
+    use crate::plugin::AlumetStart;
+
+    use super::PipelineBuilder;
+
+    #[test]
+    #[cfg(target_os = "linux")]
+    fn sources_run_on_their_package() {
+        let Ok(topology) = placement::package_cpus() else {
+            return; // no sysfs, nothing to test
+        };
+        let (&package, package_cpus) = topology.iter().next().unwrap();
+
+        let threads = Arc::new(Mutex::new(Vec::new()));
+        let mut pipeline_builder = PipelineBuilder::new();
+        pipeline_builder.allow_no_metrics = true;
+        pipeline_builder.placement = PlacementConfig {
+            package_local_sources: true,
+            ..Default::default()
+        };
+        let mut alumet = AlumetStart::new(&mut pipeline_builder, String::from("test"));
+        let trigger = |package: Option<u32>| {
+            let builder = trigger::builder::time_interval(Duration::from_millis(5));
+            match package {
+                Some(p) => builder.on_package(p).build().unwrap(),
+                None => builder.build().unwrap(),
+            }
+        };
+        alumet.add_named_source("local", Box::new(ThreadSource(threads.clone())), trigger(Some(package)));
+        alumet.add_named_source("elsewhere", Box::new(ThreadSource(threads.clone())), trigger(None));
+        alumet.add_output(Box::new(NullOutput));
+
+        let mut pipeline = pipeline_builder.build().unwrap().start();
+        std::thread::sleep(Duration::from_millis(50));
+        pipeline.control_handle().shutdown();
+        pipeline.wait_for_shutdown().unwrap();
+
+        let threads = threads.lock().unwrap();
+        let local_thread = format!("package{package}-worker");
+        let (local, elsewhere): (Vec<_>, Vec<_>) = threads.iter().partition(|(name, _)| name == &local_thread);
+        assert!(
+            !local.is_empty(),
+            "the source of package {package} never ran on its thread: {threads:?}"
+        );
+        assert!(
+            !elsewhere.is_empty(),
+            "the other source should run on the normal runtime: {threads:?}"
+        );
+        for (_, cpus) in local {
+            assert!(
+                cpus.iter().all(|cpu| package_cpus.contains(cpu)),
+                "{cpus:?} not in {package_cpus:?}"
+            );
+        }
+    }
+
+    /// Records the name and affinity of the threads that poll it.
+    struct ThreadSource(Arc<Mutex<Vec<(String, Vec<usize>)>>>);
+
+    impl Source for ThreadSource {
+        fn poll(&mut self, _acc: &mut MeasurementAccumulator, _t: Timestamp) -> Result<(), PollError> {
+            let name = std::thread::current().name().unwrap_or_default().to_owned();
+            let cpus = crate::pipeline::threading::current_thread_affinity().unwrap();
+            self.0.lock().unwrap().push((name, cpus));
+            Ok(())
+        }
+    }
+
+    struct NullOutput;
+
+    impl Output for NullOutput {
+        fn write(&mut self, _measurements: &MeasurementBuffer, _ctx: &OutputContext) -> Result<(), WriteError> {
+            Ok(())
+        }
+    }
+}
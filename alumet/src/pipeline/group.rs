@@ -0,0 +1,278 @@
+//! Trigger groups.
+//!
+//! Every managed source normally runs in its own task, with its own timer.
+//! When many sources have the same polling interval (for instance, one source per pod),
+//! this means as many timer wakeups, polling timestamps and (small) buffers to flush.
+//!
+//! Sources with a [grouped trigger](super::trigger::builder::TimeTriggerBuilder::grouped) are instead
+//! polled one after another by a single task, on each tick of a single timer. They share the same timestamp
+//! and their measurements are flushed in a single buffer.
+
+use std::collections::HashMap;
+use std::future::Future;
+use std::sync::Arc;
+use std::time::Instant;
+
+use anyhow::Context;
+use tokio::sync::mpsc::error::TrySendError;
+use tokio::sync::{mpsc, watch};
+use tokio::task::JoinSet;
+
+use crate::measurement::{MeasurementBuffer, Timestamp};
+
+use super::overload::{OverloadState, SourceOverload};
+use super::pool::{BufferPool, SourceBufferPool};
+use super::runtime::{run_source, SourceCmd};
+use super::telemetry::SourceStats;
+use super::trigger::{Trigger, TriggerGroupKey, TriggerSpec};
+use super::{PollError, Source};
+
+/// A source that belongs to a trigger group.
+pub(crate) struct GroupMember {
+    pub stats: Arc<SourceStats>,
+    pub name: String,
+    pub source: Box<dyn Source>,
+    pub commands: watch::Receiver<SourceCmd>,
+}
+
+/// The running trigger groups of a pipeline.
+#[derive(Default)]
+pub(crate) struct TriggerGroups {
+    /// Sends new members to the task of each group.
+    groups: HashMap<TriggerGroupKey, mpsc::UnboundedSender<GroupMember>>,
+}
+
+impl TriggerGroups {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Adds a source to the group that corresponds to its trigger.
+    ///
+    /// If the group is not running yet, returns the task that runs the group. It must be spawned by the caller.
+    pub fn add(
+        &mut self,
+        key: TriggerGroupKey,
+        spec: TriggerSpec,
+        member: GroupMember,
+        tx: mpsc::Sender<MeasurementBuffer>,
+        overload: Arc<OverloadState>,
+        buffer_pool: Arc<BufferPool>,
+    ) -> Option<impl Future<Output = anyhow::Result<()>> + Send + 'static> {
+        let member = match self.groups.get(&key) {
+            Some(group) => match group.send(member) {
+                Ok(()) => return None,
+                // the group has stopped, start a new one
+                Err(mpsc::error::SendError(member)) => member,
+            },
+            None => member,
+        };
+        log::debug!("Starting a new trigger group for {key:?}");
+        let (members_tx, members_rx) = mpsc::unbounded_channel();
+        self.groups.insert(key, members_tx);
+        Some(run_group(spec, member, members_rx, tx, overload, buffer_pool))
+    }
+
+    /// Forgets the groups that have stopped because all their sources have been removed.
+    pub fn prune(&mut self) {
+        self.groups.retain(|_, members_tx| !members_tx.is_closed());
+    }
+}
+
+struct RunningMember {
+    stats: Arc<SourceStats>,
+    name: String,
+    source: Box<dyn Source>,
+    commands: watch::Receiver<SourceCmd>,
+    paused: bool,
+}
+
+impl From<GroupMember> for RunningMember {
+    fn from(mut m: GroupMember) -> Self {
+        // The initial command is the trigger of the source, which is the trigger of the group.
+        m.commands.borrow_and_update();
+        Self {
+            stats: m.stats,
+            name: m.name,
+            source: m.source,
+            commands: m.commands,
+            paused: false,
+        }
+    }
+}
+
+/// What to do with a member of the group after a command.
+enum MemberUpdate {
+    Keep,
+    Stop,
+    /// The trigger of the source has changed, it must leave the group.
+    Leave,
+}
+
+async fn run_group(
+    spec: TriggerSpec,
+    first: GroupMember,
+    mut new_members: mpsc::UnboundedReceiver<GroupMember>,
+    tx: mpsc::Sender<MeasurementBuffer>,
+    overload: Arc<OverloadState>,
+    buffer_pool: Arc<BufferPool>,
+) -> anyhow::Result<()> {
+    fn init_trigger(spec: TriggerSpec) -> anyhow::Result<Trigger> {
+        Trigger::without_signal(spec)
+            .context("failed to create the trigger of a group")?
+            .context("the trigger of a group must not be interruptible")
+    }
+
+    let key = spec.group_key().expect("the trigger of a group must be groupable");
+    let mut trigger = init_trigger(spec.clone())?;
+    let mut members: Vec<RunningMember> = vec![first.into()];
+
+    // Sources that have left the group because their trigger has changed, they run on their own.
+    let mut detached = JoinSet::new();
+
+    // The whole group reacts to overloads like a single source would.
+    let mut group_overload = SourceOverload::new(overload.clone());
+    let group_pool = SourceBufferPool::new(buffer_pool.clone());
+    let mut buffer = group_pool.take(trigger.config.flush_rounds);
+
+    let mut i = 1usize;
+    loop {
+        trigger.next().await?;
+        let lateness = trigger.lateness();
+
+        // Accept the new sources.
+        while let Ok(m) = new_members.try_recv() {
+            log::debug!("{} joined the trigger group {key:?}", m.name);
+            members.push(m.into());
+        }
+
+        // Poll all the sources with the same timestamp.
+        let timestamp = trigger.tick_timestamp().unwrap_or_else(Timestamp::now);
+        let mut acc = buffer.as_accumulator();
+        members.retain_mut(|m| {
+            if m.paused {
+                return true;
+            }
+            if let Some(lateness) = lateness {
+                m.stats.record_lateness(lateness);
+            }
+            let poll_start = Instant::now();
+            let res = m.source.poll(&mut acc, timestamp);
+            m.stats.record_poll(poll_start.elapsed());
+            match res {
+                Ok(()) => true,
+                Err(PollError::CanRetry(e)) => {
+                    log::error!("Non-fatal error when polling {} (will retry): {e:#}", m.name);
+                    true
+                }
+                Err(PollError::Fatal(e)) => {
+                    log::error!("Fatal error when polling {} (will stop running): {e:?}", m.name);
+                    false
+                }
+            }
+        });
+
+        // Flush the measurements of the whole group.
+        if i % trigger.config.flush_rounds == 0 {
+            let prev_length = buffer.len();
+            buffer = match tx.try_send(buffer) {
+                Ok(()) => {
+                    log::debug!("trigger group {key:?} flushed {prev_length} measurements");
+                    if let Some(factor) = group_overload.flushed(prev_length) {
+                        trigger = init_trigger(spec.stretched(factor).unwrap())?;
+                    }
+                    group_pool.take(prev_length)
+                }
+                Err(TrySendError::Closed(_buf)) => {
+                    panic!("source channel should stay open");
+                }
+                Err(TrySendError::Full(mut buf)) => {
+                    let name = format!("trigger group {key:?}");
+                    if let Some(factor) = group_overload.overloaded(&mut buf, &name, true) {
+                        trigger = init_trigger(spec.stretched(factor).unwrap())?;
+                    }
+                    buf
+                }
+            };
+        }
+
+        // Apply the commands of the sources.
+        if i % trigger.config.update_rounds == 0 {
+            let mut k = 0;
+            while k < members.len() {
+                match update_member(&mut members[k], &key) {
+                    MemberUpdate::Keep => k += 1,
+                    MemberUpdate::Stop => {
+                        log::debug!("{} left the trigger group {key:?}", members[k].name);
+                        members.swap_remove(k);
+                    }
+                    MemberUpdate::Leave => {
+                        let m = members.swap_remove(k);
+                        log::debug!("{} left the trigger group {key:?} because its trigger has changed", m.name);
+                        let task = run_source(
+                            m.stats,
+                            m.name,
+                            m.source,
+                            tx.clone(),
+                            m.commands,
+                            overload.clone(),
+                            buffer_pool.clone(),
+                        );
+                        detached.spawn(task);
+                    }
+                }
+            }
+        }
+
+        if members.is_empty() {
+            // Stop the group, unless a source has been added in the meantime.
+            new_members.close();
+            while let Ok(m) = new_members.try_recv() {
+                members.push(m.into());
+            }
+            if members.is_empty() {
+                break;
+            }
+        }
+
+        i = i.wrapping_add(1);
+    }
+
+    // Flush the remaining measurements (wait for some room in the channel if the pipeline is overloaded).
+    if !buffer.is_empty() {
+        tx.send(buffer)
+            .await
+            .expect("failed to flush measurements after stopping the trigger group");
+    }
+
+    // Wait for the sources that have left the group.
+    while let Some(res) = detached.join_next().await {
+        res.context("a source that left its trigger group has panicked")??;
+    }
+    Ok(())
+}
+
+/// Applies the latest command of a group member.
+fn update_member(m: &mut RunningMember, key: &TriggerGroupKey) -> MemberUpdate {
+    // When the source is removed, its command sender is dropped right after sending `Stop`:
+    // the channel is closed but the last command must still be applied.
+    if let Ok(false) = m.commands.has_changed() {
+        return MemberUpdate::Keep;
+    }
+    let cmd = m.commands.borrow_and_update().clone();
+    log::trace!("{} received {cmd:?}", m.name);
+    match cmd {
+        SourceCmd::Run => {
+            m.paused = false;
+            MemberUpdate::Keep
+        }
+        SourceCmd::Pause => {
+            m.paused = true;
+            MemberUpdate::Keep
+        }
+        SourceCmd::Stop => MemberUpdate::Stop,
+        SourceCmd::SetTrigger(Some(spec)) if spec.group_key().as_ref() == Some(key) => MemberUpdate::Keep,
+        // run_source will pick up the new trigger from the command channel
+        SourceCmd::SetTrigger(_) => MemberUpdate::Leave,
+    }
+}
@@ -0,0 +1,193 @@
+//! Lock-free histograms of durations.
+//!
+//! The histograms are meant to be updated on the hot path of the pipeline (on every poll of every source),
+//! and read from time to time by the self-telemetry or on demand.
+//! Like an HDR histogram, they have a bounded relative error over the whole range of values:
+//! each power of two is divided into a fixed number of linear sub-buckets. Recording a value
+//! only takes one relaxed atomic increment, the percentiles are computed when the histogram is read.
+
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::time::Duration;
+
+/// Number of bits of precision kept for each value: each power of two is divided into `2^SUB_BUCKET_BITS` buckets,
+/// which gives a relative error of at most 1/8 (12.5%).
+const SUB_BUCKET_BITS: u32 = 3;
+const SUB_BUCKETS: usize = 1 << SUB_BUCKET_BITS;
+
+/// Number of buckets needed to cover all the `u64` values.
+const BUCKETS: usize = (64 - SUB_BUCKET_BITS as usize + 1) * SUB_BUCKETS;
+
+/// A histogram of durations, with a nanosecond resolution.
+pub(crate) struct Histogram {
+    counts: Box<[AtomicU64]>,
+}
+
+/// A copy of the counts of a [`Histogram`], at some point in time.
+#[derive(Clone)]
+pub(crate) struct HistogramSnapshot {
+    counts: Vec<u64>,
+}
+
+/// Some percentiles of a distribution of durations.
+///
+/// The values are rounded up to the upper bound of their bucket, with a relative error of at most 12.5%.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub struct Percentiles {
+    /// Number of recorded values.
+    pub count: u64,
+    pub p50: Duration,
+    pub p90: Duration,
+    pub p99: Duration,
+    pub p999: Duration,
+    pub max: Duration,
+}
+
+impl Default for Histogram {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl Histogram {
+    pub fn new() -> Self {
+        Self {
+            counts: (0..BUCKETS).map(|_| AtomicU64::new(0)).collect(),
+        }
+    }
+
+    /// Records a duration.
+    pub fn record(&self, value: Duration) {
+        let nanos = u64::try_from(value.as_nanos()).unwrap_or(u64::MAX);
+        self.counts[bucket_index(nanos)].fetch_add(1, Ordering::Relaxed);
+    }
+
+    /// Copies the current counts.
+    ///
+    /// The copy is not atomic: the values that are recorded during the copy may or may not be included.
+    pub fn snapshot(&self) -> HistogramSnapshot {
+        HistogramSnapshot {
+            counts: self.counts.iter().map(|c| c.load(Ordering::Relaxed)).collect(),
+        }
+    }
+}
+
+impl HistogramSnapshot {
+    /// Returns the values that have been recorded since `previous`, which must be an older snapshot of the same histogram.
+    pub fn since(&self, previous: &HistogramSnapshot) -> HistogramSnapshot {
+        HistogramSnapshot {
+            counts: self
+                .counts
+                .iter()
+                .zip(&previous.counts)
+                .map(|(now, before)| now.saturating_sub(*before))
+                .collect(),
+        }
+    }
+
+    /// Computes the percentiles of the recorded values.
+    pub fn percentiles(&self) -> Percentiles {
+        let count: u64 = self.counts.iter().sum();
+        if count == 0 {
+            return Percentiles::default();
+        }
+        // Targets in increasing order, found in a single pass over the buckets.
+        let targets = [0.5, 0.9, 0.99, 0.999, 1.0].map(|q: f64| ((q * count as f64).ceil() as u64).max(1));
+        let mut results = [Duration::ZERO; 5];
+        let mut next = 0;
+        let mut seen = 0;
+        for (i, c) in self.counts.iter().enumerate() {
+            seen += c;
+            while next < targets.len() && seen >= targets[next] {
+                results[next] = Duration::from_nanos(bucket_upper_bound(i));
+                next += 1;
+            }
+            if next == targets.len() {
+                break;
+            }
+        }
+        let [p50, p90, p99, p999, max] = results;
+        Percentiles {
+            count,
+            p50,
+            p90,
+            p99,
+            p999,
+            max,
+        }
+    }
+}
+
+/// Returns the index of the bucket that contains `value`.
+fn bucket_index(value: u64) -> usize {
+    if value < SUB_BUCKETS as u64 {
+        return value as usize;
+    }
+    // position of the highest bit, at least SUB_BUCKET_BITS
+    let exp = 63 - value.leading_zeros();
+    let shift = exp - SUB_BUCKET_BITS;
+    let sub_bucket = (value >> shift) as usize & (SUB_BUCKETS - 1);
+    (shift as usize + 1) * SUB_BUCKETS + sub_bucket
+}
+
+/// Returns the highest value that belongs to the bucket `index`.
+fn bucket_upper_bound(index: usize) -> u64 {
+    if index < SUB_BUCKETS {
+        return index as u64;
+    }
+    let shift = (index / SUB_BUCKETS - 1) as u32;
+    let lower = ((SUB_BUCKETS + index % SUB_BUCKETS) as u64) << shift;
+    lower + ((1u64 << shift) - 1)
+}
+
+#[cfg(test)]
+mod tests {
+    use std::time::Duration;
+
+    use super::{bucket_index, bucket_upper_bound, Histogram, BUCKETS};
+
+    #[test]
+    fn buckets() {
+        assert_eq!(0, bucket_index(0));
+        assert_eq!(7, bucket_index(7));
+        assert_eq!(8, bucket_index(8));
+        assert_eq!(15, bucket_index(15));
+        assert_eq!(16, bucket_index(16));
+        assert_eq!(16, bucket_index(17));
+        assert_eq!(BUCKETS - 1, bucket_index(u64::MAX));
+        assert_eq!(u64::MAX, bucket_upper_bound(BUCKETS - 1));
+
+        // every value is in a bucket whose upper bound is close to it
+        for value in [1, 9, 100, 1_000, 12_345, 1_000_000, 987_654_321, u64::MAX / 3] {
+            let upper = bucket_upper_bound(bucket_index(value));
+            assert!(upper >= value, "{upper} < {value}");
+            assert!(upper - value <= value / 8, "{upper} is too far from {value}");
+        }
+    }
+
+    #[test]
+    fn percentiles() {
+        let h = Histogram::new();
+        assert_eq!(0, h.snapshot().percentiles().count);
+
+        for i in 1..=1000 {
+            h.record(Duration::from_micros(i));
+        }
+        let p = h.snapshot().percentiles();
+        assert_eq!(1000, p.count);
+        let close = |d: Duration, micros: u64| {
+            let expected = Duration::from_micros(micros);
+            d >= expected && d <= expected + expected / 8
+        };
+        assert!(close(p.p50, 500), "p50 = {:?}", p.p50);
+        assert!(close(p.p90, 900), "p90 = {:?}", p.p90);
+        assert!(close(p.p99, 990), "p99 = {:?}", p.p99);
+        assert!(close(p.max, 1000), "max = {:?}", p.max);
+
+        // only the new values
+        let before = h.snapshot();
+        h.record(Duration::from_secs(1));
+        let p = h.snapshot().since(&before).percentiles();
+        assert_eq!(1, p.count);
+        assert!(close(p.p50, 1_000_000));
+    }
+}
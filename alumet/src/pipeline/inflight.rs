@@ -0,0 +1,345 @@
+//! In-flight writes of the async outputs.
+//!
+//! An [`AsyncOutput`] returns a future for each write. Each future is spawned on the runtime,
+//! so that the network requests of several writes can progress at the same time, while the
+//! pipeline keeps receiving new measurements. The results are handled in the order of the writes,
+//! and the number of writes in flight is bounded, which gives some backpressure on slow outputs.
+//!
+//! The writes that fail with [`WriteError::CanRetry`] go into the [retry queue](super::retry) of the output.
+//! Before starting a new write, the writes that have already finished are handled, so that a failure is
+//! known before the next measurements are given to the output. While the retry queue is not empty, the new
+//! measurements go through it, and the queue is only replayed when no other write is in flight.
+//! Only the writes that overlap with the failed one, which have no order anyway, can reach the output first.
+
+use std::collections::VecDeque;
+use std::sync::Arc;
+
+use anyhow::anyhow;
+use tokio::task::JoinHandle;
+use tokio::time::Instant;
+
+use crate::measurement::MeasurementBuffer;
+use crate::metrics::SharedMetricRegistry;
+
+use super::retry::RetryQueue;
+use super::telemetry::ElementStats;
+use super::worker::{refresh_metrics, OutputWorkerSettings, QueueDepth};
+use super::{AsyncOutput, OutputContext, WriteError};
+
+/// The writes in flight of an async output.
+pub(crate) struct InFlightWrites {
+    name: String,
+    output: Box<dyn AsyncOutput>,
+    ctx: OutputContext,
+    metrics: Arc<SharedMetricRegistry>,
+    metrics_version: u64,
+    max_in_flight: usize,
+    /// Writes in progress, the oldest first.
+    pending: VecDeque<InFlightWrite>,
+    retry: RetryQueue,
+    depth: QueueDepth,
+    stats: Arc<ElementStats>,
+}
+
+struct InFlightWrite {
+    measurements: Arc<MeasurementBuffer>,
+    started: Instant,
+    /// Is this a write of the retry queue?
+    retry: bool,
+    task: JoinHandle<Result<(), WriteError>>,
+}
+
+impl InFlightWrites {
+    pub fn new(
+        name: String,
+        output: Box<dyn AsyncOutput>,
+        ctx: OutputContext,
+        metrics: Arc<SharedMetricRegistry>,
+        settings: OutputWorkerSettings,
+    ) -> Self {
+        let max_in_flight = settings.max_in_flight.max(1);
+        let retry = RetryQueue::open(&settings.retry, &name);
+        Self {
+            name,
+            output,
+            ctx,
+            metrics_version: metrics.version(),
+            metrics,
+            max_in_flight,
+            pending: VecDeque::with_capacity(max_in_flight),
+            retry,
+            depth: settings.queue_depth,
+            stats: settings.stats,
+        }
+    }
+
+    /// Starts writing the measurements.
+    ///
+    /// If the maximum number of writes are already in flight, waits for the oldest one to finish first.
+    /// Returns an error if a previous write has failed with a fatal error.
+    pub async fn write(&mut self, measurements: Arc<MeasurementBuffer>) -> anyhow::Result<()> {
+        while self.pending.len() >= self.max_in_flight {
+            self.next_done().await?;
+        }
+
+        // A write that has already failed must go into the retry queue before the new measurements.
+        // The results are handled in order, which can wait for older writes that are still running.
+        while self.pending.iter().any(|w| w.task.is_finished()) {
+            self.next_done().await?;
+        }
+
+        // Metrics may have been registered since the last write, which is rare: checking the version is enough.
+        refresh_metrics(&mut self.ctx, &self.metrics, &mut self.metrics_version);
+
+        // Don't write the new measurements before the ones that have failed.
+        if !self.retry.is_empty() {
+            self.retry.push(measurements, &self.ctx.metrics);
+            return Ok(());
+        }
+        self.start(measurements, false);
+        Ok(())
+    }
+
+    fn start(&mut self, measurements: Arc<MeasurementBuffer>, retry: bool) {
+        let write = self.output.write(measurements.clone(), &self.ctx);
+        self.pending.push_back(InFlightWrite {
+            measurements,
+            started: Instant::now(),
+            retry,
+            task: tokio::spawn(write),
+        });
+        self.depth.increment();
+    }
+
+    /// Waits for the oldest write to finish, and handles its result.
+    ///
+    /// If no write is in flight, waits for the next retry and starts it, or never returns if there is nothing to retry.
+    /// This method is cancel safe: if it is cancelled, the oldest write stays in flight.
+    pub async fn next_done(&mut self) -> anyhow::Result<()> {
+        let Some(oldest) = self.pending.front_mut() else {
+            // Retry the oldest failed write, one at a time.
+            let Some(deadline) = self.retry.next_attempt() else {
+                return std::future::pending().await;
+            };
+            tokio::time::sleep_until(deadline).await;
+            refresh_metrics(&mut self.ctx, &self.metrics, &mut self.metrics_version);
+            if let Some(measurements) = self.retry.front(&self.ctx.metrics) {
+                self.start(measurements, true);
+            }
+            return Ok(());
+        };
+        let res = (&mut oldest.task).await;
+        let write = self.pending.pop_front().unwrap();
+        self.depth.decrement();
+        self.stats.record(write.started.elapsed(), write.measurements.len());
+
+        let name = &self.name;
+        match res {
+            Ok(Ok(())) => {
+                if write.retry {
+                    self.retry.pop_front();
+                }
+                Ok(())
+            }
+            Ok(Err(WriteError::CanRetry(e))) if write.retry => {
+                log::warn!("Output {name} failed again to write the measurements (will retry later): {e:#}");
+                self.retry.failed();
+                Ok(())
+            }
+            Ok(Err(WriteError::CanRetry(e))) if self.retry.is_enabled() => {
+                log::error!("Non-fatal error in output {name} (the measurements will be written later): {e:#}");
+                self.retry.push(write.measurements, &self.ctx.metrics);
+                Ok(())
+            }
+            Ok(Err(WriteError::CanRetry(e))) => {
+                log::error!(
+                    "Non-fatal error in output {name} (retries are disabled, the measurements are lost): {e:#}"
+                );
+                Ok(())
+            }
+            Ok(Err(WriteError::Fatal(e))) => {
+                log::error!("Fatal error in output {name} (it will stop running): {e:?}");
+                Err(e.context(format!("fatal error in output {name}")))
+            }
+            Err(e) if e.is_panic() => Err(anyhow!("A write of output {name} panicked, there is a bug somewhere!")),
+            Err(e) => Err(anyhow!("A write of output {name} has been cancelled: {e}")),
+        }
+    }
+
+    /// Waits for all the writes in flight to finish.
+    ///
+    /// The measurements that still have to be retried are saved, if the retry queue has a directory.
+    pub async fn finish(mut self) -> anyhow::Result<()> {
+        while !self.pending.is_empty() {
+            self.next_done().await?;
+        }
+        Ok(())
+    }
+}
+
+impl Drop for InFlightWrites {
+    fn drop(&mut self) {
+        // Only happens if the output has failed: the other writes are not needed anymore.
+        for write in self.pending.drain(..) {
+            write.task.abort();
+        }
+        self.retry.persist(&self.ctx.metrics);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::{Arc, Mutex};
+    use std::time::Duration;
+
+    use anyhow::anyhow;
+
+    use crate::measurement::MeasurementBuffer;
+    use crate::metrics::{MetricRegistry, RawMetricId, SharedMetricRegistry};
+    use crate::pipeline::queue::OverflowPolicy;
+    use crate::pipeline::retry::RetryConfig;
+    use crate::pipeline::testing;
+    use crate::pipeline::worker::{OutputWorkerSettings, QueueDepth};
+    use crate::pipeline::{AsyncOutput, OutputContext, WriteError, WriteFuture};
+    use crate::resources::ResourceRegistry;
+
+    use super::InFlightWrites;
+
+    /// Completes the writes in the reverse order of their start, after a delay.
+    struct SlowOutput {
+        started: usize,
+        in_flight: Arc<Mutex<(usize, usize)>>,
+        fail_at: Option<usize>,
+    }
+
+    impl AsyncOutput for SlowOutput {
+        fn write(&mut self, _measurements: Arc<MeasurementBuffer>, _ctx: &OutputContext) -> WriteFuture {
+            let n = self.started;
+            self.started += 1;
+            let in_flight = self.in_flight.clone();
+            let fail = self.fail_at == Some(n);
+            Box::pin(async move {
+                {
+                    let mut state = in_flight.lock().unwrap();
+                    state.0 += 1;
+                    state.1 = state.1.max(state.0);
+                }
+                tokio::time::sleep(Duration::from_millis(50 - 10 * (n as u64 % 4))).await;
+                in_flight.lock().unwrap().0 -= 1;
+                if fail {
+                    return Err(WriteError::Fatal(anyhow!("write {n} failed")));
+                }
+                Ok(())
+            })
+        }
+    }
+
+    /// Writes the measurements after a delay that depends on their length, and fails once on the buffers of length 2.
+    struct FlakyOutput {
+        failed: bool,
+        written: Arc<Mutex<Vec<usize>>>,
+    }
+
+    impl AsyncOutput for FlakyOutput {
+        fn write(&mut self, measurements: Arc<MeasurementBuffer>, _ctx: &OutputContext) -> WriteFuture {
+            let len = measurements.len();
+            let fail = len == 2 && !self.failed;
+            self.failed |= fail;
+            let written = self.written.clone();
+            Box::pin(async move {
+                if len == 1 {
+                    tokio::time::sleep(Duration::from_millis(50)).await;
+                }
+                if fail {
+                    return Err(WriteError::CanRetry(anyhow!("not now")));
+                }
+                written.lock().unwrap().push(len);
+                Ok(())
+            })
+        }
+    }
+
+    fn writes(max_in_flight: usize, fail_at: Option<usize>) -> (InFlightWrites, Arc<Mutex<(usize, usize)>>) {
+        let in_flight = Arc::new(Mutex::new((0, 0)));
+        let output = Box::new(SlowOutput {
+            started: 0,
+            in_flight: in_flight.clone(),
+            fail_at,
+        });
+        (start(output, max_in_flight, RetryConfig::default()), in_flight)
+    }
+
+    fn start(output: Box<dyn AsyncOutput>, max_in_flight: usize, retry: RetryConfig) -> InFlightWrites {
+        let metrics = Arc::new(SharedMetricRegistry::new(MetricRegistry::new()));
+        let ctx = OutputContext {
+            metrics: metrics.snapshot(),
+            resources: Arc::new(ResourceRegistry::new()),
+        };
+        let settings = OutputWorkerSettings {
+            queue_capacity: 0,
+            overflow: OverflowPolicy::default(),
+            cpu: None,
+            max_in_flight,
+            retry,
+            queue_depth: QueueDepth::default(),
+            stats: Default::default(),
+        };
+        InFlightWrites::new(String::from("test"), output, ctx, metrics, settings)
+    }
+
+    fn buffer(n: usize) -> Arc<MeasurementBuffer> {
+        testing::buffer(RawMetricId(0), n)
+    }
+
+    #[tokio::test(flavor = "multi_thread")]
+    async fn bounded_concurrent_writes() {
+        let (mut writes, in_flight) = writes(3, None);
+        for _ in 0..10 {
+            writes.write(Arc::new(MeasurementBuffer::new())).await.unwrap();
+            assert!(writes.pending.len() <= 3);
+        }
+        writes.finish().await.unwrap();
+        let (current, max) = *in_flight.lock().unwrap();
+        assert_eq!(0, current);
+        assert_eq!(3, max, "the writes should run concurrently, up to the limit");
+    }
+
+    #[tokio::test(flavor = "multi_thread")]
+    async fn errors_in_order() {
+        // The write 1 fails after the write 2 has finished, but its error is reported first.
+        let (mut writes, _) = writes(4, Some(1));
+        for _ in 0..3 {
+            writes.write(Arc::new(MeasurementBuffer::new())).await.unwrap();
+        }
+        writes.next_done().await.unwrap();
+        let err = writes.next_done().await.unwrap_err();
+        assert!(format!("{err:#}").contains("write 1 failed"));
+        assert_eq!(1, writes.pending.len());
+    }
+
+    #[tokio::test(flavor = "multi_thread")]
+    async fn no_write_after_known_failure() {
+        let written = Arc::new(Mutex::new(Vec::new()));
+        let output = Box::new(FlakyOutput {
+            failed: false,
+            written: written.clone(),
+        });
+        let retry = RetryConfig {
+            initial_backoff: Duration::from_millis(1),
+            ..Default::default()
+        };
+        let mut writes = start(output, 4, retry);
+        // The write of 2 fails while the write of 1 is still running.
+        writes.write(buffer(1)).await.unwrap();
+        writes.write(buffer(2)).await.unwrap();
+        tokio::time::sleep(Duration::from_millis(10)).await;
+        writes.write(buffer(3)).await.unwrap();
+        while written.lock().unwrap().len() < 3 {
+            tokio::time::timeout(Duration::from_secs(1), writes.next_done())
+                .await
+                .unwrap()
+                .unwrap();
+        }
+        assert_eq!(vec![1, 2, 3], *written.lock().unwrap());
+    }
+}
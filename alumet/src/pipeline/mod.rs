@@ -1,14 +1,30 @@
 //! Asynchronous and modular measurement pipeline.
 
 use std::fmt;
+use std::future::Future;
+use std::pin::Pin;
+use std::sync::Arc;
 
-use crate::{measurement::{MeasurementAccumulator, MeasurementBuffer, Timestamp}, metrics::MetricRegistry};
+use crate::{measurement::{MeasurementAccumulator, MeasurementBuffer, Timestamp}, metrics::MetricRegistry, resources::ResourceRegistry};
 
 pub mod runtime;
 pub mod builder;
 mod threading;
-mod scoped;
+pub mod placement;
 pub mod trigger;
+pub mod overload;
+pub mod pool;
+pub mod batch;
+pub mod telemetry;
+pub mod histogram;
+pub mod worker;
+pub mod retry;
+pub mod queue;
+mod spill;
+mod inflight;
+mod group;
+#[cfg(test)]
+pub(crate) mod testing;
 
 /// Produces measurements related to some metrics.
 pub trait Source: Send {
@@ -28,8 +44,29 @@ pub trait Output: Send {
     fn write(&mut self, measurements: &MeasurementBuffer, ctx: &OutputContext) -> Result<(), WriteError>;
 }
 
+/// Exports measurements to an external entity, asynchronously.
+///
+/// Unlike [`Output`], which runs on its own thread, an `AsyncOutput` is driven by the async runtime
+/// of the pipeline. This is the best choice for outputs that use an async library to send the
+/// measurements over the network (HTTP, gRPC, ...): they don't need to block a thread on each write,
+/// and several writes can be in flight at the same time.
+pub trait AsyncOutput: Send {
+    /// Starts writing the measurements to the output.
+    ///
+    /// The returned future does not borrow the output: it can run while the next measurements are
+    /// being prepared. The pipeline bounds the number of writes that are in flight, and handles their
+    /// results in the order of the calls to `write`.
+    fn write(&mut self, measurements: Arc<MeasurementBuffer>, ctx: &OutputContext) -> WriteFuture;
+}
+
+/// A write in progress, returned by [`AsyncOutput::write`].
+pub type WriteFuture = Pin<Box<dyn Future<Output = Result<(), WriteError>> + Send + 'static>>;
+
 pub struct OutputContext {
-    pub metrics: MetricRegistry,
+    /// Current state of the metric registry, shared by all the outputs.
+    pub metrics: Arc<MetricRegistry>,
+    /// Registry of the resources and consumers of the pipeline.
+    pub resources: Arc<ResourceRegistry>,
 }
 
 // ====== Errors ======
@@ -56,7 +93,7 @@ pub enum TransformError {
     UnexpectedInput(anyhow::Error),
 }
 
-/// Error which can occur during [`Output::write`].
+/// Error which can occur during [`Output::write`] or [`AsyncOutput::write`].
 #[derive(Debug)]
 pub enum WriteError {
     /// The measurements could not be written properly, and the output cannot be used anymore.
@@ -0,0 +1,431 @@
+//! Handling of pipeline overloads (backpressure).
+//!
+//! Managed sources flush their measurements to the transforms through a bounded channel.
+//! When the rest of the pipeline is too slow (for instance, an output waits for a remote database),
+//! this channel fills up and the sources cannot flush anymore.
+//! The [`OverloadPolicy`] defines how the sources react to this situation.
+
+use std::mem::size_of;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex, Weak};
+use std::time::{Duration, Instant};
+
+use crate::measurement::{MeasurementBuffer, MeasurementPoint};
+
+/// Default memory budget of the buffer of each source, in bytes.
+pub const DEFAULT_MAX_BUFFER_BYTES: usize = 16 * 1024 * 1024;
+
+/// Default maximum stretching factor of the polling interval, for [`OverloadPolicy::SlowDown`].
+pub const DEFAULT_MAX_SLOWDOWN_FACTOR: u32 = 8;
+
+/// Number of consecutive successful flushes required to halve the stretching factor of a source.
+const RECOVERY_FLUSHES: u32 = 8;
+
+/// How long the rate of a source is taken into account to find the heaviest sources.
+const RATE_WINDOW: Duration = Duration::from_secs(30);
+
+/// Defines what a source does when it cannot flush its measurements because the pipeline is overloaded.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum OverloadPolicy {
+    /// Keeps the measurements in the buffer of the source, and tries to flush them again later.
+    ///
+    /// When the buffer exceeds `max_bytes`, the oldest measurements are discarded.
+    Accumulate { max_bytes: usize },
+
+    /// Keeps the measurements of the last flush only, and discards the older ones.
+    ///
+    /// When a flush fails, the measurements are kept and the source tries to flush them again later.
+    /// If that next flush fails too, the measurements of the failed flush are discarded (from the front
+    /// of the buffer), and the new measurements are kept.
+    /// This bounds the memory usage of the source, at the cost of losing the oldest data
+    /// as soon as the pipeline stays overloaded.
+    DropOldest,
+
+    /// Stretches the polling interval of the sources that produce the most measurements per second,
+    /// up to `max_factor` times the configured interval.
+    ///
+    /// The measurements are kept like with [`OverloadPolicy::Accumulate`], and the oldest ones
+    /// are discarded when the buffer exceeds `max_bytes`.
+    /// The polling interval is progressively restored when the pipeline recovers.
+    SlowDown { max_bytes: usize, max_factor: u32 },
+}
+
+impl Default for OverloadPolicy {
+    fn default() -> Self {
+        OverloadPolicy::Accumulate {
+            max_bytes: DEFAULT_MAX_BUFFER_BYTES,
+        }
+    }
+}
+
+/// Counts how often the [`OverloadPolicy`] has been applied, since the start of the pipeline.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct OverloadStats {
+    /// Number of times a source has kept its measurements because it could not flush them.
+    pub accumulated: u64,
+    /// Number of times a source has discarded some measurements.
+    pub dropped: u64,
+    /// Total number of measurement points that have been discarded.
+    pub dropped_points: u64,
+    /// Number of times the polling interval of a source has been stretched.
+    pub slowed_down: u64,
+}
+
+impl OverloadStats {
+    /// Returns true if no overload has been detected.
+    pub fn is_empty(&self) -> bool {
+        *self == Self::default()
+    }
+}
+
+/// Overload handling state, shared by all the managed sources of a pipeline.
+pub(crate) struct OverloadState {
+    policy: OverloadPolicy,
+
+    // counters
+    accumulated: AtomicU64,
+    dropped: AtomicU64,
+    dropped_points: AtomicU64,
+    slowed_down: AtomicU64,
+
+    /// Reference point of the [`SourceRate`] timestamps.
+    start: Instant,
+    /// The rate of each source, to find the heaviest ones. Dropped sources are removed lazily.
+    rates: Mutex<Vec<Weak<SourceRate>>>,
+}
+
+/// Number of points per second produced by a source, measured on its last flush.
+///
+/// It is updated by the source without locking, and only read when the pipeline is overloaded.
+#[derive(Default)]
+struct SourceRate {
+    points_per_sec: AtomicU64,
+    /// When the rate has been measured, in milliseconds since [`OverloadState::start`].
+    updated_at: AtomicU64,
+}
+
+impl OverloadState {
+    pub fn new(policy: OverloadPolicy) -> Self {
+        Self {
+            policy,
+            accumulated: AtomicU64::new(0),
+            dropped: AtomicU64::new(0),
+            dropped_points: AtomicU64::new(0),
+            slowed_down: AtomicU64::new(0),
+            start: Instant::now(),
+            rates: Mutex::new(Vec::new()),
+        }
+    }
+
+    fn register_source(&self) -> Arc<SourceRate> {
+        let rate = Arc::new(SourceRate::default());
+        let mut rates = self.rates.lock().unwrap();
+        rates.retain(|r| r.strong_count() > 0);
+        rates.push(Arc::downgrade(&rate));
+        rate
+    }
+
+    fn millis_since_start(&self, t: Instant) -> u64 {
+        t.saturating_duration_since(self.start).as_millis() as u64
+    }
+
+    /// Returns the maximum rate of the sources that have been measured in the last [`RATE_WINDOW`].
+    fn max_recent_rate(&self, now: Instant) -> u64 {
+        let window_start = self
+            .millis_since_start(now)
+            .saturating_sub(RATE_WINDOW.as_millis() as u64);
+        let rates = self.rates.lock().unwrap();
+        rates
+            .iter()
+            .filter_map(|r| r.upgrade())
+            .filter(|r| r.updated_at.load(Ordering::Relaxed) >= window_start)
+            .map(|r| r.points_per_sec.load(Ordering::Relaxed))
+            .max()
+            .unwrap_or(0)
+    }
+
+    /// Returns a snapshot of the counters.
+    pub fn stats(&self) -> OverloadStats {
+        OverloadStats {
+            accumulated: self.accumulated.load(Ordering::Relaxed),
+            dropped: self.dropped.load(Ordering::Relaxed),
+            dropped_points: self.dropped_points.load(Ordering::Relaxed),
+            slowed_down: self.slowed_down.load(Ordering::Relaxed),
+        }
+    }
+}
+
+/// Overload handling state of a single source.
+pub(crate) struct SourceOverload {
+    shared: Arc<OverloadState>,
+    /// When the last successful flush occurred.
+    last_flush: Instant,
+    /// Number of points per second produced by the source, measured on the last flush.
+    rate: Arc<SourceRate>,
+    /// Current stretching factor of the polling interval (1 = not stretched).
+    factor: u32,
+    /// Number of consecutive successful flushes since the last change of `factor`.
+    successes: u32,
+    /// Number of measurements at the front of the buffer that the last flush could not send.
+    unflushed: usize,
+}
+
+impl SourceOverload {
+    pub fn new(shared: Arc<OverloadState>) -> Self {
+        let rate = shared.register_source();
+        Self {
+            shared,
+            last_flush: Instant::now(),
+            rate,
+            factor: 1,
+            successes: 0,
+            unflushed: 0,
+        }
+    }
+
+    /// Forgets the current stretching factor, for instance because the trigger has been replaced.
+    pub fn reset_factor(&mut self) {
+        self.factor = 1;
+        self.successes = 0;
+    }
+
+    /// Must be called after a successful flush of `n_points` measurements.
+    ///
+    /// Returns the new stretching factor of the polling interval, if it must change.
+    pub fn flushed(&mut self, n_points: usize) -> Option<u32> {
+        let now = Instant::now();
+        let elapsed = now.duration_since(self.last_flush).as_secs_f64();
+        self.last_flush = now;
+        self.unflushed = 0;
+        if elapsed > 0.0 {
+            self.record_rate((n_points as f64 / elapsed) as u64, now);
+        }
+
+        if self.factor > 1 {
+            self.successes += 1;
+            if self.successes >= RECOVERY_FLUSHES {
+                self.factor /= 2;
+                self.successes = 0;
+                return Some(self.factor);
+            }
+        }
+        None
+    }
+
+    fn record_rate(&self, points_per_sec: u64, now: Instant) {
+        self.rate.points_per_sec.store(points_per_sec, Ordering::Relaxed);
+        self.rate
+            .updated_at
+            .store(self.shared.millis_since_start(now), Ordering::Relaxed);
+    }
+
+    /// Applies the overload policy to a buffer that could not be flushed.
+    ///
+    /// `can_stretch` indicates whether the polling interval of the source can be modified.
+    /// Returns the new stretching factor of the polling interval, if it must change.
+    pub fn overloaded(&mut self, buffer: &mut MeasurementBuffer, source_name: &str, can_stretch: bool) -> Option<u32> {
+        self.successes = 0;
+        match self.shared.policy {
+            OverloadPolicy::DropOldest => {
+                // The buffer contains the measurements of the previous failed flush, followed by the new ones.
+                let n = self.unflushed.min(buffer.len());
+                if n > 0 {
+                    buffer.remove_oldest(n);
+                    self.count_dropped(n);
+                    log::warn!("The pipeline is overloaded, {source_name} discarded its {n} oldest measurements.");
+                } else {
+                    self.shared.accumulated.fetch_add(1, Ordering::Relaxed);
+                    log::debug!("The pipeline is overloaded, {source_name} keeps its measurements for later.");
+                }
+                self.unflushed = buffer.len();
+                None
+            }
+            OverloadPolicy::Accumulate { max_bytes } => {
+                self.shared.accumulated.fetch_add(1, Ordering::Relaxed);
+                log::debug!("The pipeline is overloaded, {source_name} keeps its measurements for later.");
+                self.enforce_budget(buffer, max_bytes, source_name);
+                None
+            }
+            OverloadPolicy::SlowDown { max_bytes, max_factor } => {
+                // Only stretch the interval of the sources that produce the most measurements.
+                let max_rate = self.shared.max_recent_rate(Instant::now());
+                let rate = self.rate.points_per_sec.load(Ordering::Relaxed);
+                let is_heavy = rate.saturating_mul(2) >= max_rate;
+                let res = if can_stretch && is_heavy && self.factor < max_factor {
+                    self.factor = self.factor.saturating_mul(2).min(max_factor);
+                    self.shared.slowed_down.fetch_add(1, Ordering::Relaxed);
+                    log::warn!(
+                        "The pipeline is overloaded, the polling interval of {source_name} is now {}x longer.",
+                        self.factor
+                    );
+                    Some(self.factor)
+                } else {
+                    self.shared.accumulated.fetch_add(1, Ordering::Relaxed);
+                    None
+                };
+                self.enforce_budget(buffer, max_bytes, source_name);
+                res
+            }
+        }
+    }
+
+    /// Discards the oldest measurements of the buffer if it exceeds the memory budget.
+    fn enforce_budget(&self, buffer: &mut MeasurementBuffer, max_bytes: usize, source_name: &str) {
+        // The attributes can take more space, but the size of the points is a good approximation.
+        let max_points = (max_bytes / size_of::<MeasurementPoint>()).max(1);
+        let len = buffer.len();
+        if len > max_points {
+            let n = len - max_points;
+            buffer.remove_oldest(n);
+            self.count_dropped(n);
+            log::warn!("The pipeline is overloaded and {source_name} exceeded its memory budget, it discarded its {n} oldest measurements.");
+        }
+    }
+
+    fn count_dropped(&self, n_points: usize) {
+        self.shared.dropped.fetch_add(1, Ordering::Relaxed);
+        self.shared.dropped_points.fetch_add(n_points as u64, Ordering::Relaxed);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::Arc;
+    use std::time::Instant;
+
+    use crate::{
+        measurement::{MeasurementBuffer, MeasurementPoint, Timestamp, WrappedMeasurementValue},
+        metrics::RawMetricId,
+        resources::{Resource, ResourceConsumer},
+    };
+
+    use super::{OverloadPolicy, OverloadState, OverloadStats, SourceOverload, RATE_WINDOW, RECOVERY_FLUSHES};
+
+    fn buffer(n: usize) -> MeasurementBuffer {
+        let mut buf = MeasurementBuffer::with_capacity(n);
+        for i in 0..n {
+            buf.push(MeasurementPoint::new_untyped(
+                Timestamp::now(),
+                RawMetricId(1),
+                Resource::LocalMachine,
+                ResourceConsumer::LocalMachine,
+                WrappedMeasurementValue::U64(i as u64),
+            ));
+        }
+        buf
+    }
+
+    #[test]
+    fn drop_oldest() {
+        let state = Arc::new(OverloadState::new(OverloadPolicy::DropOldest));
+        let mut overload = SourceOverload::new(state.clone());
+
+        // the first failed flush keeps the measurements
+        let mut buf = buffer(10);
+        assert_eq!(None, overload.overloaded(&mut buf, "src", true));
+        assert_eq!(10, buf.len());
+
+        // the next one discards them, but keeps the new measurements
+        buf.push(buffer(1).iter().next().unwrap().clone());
+        buf.push(buffer(1).iter().next().unwrap().clone());
+        assert_eq!(None, overload.overloaded(&mut buf, "src", true));
+        assert_eq!(2, buf.len());
+        assert!(buf.iter().all(|p| matches!(p.value, WrappedMeasurementValue::U64(0))));
+        let expected = OverloadStats {
+            accumulated: 1,
+            dropped: 1,
+            dropped_points: 10,
+            ..Default::default()
+        };
+        assert_eq!(expected, state.stats());
+
+        // after a successful flush, nothing is discarded
+        overload.flushed(2);
+        let mut buf = buffer(3);
+        assert_eq!(None, overload.overloaded(&mut buf, "src", true));
+        assert_eq!(3, buf.len());
+    }
+
+    #[test]
+    fn accumulate_within_budget() {
+        let max_bytes = 5 * std::mem::size_of::<MeasurementPoint>();
+        let state = Arc::new(OverloadState::new(OverloadPolicy::Accumulate { max_bytes }));
+        let mut overload = SourceOverload::new(state.clone());
+
+        let mut buf = buffer(4);
+        assert_eq!(None, overload.overloaded(&mut buf, "src", true));
+        assert_eq!(4, buf.len());
+
+        // exceed the budget: the oldest points must be discarded
+        buf.push(buffer(3).iter().next().unwrap().clone());
+        buf.push(buffer(3).iter().next().unwrap().clone());
+        assert_eq!(None, overload.overloaded(&mut buf, "src", true));
+        assert_eq!(5, buf.len());
+        let first = buf.iter().next().unwrap();
+        assert!(matches!(first.value, WrappedMeasurementValue::U64(1)));
+
+        let expected = OverloadStats {
+            accumulated: 2,
+            dropped: 1,
+            dropped_points: 1,
+            slowed_down: 0,
+        };
+        assert_eq!(expected, state.stats());
+    }
+
+    #[test]
+    fn slow_down_and_recover() {
+        let policy = OverloadPolicy::SlowDown {
+            max_bytes: usize::MAX,
+            max_factor: 4,
+        };
+        let state = Arc::new(OverloadState::new(policy));
+        let mut heavy = SourceOverload::new(state.clone());
+        let mut light = SourceOverload::new(state.clone());
+        heavy.record_rate(1000, Instant::now());
+        light.record_rate(10, Instant::now());
+
+        let mut buf = buffer(2);
+        assert_eq!(Some(2), heavy.overloaded(&mut buf, "heavy", true));
+        assert_eq!(Some(4), heavy.overloaded(&mut buf, "heavy", true));
+        assert_eq!(None, heavy.overloaded(&mut buf, "heavy", true), "max_factor must be respected");
+        assert_eq!(None, light.overloaded(&mut buf, "light", true), "light sources must not be slowed down");
+        assert_eq!(2, state.stats().slowed_down);
+        assert_eq!(2, state.stats().accumulated);
+
+        // recover progressively
+        for _ in 1..RECOVERY_FLUSHES {
+            assert_eq!(None, heavy.flushed(2));
+        }
+        assert_eq!(Some(2), heavy.flushed(2));
+        for _ in 1..RECOVERY_FLUSHES {
+            assert_eq!(None, heavy.flushed(2));
+        }
+        assert_eq!(Some(1), heavy.flushed(2));
+        assert_eq!(None, heavy.flushed(2));
+    }
+
+    #[test]
+    fn max_rate_over_window() {
+        let state = Arc::new(OverloadState::new(OverloadPolicy::default()));
+        let heavy = SourceOverload::new(state.clone());
+        let light = SourceOverload::new(state.clone());
+        let now = Instant::now();
+        heavy.record_rate(1000, now);
+
+        // the flushes of the other sources must not lower the maximum
+        for _ in 0..100 {
+            light.record_rate(10, now);
+        }
+        assert_eq!(1000, state.max_recent_rate(now));
+
+        // the rate of a source that has not flushed for a while is ignored
+        let later = now + RATE_WINDOW * 2;
+        light.record_rate(10, later);
+        assert_eq!(10, state.max_recent_rate(later));
+
+        // and so is the rate of a removed source
+        drop(light);
+        assert_eq!(0, state.max_recent_rate(later));
+    }
+}
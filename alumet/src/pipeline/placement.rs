@@ -0,0 +1,243 @@
+//! Placement of the pipeline threads on the CPUs.
+//!
+//! By default, the worker threads of the tokio runtimes can run on any CPU, and the OS scheduler moves them around.
+//! On machines with several CPU packages (sockets), the sources can then read the counters of a package from
+//! a core of another package, and the overhead of the measurement lands on the cores that the workload needs.
+//!
+//! [`PlacementConfig`] restricts each runtime to an explicit set of CPUs. It can also give each CPU package
+//! its own worker thread, pinned to the CPUs of the package, for the sources that measure this package
+//! (see [`TimeTriggerBuilder::on_package`](super::trigger::builder::TimeTriggerBuilder::on_package)).
+
+use std::collections::BTreeMap;
+use std::fmt::Write;
+use std::path::Path;
+
+use anyhow::{anyhow, Context};
+
+use super::threading;
+
+/// Directory that describes the CPUs in the sysfs.
+const SYSFS_CPU_DIR: &str = "/sys/devices/system/cpu";
+
+/// Configures the CPUs on which the tokio runtimes of the pipeline run.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct PlacementConfig {
+    /// Pins the worker threads of the normal runtime to these CPUs (empty means no pinning).
+    pub normal_cpus: Vec<usize>,
+    /// Pins the worker threads of the "realtime priority" runtime to these CPUs (empty means no pinning).
+    pub priority_cpus: Vec<usize>,
+    /// Runs the sources that measure a single CPU package on a thread that is pinned to the CPUs of this package.
+    ///
+    /// Each package that is measured by at least one source gets its own worker thread.
+    /// The other sources are not affected.
+    pub package_local_sources: bool,
+}
+
+/// Parses a list of CPUs in the format of the Linux kernel, for instance `0-3,8,10-11`.
+pub fn parse_cpu_list(list: &str) -> anyhow::Result<Vec<usize>> {
+    let mut cpus = Vec::new();
+    for item in list.trim().split(',').map(str::trim).filter(|item| !item.is_empty()) {
+        let parse = |n: &str| {
+            n.parse::<usize>()
+                .with_context(|| format!("invalid cpu list item: {item}"))
+        };
+        match item.split_once('-') {
+            Some((start, end)) => {
+                let (start, end) = (parse(start)?, parse(end)?);
+                if start > end {
+                    return Err(anyhow!("invalid cpu range: {item}"));
+                }
+                cpus.extend(start..=end);
+            }
+            None => cpus.push(parse(item)?),
+        }
+    }
+    Ok(cpus)
+}
+
+/// Formats a list of CPUs in the format of the Linux kernel, for instance `0-3,8,10-11`.
+pub fn format_cpu_list(cpus: &[usize]) -> String {
+    let mut sorted = cpus.to_vec();
+    sorted.sort_unstable();
+    sorted.dedup();
+
+    let mut res = String::new();
+    let mut i = 0;
+    while i < sorted.len() {
+        // find the end of the range of consecutive CPUs
+        let start = sorted[i];
+        let mut end = start;
+        while i + 1 < sorted.len() && sorted[i + 1] == end + 1 {
+            end += 1;
+            i += 1;
+        }
+        if !res.is_empty() {
+            res.push(',');
+        }
+        match end - start {
+            0 => write!(res, "{start}"),
+            _ => write!(res, "{start}-{end}"),
+        }
+        .unwrap();
+        i += 1;
+    }
+    res
+}
+
+/// Returns the online CPUs of each CPU package, sorted by package id.
+pub(crate) fn package_cpus() -> anyhow::Result<BTreeMap<u32, Vec<usize>>> {
+    read_package_cpus(Path::new(SYSFS_CPU_DIR))
+}
+
+fn read_package_cpus(cpu_dir: &Path) -> anyhow::Result<BTreeMap<u32, Vec<usize>>> {
+    let online_path = cpu_dir.join("online");
+    let online =
+        std::fs::read_to_string(&online_path).with_context(|| format!("failed to read {}", online_path.display()))?;
+    let mut packages: BTreeMap<u32, Vec<usize>> = BTreeMap::new();
+    for cpu in parse_cpu_list(&online)? {
+        let path = cpu_dir.join(format!("cpu{cpu}/topology/physical_package_id"));
+        let content = std::fs::read_to_string(&path).with_context(|| format!("failed to read {}", path.display()))?;
+        let package: u32 = content
+            .trim()
+            .parse()
+            .with_context(|| format!("invalid package id in {}: {content}", path.display()))?;
+        packages.entry(package).or_default().push(cpu);
+    }
+    Ok(packages)
+}
+
+/// The CPUs on which a runtime will actually run.
+pub(crate) struct EffectivePlacement {
+    /// The CPUs to give to [`threading::pin_current_thread_to`], empty if the threads must not be pinned.
+    pub cpus: Vec<usize>,
+    /// Human-readable description of the placement.
+    pub description: String,
+}
+
+impl EffectivePlacement {
+    /// Computes where the threads will run, if they are pinned to the `requested` CPUs.
+    ///
+    /// The kernel restricts the affinity of the threads to the CPUs that the process is allowed to use
+    /// (e.g. because of the cpuset of its cgroup), `allowed` is this set of CPUs, if known.
+    pub fn resolve(requested: &[usize], allowed: Option<&[usize]>) -> Self {
+        match (requested, allowed) {
+            ([], Some(allowed)) => EffectivePlacement {
+                cpus: Vec::new(),
+                description: format!("not pinned, allowed CPUs {}", format_cpu_list(allowed)),
+            },
+            ([], None) => EffectivePlacement {
+                cpus: Vec::new(),
+                description: String::from("not pinned"),
+            },
+            (requested, None) => EffectivePlacement {
+                cpus: requested.to_vec(),
+                description: format!("pinned to CPUs {}", format_cpu_list(requested)),
+            },
+            (requested, Some(allowed)) => {
+                let cpus: Vec<usize> = requested.iter().copied().filter(|cpu| allowed.contains(cpu)).collect();
+                let description = if cpus.is_empty() {
+                    format!(
+                        "not pinned, none of the requested CPUs {} is allowed (allowed CPUs {})",
+                        format_cpu_list(requested),
+                        format_cpu_list(allowed)
+                    )
+                } else if cpus.len() < requested.len() {
+                    format!(
+                        "pinned to CPUs {} (requested {}, some of them are not allowed)",
+                        format_cpu_list(&cpus),
+                        format_cpu_list(requested)
+                    )
+                } else {
+                    format!("pinned to CPUs {}", format_cpu_list(&cpus))
+                };
+                EffectivePlacement { cpus, description }
+            }
+        }
+    }
+}
+
+/// Pins the current worker thread to the given CPUs, if any.
+///
+/// Meant to be called by `on_thread_start`: failures are logged, the thread keeps running wherever the OS schedules it.
+pub(crate) fn pin_worker_thread(cpus: &[usize]) {
+    if cpus.is_empty() {
+        return;
+    }
+    let current_thread = std::thread::current();
+    let thread_name = current_thread.name().unwrap_or("<unnamed>");
+    match threading::pin_current_thread_to(cpus) {
+        Ok(()) => match threading::current_thread_affinity() {
+            Ok(effective) => log::debug!("Thread {thread_name} runs on CPUs {}.", format_cpu_list(&effective)),
+            Err(e) => log::debug!("Thread {thread_name} has been pinned, but its affinity cannot be read: {e}"),
+        },
+        Err(e) => log::warn!(
+            "Unable to pin thread {thread_name} to CPUs {}: {e}",
+            format_cpu_list(cpus)
+        ),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::collections::BTreeMap;
+
+    use crate::pipeline::testing::temp_dir;
+
+    use super::{format_cpu_list, parse_cpu_list, read_package_cpus, EffectivePlacement};
+
+    #[test]
+    fn cpu_list() {
+        assert_eq!(Vec::<usize>::new(), parse_cpu_list("").unwrap());
+        assert_eq!(vec![0], parse_cpu_list("0\n").unwrap());
+        assert_eq!(vec![0, 1, 2, 3, 8, 10, 11], parse_cpu_list("0-3,8,10-11").unwrap());
+        assert_eq!(vec![0, 64], parse_cpu_list("0, 64").unwrap());
+        assert!(parse_cpu_list("3-1").is_err());
+        assert!(parse_cpu_list("a").is_err());
+        assert!(parse_cpu_list("1-2-3").is_err());
+
+        assert_eq!("", format_cpu_list(&[]));
+        assert_eq!("5", format_cpu_list(&[5]));
+        assert_eq!("0-3,8,10-11", format_cpu_list(&[11, 0, 1, 2, 3, 8, 10, 2]));
+        for list in ["0", "0-3,8,10-11", "0,2,4,6", "16-31,48-63"] {
+            assert_eq!(list, format_cpu_list(&parse_cpu_list(list).unwrap()));
+        }
+    }
+
+    #[test]
+    fn effective_placement() {
+        let allowed: Vec<usize> = (0..8).collect();
+
+        let p = EffectivePlacement::resolve(&[], Some(&allowed));
+        assert!(p.cpus.is_empty());
+        assert_eq!("not pinned, allowed CPUs 0-7", p.description);
+
+        let p = EffectivePlacement::resolve(&[6, 7, 8, 9], Some(&allowed));
+        assert_eq!(vec![6, 7], p.cpus);
+
+        let p = EffectivePlacement::resolve(&[12, 13], Some(&allowed));
+        assert!(p.cpus.is_empty());
+
+        let p = EffectivePlacement::resolve(&[2, 3], None);
+        assert_eq!(vec![2, 3], p.cpus);
+        assert_eq!("pinned to CPUs 2-3", p.description);
+    }
+
+    #[test]
+    fn package_topology() {
+        let root = temp_dir("topology");
+        for (cpu, package) in [(0, 0), (1, 1), (2, 0), (3, 1)] {
+            let dir = root.join(format!("cpu{cpu}/topology"));
+            std::fs::create_dir_all(&dir).unwrap();
+            std::fs::write(dir.join("physical_package_id"), format!("{package}\n")).unwrap();
+        }
+        std::fs::write(root.join("online"), "0-3\n").unwrap();
+
+        let packages = read_package_cpus(&root).unwrap();
+        assert_eq!(BTreeMap::from([(0, vec![0, 2]), (1, vec![1, 3])]), packages);
+
+        // a CPU that is online but has no topology
+        std::fs::write(root.join("online"), "0-4\n").unwrap();
+        assert!(read_package_cpus(&root).is_err());
+        std::fs::remove_dir_all(&root).unwrap();
+    }
+}
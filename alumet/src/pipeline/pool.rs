@@ -0,0 +1,197 @@
+//! Recycling of measurement buffers.
+//!
+//! Every flush of a managed source sends its [`MeasurementBuffer`] to the rest of the pipeline,
+//! and the source needs a new buffer for the next measurements.
+//! Instead of allocating a new buffer each time, the sources take their buffers from a pool.
+//! Once every output is done with a buffer, its memory is cleared and handed back
+//! to the source that produced it, with its capacity intact.
+
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+
+use crate::measurement::{MeasurementBuffer, MeasurementPoint};
+
+/// Maximum number of free buffers kept by each source.
+///
+/// In the steady state, a source gets one buffer back for each buffer that it sends,
+/// so a small number is enough to absorb the jitter of the outputs.
+const MAX_FREE_BUFFERS: usize = 4;
+
+/// Counts how the buffer pool has been used, since the start of the pipeline.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct BufferPoolStats {
+    /// Number of buffers that have been reused.
+    pub hits: u64,
+    /// Number of buffers that have been allocated because no buffer was available.
+    pub misses: u64,
+    /// Number of buffers that have been given back to their source after use.
+    pub recycled: u64,
+    /// Number of buffers that have been freed because their source already had enough free buffers.
+    pub discarded: u64,
+}
+
+/// Buffer pool of a pipeline.
+///
+/// The buffers are stored per source (see [`SourceBufferPool`]), this struct holds the counters.
+#[derive(Default)]
+pub(crate) struct BufferPool {
+    hits: AtomicU64,
+    misses: AtomicU64,
+    recycled: AtomicU64,
+    discarded: AtomicU64,
+}
+
+impl BufferPool {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Returns a snapshot of the counters.
+    pub fn stats(&self) -> BufferPoolStats {
+        BufferPoolStats {
+            hits: self.hits.load(Ordering::Relaxed),
+            misses: self.misses.load(Ordering::Relaxed),
+            recycled: self.recycled.load(Ordering::Relaxed),
+            discarded: self.discarded.load(Ordering::Relaxed),
+        }
+    }
+}
+
+/// Free buffers of a single source.
+pub(crate) struct SourceBufferPool {
+    shared: Arc<BufferPool>,
+    free: Mutex<Vec<Vec<MeasurementPoint>>>,
+}
+
+impl SourceBufferPool {
+    pub fn new(shared: Arc<BufferPool>) -> Arc<Self> {
+        Arc::new(Self {
+            shared,
+            free: Mutex::new(Vec::with_capacity(MAX_FREE_BUFFERS)),
+        })
+    }
+
+    /// Returns an empty buffer with at least the given capacity.
+    ///
+    /// When the buffer is dropped, its memory goes back to this pool.
+    pub fn take(self: &Arc<Self>, capacity: usize) -> MeasurementBuffer {
+        let recycled = self.free.lock().unwrap().pop();
+        let points = match recycled {
+            Some(mut points) => {
+                self.shared.hits.fetch_add(1, Ordering::Relaxed);
+                points.reserve(capacity);
+                points
+            }
+            None => {
+                self.shared.misses.fetch_add(1, Ordering::Relaxed);
+                Vec::with_capacity(capacity)
+            }
+        };
+        MeasurementBuffer::recyclable(points, self.clone())
+    }
+
+    /// Gives the memory of a buffer back to the pool.
+    ///
+    /// This is called when the last reference to the buffer is dropped, usually by an output.
+    pub fn recycle(&self, mut points: Vec<MeasurementPoint>) {
+        points.clear();
+        let mut free = self.free.lock().unwrap();
+        if free.len() < MAX_FREE_BUFFERS {
+            free.push(points);
+            self.shared.recycled.fetch_add(1, Ordering::Relaxed);
+        } else {
+            drop(free);
+            self.shared.discarded.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::Arc;
+
+    use crate::{
+        measurement::{MeasurementPoint, Timestamp, WrappedMeasurementValue},
+        metrics::RawMetricId,
+        resources::{ResourceConsumer, ResourceId},
+    };
+
+    use super::{BufferPool, BufferPoolStats, SourceBufferPool, MAX_FREE_BUFFERS};
+
+    fn point() -> MeasurementPoint {
+        MeasurementPoint::new_untyped(
+            Timestamp::now(),
+            RawMetricId(0),
+            ResourceId::LOCAL_MACHINE,
+            ResourceConsumer::LocalMachine,
+            WrappedMeasurementValue::U64(1),
+        )
+    }
+
+    #[test]
+    fn recycle_on_drop() {
+        let shared = Arc::new(BufferPool::new());
+        let pool = SourceBufferPool::new(shared.clone());
+
+        let mut buf = pool.take(8);
+        for _ in 0..100 {
+            buf.push(point());
+        }
+        // shared with the outputs, like in the pipeline
+        let buf = Arc::new(buf);
+        let for_output = buf.clone();
+        drop(buf);
+        assert_eq!(0, shared.stats().recycled, "the buffer must not be recycled before the last output is done");
+        drop(for_output);
+
+        let buf = pool.take(8);
+        assert!(buf.is_empty());
+        assert!(buf.capacity() >= 100, "the capacity must be kept");
+        let expected = BufferPoolStats {
+            hits: 1,
+            misses: 1,
+            recycled: 1,
+            discarded: 0,
+        };
+        assert_eq!(expected, shared.stats());
+
+        // a clone does not go back to the pool
+        drop(buf.clone());
+        assert_eq!(1, shared.stats().recycled);
+    }
+
+    #[test]
+    fn merge_keeps_capacity() {
+        let shared = Arc::new(BufferPool::new());
+        let pool_a = SourceBufferPool::new(shared.clone());
+        let pool_b = SourceBufferPool::new(shared.clone());
+
+        let mut batch = pool_a.take(4);
+        let mut other = pool_b.take(4);
+        for _ in 0..4 {
+            batch.push(point());
+            other.push(point());
+        }
+        let capacity = batch.capacity();
+        batch.merge(&mut other);
+        assert_eq!(8, batch.len());
+        drop(other);
+        assert_eq!(2, shared.stats().recycled, "the merge must recycle the batch");
+        drop(batch);
+        assert_eq!(2, shared.stats().recycled, "the merged batch is not recycled");
+
+        let buf = pool_a.take(4);
+        assert_eq!(capacity, buf.capacity(), "the pool must get the original buffer back");
+    }
+
+    #[test]
+    fn bounded() {
+        let shared = Arc::new(BufferPool::new());
+        let pool = SourceBufferPool::new(shared.clone());
+        let buffers: Vec<_> = (0..MAX_FREE_BUFFERS + 2).map(|_| pool.take(1)).collect();
+        drop(buffers);
+        let stats = shared.stats();
+        assert_eq!(MAX_FREE_BUFFERS as u64, stats.recycled);
+        assert_eq!(2, stats.discarded);
+    }
+}
@@ -0,0 +1,192 @@
+//! Per-output queues.
+//!
+//! The transform step sends every batch of measurements to the queue of each output.
+//! Each output has its own bounded queue, which is drained by the task of the output:
+//! a slow output fills its own queue, without slowing down the other outputs.
+//! When the queue of an output is full, its [`OverflowPolicy`] decides what happens to the measurements.
+
+use std::path::PathBuf;
+use std::sync::Arc;
+
+use crate::measurement::MeasurementBuffer;
+use crate::metrics::MetricRegistry;
+
+use super::spill::{output_dir_name, SpillQueue};
+use super::telemetry::ElementStats;
+use super::worker::QueueDepth;
+
+/// What to do when the queue of an output is full.
+#[derive(Debug, Clone, PartialEq, Eq, Default)]
+pub enum OverflowPolicy {
+    /// Drop the oldest measurements of the queue.
+    #[default]
+    DropOldest,
+    /// Drop the new measurements.
+    DropNewest,
+    /// Wait for some room in the queue.
+    ///
+    /// No measurement is lost, but a slow output blocks the transforms, and therefore every other output.
+    Block,
+    /// Move the oldest measurements of the queue to the disk.
+    ///
+    /// The measurements are written to the output, in order, once it catches up. When the output stops,
+    /// it writes its queue for a short time, and the rest is kept on the disk and written after a restart.
+    Spill {
+        /// Directory where the queues are saved (in a subdirectory of each output).
+        directory: PathBuf,
+        /// Maximum number of bytes on the disk, for each output.
+        /// When the quota is exceeded, the oldest measurements are deleted.
+        max_disk_bytes: u64,
+    },
+}
+
+/// The measurements that are waiting to be written to an output.
+pub(crate) struct OutputQueue {
+    queue: SpillQueue,
+    capacity: usize,
+    policy: OverflowPolicy,
+    depth: QueueDepth,
+    stats: Arc<ElementStats>,
+}
+
+impl OutputQueue {
+    pub fn new(
+        output_name: &str,
+        capacity: usize,
+        policy: OverflowPolicy,
+        depth: QueueDepth,
+        stats: Arc<ElementStats>,
+    ) -> Self {
+        let capacity = capacity.max(1);
+        let directory = match &policy {
+            OverflowPolicy::Spill {
+                directory,
+                max_disk_bytes,
+            } => Some((
+                directory.join(output_dir_name(output_name)).join("queue"),
+                *max_disk_bytes,
+            )),
+            _ => None,
+        };
+        let queue = SpillQueue::open(format!("queue of output {output_name}"), capacity, directory);
+        Self {
+            queue,
+            capacity,
+            policy,
+            depth,
+            stats,
+        }
+    }
+
+    /// Returns `true` if the queue accepts new measurements right now.
+    ///
+    /// With [`OverflowPolicy::Block`], the queue does not accept measurements when it is full,
+    /// which eventually blocks the transforms. The other policies always accept new measurements.
+    pub fn can_accept(&self) -> bool {
+        self.policy != OverflowPolicy::Block || self.queue.memory_len() < self.capacity
+    }
+
+    /// Adds some measurements at the end of the queue, or drops some measurements if the queue is full.
+    pub fn push(&mut self, measurements: Arc<MeasurementBuffer>, metrics: &MetricRegistry) {
+        let before = self.queue.memory_len();
+        if self.policy == OverflowPolicy::DropNewest && before >= self.capacity {
+            log::warn!(
+                "The queue of an output is full, the newest measurements ({} points) are lost.",
+                measurements.len()
+            );
+            self.stats.dropped(1);
+            return;
+        }
+        // The SpillQueue drops the oldest measurements or moves them to the disk.
+        let lost = self.queue.push(measurements, metrics);
+        self.stats.dropped(lost);
+        self.update_depth(before);
+    }
+
+    /// Returns the oldest measurements of the queue, without removing them.
+    pub fn front(&mut self, metrics: &MetricRegistry) -> Option<Arc<MeasurementBuffer>> {
+        self.queue.front(metrics)
+    }
+
+    /// Removes the oldest measurements of the queue, once they have been given to the output.
+    pub fn pop_front(&mut self) {
+        let before = self.queue.memory_len();
+        self.queue.pop_front();
+        self.update_depth(before);
+    }
+
+    /// Returns `true` if the measurements that remain in the queue can be saved to the disk
+    /// instead of being written when the output stops.
+    pub fn can_persist(&self) -> bool {
+        self.queue.has_disk()
+    }
+
+    /// Saves the measurements that remain in the queue to the disk.
+    pub fn persist(&mut self, metrics: &MetricRegistry) {
+        let before = self.queue.memory_len();
+        self.queue.persist(metrics);
+        self.update_depth(before);
+    }
+
+    fn update_depth(&self, before: usize) {
+        let after = self.queue.memory_len();
+        if after > before {
+            self.depth.add(after - before);
+        } else {
+            self.depth.sub(before - after);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::pipeline::testing::{buffer, registry, temp_dir};
+    use crate::pipeline::worker::QueueDepth;
+
+    use super::{OutputQueue, OverflowPolicy};
+
+    fn fill(policy: OverflowPolicy) -> (Vec<usize>, QueueDepth) {
+        let (registry, metric) = registry();
+        let depth = QueueDepth::default();
+        let mut queue = OutputQueue::new("test", 3, policy, depth.clone(), Default::default());
+        for n in 1..=5 {
+            if queue.can_accept() {
+                queue.push(buffer(metric, n), &registry);
+            }
+        }
+        assert_eq!(3, depth.get());
+        let content = std::iter::from_fn(|| {
+            let front = queue.front(&registry)?;
+            queue.pop_front();
+            Some(front.len())
+        });
+        let content = content.collect();
+        (content, depth)
+    }
+
+    #[test]
+    fn overflow_policies() {
+        let (content, depth) = fill(OverflowPolicy::DropOldest);
+        assert_eq!(vec![3, 4, 5], content);
+        assert_eq!(0, depth.get());
+
+        let (content, _) = fill(OverflowPolicy::DropNewest);
+        assert_eq!(vec![1, 2, 3], content);
+
+        let (content, _) = fill(OverflowPolicy::Block);
+        assert_eq!(vec![1, 2, 3], content);
+    }
+
+    #[test]
+    fn spill_to_disk() {
+        let dir = temp_dir("queue-spill");
+        let (content, depth) = fill(OverflowPolicy::Spill {
+            directory: dir.clone(),
+            max_disk_bytes: 1024 * 1024,
+        });
+        // nothing is lost, and the spilled measurements come first
+        assert_eq!(vec![1, 2, 3, 4, 5], content);
+        assert_eq!(0, depth.get());
+        std::fs::remove_dir_all(dir).unwrap();
+    }
+}
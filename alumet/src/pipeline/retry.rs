@@ -0,0 +1,207 @@
+//! Retry of the failed writes.
+//!
+//! When an output fails to write some measurements with [`WriteError::CanRetry`](super::WriteError::CanRetry),
+//! the measurements are not lost: they go into the retry queue of the output, and are written again later,
+//! with an exponential backoff between the attempts. Once a write has failed, the new measurements
+//! also go into the queue, behind the failed ones, so that the output receives them in order when it recovers.
+//!
+//! The queue is a [`SpillQueue`]: when a directory is configured, it spills to the disk, it is saved
+//! when the output stops and it is reloaded when the output starts again.
+
+use std::path::PathBuf;
+use std::sync::Arc;
+use std::time::Duration;
+
+use tokio::time::Instant;
+
+use crate::measurement::MeasurementBuffer;
+use crate::metrics::MetricRegistry;
+
+use super::spill::{output_dir_name, SpillQueue};
+
+/// Configures the retry queue of each output.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct RetryConfig {
+    /// Maximum number of measurement buffers kept in memory.
+    ///
+    /// When the memory queue is full, the oldest buffers are moved to the disk if `directory` is set,
+    /// and dropped otherwise. Set it to zero to disable the retries.
+    pub max_memory_buffers: usize,
+
+    /// Directory where the queues are saved (in a subdirectory of each output).
+    ///
+    /// If `None`, the queues only live in memory and are lost when the outputs stop.
+    pub directory: Option<PathBuf>,
+
+    /// Maximum number of bytes on the disk, for each output.
+    ///
+    /// When the quota is exceeded, the oldest measurements are deleted.
+    pub max_disk_bytes: u64,
+
+    /// Delay before the first retry.
+    pub initial_backoff: Duration,
+
+    /// Maximum delay between two retries.
+    pub max_backoff: Duration,
+}
+
+impl Default for RetryConfig {
+    fn default() -> Self {
+        Self {
+            max_memory_buffers: 64,
+            directory: None,
+            max_disk_bytes: 256 * 1024 * 1024,
+            initial_backoff: Duration::from_secs(1),
+            max_backoff: Duration::from_secs(300),
+        }
+    }
+}
+
+/// The failed writes of an output, waiting to be retried.
+pub(crate) struct RetryQueue {
+    name: String,
+    enabled: bool,
+    queue: SpillQueue,
+    backoff: Duration,
+    initial_backoff: Duration,
+    max_backoff: Duration,
+    next_attempt: Option<Instant>,
+}
+
+impl RetryQueue {
+    /// Creates the retry queue of an output, and loads the buffers that have been saved by a previous run.
+    pub fn open(config: &RetryConfig, output_name: &str) -> Self {
+        let directory = config
+            .directory
+            .as_ref()
+            .map(|dir| (dir.join(output_dir_name(output_name)).join("retry"), config.max_disk_bytes));
+        let queue = SpillQueue::open(
+            format!("retry queue of output {output_name}"),
+            config.max_memory_buffers,
+            directory,
+        );
+        let mut retry = Self {
+            name: output_name.to_owned(),
+            enabled: config.max_memory_buffers > 0,
+            queue,
+            backoff: config.initial_backoff,
+            initial_backoff: config.initial_backoff,
+            max_backoff: config.max_backoff.max(config.initial_backoff),
+            next_attempt: None,
+        };
+        if !retry.is_empty() {
+            log::info!(
+                "Output {output_name} has {} bytes of measurements to write from a previous run.",
+                retry.queue.disk_bytes()
+            );
+            retry.next_attempt = Some(Instant::now());
+        }
+        retry
+    }
+
+    /// Returns `true` if the failed writes are retried.
+    pub fn is_enabled(&self) -> bool {
+        self.enabled
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.queue.is_empty()
+    }
+
+    /// When to write the oldest buffer again, if the queue is not empty.
+    pub fn next_attempt(&self) -> Option<Instant> {
+        self.next_attempt
+    }
+
+    /// Adds some measurements at the end of the queue.
+    ///
+    /// Use this for the measurements that could not be written, and for all the new measurements
+    /// as long as the queue is not empty.
+    pub fn push(&mut self, measurements: Arc<MeasurementBuffer>, metrics: &MetricRegistry) {
+        if !self.enabled {
+            return;
+        }
+        if self.is_empty() {
+            self.next_attempt = Some(Instant::now() + self.backoff);
+        }
+        self.queue.push(measurements, metrics);
+    }
+
+    /// Returns the oldest buffer of the queue, without removing it.
+    pub fn front(&mut self, metrics: &MetricRegistry) -> Option<Arc<MeasurementBuffer>> {
+        let front = self.queue.front(metrics);
+        if front.is_none() {
+            self.next_attempt = None;
+        }
+        front
+    }
+
+    /// Removes the oldest buffer of the queue, after a successful write.
+    pub fn pop_front(&mut self) {
+        self.queue.pop_front();
+        self.backoff = self.initial_backoff;
+        // replay the rest of the queue without waiting
+        self.next_attempt = (!self.is_empty()).then(Instant::now);
+    }
+
+    /// Schedules the next attempt after a failed retry.
+    pub fn failed(&mut self) {
+        self.backoff = (self.backoff * 2).min(self.max_backoff);
+        self.next_attempt = Some(Instant::now() + self.backoff);
+        log::debug!("Output {} will retry to write in {:?}", self.name, self.backoff);
+    }
+
+    /// Saves the buffers in memory to the disk, so that they can be written after a restart.
+    pub fn persist(&mut self, metrics: &MetricRegistry) {
+        self.queue.persist(metrics);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::time::Duration;
+
+    use crate::pipeline::testing::{buffer, registry, temp_dir};
+
+    use super::{RetryConfig, RetryQueue};
+
+    #[test]
+    fn spill_and_reload_in_order() {
+        let (registry, metric) = registry();
+        let dir = temp_dir("retry-reload");
+        let config = RetryConfig {
+            max_memory_buffers: 2,
+            directory: Some(dir.clone()),
+            initial_backoff: Duration::from_millis(1),
+            ..Default::default()
+        };
+
+        // 5 buffers: 3 spilled to the disk, 2 saved when stopping
+        let mut queue = RetryQueue::open(&config, "test/output");
+        for n in 1..=5 {
+            queue.push(buffer(metric, n), &registry);
+        }
+        assert_eq!(Some(1), queue.front(&registry).map(|b| b.len()));
+        queue.pop_front();
+        queue.persist(&registry);
+        drop(queue);
+
+        // the queue survives a restart
+        let mut queue = RetryQueue::open(&config, "test/output");
+        assert!(!queue.is_empty());
+        assert!(queue.next_attempt().is_some());
+        let mut lengths = Vec::new();
+        while let Some(buf) = queue.front(&registry) {
+            lengths.push(buf.len());
+            queue.pop_front();
+        }
+        assert_eq!(vec![2, 3, 4, 5], lengths);
+        assert!(queue.is_empty());
+        assert!(queue.next_attempt().is_none());
+        drop(queue);
+
+        let queue = RetryQueue::open(&config, "test/output");
+        assert!(queue.is_empty());
+        std::fs::remove_dir_all(dir).unwrap();
+    }
+}
@@ -1,33 +1,40 @@
 //! Implementation of the measurement pipeline.
 
-use std::collections::HashMap;
+use std::collections::{BTreeMap, HashMap};
 use std::ops::BitOrAssign;
 use std::sync::atomic::{AtomicU64, Ordering};
 use std::sync::Arc;
-use std::time::Duration;
+use std::time::{Duration, Instant};
 
 use anyhow::{anyhow, Context};
 
 use tokio::sync::mpsc::error::TrySendError;
 use tokio::sync::mpsc::{UnboundedReceiver, UnboundedSender};
-use tokio::sync::{broadcast, mpsc};
+use tokio::sync::mpsc;
 use tokio::task::{JoinError, JoinHandle, JoinSet};
 use tokio::time::timeout;
 use tokio::{runtime::Runtime, sync::watch};
 use tokio_util::sync::CancellationToken;
 
 use crate::measurement::Timestamp;
-use crate::metrics::{Metric, RawMetricId};
-use crate::pipeline::scoped;
+use crate::resources::ResourceRegistry;
 use crate::pipeline::trigger::TriggerReason;
 use crate::{
     measurement::MeasurementBuffer,
-    metrics::MetricRegistry,
-    pipeline::{Output, Source},
+    metrics::{MetricRegistry, SharedMetricRegistry},
+    pipeline::Source,
 };
 
 use super::builder;
-use super::builder::{ConfiguredTransform, ElementType};
+use super::builder::{ConfiguredTransform, ElementType, OutputKind};
+use super::batch::BatchConfig;
+use super::group::{GroupMember, TriggerGroups};
+use super::inflight::InFlightWrites;
+use super::queue::OutputQueue;
+use super::worker::{OutputWorker, OutputWorkerConfig, OutputWorkerSettings};
+use super::overload::{OverloadState, OverloadStats, SourceOverload};
+use super::pool::{BufferPool, BufferPoolStats, SourceBufferPool};
+use super::telemetry::{PipelineStats, SourceStats, SourceTiming};
 use super::trigger::{Trigger, TriggerSpec};
 use super::{OutputContext, PollError, TransformError, WriteError};
 
@@ -39,21 +46,39 @@ pub struct IdlePipeline {
     pub(super) outputs: Vec<builder::ConfiguredOutput>,
     pub(super) autonomous_sources: Vec<builder::ConfiguredAutonomousSource>,
 
+    /// Names of the elements, to give unique names to the sources added at runtime.
+    pub(super) namegen: builder::ElementNameGenerator,
+
     // Cancellation token to implement the graceful shutdown of autonomous sources.
     pub(super) autonomous_shutdown_token: CancellationToken,
 
     // tokio Runtimes that execute the tasks
     pub(super) rt_normal: Runtime,
     pub(super) rt_priority: Option<Runtime>,
+    /// Runtimes of the sources that run on the CPU package they measure, by package id.
+    pub(super) rt_packages: BTreeMap<u32, Runtime>,
 
     // registries
-    pub(super) metrics: MetricRegistry,
+    pub(super) metrics: Arc<SharedMetricRegistry>,
+    pub(super) resources: Arc<ResourceRegistry>,
+
+    /// How the sources react to an overload of the pipeline.
+    pub(super) overload: Arc<OverloadState>,
+
+    /// Recycles the buffers of the sources.
+    pub(super) buffer_pool: Arc<BufferPool>,
+
+    /// How the transform step merges the measurements of the sources.
+    pub(super) batching: BatchConfig,
+
+    /// How the outputs run on their threads.
+    pub(super) output_workers: OutputWorkerConfig,
+
+    /// Statistics of the elements, for the self-telemetry.
+    pub(super) stats: Arc<PipelineStats>,
 
     /// Channel: source -> transforms
     pub(super) from_sources: (mpsc::Sender<MeasurementBuffer>, mpsc::Receiver<MeasurementBuffer>),
-
-    /// Broadcast queue to outputs
-    pub(super) to_outputs: broadcast::Sender<OutputMsg>,
 }
 
 /// A message to control the pipeline.
@@ -65,6 +90,11 @@ enum ControlMessage {
         source: Box<dyn Source>,
         trigger: TriggerSpec,
     },
+    RemoveSource {
+        plugin_name: String,
+        /// The name of the source, or `None` to remove all the sources of the plugin.
+        source_name: Option<String>,
+    },
     ModifySource(ElementCommand<SourceCmd>),
     ModifyTransform(ElementCommand<TransformCmd>),
     ModifyOutput(ElementCommand<OutputCmd>),
@@ -91,6 +121,7 @@ pub struct RunningPipeline {
     // Keep the tokio runtimes alive
     _rt_normal: Runtime,
     _rt_priority: Option<Runtime>,
+    _rt_packages: BTreeMap<u32, Runtime>,
 
     /// Handle to the task that handles the shutdown of the pipeline.
     ///
@@ -99,6 +130,12 @@ pub struct RunningPipeline {
 
     /// Controls the pipeline.
     control_handle: ControlHandle,
+
+    /// Overload handling, shared by the sources.
+    overload: Arc<OverloadState>,
+
+    /// Buffer recycling, shared by the sources.
+    buffer_pool: Arc<BufferPool>,
 }
 
 struct PipelineControllerState {
@@ -106,7 +143,7 @@ struct PipelineControllerState {
     global_shutdown_send: UnboundedSender<()>,
 
     // Senders to keep the receivers alive and to send commands.
-    source_command_senders_by_plugin: HashMap<String, Vec<watch::Sender<SourceCmd>>>,
+    source_command_senders_by_plugin: HashMap<String, Vec<SourceCommandSender>>,
     output_command_senders_by_plugin: HashMap<String, Vec<watch::Sender<OutputCmd>>>,
 
     /// Currently active transforms.
@@ -122,10 +159,29 @@ struct PipelineControllerState {
     modifier: PipelineModifierState,
 }
 
+impl PipelineControllerState {
+    /// Forgets the command senders of the sources that have stopped on their own, after a fatal error.
+    ///
+    /// A source drops its command receiver when it stops, which closes the corresponding sender.
+    fn forget_stopped_sources(&mut self) {
+        for senders in self.source_command_senders_by_plugin.values_mut() {
+            senders.retain(|s| {
+                let stopped = s.tx.is_closed();
+                if stopped {
+                    log::debug!("Source {} has stopped, forgetting it.", s.name);
+                    self.modifier.namegen.release(&s.name);
+                }
+                !stopped
+            });
+        }
+    }
+}
+
 /// Things necessary for modifying the pipeline at runtime,
 /// that is, adding or removing pipeline elements.
 struct PipelineModifierState {
-    /// Name generator for the new sources.
+    /// Names of the elements of the pipeline, including the sources added at startup.
+    /// The name of a source is released when it is removed or when it stops on its own.
     namegen: builder::ElementNameGenerator,
 
     /// All the JoinSets of the running pipeline.
@@ -134,8 +190,63 @@ struct PipelineModifierState {
     /// Sends measurements from Sources.
     in_tx: mpsc::Sender<MeasurementBuffer>,
 
+    /// Overload handling, shared by the sources.
+    overload: Arc<OverloadState>,
+
+    /// Buffer recycling, shared by the sources.
+    buffer_pool: Arc<BufferPool>,
+
+    /// Statistics of the elements, the new sources register their own.
+    stats: Arc<PipelineStats>,
+
+    /// Sources that are polled together, from a single timer.
+    trigger_groups: TriggerGroups,
+
     /// Handle to the tokio runtime with "normal" threads.
     rt_normal: tokio::runtime::Handle,
+
+    /// Handle to the tokio runtime with high-priority threads, if any.
+    rt_priority: Option<tokio::runtime::Handle>,
+
+    /// Handles to the runtimes pinned to a CPU package, by package id.
+    rt_packages: BTreeMap<u32, tokio::runtime::Handle>,
+}
+
+/// Chooses the runtime that executes a managed source, according to its trigger.
+///
+/// Sources that are bound to a CPU package run on that package, realtime sources run on the
+/// high-priority threads (when they are available) and the other sources run on the normal threads.
+fn source_runtime<'a, R>(
+    trigger: &TriggerSpec,
+    rt_normal: &'a R,
+    rt_priority: Option<&'a R>,
+    rt_packages: &'a BTreeMap<u32, R>,
+) -> &'a R {
+    match trigger.package.and_then(|p| rt_packages.get(&p)) {
+        Some(rt_package) => rt_package,
+        None if trigger.realtime_priority => rt_priority.unwrap_or(rt_normal),
+        None => rt_normal,
+    }
+}
+
+/// Sends commands to a managed source.
+struct SourceCommandSender {
+    /// Full name of the source, i.e. `plugin/source`.
+    name: String,
+    tx: watch::Sender<SourceCmd>,
+}
+
+impl SourceCommandSender {
+    /// Sends a command to the source. Returns `false` if the source has stopped.
+    fn send(&self, command: &SourceCmd) -> bool {
+        match self.tx.send(command.clone()) {
+            Ok(()) => true,
+            Err(_) => {
+                log::debug!("Source {} has stopped, it does not receive {command:?}.", self.name);
+                false
+            }
+        }
+    }
 }
 
 #[derive(Clone)]
@@ -144,15 +255,19 @@ pub struct ControlHandle {
     ///
     /// Closed when the pipeline shuts down.
     tx: mpsc::Sender<ControlMessage>,
+
+    /// Statistics of the elements, readable without going through the control task.
+    stats: Arc<PipelineStats>,
 }
 
 impl IdlePipeline {
     pub fn metric_count(&self) -> usize {
-        self.metrics.len()
+        self.metrics.snapshot().len()
     }
 
-    pub fn metric_iter(&self) -> crate::metrics::MetricIter<'_> {
-        self.metrics.iter()
+    /// Returns the current state of the metric registry.
+    pub fn metrics(&self) -> Arc<MetricRegistry> {
+        self.metrics.snapshot()
     }
 
     /// Starts the measurement pipeline.
@@ -172,14 +287,18 @@ impl IdlePipeline {
         let (in_tx, in_rx) = self.from_sources;
 
         // 1. Outputs
-        for out in self.outputs {
-            let msg_rx = self.to_outputs.subscribe();
+        let mut to_outputs = Vec::with_capacity(self.outputs.len());
+        for (i, out) in self.outputs.into_iter().enumerate() {
+            // Each output has its own channel, which is drained into the queue of the output by its task.
+            let (msg_tx, msg_rx) = mpsc::channel::<OutputMsg>(OUTPUT_CHANNEL_CAPACITY);
+            to_outputs.push(msg_tx);
             let (command_tx, command_rx) = watch::channel(OutputCmd::Run);
             let ctx = OutputContext {
-                // Each output task owns its OutputContext, which contains a copy of the MetricRegistry.
-                // This allows fast, uncontended access to the registry, and avoids a global state (no Arc<Mutex<...>>).
-                // The cost is a duplication of the registry (increased memory use) in the case where multiple outputs exist.
-                metrics: self.metrics.clone(),
+                // Each output task owns its OutputContext, which contains a snapshot of the MetricRegistry.
+                // The snapshot is shared by all the outputs, and is only replaced when new metrics are registered.
+                // This allows fast, uncontended access to the registry, without duplicating it.
+                metrics: self.metrics.snapshot(),
+                resources: self.resources.clone(),
             };
 
             // Store command_tx so that we can accept commands later (commands can target the outputs of a specific plugin).
@@ -189,7 +308,25 @@ impl IdlePipeline {
                 .push(command_tx);
 
             // Spawn the task in the JoinSet.
-            let task = run_output_from_broadcast(out.name, out.output, msg_rx, command_rx, ctx);
+            let cpus = &self.output_workers.cpus;
+            let worker = OutputWorkerSettings {
+                queue_capacity: self.output_workers.queue_capacity,
+                overflow: self.output_workers.overflow.clone(),
+                cpu: (!cpus.is_empty()).then(|| cpus[i % cpus.len()]),
+                max_in_flight: self.output_workers.max_in_flight,
+                retry: self.output_workers.retry.clone(),
+                queue_depth: out.queue_depth,
+                stats: out.stats,
+            };
+            let task = run_output(
+                out.name,
+                out.output,
+                msg_rx,
+                command_rx,
+                ctx,
+                self.metrics.clone(),
+                worker,
+            );
             output_set.spawn_on(task, self.rt_normal.handle());
         }
 
@@ -202,24 +339,62 @@ impl IdlePipeline {
                 .or_default()
                 .bitor_assign(mask);
         }
-        let transforms_task = run_transforms(self.transforms, in_rx, self.to_outputs, active_transforms.clone());
+        let transforms_task = run_transforms(
+            self.transforms,
+            in_rx,
+            to_outputs,
+            active_transforms.clone(),
+            self.batching,
+        );
         transform_set.spawn_on(transforms_task, self.rt_normal.handle());
 
         // 3. Managed sources
+        let mut trigger_groups = TriggerGroups::new();
         for src in self.sources {
             let data_tx = in_tx.clone();
-            let runtime = match src.trigger_provider.realtime_priority {
-                true => self.rt_priority.as_ref().unwrap_or(&self.rt_normal),
-                false => &self.rt_normal,
-            };
+            let runtime = source_runtime(
+                &src.trigger_provider,
+                &self.rt_normal,
+                self.rt_priority.as_ref(),
+                &self.rt_packages,
+            );
+            let group_key = src.trigger_provider.group_key();
+            let spec = src.trigger_provider.clone();
             let (command_tx, command_rx) = watch::channel(SourceCmd::SetTrigger(Some(src.trigger_provider)));
+            let stats = self.stats.source(&src.plugin_name, &src.name);
             source_command_senders_by_plugin
                 .entry(src.plugin_name)
                 .or_default()
-                .push(command_tx);
-
-            let task = run_source(src.name, src.source, data_tx, command_rx);
-            source_set.spawn_on(task, runtime.handle());
+                .push(SourceCommandSender {
+                    name: src.name.clone(),
+                    tx: command_tx,
+                });
+
+            if let Some(key) = group_key {
+                // Poll the source with the other sources of its group, from a single task.
+                let member = GroupMember {
+                    stats,
+                    name: src.name,
+                    source: src.source,
+                    commands: command_rx,
+                };
+                let overload = self.overload.clone();
+                let buffer_pool = self.buffer_pool.clone();
+                if let Some(task) = trigger_groups.add(key, spec, member, data_tx, overload, buffer_pool) {
+                    source_set.spawn_on(task, runtime.handle());
+                }
+            } else {
+                let task = run_source(
+                    stats,
+                    src.name,
+                    src.source,
+                    data_tx,
+                    command_rx,
+                    self.overload.clone(),
+                    self.buffer_pool.clone(),
+                );
+                source_set.spawn_on(task, runtime.handle());
+            }
         }
 
         // 4. Autonomous sources
@@ -255,13 +430,26 @@ impl IdlePipeline {
             transforms_mask_by_plugin,
             autonomous_shutdown_token: self.autonomous_shutdown_token,
             modifier: PipelineModifierState {
-                namegen: builder::ElementNameGenerator::new(),
+                namegen: self.namegen,
                 join_sets,
                 in_tx,
+                overload: self.overload.clone(),
+                buffer_pool: self.buffer_pool.clone(),
+                stats: self.stats.clone(),
+                trigger_groups,
                 rt_normal: self.rt_normal.handle().clone(),
+                rt_priority: self.rt_priority.as_ref().map(|rt| rt.handle().clone()),
+                rt_packages: self
+                    .rt_packages
+                    .iter()
+                    .map(|(package, rt)| (*package, rt.handle().clone()))
+                    .collect(),
             },
         };
-        let control_handle = ControlHandle { tx: control_tx };
+        let control_handle = ControlHandle {
+            tx: control_tx,
+            stats: self.stats.clone(),
+        };
         let control_task_handle = self.rt_normal.spawn(pipeline_control_task(
             global_shutdown_recv,
             control_rx,
@@ -271,8 +459,11 @@ impl IdlePipeline {
         RunningPipeline {
             _rt_normal: self.rt_normal,
             _rt_priority: self.rt_priority,
+            _rt_packages: self.rt_packages,
             shutdown_task_handle: Some(control_task_handle),
             control_handle,
+            overload: self.overload,
+            buffer_pool: self.buffer_pool,
         }
     }
 }
@@ -293,25 +484,45 @@ pub enum SourceCmd {
     SetTrigger(Option<TriggerSpec>),
 }
 
-async fn run_source(
+pub(super) async fn run_source(
+    stats: Arc<SourceStats>,
     source_name: String,
     mut source: Box<dyn Source>,
     tx: mpsc::Sender<MeasurementBuffer>,
     mut commands: watch::Receiver<SourceCmd>,
+    overload: Arc<OverloadState>,
+    buffer_pool: Arc<BufferPool>,
 ) -> anyhow::Result<()> {
-    /// Takes the [`Trigger`] from the option and initializes it.
+    /// Takes the [`TriggerSpec`] from the option and initializes the corresponding [`Trigger`].
+    ///
+    /// The spec is returned with the trigger, in order to be able to rebuild the trigger
+    /// with a different polling interval (see [`OverloadPolicy::SlowDown`](super::overload::OverloadPolicy::SlowDown)).
     fn init_trigger(
         trigger_spec: &mut Option<TriggerSpec>,
         interrupt_signal: watch::Receiver<SourceCmd>,
-    ) -> Result<Trigger, std::io::Error> {
+    ) -> Result<(TriggerSpec, Trigger), std::io::Error> {
         let spec = trigger_spec
             .take()
             .expect("invalid empty trigger in message Init(trigger)");
-        Trigger::new(spec, interrupt_signal)
+        let trigger = Trigger::new(spec.clone(), interrupt_signal)?;
+        Ok((spec, trigger))
+    }
+
+    /// Rebuilds the trigger with a polling interval `factor` times longer than the one of the spec.
+    fn stretch_trigger(
+        trigger: &mut Trigger,
+        trigger_spec: &TriggerSpec,
+        factor: u32,
+        interrupt_signal: watch::Receiver<SourceCmd>,
+    ) -> Result<(), std::io::Error> {
+        if let Some(spec) = trigger_spec.stretched(factor) {
+            *trigger = Trigger::new(spec, interrupt_signal)?;
+        }
+        Ok(())
     }
 
     // the first command must be "init"
-    let mut trigger: Trigger = {
+    let (mut trigger_spec, mut trigger) = {
         let signal = commands.clone();
         let init_cmd = commands
             .wait_for(|c| matches!(c, SourceCmd::SetTrigger(_)))
@@ -327,9 +538,15 @@ async fn run_source(
         }
     };
 
+    // Reacts to the overload of the pipeline, when the buffer cannot be flushed.
+    let mut overload = SourceOverload::new(overload);
+
+    // Buffers sent to the transforms and outputs come back here once they have been written.
+    let buffer_pool = SourceBufferPool::new(buffer_pool);
+
     // Store measurements in this buffer, and replace it every `flush_rounds` rounds.
     // For now, we don't know how many measurements the source will produce, so we allocate 1 per round.
-    let mut buffer = MeasurementBuffer::with_capacity(trigger.config.flush_rounds);
+    let mut buffer = buffer_pool.take(trigger.config.flush_rounds);
 
     // main loop
     let mut i = 1usize;
@@ -341,9 +558,18 @@ async fn run_source(
 
         let update = match reason {
             TriggerReason::Triggered => {
+                if let Some(lateness) = trigger.lateness() {
+                    stats.record_lateness(lateness);
+                }
+
                 // poll the source
-                let timestamp = Timestamp::now();
-                match source.poll(&mut buffer.as_accumulator(), timestamp) {
+                let timestamp = trigger.tick_timestamp().unwrap_or_else(Timestamp::now);
+                let prev_length = buffer.len();
+                let poll_start = Instant::now();
+                let res = source.poll(&mut buffer.as_accumulator(), timestamp);
+                stats.record_poll(poll_start.elapsed());
+                trigger.observe(buffer.iter().skip(prev_length));
+                match res {
                     Ok(()) => (),
                     Err(PollError::CanRetry(e)) => {
                         log::error!("Non-fatal error when polling {source_name} (will retry): {e:#}");
@@ -365,20 +591,27 @@ async fn run_source(
 
                     buffer = match tx.try_send(buffer) {
                         Ok(()) => {
-                            // buffer has been sent, create a new one
+                            // buffer has been sent, take a new one
                             log::debug!("{source_name} flushed {prev_length} measurements");
-                            MeasurementBuffer::with_capacity(prev_length)
+                            if let Some(factor) = overload.flushed(prev_length) {
+                                // the pipeline has recovered, restore (a part of) the polling frequency
+                                stretch_trigger(&mut trigger, &trigger_spec, factor, commands.clone())
+                                    .with_context(|| format!("failed to restore the trigger of {source_name}"))?;
+                            }
+                            buffer_pool.take(prev_length)
                         }
                         Err(TrySendError::Closed(_buf)) => {
                             // the channel Receiver has been closed
                             panic!("source channel should stay open");
                         }
-                        Err(TrySendError::Full(_buf)) => {
-                            // the channel's buffer is full! reduce the measurement frequency
-                            // TODO it would be better to choose which source to slow down based
-                            // on its frequency and number of measurements per poll.
-                            // buf
-                            todo!("buffer is full")
+                        Err(TrySendError::Full(mut buf)) => {
+                            // the channel's buffer is full! apply the overload policy
+                            let can_stretch = trigger_spec.can_stretch();
+                            if let Some(factor) = overload.overloaded(&mut buf, &source_name, can_stretch) {
+                                stretch_trigger(&mut trigger, &trigger_spec, factor, commands.clone())
+                                    .with_context(|| format!("failed to slow down the trigger of {source_name}"))?;
+                            }
+                            buf
                         }
                     };
                 }
@@ -418,9 +651,10 @@ async fn run_source(
                         SourceCmd::Run => break 'pause,
                         SourceCmd::Pause => paused = true,
                         SourceCmd::Stop => {
-                            // flush now, then stop
+                            // flush now, then stop (wait for some room in the channel if the pipeline is overloaded)
                             if !buffer.is_empty() {
-                                tx.try_send(buffer)
+                                tx.send(buffer)
+                                    .await
                                     .expect("failed to flush measurements after receiving SourceCmd::Stop");
                             }
                             break 'run;
@@ -428,9 +662,10 @@ async fn run_source(
                         SourceCmd::SetTrigger(mut opt) => {
                             let prev_flush_rounds = trigger.config.flush_rounds;
 
-                            // update the trigger
+                            // update the trigger, it replaces any previous slowdown
                             let signal = commands.clone();
-                            trigger = init_trigger(&mut opt, signal).unwrap();
+                            (trigger_spec, trigger) = init_trigger(&mut opt, signal).unwrap();
+                            overload.reset_factor();
 
                             // don't reset the round count
                             // i = 1;
@@ -468,11 +703,15 @@ pub enum TransformCmd {
 async fn run_transforms(
     mut transforms: Vec<ConfiguredTransform>,
     mut rx: mpsc::Receiver<MeasurementBuffer>,
-    tx: broadcast::Sender<OutputMsg>,
+    mut outputs: Vec<mpsc::Sender<OutputMsg>>,
     active_flags: Arc<AtomicU64>,
+    batching: BatchConfig,
 ) -> anyhow::Result<()> {
     loop {
         if let Some(mut measurements) = rx.recv().await {
+            // Merge the buffers that are waiting, in order to run the transforms and to notify the outputs only once.
+            batching.fill(&mut measurements, &mut rx).await;
+
             // Update the list of active transforms (the PipelineController can update the flags).
             let current_flags = active_flags.load(Ordering::Relaxed);
 
@@ -480,7 +719,10 @@ async fn run_transforms(
             for (i, t) in &mut transforms.iter_mut().enumerate() {
                 let t_flag = 1 << i;
                 if current_flags & t_flag != 0 {
-                    match t.transform.apply(&mut measurements) {
+                    let apply_start = Instant::now();
+                    let res = t.transform.apply(&mut measurements);
+                    t.stats.record(apply_start.elapsed(), measurements.len());
+                    match res {
                         Ok(()) => (),
                         Err(TransformError::UnexpectedInput(e)) => {
                             log::error!("Transform function {} received unexpected measurements: {e:#}", t.name);
@@ -497,8 +739,25 @@ async fn run_transforms(
             }
 
             // Send the results to the outputs.
-            tx.send(OutputMsg::WriteMeasurements(measurements))
-                .context("could not send the measurements from transforms to the outputs")?;
+            // The buffer is now immutable: share it between all the outputs instead of copying it for each of them.
+            // The task of each output keeps receiving while the output is busy, therefore this only waits
+            // for the outputs that are configured to block the transforms (see OverflowPolicy::Block).
+            let measurements = Arc::new(measurements);
+            let mut i = 0;
+            while i < outputs.len() {
+                match outputs[i].send(OutputMsg::WriteMeasurements(measurements.clone())).await {
+                    Ok(()) => i += 1,
+                    Err(_) => {
+                        // the output has stopped, don't send anything to it anymore
+                        outputs.swap_remove(i);
+                    }
+                }
+            }
+            if outputs.is_empty() {
+                return Err(anyhow!(
+                    "could not send the measurements from transforms to the outputs: no output is running"
+                ));
+            }
         } else {
             log::debug!("The channel connected to the transform step has been closed, the transforms will stop.");
             break;
@@ -515,112 +774,74 @@ pub enum OutputCmd {
     Stop,
 }
 
+/// A message for the outputs.
+///
+/// Every output receives its own clone of the message, which is why the measurements are
+/// wrapped in an `Arc`: cloning the message does not copy the buffer, no matter how many outputs there are.
 #[derive(Debug, Clone)]
 pub enum OutputMsg {
-    WriteMeasurements(MeasurementBuffer),
-    RegisterMetrics {
-        metrics: Vec<Metric>,
-        source_name: String,
-        reply_to: tokio::sync::mpsc::Sender<Vec<RawMetricId>>,
-    },
+    WriteMeasurements(Arc<MeasurementBuffer>),
 }
 
-async fn run_output_from_broadcast(
+/// Capacity of the channel between the transforms and each output.
+///
+/// The task of the output moves the messages to the queue of the output as soon as they arrive,
+/// the channel only needs to absorb the bursts.
+const OUTPUT_CHANNEL_CAPACITY: usize = 8;
+
+/// When an output stops, maximum time to write the measurements of its queue before saving them on the disk.
+const OUTPUT_DRAIN_TIMEOUT: Duration = Duration::from_secs(2);
+
+async fn run_output(
     output_name: String,
-    mut output: Box<dyn Output>,
-    mut rx: broadcast::Receiver<OutputMsg>,
+    output: OutputKind,
+    mut rx: mpsc::Receiver<OutputMsg>,
     mut commands: watch::Receiver<OutputCmd>,
-    mut ctx: OutputContext,
+    ctx: OutputContext,
+    metrics: Arc<SharedMetricRegistry>,
+    worker_config: OutputWorkerSettings,
 ) -> anyhow::Result<()> {
-    // Two possible designs:
-    // A) Use one mpsc channel + one shared variable that contains the current command,
-    // - when a message is received, check the command and act accordingly
-    // - to change the command, update the variable and send a special message through the channel
-    // In this alternative design, each Output would have one mpsc channel, and the Transform step would call send() or try_send() on each of them.
-    //
-    // B) use a broadcast + watch, where the broadcast discards old values when a receiver (output) lags behind,
-    // instead of either (with option A):
-    // - preventing the transform from running (mpsc channel's send() blocks when the queue is full).
-    // - losing the most recent messages in transform, for one output. Other outputs that are not lagging behind will receive all messages fine, since try_send() does not block.
-    //     The problem is: what to do with messages that could not be sent, when try_send() fails?
-    //
-    // We have chosen option (B).
-
-    async fn handle_message(
-        received_msg: OutputMsg,
-        output_name: &str,
-        output: &mut dyn Output,
-        ctx: &mut OutputContext,
-    ) -> anyhow::Result<()> {
-        match received_msg {
-            OutputMsg::WriteMeasurements(measurements) => {
-                // output.write() is blocking, do it in a dedicated thread.
-
-                // Output is not Sync, we could move the value to the future and back (idem for ctx),
-                // but that would likely introduce a needless copy, and would be cumbersome to work with.
-                // Instead, we use the `scoped` module.
-                let res =
-                    scoped::spawn_blocking_with_output(output, ctx, move |out, ctx| out.write(&measurements, ctx))
-                        .await;
-                match res {
-                    Ok(write_res) => {
-                        match write_res {
-                            Ok(_) => Ok(()),
-                            Err(WriteError::CanRetry(e)) => {
-                                log::error!("Non-fatal error in output {output_name} (in a future version of Alumet, this means that the Output will try to write the same measurements later): {e:#}");
-                                // TODO retry with the same measurements
-                                Ok(())
-                            }
-                            Err(WriteError::Fatal(e)) => {
-                                log::error!("Fatal error in output {output_name} (it will stop running): {e:?}");
-                                Err(e.context(format!("fatal error in output {output_name}")))
-                            }
-                        }
-                    }
-                    Err(await_err) => {
-                        if await_err.is_panic() {
-                            Err(anyhow!(
-                                "A blocking writing task panicked, there is a bug somewhere! Details: {}",
-                                await_err
-                            ))
-                        } else {
-                            todo!("unhandled error");
-                        }
-                    }
-                }
-            }
-            OutputMsg::RegisterMetrics {
-                metrics,
-                source_name,
-                reply_to,
-            } => {
-                let metric_ids = ctx.metrics.extend_infallible(metrics, &source_name);
-                reply_to.send(metric_ids).await?;
-                Ok(())
-            }
+    // Each output has its own mpsc channel and its own bounded queue, which is filled by this task.
+    // The task keeps receiving while the output is busy (or paused), so that a slow output never slows down
+    // the transforms, nor the other outputs. When the queue is full, the overflow policy decides what to do:
+    // drop the oldest or the newest measurements, spill them to the disk, or stop receiving, which blocks the transforms.
+    let mut queue = OutputQueue::new(
+        &output_name,
+        worker_config.queue_capacity,
+        worker_config.overflow.clone(),
+        worker_config.queue_depth.clone(),
+        worker_config.stats.clone(),
+    );
+    let mut registry = metrics.snapshot();
+    let mut registry_version = metrics.version();
+
+    let mut driver = match output {
+        OutputKind::Blocking(output) => {
+            // output.write() is blocking, it runs on a dedicated thread, which receives the measurements from this task.
+            let worker = OutputWorker::spawn(output_name.clone(), output, ctx, metrics.clone(), worker_config)
+                .with_context(|| format!("failed to start the thread of output {output_name}"))?;
+            OutputDriver::Thread(worker)
         }
-    }
+        OutputKind::Async(output) => {
+            // the writes run on this runtime, next to this task
+            let writes = InFlightWrites::new(output_name.clone(), output, ctx, metrics.clone(), worker_config);
+            OutputDriver::Async(writes)
+        }
+    };
 
+    let mut paused = false;
     loop {
+        // The oldest measurements of the queue, to give to the output.
+        let next = match paused {
+            true => None,
+            false => queue.front(&registry),
+        };
         tokio::select! {
             received_cmd = commands.changed() => {
                 // Process new command, clone it to quickly end the borrow (which releases the internal lock as suggested by the doc)
                 match received_cmd.map(|_| commands.borrow().clone()) {
-                    Ok(OutputCmd::Run) => (), // continue running
-                    Ok(OutputCmd::Pause) => {
-                        // wait for the command to change
-                        match commands.wait_for(|cmd| cmd != &OutputCmd::Pause).await {
-                            Ok(new_cmd) => {
-                                log::trace!("{output_name} received {new_cmd:?}");
-                                match *new_cmd {
-                                    OutputCmd::Run => (), // exit the wait
-                                    OutputCmd::Stop => break, // stop the loop,
-                                    OutputCmd::Pause => unreachable!(),
-                                }
-                            },
-                            Err(_) => todo!("watch channel closed"),
-                        };
-                    },
+                    Ok(OutputCmd::Run) => paused = false,
+                    Ok(OutputCmd::Pause) => paused = true, // keep receiving, but don't write anything
                     Ok(OutputCmd::Stop) => {
                         log::trace!("{output_name} received OutputCmd::Stop");
                         break // stop the loop
@@ -628,25 +849,108 @@ async fn run_output_from_broadcast(
                     Err(_) => todo!("watch channel closed")
                 }
             },
-            received_msg = rx.recv() => {
+            res = async {
+                match next {
+                    Some(measurements) => driver.write(measurements).await.map(|()| true),
+                    None => driver.progress().await.map(|()| false),
+                }
+            } => {
+                // stop if the output has failed
+                if res? {
+                    queue.pop_front();
+                }
+            },
+            received_msg = rx.recv(), if queue.can_accept() => {
                 match received_msg {
-                    Ok(msg) => {
-                        handle_message(msg, &output_name, output.as_mut(), &mut ctx).await?;
-                    },
-                    Err(broadcast::error::RecvError::Lagged(n)) => {
-                        log::warn!("Output {output_name} is too slow, it lost the oldest {n} messages.");
+                    Some(OutputMsg::WriteMeasurements(measurements)) => {
+                        // Metrics may have been registered since the last message, which is rare: checking the version is enough.
+                        let current = metrics.version();
+                        if current != registry_version {
+                            registry = metrics.snapshot();
+                            registry_version = current;
+                        }
+                        queue.push(measurements, &registry);
                     },
-                    Err(broadcast::error::RecvError::Closed) => {
-                        log::warn!("The channel connected to output was closed, it will now stop.");
+                    None => {
+                        log::debug!("The channel connected to output {output_name} was closed, it will now stop.");
                         break;
                     }
                 }
             }
         }
     }
-    Ok(())
+
+    // Handle the measurements that are still in the queue: write them, and save the rest if the output is too slow.
+    rx.close();
+    if queue.can_persist() {
+        while let Some(OutputMsg::WriteMeasurements(measurements)) = rx.recv().await {
+            queue.push(measurements, &registry);
+        }
+        // A paused output does not write anything, everything is saved.
+        let deadline = tokio::time::Instant::now() + OUTPUT_DRAIN_TIMEOUT;
+        while !paused {
+            let Some(measurements) = queue.front(&registry) else {
+                break;
+            };
+            match tokio::time::timeout_at(deadline, driver.write(measurements)).await {
+                Ok(res) => {
+                    res?;
+                    queue.pop_front();
+                }
+                Err(_) => {
+                    log::warn!("Output {output_name} is too slow to write its queue before stopping, the rest is saved on the disk.");
+                    break;
+                }
+            }
+        }
+        queue.persist(&registry);
+    } else {
+        while let Some(measurements) = queue.front(&registry) {
+            driver.write(measurements).await?;
+            queue.pop_front();
+        }
+        while let Some(OutputMsg::WriteMeasurements(measurements)) = rx.recv().await {
+            driver.write(measurements).await?;
+        }
+    }
+    driver.stop().await
+}
+
+/// Runs an output, blocking or async.
+enum OutputDriver {
+    Thread(OutputWorker),
+    Async(InFlightWrites),
 }
 
+impl OutputDriver {
+    /// Gives the measurements to the output. Cancel safe.
+    async fn write(&mut self, measurements: Arc<MeasurementBuffer>) -> anyhow::Result<()> {
+        match self {
+            OutputDriver::Thread(worker) => worker.write(measurements).await,
+            OutputDriver::Async(writes) => writes.write(measurements).await,
+        }
+    }
+
+    /// Waits for the output to make progress in the background.
+    ///
+    /// Returns an error if the output has failed. Cancel safe.
+    async fn progress(&mut self) -> anyhow::Result<()> {
+        match self {
+            // the output thread only stops on its own if the output fails
+            OutputDriver::Thread(worker) => Err(worker.failed().await),
+            OutputDriver::Async(writes) => writes.next_done().await,
+        }
+    }
+
+    async fn stop(self) -> anyhow::Result<()> {
+        match self {
+            OutputDriver::Thread(worker) => worker.stop().await,
+            OutputDriver::Async(writes) => writes.finish().await,
+        }
+    }
+}
+
+
 #[derive(Debug)]
 pub struct PipelineError {
     pub error: anyhow::Error,
@@ -761,6 +1065,12 @@ async fn pipeline_control_task(
                     break;
                 }
             }
+            Some(task_res) = state.modifier.join_sets.source_set.join_next(), if !state.modifier.join_sets.source_set.is_empty() => {
+                // A source has stopped (it has been removed, or has failed), free its task.
+                handle_task_result("source", task_res);
+                state.modifier.trigger_groups.prune();
+                state.forget_stopped_sources();
+            }
         }
     }
     // End of the loop = shutdown phase.
@@ -771,7 +1081,7 @@ async fn pipeline_control_task(
         .source_command_senders_by_plugin
         .values()
         .flatten()
-        .cloned()
+        .map(|s| s.tx.clone())
         .collect();
     let output_command_senders: Vec<watch::Sender<OutputCmd>> = state
         .output_command_senders_by_plugin
@@ -810,12 +1120,20 @@ async fn pipeline_control_task(
     while let Some(task_res) = join_sets.output_set.join_next().await {
         handle_task_result("output", task_res);
     }
+
+    let overload_stats = state.modifier.overload.stats();
+    if !overload_stats.is_empty() {
+        log::warn!("The measurement pipeline has been overloaded: {overload_stats:?}");
+    }
+    log::debug!("Buffer pool: {:?}", state.modifier.buffer_pool.stats());
 }
 
 /// Processes a message received by the PipelineController.
 ///
 /// This function uses the `state` to modify the pipeline according to the `message`.
 fn handle_control_message(state: &mut PipelineControllerState, message: ControlMessage) {
+    // A grouped source that fails does not end the task of its group: forget it before sending commands.
+    state.forget_stopped_sources();
     match message {
         ControlMessage::Shutdown => {
             state
@@ -835,34 +1153,94 @@ fn handle_control_message(state: &mut PipelineControllerState, message: ControlM
             let modif = &mut state.modifier;
             let source_name = modif.namegen.deduplicate(format!("{plugin}/{requested_name}"), false);
             let in_tx = modif.in_tx.clone();
+            let group_key = trigger.group_key();
+            let spec = trigger.clone();
+            let runtime = source_runtime(
+                &trigger,
+                &modif.rt_normal,
+                modif.rt_priority.as_ref(),
+                &modif.rt_packages,
+            )
+            .clone();
             let (command_tx, command_rx) = watch::channel(SourceCmd::SetTrigger(Some(trigger)));
 
+            let stats = modif.stats.source(&plugin, &source_name);
+
             // save the command sender so that we can control the source task
             state
                 .source_command_senders_by_plugin
                 .entry(plugin)
                 .or_default()
-                .push(command_tx);
+                .push(SourceCommandSender {
+                    name: source_name.clone(),
+                    tx: command_tx,
+                });
 
             // submit the task to the tokio Runtime, unless we are shutting down
-            let task = run_source(source_name, source, in_tx, command_rx);
-            modif.join_sets.source_set.spawn_on(task, &modif.rt_normal);
+            if let Some(key) = group_key {
+                let member = GroupMember {
+                    stats,
+                    name: source_name,
+                    source,
+                    commands: command_rx,
+                };
+                let overload = modif.overload.clone();
+                let buffer_pool = modif.buffer_pool.clone();
+                if let Some(task) = modif.trigger_groups.add(key, spec, member, in_tx, overload, buffer_pool) {
+                    modif.join_sets.source_set.spawn_on(task, &runtime);
+                }
+            } else {
+                let task = run_source(
+                    stats,
+                    source_name,
+                    source,
+                    in_tx,
+                    command_rx,
+                    modif.overload.clone(),
+                    modif.buffer_pool.clone(),
+                );
+                modif.join_sets.source_set.spawn_on(task, &runtime);
+            }
+        }
+
+        ControlMessage::RemoveSource {
+            plugin_name,
+            source_name,
+        } => {
+            let full_name = source_name.map(|name| format!("{plugin_name}/{name}"));
+            let Some(senders) = state.source_command_senders_by_plugin.get_mut(&plugin_name) else {
+                log::warn!("Cannot remove the sources of plugin {plugin_name}: it has no source.");
+                return;
+            };
+            let before = senders.len();
+            senders.retain(|s| {
+                if full_name.as_ref().is_some_and(|name| name != &s.name) {
+                    return true;
+                }
+                // The source flushes its measurements and stops, which drops the source and its trigger.
+                // Its task is then reaped by the control loop.
+                log::debug!("Removing source {}", s.name);
+                s.tx.send_replace(SourceCmd::Stop);
+                state.modifier.namegen.release(&s.name);
+                false
+            });
+            if senders.len() == before {
+                log::warn!("Cannot remove source {}: not found.", full_name.unwrap_or(plugin_name));
+            }
         }
 
         ControlMessage::ModifySource(ElementCommand {
             destination,
             command: message,
         }) => match destination {
-            MessageDestination::Plugin(plugin) => {
-                for s in state.source_command_senders_by_plugin.get(&plugin).unwrap() {
-                    s.send(message.clone()).unwrap();
-                }
-            }
+            // A source that has stopped since the last message cannot receive the command, forget it.
+            MessageDestination::Plugin(plugin) => match state.source_command_senders_by_plugin.get_mut(&plugin) {
+                Some(senders) => senders.retain(|s| s.send(&message)),
+                None => log::warn!("Cannot send {message:?} to the sources of plugin {plugin}: it has no source."),
+            },
             MessageDestination::All => {
-                for senders in state.source_command_senders_by_plugin.values() {
-                    for s in senders {
-                        s.send(message.clone()).unwrap();
-                    }
+                for senders in state.source_command_senders_by_plugin.values_mut() {
+                    senders.retain(|s| s.send(&message));
                 }
             }
         },
@@ -922,6 +1300,22 @@ impl RunningPipeline {
     pub fn control_handle(&mut self) -> ControlHandle {
         self.control_handle.clone()
     }
+
+    /// Returns how many times the sources have applied their [`OverloadPolicy`](super::overload::OverloadPolicy)
+    /// because the pipeline was overloaded.
+    pub fn overload_stats(&self) -> OverloadStats {
+        self.overload.stats()
+    }
+
+    /// Returns how many buffers have been reused by the sources, instead of being allocated.
+    pub fn buffer_pool_stats(&self) -> BufferPoolStats {
+        self.buffer_pool.stats()
+    }
+
+    /// Returns the trigger lateness and the poll duration of each running source.
+    pub fn source_timings(&self) -> Vec<SourceTiming> {
+        self.control_handle.source_timings()
+    }
 }
 
 impl Drop for RunningPipeline {
@@ -931,6 +1325,11 @@ impl Drop for RunningPipeline {
 }
 
 impl ControlHandle {
+    /// Returns the trigger lateness and the poll duration of each running source, since it has started.
+    pub fn source_timings(&self) -> Vec<SourceTiming> {
+        self.stats.source_timings()
+    }
+
     pub fn all(&self) -> ScopedControlHandle {
         ScopedControlHandle {
             handle: self,
@@ -984,6 +1383,36 @@ impl ControlHandle {
         };
         self.tx.try_send(msg).unwrap()
     }
+
+    /// Removes a source from the pipeline, without interrupting the other elements.
+    ///
+    /// The source is identified by the name that has been given to [`add_source`](Self::add_source),
+    /// or to [`AlumetStart::add_named_source`](crate::plugin::AlumetStart::add_named_source).
+    /// It flushes its last measurements, then the source, its trigger and its task are dropped.
+    ///
+    /// Returns an error if the pipeline has shut down, or if too many control messages are waiting.
+    /// This function does not block, it can be called from any thread.
+    pub fn remove_source(&self, plugin_name: String, source_name: String) -> anyhow::Result<()> {
+        self.try_send(ControlMessage::RemoveSource {
+            plugin_name,
+            source_name: Some(source_name),
+        })
+    }
+
+    /// Removes all the sources of a plugin from the pipeline, like [`remove_source`](Self::remove_source).
+    pub fn remove_plugin_sources(&self, plugin_name: String) -> anyhow::Result<()> {
+        self.try_send(ControlMessage::RemoveSource {
+            plugin_name,
+            source_name: None,
+        })
+    }
+
+    fn try_send(&self, msg: ControlMessage) -> anyhow::Result<()> {
+        self.tx.try_send(msg).map_err(|e| match e {
+            TrySendError::Closed(_) => anyhow!("the pipeline has shut down"),
+            TrySendError::Full(_) => anyhow!("too many control messages are waiting"),
+        })
+    }
 }
 
 pub struct ScopedControlHandle<'a> {
@@ -1071,7 +1500,7 @@ mod tests {
 
     use tokio::{
         runtime::Runtime,
-        sync::{broadcast, mpsc, watch},
+        sync::{mpsc, watch},
     };
 
     use crate::{
@@ -1079,13 +1508,23 @@ mod tests {
             MeasurementAccumulator, MeasurementBuffer, MeasurementPoint, Timestamp, WrappedMeasurementType,
             WrappedMeasurementValue,
         },
-        metrics::{MetricRegistry, RawMetricId},
-        pipeline::{builder::ConfiguredTransform, trigger::TriggerSpec, OutputContext, Transform},
-        resources::{Resource, ResourceConsumer},
+        metrics::{MetricRegistry, RawMetricId, SharedMetricRegistry},
+        pipeline::{
+            batch::BatchConfig,
+            queue::OverflowPolicy,
+            retry::RetryConfig,
+            worker::{OutputWorkerSettings, QueueDepth},
+            builder::{ConfiguredTransform, OutputKind},
+            overload::{OverloadPolicy, OverloadState},
+            pool::BufferPool,
+            trigger::TriggerSpec,
+            OutputContext, Transform,
+        },
+        resources::{Resource, ResourceConsumer, ResourceRegistry},
     };
 
     use super::{
-        super::trigger, run_output_from_broadcast, run_source, run_transforms, OutputCmd, OutputMsg, SourceCmd,
+        super::trigger, run_output, run_source, run_transforms, OutputCmd, OutputMsg, SourceCmd,
     };
 
     #[test]
@@ -1148,7 +1587,15 @@ mod tests {
         });
 
         // poll the source for some time
-        rt.spawn(run_source(String::from("test_source"), Box::new(source), tx, cmd_rx));
+        rt.spawn(run_source(
+            Default::default(),
+            String::from("test_source"),
+            Box::new(source),
+            tx,
+            cmd_rx,
+            new_overload_state(),
+            Arc::new(BufferPool::new()),
+        ));
         sleep(2 * period);
 
         // pause source
@@ -1235,6 +1682,7 @@ mod tests {
                 transform: t,
                 name: String::from("test_transform"),
                 plugin_name: String::from(""),
+                stats: Default::default(),
             })
             .collect();
 
@@ -1245,14 +1693,14 @@ mod tests {
         let (_src_cmd_tx, src_cmd_rx) = watch::channel(SourceCmd::SetTrigger(Some(tp)));
 
         // create transform channels and control flags
-        let (trans_tx, mut out_rx) = broadcast::channel::<OutputMsg>(64);
+        let (trans_tx, mut out_rx) = mpsc::channel::<OutputMsg>(64);
         let active_flags = Arc::new(AtomicU64::new(u64::MAX));
         let active_flags2 = active_flags.clone();
         let active_flags3 = active_flags.clone();
 
         rt.spawn(async move {
-            loop {
-                if let Ok(OutputMsg::WriteMeasurements(measurements)) = out_rx.recv().await {
+            while let Some(OutputMsg::WriteMeasurements(measurements)) = out_rx.recv().await {
+                {
                     let current_flags = active_flags2.load(Ordering::Relaxed);
                     let transform1_enabled = current_flags & 1 != 0;
                     let transform2_enabled = current_flags & 2 != 0;
@@ -1283,14 +1731,27 @@ mod tests {
         });
 
         // run the transforms
-        rt.spawn(run_transforms(transforms, src_rx, trans_tx, active_flags3));
+        rt.spawn(run_transforms(
+            transforms,
+            src_rx,
+            vec![trans_tx],
+            active_flags3,
+            // the transforms expect the buffers of the source, don't merge them
+            BatchConfig {
+                max_points: 0,
+                ..Default::default()
+            },
+        ));
 
         // poll the source for some time
         rt.spawn(run_source(
+            Default::default(),
             String::from("test_source"),
             Box::new(source),
             src_tx,
             src_cmd_rx,
+            new_overload_state(),
+            Arc::new(BufferPool::new()),
         ));
         sleep(Duration::from_millis(20));
 
@@ -1328,7 +1789,7 @@ mod tests {
 
         // no transforms but a transform task to send the values to the output
         let transforms = vec![];
-        let (trans_tx, out_rx) = broadcast::channel::<OutputMsg>(64);
+        let (trans_tx, out_rx) = mpsc::channel::<OutputMsg>(64);
         let active_flags = Arc::new(AtomicU64::new(u64::MAX));
 
         // create output
@@ -1338,20 +1799,50 @@ mod tests {
             output_count: output_count.clone(),
         });
         let (out_cmd_tx, out_cmd_rx) = watch::channel(OutputCmd::Run);
+        let metrics = Arc::new(SharedMetricRegistry::new(MetricRegistry::new()));
         let out_ctx = OutputContext {
-            metrics: MetricRegistry::new(),
+            metrics: metrics.snapshot(),
+            resources: Arc::new(ResourceRegistry::new()),
         };
 
         // start tasks
-        rt.spawn(run_output_from_broadcast(
+        rt.spawn(run_output(
             String::from("test_output"),
-            output,
+            OutputKind::Blocking(output),
             out_rx,
             out_cmd_rx,
             out_ctx,
+            metrics,
+            OutputWorkerSettings {
+                queue_capacity: 8,
+                overflow: OverflowPolicy::default(),
+                cpu: None,
+                max_in_flight: 1,
+                retry: RetryConfig::default(),
+                queue_depth: QueueDepth::default(),
+                stats: Default::default(),
+            },
+        ));
+        rt.spawn(run_transforms(
+            transforms,
+            trans_rx,
+            vec![trans_tx],
+            active_flags,
+            // the output expects the buffers of the source, don't merge them
+            BatchConfig {
+                max_points: 0,
+                ..Default::default()
+            },
+        ));
+        rt.spawn(run_source(
+            Default::default(),
+            String::from("test_source"),
+            source,
+            src_tx,
+            src_cmd_rx,
+            new_overload_state(),
+            Arc::new(BufferPool::new()),
         ));
-        rt.spawn(run_transforms(transforms, trans_rx, trans_tx, active_flags));
-        rt.spawn(run_source(String::from("test_source"), source, src_tx, src_cmd_rx));
 
         // check the output
         sleep(Duration::from_millis(20));
@@ -1390,6 +1881,10 @@ mod tests {
         builder.build().unwrap()
     }
 
+    fn new_overload_state() -> Arc<OverloadState> {
+        Arc::new(OverloadState::new(OverloadPolicy::default()))
+    }
+
     fn new_rt(n_threads: usize) -> Runtime {
         tokio::runtime::Builder::new_multi_thread()
             .worker_threads(n_threads)
@@ -1447,7 +1942,7 @@ mod tests {
         fn apply(&mut self, measurements: &mut MeasurementBuffer) -> Result<(), crate::pipeline::TransformError> {
             assert_eq!(measurements.len(), self.expected_input_len);
             for m in measurements.iter_mut() {
-                assert_eq!(m.resource, Resource::LocalMachine);
+                assert_eq!(m.resource.resolve(), &Resource::LocalMachine);
                 if self.check_input_type.load(Ordering::Relaxed) {
                     assert_eq!(m.value.measurement_type(), self.expected_input_type);
                 }
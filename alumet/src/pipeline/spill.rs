@@ -0,0 +1,638 @@
+//! Queues of measurement buffers that spill to the disk.
+//!
+//! A [`SpillQueue`] keeps the most recent buffers in memory. When there are too many of them, the oldest
+//! buffers are moved to append-only segment files on the local disk (if the queue has a directory),
+//! or dropped. The buffers that remain in memory can be saved to the disk when the queue is not needed
+//! anymore, and are loaded again when a new queue is opened in the same directory, which allows
+//! the measurements to survive a restart of the agent.
+
+use std::collections::{HashMap, VecDeque};
+use std::fs::{self, File, OpenOptions};
+use std::io::{self, Read, Seek, SeekFrom, Write};
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+use std::time::{Duration, SystemTime, UNIX_EPOCH};
+
+use anyhow::{anyhow, Context};
+
+use crate::measurement::{AttributeKey, AttributeValue, MeasurementBuffer, MeasurementPoint, WrappedMeasurementValue};
+use crate::metrics::MetricRegistry;
+use crate::resources::{ConsumerId, Resource, ResourceConsumer, ResourceId};
+
+/// A queue of measurement buffers, in memory and on the disk.
+pub(crate) struct SpillQueue {
+    /// Describes the queue in the logs.
+    description: String,
+    max_memory_buffers: usize,
+    /// The oldest buffers, if any. They come before the buffers in memory.
+    disk: Option<DiskQueue>,
+    /// The head of the disk queue, once it has been loaded.
+    disk_head: Option<Arc<MeasurementBuffer>>,
+    /// The newest buffers.
+    memory: VecDeque<Arc<MeasurementBuffer>>,
+}
+
+impl SpillQueue {
+    /// Creates a queue, and loads the buffers that have been saved in `directory`, if any.
+    ///
+    /// If the directory cannot be used, the queue only lives in memory.
+    pub fn open(description: String, max_memory_buffers: usize, directory: Option<(PathBuf, u64)>) -> Self {
+        let disk = directory.and_then(|(dir, max_disk_bytes)| match DiskQueue::open(&dir, max_disk_bytes) {
+            Ok(disk) => Some(disk),
+            Err(e) => {
+                log::error!(
+                    "Cannot use the directory {dir:?} for the {description}, it will only be kept in memory: {e:#}"
+                );
+                None
+            }
+        });
+        Self {
+            description,
+            max_memory_buffers,
+            disk,
+            disk_head: None,
+            memory: VecDeque::new(),
+        }
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.memory.is_empty() && self.disk_head.is_none() && self.disk.as_ref().map_or(true, |d| d.is_empty())
+    }
+
+    /// Number of buffers in memory.
+    pub fn memory_len(&self) -> usize {
+        self.memory.len()
+    }
+
+    /// Number of bytes on the disk.
+    pub fn disk_bytes(&self) -> u64 {
+        self.disk.as_ref().map_or(0, |d| d.total_bytes)
+    }
+
+    /// Returns `true` if the queue can move buffers to the disk.
+    pub fn has_disk(&self) -> bool {
+        self.disk.is_some()
+    }
+
+    /// Adds some measurements at the end of the queue.
+    ///
+    /// If there are too many buffers in memory, the oldest one goes to the disk, or is dropped.
+    /// Returns the number of buffers that have been lost.
+    pub fn push(&mut self, measurements: Arc<MeasurementBuffer>, metrics: &MetricRegistry) -> usize {
+        let mut lost = 0;
+        self.memory.push_back(measurements);
+        while self.memory.len() > self.max_memory_buffers {
+            let oldest = self.memory.pop_front().unwrap();
+            match &mut self.disk {
+                Some(disk) => {
+                    if let Err(e) = disk.append(&oldest, metrics) {
+                        log::error!(
+                            "Could not save the measurements of the {} on the disk, they are lost: {e:#}",
+                            self.description
+                        );
+                        lost += 1;
+                    }
+                }
+                None => {
+                    log::warn!(
+                        "The {} is full, the oldest measurements ({} points) are lost.",
+                        self.description,
+                        oldest.len()
+                    );
+                    lost += 1;
+                }
+            }
+        }
+        lost
+    }
+
+    /// Returns the oldest buffer of the queue, without removing it.
+    pub fn front(&mut self, metrics: &MetricRegistry) -> Option<Arc<MeasurementBuffer>> {
+        if self.disk_head.is_none() {
+            if let Some(disk) = &mut self.disk {
+                // skip the records that cannot be read
+                while !disk.is_empty() {
+                    match disk.read_front(metrics) {
+                        Ok(buf) => {
+                            self.disk_head = Some(Arc::new(buf));
+                            break;
+                        }
+                        Err(e) => {
+                            log::error!("Invalid measurements in the {}, they are lost: {e:#}", self.description);
+                            disk.skip_front();
+                        }
+                    }
+                }
+            }
+        }
+        self.disk_head.clone().or_else(|| self.memory.front().cloned())
+    }
+
+    /// Removes the oldest buffer of the queue.
+    pub fn pop_front(&mut self) {
+        if self.disk_head.take().is_some() {
+            self.disk.as_mut().unwrap().pop_front();
+        } else {
+            self.memory.pop_front();
+        }
+    }
+
+    /// Saves the buffers in memory to the disk.
+    ///
+    /// If the queue has no directory, the buffers are dropped.
+    pub fn persist(&mut self, metrics: &MetricRegistry) {
+        if self.memory.is_empty() {
+            return;
+        }
+        match &mut self.disk {
+            Some(disk) => {
+                for buf in self.memory.drain(..) {
+                    if let Err(e) = disk.append(&buf, metrics) {
+                        log::error!(
+                            "Could not save the measurements of the {} on the disk, they are lost: {e:#}",
+                            self.description
+                        );
+                    }
+                }
+            }
+            None => {
+                log::warn!(
+                    "The {} is dropped with {} buffers, they are lost (set a directory to keep them).",
+                    self.description,
+                    self.memory.len()
+                );
+                self.memory.clear();
+            }
+        }
+    }
+}
+
+/// Turns the name of an output into the name of a directory.
+pub(crate) fn output_dir_name(output_name: &str) -> String {
+    output_name
+        .chars()
+        .map(|c| if c.is_ascii_alphanumeric() || c == '-' { c } else { '_' })
+        .collect()
+}
+
+// ====== Segment files ======
+
+const SEGMENT_EXTENSION: &str = "seg";
+const CURSOR_FILE: &str = "cursor";
+
+/// Maximum size of an encoded buffer. A larger length on the disk means that the segment is corrupted.
+const MAX_RECORD_BYTES: u64 = 256 * 1024 * 1024;
+
+/// A queue of measurement buffers stored in append-only segment files.
+///
+/// Each record is the length of the encoded buffer (u32, little endian) followed by the buffer.
+/// The `cursor` file stores the position of the oldest record that has not been written by the output yet.
+/// If the agent crashes, some buffers may be written twice, but none is lost.
+struct DiskQueue {
+    dir: PathBuf,
+    /// Sequence number and size of each segment, the oldest first.
+    segments: VecDeque<(u64, u64)>,
+    /// Position of the oldest record in the first segment.
+    read_offset: u64,
+    /// Size of the oldest record, once it has been read.
+    front_len: Option<u64>,
+    total_bytes: u64,
+    max_bytes: u64,
+    segment_bytes: u64,
+}
+
+impl DiskQueue {
+    fn open(dir: &Path, max_bytes: u64) -> anyhow::Result<Self> {
+        fs::create_dir_all(dir).with_context(|| format!("failed to create {dir:?}"))?;
+        let mut segments = Vec::new();
+        for entry in fs::read_dir(dir)? {
+            let path = entry?.path();
+            if path.extension().is_some_and(|ext| ext == SEGMENT_EXTENSION) {
+                if let Some(seq) = path.file_stem().and_then(|s| s.to_str()).and_then(|s| s.parse().ok()) {
+                    segments.push((seq, fs::metadata(&path)?.len()));
+                }
+            }
+        }
+        segments.sort_unstable();
+
+        // Find where the previous run has stopped.
+        let mut read_offset = 0;
+        if let Ok(cursor) = fs::read_to_string(dir.join(CURSOR_FILE)) {
+            if let Some((seq, offset)) = cursor.trim().split_once(' ') {
+                let (seq, offset): (u64, u64) = (seq.parse()?, offset.parse()?);
+                for (s, _) in segments.iter().filter(|(s, _)| *s < seq) {
+                    fs::remove_file(segment_path(dir, *s))?;
+                }
+                segments.retain(|(s, _)| *s >= seq);
+                if segments.first().is_some_and(|(s, _)| *s == seq) {
+                    read_offset = offset;
+                }
+            }
+        }
+
+        let total_bytes = segments
+            .iter()
+            .map(|(_, len)| len)
+            .sum::<u64>()
+            .saturating_sub(read_offset);
+        let mut queue = Self {
+            dir: dir.to_owned(),
+            segments: segments.into(),
+            read_offset,
+            front_len: None,
+            total_bytes,
+            max_bytes,
+            segment_bytes: (max_bytes / 8).clamp(64 * 1024, 16 * 1024 * 1024),
+        };
+        queue.drop_consumed_segments()?;
+        Ok(queue)
+    }
+
+    fn is_empty(&self) -> bool {
+        self.total_bytes == 0
+    }
+
+    /// Appends a buffer at the end of the queue.
+    fn append(&mut self, buf: &MeasurementBuffer, metrics: &MetricRegistry) -> anyhow::Result<()> {
+        let mut record = vec![0u8; 4];
+        encode_buffer(buf, metrics, &mut record);
+        let len = u32::try_from(record.len() - 4)
+            .ok()
+            .filter(|len| u64::from(*len) <= MAX_RECORD_BYTES)
+            .context("measurement buffer too large")?;
+        record[..4].copy_from_slice(&len.to_le_bytes());
+        let record_len = record.len() as u64;
+        if record_len > self.max_bytes {
+            return Err(anyhow!("{record_len} bytes exceed the disk quota"));
+        }
+
+        // Make some room by deleting the oldest segments.
+        let mut dropped = false;
+        while self.total_bytes + record_len > self.max_bytes && !self.segments.is_empty() {
+            let (seq, len) = self.segments.pop_front().unwrap();
+            let lost = len - self.read_offset;
+            log::warn!(
+                "Retry queue {:?} exceeds its disk quota, {lost} bytes of measurements are lost.",
+                self.dir
+            );
+            fs::remove_file(segment_path(&self.dir, seq))?;
+            self.total_bytes -= lost;
+            self.read_offset = 0;
+            self.front_len = None;
+            dropped = true;
+        }
+
+        let seq = match self.segments.back() {
+            Some((seq, len)) if len + record_len <= self.segment_bytes => *seq,
+            last => {
+                let seq = last.map(|(seq, _)| seq + 1).unwrap_or(0);
+                self.segments.push_back((seq, 0));
+                seq
+            }
+        };
+        let mut file = OpenOptions::new()
+            .create(true)
+            .append(true)
+            .open(segment_path(&self.dir, seq))?;
+        file.write_all(&record)?;
+        self.segments.back_mut().unwrap().1 += record_len;
+        self.total_bytes += record_len;
+        if dropped {
+            self.save_cursor()?;
+        }
+        Ok(())
+    }
+
+    /// Reads the oldest buffer of the queue.
+    fn read_front(&mut self, metrics: &MetricRegistry) -> anyhow::Result<MeasurementBuffer> {
+        let (seq, segment_len) = *self.segments.front().expect("the queue should not be empty");
+        let mut file = File::open(segment_path(&self.dir, seq))?;
+        file.seek(SeekFrom::Start(self.read_offset))?;
+        let mut len = [0u8; 4];
+        file.read_exact(&mut len)?;
+        let len = u32::from_le_bytes(len) as u64;
+        let remaining = segment_len - self.read_offset;
+        if len > MAX_RECORD_BYTES || len + 4 > remaining {
+            // An incomplete record can be left by a crash, and the length can be corrupted.
+            // The next records cannot be found anymore: skip the rest of the segment.
+            self.front_len = Some(remaining);
+            return Err(anyhow!(
+                "corrupted record in segment {seq}: {len} bytes announced, {remaining} bytes left"
+            ));
+        }
+        self.front_len = Some(len + 4);
+        let mut record = vec![0u8; len as usize];
+        file.read_exact(&mut record)?;
+        decode_buffer(&record, metrics)
+    }
+
+    /// Removes the oldest buffer of the queue, after a successful write.
+    fn pop_front(&mut self) {
+        if let Err(e) = self.advance() {
+            log::error!("Failed to update the retry queue {:?}: {e:#}", self.dir);
+        }
+    }
+
+    /// Removes the oldest buffer of the queue, which cannot be read.
+    fn skip_front(&mut self) {
+        if self.front_len.is_none() {
+            // the length itself cannot be read, skip the whole segment
+            let (_, segment_len) = self.segments.front().unwrap();
+            self.front_len = Some(segment_len - self.read_offset);
+        }
+        self.pop_front();
+    }
+
+    fn advance(&mut self) -> anyhow::Result<()> {
+        let Some(len) = self.front_len.take() else {
+            // the record has been deleted to respect the disk quota
+            return Ok(());
+        };
+        self.read_offset += len;
+        self.total_bytes -= len;
+        self.drop_consumed_segments()?;
+        self.save_cursor()
+    }
+
+    /// Deletes the segments that have been entirely written by the output.
+    fn drop_consumed_segments(&mut self) -> anyhow::Result<()> {
+        while let Some((seq, len)) = self.segments.front() {
+            if self.read_offset < *len {
+                break;
+            }
+            fs::remove_file(segment_path(&self.dir, *seq))?;
+            self.segments.pop_front();
+            self.read_offset = 0;
+        }
+        Ok(())
+    }
+
+    fn save_cursor(&self) -> anyhow::Result<()> {
+        let seq = self.segments.front().map(|(seq, _)| *seq).unwrap_or(0);
+        fs::write(self.dir.join(CURSOR_FILE), format!("{seq} {}", self.read_offset))?;
+        Ok(())
+    }
+}
+
+fn segment_path(dir: &Path, seq: u64) -> PathBuf {
+    dir.join(format!("{seq:020}.{SEGMENT_EXTENSION}"))
+}
+
+// ====== Encoding ======
+//
+// The buffers are stored with the names of the metrics and the values of the resources, consumers
+// and attribute keys, because their ids are only valid in the current process.
+
+fn encode_buffer(buf: &MeasurementBuffer, metrics: &MetricRegistry, out: &mut Vec<u8>) {
+    fn put_str(out: &mut Vec<u8>, s: &str) {
+        out.extend_from_slice(&(s.len() as u32).to_le_bytes());
+        out.extend_from_slice(s.as_bytes());
+    }
+    fn put_kind_id(out: &mut Vec<u8>, local_machine: bool, kind: &str, id: Option<String>) {
+        if local_machine {
+            out.push(0);
+        } else {
+            out.push(1);
+            put_str(out, kind);
+            put_str(out, &id.unwrap_or_default());
+        }
+    }
+
+    out.extend_from_slice(&(buf.len() as u32).to_le_bytes());
+    for m in buf.iter() {
+        let metric = metrics.with_id(&m.metric).map(|m| m.name.as_str()).unwrap_or_default();
+        put_str(out, metric);
+
+        let t = SystemTime::from(m.timestamp)
+            .duration_since(UNIX_EPOCH)
+            .unwrap_or_default();
+        out.extend_from_slice(&t.as_secs().to_le_bytes());
+        out.extend_from_slice(&t.subsec_nanos().to_le_bytes());
+
+        match m.value {
+            WrappedMeasurementValue::F64(v) => {
+                out.push(0);
+                out.extend_from_slice(&v.to_le_bytes());
+            }
+            WrappedMeasurementValue::U64(v) => {
+                out.push(1);
+                out.extend_from_slice(&v.to_le_bytes());
+            }
+        }
+
+        let resource = m.resource.resolve();
+        put_kind_id(
+            out,
+            *resource == Resource::LocalMachine,
+            resource.kind(),
+            resource.id_string(),
+        );
+        let consumer = m.consumer.resolve();
+        put_kind_id(
+            out,
+            *consumer == ResourceConsumer::LocalMachine,
+            consumer.kind(),
+            consumer.id_string(),
+        );
+
+        out.extend_from_slice(&(m.attributes_len() as u32).to_le_bytes());
+        for (key, value) in m.attributes() {
+            put_str(out, key);
+            match value {
+                AttributeValue::F64(v) => {
+                    out.push(0);
+                    out.extend_from_slice(&v.to_le_bytes());
+                }
+                AttributeValue::U64(v) => {
+                    out.push(1);
+                    out.extend_from_slice(&v.to_le_bytes());
+                }
+                AttributeValue::Bool(v) => {
+                    out.push(2);
+                    out.push(*v as u8);
+                }
+                AttributeValue::Str(v) => {
+                    out.push(3);
+                    put_str(out, v);
+                }
+                AttributeValue::String(v) => {
+                    out.push(3);
+                    put_str(out, v);
+                }
+            }
+        }
+    }
+}
+
+fn decode_buffer(record: &[u8], metrics: &MetricRegistry) -> anyhow::Result<MeasurementBuffer> {
+    let mut r = Reader(record);
+    let n = r.u32()? as usize;
+    let mut buf = MeasurementBuffer::with_capacity(n);
+    let mut unknown_metrics = 0;
+    // the points of the buffer share the handles of their resources and consumers
+    let mut resources: HashMap<Resource, ResourceId> = HashMap::new();
+    let mut consumers: HashMap<ResourceConsumer, ConsumerId> = HashMap::new();
+    for _ in 0..n {
+        let metric = metrics.id_with_name(r.str()?);
+        let timestamp = UNIX_EPOCH + Duration::new(r.u64()?, r.u32()?);
+        let value = match r.u8()? {
+            0 => WrappedMeasurementValue::F64(f64::from_bits(r.u64()?)),
+            1 => WrappedMeasurementValue::U64(r.u64()?),
+            t => return Err(anyhow!("invalid value type {t}")),
+        };
+        let resource = match r.u8()? {
+            0 => Resource::LocalMachine,
+            _ => {
+                let (kind, id) = (r.str()?.to_owned(), r.str()?.to_owned());
+                Resource::parse(kind, id).map_err(|e| anyhow!("{e}"))?
+            }
+        };
+        let consumer = match r.u8()? {
+            0 => ResourceConsumer::LocalMachine,
+            _ => {
+                let (kind, id) = (r.str()?.to_owned(), r.str()?.to_owned());
+                ResourceConsumer::parse(kind, id).map_err(|e| anyhow!("{e}"))?
+            }
+        };
+        let n_attrs = r.u32()? as usize;
+        let mut attributes = Vec::with_capacity(n_attrs);
+        for _ in 0..n_attrs {
+            let name = r.str()?;
+            let key =
+                AttributeKey::try_new(name).ok_or_else(|| anyhow!("too many attribute keys, cannot load {name}"))?;
+            let value = match r.u8()? {
+                0 => AttributeValue::F64(f64::from_bits(r.u64()?)),
+                1 => AttributeValue::U64(r.u64()?),
+                2 => AttributeValue::Bool(r.u8()? != 0),
+                3 => AttributeValue::String(r.str()?.to_owned()),
+                t => return Err(anyhow!("invalid attribute type {t}")),
+            };
+            attributes.push((key, value));
+        }
+
+        // The metrics may have changed since the measurements have been saved.
+        let Some(metric) = metric else {
+            unknown_metrics += 1;
+            continue;
+        };
+        let resource = resources
+            .entry(resource)
+            .or_insert_with_key(|r| r.clone().into())
+            .clone();
+        let consumer = consumers
+            .entry(consumer)
+            .or_insert_with_key(|c| c.clone().into())
+            .clone();
+        let point = MeasurementPoint::new_untyped(timestamp.into(), metric, resource, consumer, value);
+        buf.push(point.with_attr_vec(attributes));
+    }
+    if unknown_metrics > 0 {
+        log::warn!(
+            "{unknown_metrics} measurements to retry refer to metrics that do not exist anymore, they are ignored."
+        );
+    }
+    Ok(buf)
+}
+
+struct Reader<'a>(&'a [u8]);
+
+impl<'a> Reader<'a> {
+    fn take(&mut self, n: usize) -> io::Result<&'a [u8]> {
+        if self.0.len() < n {
+            return Err(io::ErrorKind::UnexpectedEof.into());
+        }
+        let (head, tail) = self.0.split_at(n);
+        self.0 = tail;
+        Ok(head)
+    }
+
+    fn u8(&mut self) -> io::Result<u8> {
+        Ok(self.take(1)?[0])
+    }
+
+    fn u32(&mut self) -> io::Result<u32> {
+        Ok(u32::from_le_bytes(self.take(4)?.try_into().unwrap()))
+    }
+
+    fn u64(&mut self) -> io::Result<u64> {
+        Ok(u64::from_le_bytes(self.take(8)?.try_into().unwrap()))
+    }
+
+    fn str(&mut self) -> anyhow::Result<&'a str> {
+        let len = self.u32()? as usize;
+        Ok(std::str::from_utf8(self.take(len)?)?)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use crate::pipeline::testing::{buffer, registry, temp_dir};
+
+    use super::{decode_buffer, encode_buffer, SpillQueue};
+
+    #[test]
+    fn encoding_roundtrip() {
+        let (registry, metric) = registry();
+        let buf = buffer(metric, 3);
+        let mut encoded = Vec::new();
+        encode_buffer(&buf, &registry, &mut encoded);
+        let decoded = decode_buffer(&encoded, &registry).unwrap();
+        assert_eq!(3, decoded.len());
+        for (a, b) in buf.iter().zip(decoded.iter()) {
+            assert_eq!(a.metric, b.metric);
+            assert_eq!(a.timestamp, b.timestamp);
+            assert_eq!(a.resource, b.resource);
+            assert_eq!(a.consumer, b.consumer);
+            assert_eq!(format!("{:?}", a.value), format!("{:?}", b.value));
+            assert_eq!(
+                a.attributes().map(|(k, v)| (k, v.to_string())).collect::<Vec<_>>(),
+                b.attributes().map(|(k, v)| (k, v.to_string())).collect::<Vec<_>>()
+            );
+        }
+    }
+
+    #[test]
+    fn disk_quota() {
+        let (registry, metric) = registry();
+        let dir = temp_dir("spill-quota");
+        let mut record = Vec::new();
+        encode_buffer(&buffer(metric, 10), &registry, &mut record);
+        // room for about 3 records
+        let max_disk_bytes = 3 * (record.len() as u64 + 4) + 10;
+
+        let mut queue = SpillQueue::open(String::from("test queue"), 1, Some((dir.clone(), max_disk_bytes)));
+        for _ in 0..100 {
+            queue.push(buffer(metric, 10), &registry);
+        }
+        assert!(queue.disk_bytes() <= max_disk_bytes);
+        let on_disk: u64 = std::fs::read_dir(&dir)
+            .unwrap()
+            .map(|e| e.unwrap().path())
+            .filter(|p| p.extension().is_some_and(|e| e == "seg"))
+            .map(|p| std::fs::metadata(p).unwrap().len())
+            .sum();
+        assert!(on_disk <= max_disk_bytes);
+        std::fs::remove_dir_all(dir).unwrap();
+    }
+
+    #[test]
+    fn corrupted_length() {
+        let (registry, metric) = registry();
+        let dir = temp_dir("spill-corrupted");
+        let mut queue = SpillQueue::open(String::from("test queue"), 1, Some((dir.clone(), 1024 * 1024)));
+        for n in 1..=3 {
+            queue.push(buffer(metric, n), &registry);
+        }
+        // the first two buffers are in the same segment, announce a huge first record
+        let segment = super::segment_path(&dir, 0);
+        let mut content = std::fs::read(&segment).unwrap();
+        content[..4].copy_from_slice(&u32::MAX.to_le_bytes());
+        std::fs::write(&segment, content).unwrap();
+
+        // the rest of the segment is skipped
+        assert_eq!(Some(3), queue.front(&registry).map(|b| b.len()));
+        queue.pop_front();
+        assert!(queue.is_empty());
+        std::fs::remove_dir_all(dir).unwrap();
+    }
+}
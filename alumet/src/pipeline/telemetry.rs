@@ -0,0 +1,500 @@
+//! Self-telemetry: measurements about the pipeline itself.
+//!
+//! When enabled, the pipeline registers its own metrics and runs a managed source that measures
+//! the internal state of the pipeline. These measurements go through the transforms and outputs
+//! like any other measurement.
+//!
+//! The elements of the pipeline update their [`ElementStats`] as they run, with relaxed atomic operations.
+//! The telemetry source reads and resets the counters on each poll: the durations are averaged
+//! over the polling interval, and the counts are the number of events since the previous poll.
+
+use std::marker::PhantomData;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use std::time::Duration;
+
+use tokio::sync::mpsc;
+
+use crate::measurement::{
+    AttributeKey, AttributeValue, MeasurementAccumulator, MeasurementBuffer, MeasurementPoint, MeasurementType,
+    Timestamp, WrappedMeasurementType,
+};
+use crate::metrics::{Metric, MetricRegistry, TypedMetricId};
+use crate::resources::{ConsumerId, ResourceId};
+use crate::units::Unit;
+
+use super::histogram::{Histogram, HistogramSnapshot, Percentiles};
+use super::worker::QueueDepth;
+use super::{PollError, Source};
+
+/// Name of the self-telemetry source.
+pub const TELEMETRY_SOURCE_NAME: &str = "alumet/telemetry";
+
+/// Configures the self-telemetry of the pipeline.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct TelemetryConfig {
+    /// Whether to measure the pipeline itself.
+    pub enabled: bool,
+    /// How often to measure the state of the pipeline.
+    pub poll_interval: Duration,
+}
+
+impl Default for TelemetryConfig {
+    fn default() -> Self {
+        Self {
+            enabled: false,
+            poll_interval: Duration::from_secs(1),
+        }
+    }
+}
+
+/// Statistics of an element of the pipeline (source, transform or output).
+#[derive(Default)]
+pub(crate) struct ElementStats {
+    /// Number of operations (polls, transform applications or writes).
+    calls: AtomicU64,
+    /// Total duration of the operations, in nanoseconds.
+    busy_nanos: AtomicU64,
+    /// Number of measurement points handled by the operations.
+    points: AtomicU64,
+    /// Number of measurement buffers lost because the element could not keep up.
+    dropped: AtomicU64,
+}
+
+impl ElementStats {
+    /// Records an operation on `points` measurement points, which took `elapsed`.
+    pub fn record(&self, elapsed: Duration, points: usize) {
+        self.calls.fetch_add(1, Ordering::Relaxed);
+        self.busy_nanos.fetch_add(elapsed.as_nanos() as u64, Ordering::Relaxed);
+        self.points.fetch_add(points as u64, Ordering::Relaxed);
+    }
+
+    /// Records that `buffers` measurement buffers have been lost.
+    pub fn dropped(&self, buffers: usize) {
+        if buffers > 0 {
+            self.dropped.fetch_add(buffers as u64, Ordering::Relaxed);
+        }
+    }
+
+    /// Returns the counters and resets them.
+    fn take(&self) -> StatsDelta {
+        StatsDelta {
+            calls: self.calls.swap(0, Ordering::Relaxed),
+            busy_nanos: self.busy_nanos.swap(0, Ordering::Relaxed),
+            points: self.points.swap(0, Ordering::Relaxed),
+            dropped: self.dropped.swap(0, Ordering::Relaxed),
+        }
+    }
+}
+
+struct StatsDelta {
+    calls: u64,
+    busy_nanos: u64,
+    points: u64,
+    dropped: u64,
+}
+
+impl StatsDelta {
+    /// Mean duration of an operation, in seconds.
+    fn mean_duration(&self) -> Option<f64> {
+        (self.calls > 0).then(|| self.busy_nanos as f64 / self.calls as f64 / 1e9)
+    }
+}
+
+/// Statistics of a source.
+#[derive(Default)]
+pub(crate) struct SourceStats {
+    /// Polls since the last measurement of the telemetry.
+    polls: ElementStats,
+    /// Duration of the polls, since the source has started.
+    poll_duration: Histogram,
+    /// Delay between the scheduled tick of the trigger and the actual wakeup, since the source has started.
+    lateness: Histogram,
+}
+
+impl SourceStats {
+    /// Records a poll that took `elapsed`.
+    pub fn record_poll(&self, elapsed: Duration) {
+        self.polls.record(elapsed, 0);
+        self.poll_duration.record(elapsed);
+    }
+
+    /// Records how late the trigger woke the source up.
+    pub fn record_lateness(&self, lateness: Duration) {
+        self.lateness.record(lateness);
+    }
+}
+
+/// Timing statistics of a source, since it has started.
+#[derive(Debug, Clone)]
+pub struct SourceTiming {
+    /// Name of the plugin that owns the source.
+    pub plugin: String,
+    /// Name of the source.
+    pub name: String,
+    /// Delay between the scheduled tick of the trigger and the actual wakeup of the source.
+    ///
+    /// Only the triggers that follow a schedule (such as [`time_interval`](super::trigger::builder::time_interval))
+    /// are measured.
+    pub lateness: Percentiles,
+    /// Duration of [`Source::poll`].
+    pub poll_duration: Percentiles,
+}
+
+struct SourceEntry {
+    plugin: String,
+    name: String,
+    stats: Arc<SourceStats>,
+    /// Histograms at the previous measurement of the telemetry, to compute the percentiles of the last interval.
+    previous: Option<(HistogramSnapshot, HistogramSnapshot)>,
+}
+
+/// The statistics of the elements of a pipeline.
+///
+/// The sources can be added while the pipeline runs: they register their stats when they start,
+/// and their stats are forgotten once they have stopped.
+#[derive(Default)]
+pub(crate) struct PipelineStats {
+    sources: Mutex<Vec<SourceEntry>>,
+    transforms: Mutex<Vec<(AttributeValue, Arc<ElementStats>)>>,
+    outputs: Mutex<Vec<(AttributeValue, Arc<ElementStats>, QueueDepth)>>,
+}
+
+impl PipelineStats {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Returns the stats of a new source.
+    pub fn source(&self, plugin: &str, name: &str) -> Arc<SourceStats> {
+        let stats = Arc::new(SourceStats::default());
+        let mut sources = self.sources.lock().unwrap();
+        sources.push(SourceEntry {
+            plugin: plugin.to_owned(),
+            name: name.to_owned(),
+            stats: stats.clone(),
+            previous: None,
+        });
+        stats
+    }
+
+    /// Returns the timing statistics of the running sources.
+    pub fn source_timings(&self) -> Vec<SourceTiming> {
+        let sources = self.sources.lock().unwrap();
+        sources
+            .iter()
+            .filter(|s| Arc::strong_count(&s.stats) > 1)
+            .map(|s| SourceTiming {
+                plugin: s.plugin.clone(),
+                name: s.name.clone(),
+                lateness: s.stats.lateness.snapshot().percentiles(),
+                poll_duration: s.stats.poll_duration.snapshot().percentiles(),
+            })
+            .collect()
+    }
+
+    /// Returns the stats of a new transform.
+    pub fn transform(&self, name: &str) -> Arc<ElementStats> {
+        let stats = Arc::new(ElementStats::default());
+        let mut transforms = self.transforms.lock().unwrap();
+        transforms.push((AttributeValue::String(name.to_owned()), stats.clone()));
+        stats
+    }
+
+    /// Returns the stats of a new output, which has a queue.
+    pub fn output(&self, name: &str, depth: QueueDepth) -> Arc<ElementStats> {
+        let stats = Arc::new(ElementStats::default());
+        let mut outputs = self.outputs.lock().unwrap();
+        outputs.push((AttributeValue::String(name.to_owned()), stats.clone(), depth));
+        stats
+    }
+}
+
+/// The metrics of the self-telemetry.
+#[derive(Clone, Copy)]
+pub(crate) struct TelemetryMetrics {
+    source_poll_duration: TypedMetricId<f64>,
+    source_poll_duration_quantile: TypedMetricId<f64>,
+    source_trigger_lateness: TypedMetricId<f64>,
+    transform_queue_depth: TypedMetricId<u64>,
+    transform_apply_duration: TypedMetricId<f64>,
+    output_queue_depth: TypedMetricId<u64>,
+    output_write_duration: TypedMetricId<f64>,
+    output_points_written: TypedMetricId<u64>,
+    output_dropped_buffers: TypedMetricId<u64>,
+}
+
+impl TelemetryMetrics {
+    /// Registers the metrics of the self-telemetry.
+    ///
+    /// The metrics are renamed if a plugin has already registered metrics with the same names.
+    pub fn register(registry: &mut MetricRegistry) -> Self {
+        let metric = |name: &str, value_type: WrappedMeasurementType, unit: Unit, description: &str| Metric {
+            name: name.to_owned(),
+            description: description.to_owned(),
+            value_type,
+            unit: unit.into(),
+        };
+        let ids = registry.extend_infallible(
+            vec![
+                metric(
+                    "alumet_source_poll_duration",
+                    f64::wrapped_type(),
+                    Unit::Second,
+                    "Mean duration of a poll of a source.",
+                ),
+                metric(
+                    "alumet_source_poll_duration_quantile",
+                    f64::wrapped_type(),
+                    Unit::Second,
+                    "Quantiles of the duration of the polls of a source.",
+                ),
+                metric(
+                    "alumet_source_trigger_lateness",
+                    f64::wrapped_type(),
+                    Unit::Second,
+                    "Quantiles of the delay between the scheduled tick of a trigger and the wakeup of its source.",
+                ),
+                metric(
+                    "alumet_transform_queue_depth",
+                    u64::wrapped_type(),
+                    Unit::Unity,
+                    "Number of measurement buffers waiting between the sources and the transforms.",
+                ),
+                metric(
+                    "alumet_transform_apply_duration",
+                    f64::wrapped_type(),
+                    Unit::Second,
+                    "Mean duration of an application of a transform.",
+                ),
+                metric(
+                    "alumet_output_queue_depth",
+                    u64::wrapped_type(),
+                    Unit::Unity,
+                    "Number of measurement buffers waiting in the queue of an output.",
+                ),
+                metric(
+                    "alumet_output_write_duration",
+                    f64::wrapped_type(),
+                    Unit::Second,
+                    "Mean latency of a write of an output.",
+                ),
+                metric(
+                    "alumet_output_points_written",
+                    u64::wrapped_type(),
+                    Unit::Unity,
+                    "Number of measurement points written by an output since the previous measurement.",
+                ),
+                metric(
+                    "alumet_output_dropped_buffers",
+                    u64::wrapped_type(),
+                    Unit::Unity,
+                    "Number of measurement buffers lost by an output since the previous measurement, because its queue was full.",
+                ),
+            ],
+            "alumet",
+        );
+        Self {
+            source_poll_duration: TypedMetricId(ids[0], PhantomData),
+            source_poll_duration_quantile: TypedMetricId(ids[1], PhantomData),
+            source_trigger_lateness: TypedMetricId(ids[2], PhantomData),
+            transform_queue_depth: TypedMetricId(ids[3], PhantomData),
+            transform_apply_duration: TypedMetricId(ids[4], PhantomData),
+            output_queue_depth: TypedMetricId(ids[5], PhantomData),
+            output_write_duration: TypedMetricId(ids[6], PhantomData),
+            output_points_written: TypedMetricId(ids[7], PhantomData),
+            output_dropped_buffers: TypedMetricId(ids[8], PhantomData),
+        }
+    }
+}
+
+/// Measures the internal state of the pipeline.
+pub(crate) struct TelemetrySource {
+    metrics: TelemetryMetrics,
+    stats: Arc<PipelineStats>,
+    /// The channel between the sources and the transforms.
+    /// The source must not keep it open, otherwise the transforms would never stop.
+    to_transforms: mpsc::WeakSender<MeasurementBuffer>,
+    source_key: AttributeKey,
+    quantile_key: AttributeKey,
+    transform_key: AttributeKey,
+    output_key: AttributeKey,
+}
+
+impl TelemetrySource {
+    pub fn new(
+        metrics: TelemetryMetrics,
+        stats: Arc<PipelineStats>,
+        to_transforms: mpsc::WeakSender<MeasurementBuffer>,
+    ) -> Self {
+        Self {
+            metrics,
+            stats,
+            to_transforms,
+            source_key: AttributeKey::from("source"),
+            quantile_key: AttributeKey::from("quantile"),
+            transform_key: AttributeKey::from("transform"),
+            output_key: AttributeKey::from("output"),
+        }
+    }
+}
+
+impl Source for TelemetrySource {
+    fn poll(&mut self, acc: &mut MeasurementAccumulator, timestamp: Timestamp) -> Result<(), PollError> {
+        fn point<T: MeasurementType>(
+            timestamp: Timestamp,
+            metric: TypedMetricId<T>,
+            value: T::T,
+            key: AttributeKey,
+            name: &AttributeValue,
+        ) -> MeasurementPoint {
+            MeasurementPoint::new(
+                timestamp,
+                metric,
+                ResourceId::LOCAL_MACHINE,
+                ConsumerId::LOCAL_MACHINE,
+                value,
+            )
+            .with_attr(key, name.clone())
+        }
+
+        // Sources, the ones that have stopped are removed after their last measurement.
+        let mut sources = self.stats.sources.lock().unwrap();
+        sources.retain_mut(|entry| {
+            let name = AttributeValue::String(entry.name.clone());
+            if let Some(mean) = entry.stats.polls.take().mean_duration() {
+                acc.push(point(
+                    timestamp,
+                    self.metrics.source_poll_duration,
+                    mean,
+                    self.source_key,
+                    &name,
+                ));
+            }
+
+            // Percentiles of the last interval.
+            let durations = entry.stats.poll_duration.snapshot();
+            let lateness = entry.stats.lateness.snapshot();
+            let (interval_durations, interval_lateness) = match &entry.previous {
+                Some((prev_durations, prev_lateness)) => {
+                    (durations.since(prev_durations), lateness.since(prev_lateness))
+                }
+                None => (durations.clone(), lateness.clone()),
+            };
+            for (metric, percentiles) in [
+                (
+                    self.metrics.source_poll_duration_quantile,
+                    interval_durations.percentiles(),
+                ),
+                (self.metrics.source_trigger_lateness, interval_lateness.percentiles()),
+            ] {
+                if percentiles.count == 0 {
+                    continue;
+                }
+                for (quantile, value) in [
+                    ("0.5", percentiles.p50),
+                    ("0.99", percentiles.p99),
+                    ("1", percentiles.max),
+                ] {
+                    let p = point(timestamp, metric, value.as_secs_f64(), self.source_key, &name)
+                        .with_attr(self.quantile_key, AttributeValue::Str(quantile));
+                    acc.push(p);
+                }
+            }
+            entry.previous = Some((durations, lateness));
+            Arc::strong_count(&entry.stats) > 1
+        });
+        drop(sources);
+
+        // Transforms
+        if let Some(tx) = self.to_transforms.upgrade() {
+            let depth = tx.max_capacity() - tx.capacity();
+            acc.push(MeasurementPoint::new(
+                timestamp,
+                self.metrics.transform_queue_depth,
+                ResourceId::LOCAL_MACHINE,
+                ConsumerId::LOCAL_MACHINE,
+                depth as u64,
+            ));
+        }
+        for (name, stats) in self.stats.transforms.lock().unwrap().iter() {
+            if let Some(mean) = stats.take().mean_duration() {
+                acc.push(point(
+                    timestamp,
+                    self.metrics.transform_apply_duration,
+                    mean,
+                    self.transform_key,
+                    name,
+                ));
+            }
+        }
+
+        // Outputs
+        for (name, stats, depth) in self.stats.outputs.lock().unwrap().iter() {
+            let delta = stats.take();
+            let key = self.output_key;
+            acc.push(point(
+                timestamp,
+                self.metrics.output_queue_depth,
+                depth.get() as u64,
+                key,
+                name,
+            ));
+            acc.push(point(
+                timestamp,
+                self.metrics.output_points_written,
+                delta.points,
+                key,
+                name,
+            ));
+            acc.push(point(
+                timestamp,
+                self.metrics.output_dropped_buffers,
+                delta.dropped,
+                key,
+                name,
+            ));
+            if let Some(mean) = delta.mean_duration() {
+                acc.push(point(timestamp, self.metrics.output_write_duration, mean, key, name));
+            }
+        }
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::time::Duration;
+
+    use super::{ElementStats, PipelineStats};
+
+    #[test]
+    fn stats_are_reset_when_read() {
+        let stats = ElementStats::default();
+        stats.record(Duration::from_millis(1), 10);
+        stats.record(Duration::from_millis(3), 20);
+        stats.dropped(2);
+        let delta = stats.take();
+        assert_eq!(2, delta.calls);
+        assert_eq!(30, delta.points);
+        assert_eq!(2, delta.dropped);
+        assert_eq!(Some(0.002), delta.mean_duration());
+        assert_eq!(None, stats.take().mean_duration());
+    }
+
+    #[test]
+    fn stopped_sources_are_forgotten() {
+        let stats = PipelineStats::new();
+        let running = stats.source("test", "running");
+        drop(stats.source("test", "stopped"));
+        running.record_poll(Duration::from_millis(2));
+        running.record_lateness(Duration::from_micros(50));
+
+        let timings = stats.source_timings();
+        assert_eq!(1, timings.len());
+        assert_eq!("running", timings[0].name);
+        assert_eq!(1, timings[0].poll_duration.count);
+        assert_eq!(1, timings[0].lateness.count);
+        assert!(timings[0].lateness.max >= Duration::from_micros(50));
+    }
+}
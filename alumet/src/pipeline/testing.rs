@@ -0,0 +1,50 @@
+//! Fixtures shared by the unit tests of the pipeline.
+
+use std::path::PathBuf;
+use std::sync::Arc;
+
+use crate::measurement::{
+    AttributeValue, MeasurementBuffer, MeasurementPoint, MeasurementType, Timestamp, WrappedMeasurementValue,
+};
+use crate::metrics::{Metric, MetricRegistry, RawMetricId};
+use crate::resources::{Resource, ResourceConsumer};
+use crate::units::Unit;
+
+/// Returns a registry that contains a single metric, and the id of this metric.
+pub(crate) fn registry() -> (MetricRegistry, RawMetricId) {
+    let mut registry = MetricRegistry::new();
+    let id = registry
+        .register(Metric {
+            name: String::from("test_metric"),
+            description: String::new(),
+            value_type: u64::wrapped_type(),
+            unit: Unit::Unity.into(),
+        })
+        .unwrap();
+    (registry, id)
+}
+
+/// Returns a buffer of `n` measurements of `metric`, with different resources and an attribute.
+pub(crate) fn buffer(metric: RawMetricId, n: usize) -> Arc<MeasurementBuffer> {
+    let mut buf = MeasurementBuffer::new();
+    for i in 0..n {
+        buf.push(
+            MeasurementPoint::new_untyped(
+                Timestamp::now(),
+                metric,
+                Resource::CpuCore { id: i as u32 },
+                ResourceConsumer::Process { pid: 42 },
+                WrappedMeasurementValue::U64(i as u64),
+            )
+            .with_attr("test_attribute", AttributeValue::String(format!("point {i}"))),
+        );
+    }
+    Arc::new(buf)
+}
+
+/// Returns a path in the temporary directory that is unique to this test process, and removes what it contains.
+pub(crate) fn temp_dir(name: &str) -> PathBuf {
+    let dir = std::env::temp_dir().join(format!("alumet-test-{name}-{}", std::process::id()));
+    let _ = std::fs::remove_dir_all(&dir);
+    dir
+}
@@ -18,3 +18,56 @@ pub fn increase_thread_priority() -> std::io::Result<()> {
     #[cfg(not(target_os = "linux"))]
     Err(std::io::Error::new(std::io::ErrorKind::Unsupported, "cannot increase the thread priority on this platform"))
 }
+
+/// Restricts the current thread to run on the given CPU.
+pub fn pin_current_thread(cpu: usize) -> std::io::Result<()> {
+    pin_current_thread_to(&[cpu])
+}
+
+/// Restricts the current thread to run on the given CPUs.
+pub fn pin_current_thread_to(cpus: &[usize]) -> std::io::Result<()> {
+    #[cfg(target_os = "linux")]
+    {
+        let mut set: libc::cpu_set_t = unsafe { std::mem::zeroed() };
+        for &cpu in cpus {
+            // CPU_SET does not check the bounds of the set
+            if cpu >= libc::CPU_SETSIZE as usize {
+                return Err(std::io::Error::new(
+                    std::io::ErrorKind::InvalidInput,
+                    format!("invalid CPU {cpu}: the maximum is {}", libc::CPU_SETSIZE - 1),
+                ));
+            }
+            unsafe { libc::CPU_SET(cpu, &mut set) };
+        }
+        let res = unsafe { libc::sched_setaffinity(0, std::mem::size_of::<libc::cpu_set_t>(), &set) };
+        if res < 0 {
+            Err(std::io::Error::last_os_error())
+        } else {
+            Ok(())
+        }
+    }
+    #[cfg(not(target_os = "linux"))]
+    Err(std::io::Error::new(std::io::ErrorKind::Unsupported, "cannot pin threads to CPUs on this platform"))
+}
+
+/// Returns the CPUs on which the current thread is allowed to run.
+pub fn current_thread_affinity() -> std::io::Result<Vec<usize>> {
+    #[cfg(target_os = "linux")]
+    {
+        let mut set: libc::cpu_set_t = unsafe { std::mem::zeroed() };
+        let res = unsafe { libc::sched_getaffinity(0, std::mem::size_of::<libc::cpu_set_t>(), &mut set) };
+        if res < 0 {
+            Err(std::io::Error::last_os_error())
+        } else {
+            let cpus = (0..libc::CPU_SETSIZE as usize)
+                .filter(|&cpu| unsafe { libc::CPU_ISSET(cpu, &set) })
+                .collect();
+            Ok(cpus)
+        }
+    }
+    #[cfg(not(target_os = "linux"))]
+    Err(std::io::Error::new(
+        std::io::ErrorKind::Unsupported,
+        "cannot get the CPU affinity on this platform",
+    ))
+}
@@ -1,5 +1,7 @@
 //! Source triggers.
 
+#[cfg(unix)]
+use std::os::fd::{AsRawFd, BorrowedFd, OwnedFd, RawFd};
 use std::time::Duration;
 use std::{fmt, time};
 use std::{future::Future, pin::Pin};
@@ -8,6 +10,11 @@ use anyhow::Context;
 use tokio::sync::watch;
 
 use super::runtime::SourceCmd;
+use crate::measurement::{MeasurementPoint, Timestamp, WrappedMeasurementValue};
+
+/// File descriptor type of the platforms that do not have `std::os::fd`.
+#[cfg(not(unix))]
+type RawFd = std::ffi::c_int;
 
 /// A boxed future, from the `futures` crate.
 pub type BoxFuture<'a, T> = Pin<Box<dyn Future<Output = T> + Send + 'a>>;
@@ -23,6 +30,11 @@ pub struct TriggerSpec {
     mechanism: TriggerMechanismSpec,
     interruptible: bool,
     pub(crate) realtime_priority: bool,
+    grouped: bool,
+    /// Phase of the ticks on the wall clock, if they are aligned.
+    alignment: Option<Duration>,
+    /// CPU package measured by the source, if it measures a single one.
+    pub(crate) package: Option<u32>,
     config: TriggerConfig,
 }
 
@@ -31,6 +43,12 @@ pub(crate) struct Trigger {
     pub config: TriggerConfig,
     mechanism: TriggerMechanism,
     interrupt_signal: Option<watch::Receiver<SourceCmd>>,
+    /// How late the last tick was, compared to its schedule.
+    lateness: Option<Duration>,
+    /// Converts the ticks to wall-clock times, if they are aligned.
+    clock: Option<AlignedClock>,
+    /// Wall-clock time of the last tick, if the ticks are aligned.
+    tick_time: Option<time::SystemTime>,
 }
 
 #[derive(Debug, Clone)]
@@ -48,6 +66,19 @@ pub(crate) struct TriggerConfig {
     pub update_rounds: usize,
 }
 
+/// Identifies a group of sources that are polled from a single timer.
+///
+/// Sources can only be grouped if their triggers are identical, except for the start time.
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub(crate) struct TriggerGroupKey {
+    pub poll_interval: time::Duration,
+    pub flush_rounds: usize,
+    pub update_rounds: usize,
+    pub realtime_priority: bool,
+    pub alignment: Option<time::Duration>,
+    pub package: Option<u32>,
+}
+
 /// Constraints that can be applied to a [`TriggerSpec`] after its construction.
 pub(crate) struct TriggerConstraints {
     pub max_update_interval: time::Duration,
@@ -55,12 +86,13 @@ pub(crate) struct TriggerConstraints {
 
 /// Builder for source triggers.
 ///
-/// See [`builder::time_interval`](self::time_interval).
+/// See [`builder::time_interval`](self::time_interval), [`builder::fd_readable`](self::fd_readable)
+/// and [`builder::adaptive`](self::adaptive).
 pub mod builder {
     use core::fmt;
     use std::time::{Duration, Instant};
 
-    use super::{TriggerConfig, TriggerMechanismSpec, TriggerSpec};
+    use super::{AdaptiveSpec, RawFd, TriggerConfig, TriggerMechanismSpec, TriggerSpec};
 
     /// Returns a builder for a source trigger that polls the source at regular intervals.
     ///
@@ -87,6 +119,58 @@ pub mod builder {
         TimeTriggerBuilder::new(poll_interval)
     }
 
+    /// Returns a builder for a source trigger that polls the source when a file descriptor becomes readable.
+    ///
+    /// This is useful for sources that are notified by the kernel when new data is available,
+    /// for instance through a perf ring buffer, an inotify instance, a netlink socket or a pipe.
+    /// The readiness of the file descriptor is monitored with epoll. The trigger does not read
+    /// anything: the source must consume the available data when it is polled, otherwise it
+    /// is polled again immediately.
+    ///
+    /// The file descriptor is not owned by the trigger, but it must stay open as long as the trigger is used,
+    /// typically by being owned by the source.
+    /// Regular files and directories are not supported by epoll.
+    ///
+    /// ## Example
+    /// ```no_run
+    /// use alumet::pipeline::trigger;
+    /// use std::os::fd::AsRawFd;
+    /// use std::time::Duration;
+    ///
+    /// # let file = std::fs::File::open("/dev/null").unwrap();
+    /// let trigger_config = trigger::builder::fd_readable(file.as_raw_fd())
+    ///     .coalesce(Duration::from_millis(10))
+    ///     .build()
+    ///     .unwrap();
+    /// ```
+    pub fn fd_readable(fd: RawFd) -> FdTriggerBuilder {
+        FdTriggerBuilder::new(fd)
+    }
+
+    /// Returns a builder for a source trigger whose polling interval adapts to the variability of the measurements.
+    ///
+    /// The source is polled every `max_interval` while its measurements are stable.
+    /// When the measurements of a poll differ from the ones of the previous poll by more than a threshold,
+    /// the source is polled every `min_interval`, to capture the burst. Then, the interval grows back
+    /// toward `max_interval` while the measurements are stable.
+    ///
+    /// The measurements are compared with the sum of the values of each poll.
+    ///
+    /// ## Example
+    /// ```
+    /// use alumet::pipeline::trigger;
+    /// use std::time::Duration;
+    ///
+    /// let trigger_config = trigger::builder::adaptive(Duration::from_millis(1), Duration::from_secs(1))
+    ///     .threshold(0.2)
+    ///     .flush_interval(Duration::from_secs(1))
+    ///     .build()
+    ///     .unwrap();
+    /// ```
+    pub fn adaptive(min_interval: Duration, max_interval: Duration) -> AdaptiveTriggerBuilder {
+        AdaptiveTriggerBuilder::new(min_interval, max_interval)
+    }
+
     /// Builder for a source trigger that polls the source at regular intervals.
     pub struct TimeTriggerBuilder {
         start: Instant,
@@ -94,6 +178,9 @@ pub mod builder {
         config: TriggerConfig,
         interruptible: bool,
         realtime_priority: bool,
+        grouped: bool,
+        alignment: Option<Duration>,
+        package: Option<u32>,
     }
 
     #[derive(Debug)]
@@ -124,6 +211,9 @@ pub mod builder {
                 },
                 interruptible: false,
                 realtime_priority: false,
+                grouped: false,
+                alignment: None,
+                package: None,
             }
         }
 
@@ -187,11 +277,65 @@ pub mod builder {
             self
         }
 
+        /// Polls the source together with the other grouped sources that have the same trigger configuration.
+        ///
+        /// All the sources of a group are polled one after another on each tick of a single timer,
+        /// with the same timestamp, and their measurements are flushed in a single buffer.
+        /// This greatly reduces the overhead of having many sources with the same polling interval,
+        /// for instance one source per container.
+        ///
+        /// The start time of the trigger is ignored: the group is started by its first source.
+        /// Triggers that need to be interruptible (see [`update_interval`](Self::update_interval)) are not grouped.
+        pub fn grouped(mut self) -> Self {
+            self.grouped = true;
+            self
+        }
+
+        /// Aligns the ticks on the wall clock: the source is polled at the multiples of the polling interval,
+        /// counted from the Unix epoch.
+        ///
+        /// For instance, with an interval of 1s, the source is polled at the beginning of each second.
+        /// The timestamp of the measurements is the exact time of the tick, instead of the time
+        /// at which the source is actually polled. Therefore, aligned sources with the same interval
+        /// produce identical timestamps, which makes it easy to join their measurements.
+        ///
+        /// The first tick is the first aligned time after the start time.
+        pub fn aligned(self) -> Self {
+            self.phase(Duration::ZERO)
+        }
+
+        /// Aligns the ticks on the wall clock, with a fixed offset.
+        ///
+        /// The source is polled at `k * poll_interval + phase`. The phase must be smaller than the polling interval.
+        /// See [`aligned`](Self::aligned).
+        pub fn phase(mut self, phase: Duration) -> Self {
+            self.alignment = Some(phase);
+            self
+        }
+
+        /// Signals that the source measures the CPU package (socket) `package`.
+        ///
+        /// When the pipeline is configured to keep the sources on the package they measure
+        /// (see [`PlacementConfig`](crate::pipeline::placement::PlacementConfig)), the source runs on a thread
+        /// that is pinned to the CPUs of this package. Otherwise, this hint has no effect.
+        pub fn on_package(mut self, package: u32) -> Self {
+            self.package = Some(package);
+            self
+        }
+
         /// Builds the trigger.
         pub fn build(mut self) -> Result<TriggerSpec, Error> {
             if self.poll_interval.is_zero() {
                 return Err(Error::InvalidConfig(String::from("poll_interval must be non-zero")));
             }
+            if let Some(phase) = self.alignment {
+                if phase >= self.poll_interval {
+                    return Err(Error::InvalidConfig(format!(
+                        "phase must be smaller than poll_interval, but {phase:?} >= {:?}",
+                        self.poll_interval
+                    )));
+                }
+            }
             // automatically enable `realtime_priority` in some cases
             if self.poll_interval <= Duration::from_millis(3) {
                 self.realtime_priority = true;
@@ -201,10 +345,203 @@ pub mod builder {
                 mechanism: TriggerMechanismSpec::TimeInterval(self.start, self.poll_interval),
                 interruptible: self.interruptible,
                 realtime_priority: self.realtime_priority,
+                grouped: self.grouped,
+                alignment: self.alignment,
+                package: self.package,
+                config: self.config,
+            })
+        }
+    }
+
+    /// Builder for a source trigger that polls the source when a file descriptor becomes readable.
+    pub struct FdTriggerBuilder {
+        fd: RawFd,
+        min_interval: Duration,
+        config: TriggerConfig,
+        realtime_priority: bool,
+        package: Option<u32>,
+    }
+
+    impl FdTriggerBuilder {
+        pub fn new(fd: RawFd) -> Self {
+            Self {
+                fd,
+                min_interval: Duration::ZERO,
+                config: TriggerConfig {
+                    flush_rounds: 1,
+                    update_rounds: 1,
+                },
+                realtime_priority: false,
+                package: None,
+            }
+        }
+
+        /// Polls the source at most once every `min_interval`.
+        ///
+        /// The events that occur in the meantime are coalesced: the source is polled once
+        /// for all of them, when the interval has elapsed.
+        pub fn coalesce(mut self, min_interval: Duration) -> Self {
+            self.min_interval = min_interval;
+            self
+        }
+
+        /// Flush the measurements every `flush_rounds` polls.
+        ///
+        /// Since the file descriptor may stay idle for a long time, the measurements of
+        /// the last rounds can wait for a long time before being flushed.
+        pub fn flush_rounds(mut self, flush_rounds: usize) -> Self {
+            self.config.flush_rounds = flush_rounds;
+            self
+        }
+
+        /// Signals that the pipeline should run the source on a thread with a high scheduling priority.
+        ///
+        /// See [`TimeTriggerBuilder::realtime_priority`].
+        pub fn realtime_priority(mut self) -> Self {
+            self.realtime_priority = true;
+            self
+        }
+
+        /// Signals that the source measures the CPU package (socket) `package`.
+        ///
+        /// See [`TimeTriggerBuilder::on_package`].
+        pub fn on_package(mut self, package: u32) -> Self {
+            self.package = Some(package);
+            self
+        }
+
+        /// Builds the trigger.
+        pub fn build(self) -> Result<TriggerSpec, Error> {
+            if self.fd < 0 {
+                return Err(Error::InvalidConfig(format!("invalid file descriptor {}", self.fd)));
+            }
+            if self.config.flush_rounds == 0 {
+                return Err(Error::InvalidConfig(String::from("flush_rounds must be non-zero")));
+            }
+            Ok(TriggerSpec {
+                mechanism: TriggerMechanismSpec::FdReadable(self.fd, self.min_interval),
+                // The file descriptor can stay idle indefinitely, the trigger must be interruptible
+                // to apply the commands in time.
+                interruptible: true,
+                realtime_priority: self.realtime_priority,
+                grouped: false,
+                alignment: None,
+                package: self.package,
                 config: self.config,
             })
         }
     }
+
+    /// Builder for a source trigger whose polling interval adapts to the variability of the measurements.
+    pub struct AdaptiveTriggerBuilder {
+        spec: AdaptiveSpec,
+        realtime_priority: bool,
+        package: Option<u32>,
+    }
+
+    impl AdaptiveTriggerBuilder {
+        pub fn new(min_interval: Duration, max_interval: Duration) -> Self {
+            Self {
+                spec: AdaptiveSpec {
+                    min_interval,
+                    max_interval,
+                    threshold: 0.1,
+                    decay: 1.25,
+                    normalize: false,
+                    flush_interval: max_interval,
+                    update_interval: max_interval,
+                },
+                realtime_priority: false,
+                package: None,
+            }
+        }
+
+        /// Polls the source faster when the sum of the measured values changes by more than `threshold`
+        /// (relatively to the previous poll). The default threshold is `0.1`, that is, a change of 10%.
+        pub fn threshold(mut self, threshold: f64) -> Self {
+            self.spec.threshold = threshold;
+            self
+        }
+
+        /// Multiplies the polling interval by `decay` after each stable poll, until it reaches the maximum.
+        /// The default decay is `1.25`.
+        pub fn decay(mut self, decay: f64) -> Self {
+            self.spec.decay = decay;
+            self
+        }
+
+        /// Compares the values divided by the polling interval, instead of the raw values.
+        ///
+        /// Use it when the source measures increments since the previous poll, like energy counters:
+        /// otherwise, changing the interval changes the values, even if the signal is stable.
+        pub fn normalize_by_interval(mut self) -> Self {
+            self.spec.normalize = true;
+            self
+        }
+
+        /// Flush the measurement after, at most, the given duration.
+        ///
+        /// The number of rounds between two flushes is recomputed when the polling interval changes.
+        pub fn flush_interval(mut self, flush_interval: Duration) -> Self {
+            self.spec.flush_interval = flush_interval;
+            self
+        }
+
+        /// Update the source command after, at most, the given duration.
+        ///
+        /// The number of rounds between two updates is recomputed when the polling interval changes.
+        pub fn update_interval(mut self, update_interval: Duration) -> Self {
+            self.spec.update_interval = update_interval;
+            self
+        }
+
+        /// Signals that the pipeline should run the source on a thread with a high scheduling priority.
+        ///
+        /// See [`TimeTriggerBuilder::realtime_priority`].
+        pub fn realtime_priority(mut self) -> Self {
+            self.realtime_priority = true;
+            self
+        }
+
+        /// Signals that the source measures the CPU package (socket) `package`.
+        ///
+        /// See [`TimeTriggerBuilder::on_package`].
+        pub fn on_package(mut self, package: u32) -> Self {
+            self.package = Some(package);
+            self
+        }
+
+        /// Builds the trigger.
+        pub fn build(mut self) -> Result<TriggerSpec, Error> {
+            let spec = &self.spec;
+            if spec.min_interval.is_zero() || spec.min_interval > spec.max_interval {
+                return Err(Error::InvalidConfig(format!(
+                    "the intervals must satisfy 0 < min_interval <= max_interval, but min_interval = {:?} and max_interval = {:?}",
+                    spec.min_interval, spec.max_interval
+                )));
+            }
+            if !(spec.threshold > 0.0) {
+                return Err(Error::InvalidConfig(String::from("threshold must be positive")));
+            }
+            if !(spec.decay > 1.0) {
+                return Err(Error::InvalidConfig(String::from("decay must be greater than 1")));
+            }
+            // automatically enable `realtime_priority` in some cases, like time_interval
+            if spec.min_interval <= Duration::from_millis(3) {
+                self.realtime_priority = true;
+            }
+            Ok(TriggerSpec {
+                config: self.spec.config_for(self.spec.max_interval),
+                // the commands must be applied in time, even when the interval is long
+                interruptible: self.spec.max_interval > self.spec.update_interval,
+                mechanism: TriggerMechanismSpec::Adaptive(self.spec),
+                realtime_priority: self.realtime_priority,
+                grouped: false,
+                alignment: None,
+                package: self.package,
+            })
+        }
+    }
 }
 
 impl TriggerSpec {
@@ -248,10 +585,85 @@ impl TriggerSpec {
                             ((max_update_interval.as_nanos() / poll_interval.as_nanos()) as usize).max(1);
                     }
                 }
+                TriggerMechanismSpec::Adaptive(ref mut spec) => {
+                    // The rounds are recomputed from the update interval when the polling interval changes.
+                    spec.update_interval = spec.update_interval.min(max_update_interval);
+                    self.interruptible = spec.max_interval > spec.update_interval;
+                    self.config = spec.config_for(spec.max_interval);
+                }
                 _ => (),
             }
         }
     }
+
+    /// Returns the group of this trigger, or `None` if the source must be polled on its own.
+    pub(crate) fn group_key(&self) -> Option<TriggerGroupKey> {
+        match self.mechanism {
+            TriggerMechanismSpec::TimeInterval(_, poll_interval) if self.grouped && !self.interruptible => {
+                Some(TriggerGroupKey {
+                    poll_interval,
+                    flush_rounds: self.config.flush_rounds,
+                    update_rounds: self.config.update_rounds,
+                    realtime_priority: self.realtime_priority,
+                    alignment: self.alignment,
+                    package: self.package,
+                })
+            }
+            _ => None,
+        }
+    }
+
+    /// Returns true if the polling interval of this trigger can be stretched with [`stretched`](Self::stretched).
+    pub(crate) fn can_stretch(&self) -> bool {
+        matches!(
+            self.mechanism,
+            TriggerMechanismSpec::TimeInterval(_, _) | TriggerMechanismSpec::Adaptive(_)
+        )
+    }
+
+    /// Returns a copy of this trigger specification with a polling interval `factor` times longer.
+    ///
+    /// The numbers of rounds are divided by the same factor, so that the flush and update intervals stay
+    /// (approximately) the same. The new trigger starts after one stretched interval.
+    /// Returns `None` if the trigger is not based on a time interval.
+    pub(crate) fn stretched(&self, factor: u32) -> Option<TriggerSpec> {
+        match self.mechanism {
+            TriggerMechanismSpec::TimeInterval(_, poll_interval) => {
+                let poll_interval = poll_interval.saturating_mul(factor);
+                let factor = factor as usize;
+                Some(TriggerSpec {
+                    mechanism: TriggerMechanismSpec::TimeInterval(time::Instant::now() + poll_interval, poll_interval),
+                    interruptible: self.interruptible,
+                    realtime_priority: self.realtime_priority,
+                    grouped: self.grouped,
+                    alignment: self.alignment,
+                    package: self.package,
+                    config: TriggerConfig {
+                        flush_rounds: (self.config.flush_rounds / factor).max(1),
+                        update_rounds: (self.config.update_rounds / factor).max(1),
+                    },
+                })
+            }
+            TriggerMechanismSpec::Adaptive(ref spec) => {
+                // Stretch both bounds, the rounds are recomputed from the flush and update intervals.
+                let spec = AdaptiveSpec {
+                    min_interval: spec.min_interval.saturating_mul(factor),
+                    max_interval: spec.max_interval.saturating_mul(factor),
+                    ..spec.clone()
+                };
+                Some(TriggerSpec {
+                    config: spec.config_for(spec.max_interval),
+                    interruptible: self.interruptible || spec.max_interval > spec.update_interval,
+                    mechanism: TriggerMechanismSpec::Adaptive(spec),
+                    realtime_priority: self.realtime_priority,
+                    grouped: self.grouped,
+                    alignment: self.alignment,
+                    package: self.package,
+                })
+            }
+            _ => None,
+        }
+    }
 }
 
 impl Default for TriggerConstraints {
@@ -271,11 +683,7 @@ pub(crate) enum TriggerReason {
 
 impl Trigger {
     pub fn new(spec: TriggerSpec, interrupt_signal: watch::Receiver<SourceCmd>) -> Result<Self, std::io::Error> {
-        Ok(Self {
-            config: spec.config,
-            mechanism: TriggerMechanism::try_from(spec.mechanism)?,
-            interrupt_signal: Some(interrupt_signal),
-        })
+        Self::create(spec, Some(interrupt_signal))
     }
 
     #[allow(unused)]
@@ -283,37 +691,98 @@ impl Trigger {
         if spec.interruptible {
             Ok(None)
         } else {
-            Ok(Some(Self {
-                config: spec.config,
-                mechanism: TriggerMechanism::try_from(spec.mechanism)?,
-                interrupt_signal: None,
-            }))
+            Self::create(spec, None).map(Some)
         }
     }
 
+    fn create(
+        mut spec: TriggerSpec,
+        interrupt_signal: Option<watch::Receiver<SourceCmd>>,
+    ) -> Result<Self, std::io::Error> {
+        // The alignment is computed now, because the spec may have been created a long time ago.
+        let clock = match (spec.alignment, &mut spec.mechanism) {
+            (Some(phase), TriggerMechanismSpec::TimeInterval(start, period)) => {
+                let clock = AlignedClock::new(*period, phase);
+                *start = clock.first_tick((*start).max(time::Instant::now()));
+                Some(clock)
+            }
+            _ => None,
+        };
+        Ok(Self {
+            config: spec.config,
+            mechanism: TriggerMechanism::try_from(spec.mechanism)?,
+            interrupt_signal,
+            lateness: None,
+            clock,
+            tick_time: None,
+        })
+    }
+
     /// Waits for the next tick of the trigger, or for an interruption.
     pub async fn next(&mut self) -> anyhow::Result<TriggerReason> {
-        if let Some(signal) = &mut self.interrupt_signal {
+        let scheduled = if let Some(signal) = &mut self.interrupt_signal {
             // Use select! to wake up on trigger _or_ signal, the first that occurs
             tokio::select! {
                 biased; // don't choose the branch randomly (for performance)
 
                 res = self.mechanism.next() => {
-                    res?;
-                    Ok(TriggerReason::Triggered)
+                    res?
                 }
                 res = signal.changed() => {
                     // changed() returns an Error if the watch::Sender has been dropped, which should not happen.
                     res.context("watch::Sender dropped, which interrupted the Trigger")?;
-                    Ok(TriggerReason::Interrupted)
+                    self.lateness = None;
+                    self.tick_time = None;
+                    return Ok(TriggerReason::Interrupted);
                 }
             }
         } else {
             // Simple case: simply wait for the trigger
-            self.mechanism.next().await?;
-            Ok(TriggerReason::Triggered)
+            self.mechanism.next().await?
+        };
+        self.lateness = scheduled.map(|t| t.elapsed());
+        self.tick_time = match (&mut self.clock, scheduled) {
+            (Some(clock), Some(t)) => {
+                if clock.needs_resync(t) && clock.resync() > clock.max_drift() {
+                    // The wall clock has been adjusted: move the next ticks back to the aligned times.
+                    let start = clock.first_tick(time::Instant::now());
+                    let period = nanos_to_duration(clock.period);
+                    self.mechanism = TriggerMechanism::try_from(TriggerMechanismSpec::TimeInterval(start, period))?;
+                }
+                Some(clock.wall_clock(t))
+            }
+            _ => None,
+        };
+        Ok(TriggerReason::Triggered)
+    }
+
+    /// Gives the measurements of the last poll to the trigger, which adapts its polling interval if it is adaptive.
+    ///
+    /// When the interval changes, the numbers of flush and update rounds are recomputed.
+    pub fn observe<'a>(&mut self, points: impl Iterator<Item = &'a MeasurementPoint>) {
+        if let TriggerMechanism::Adaptive(timer) = &mut self.mechanism {
+            if let Some(interval) = timer.observe(points) {
+                self.config = timer.spec.config_for(interval);
+            }
         }
     }
+
+    /// Returns the timestamp of the last tick, if the trigger is aligned on the wall clock.
+    ///
+    /// The timestamp is an exact multiple of the polling interval (plus the phase), so that the sources
+    /// that are polled at the same tick get the same timestamp.
+    /// Returns `None` if the trigger is not aligned, or if the last call to [`next`](Self::next) has been interrupted.
+    pub fn tick_timestamp(&self) -> Option<Timestamp> {
+        self.tick_time.map(Timestamp::from)
+    }
+
+    /// Returns how late the last tick of the trigger was, compared to its schedule.
+    ///
+    /// Returns `None` if the last call to [`next`](Self::next) has been interrupted,
+    /// or if the trigger does not follow a schedule.
+    pub fn lateness(&self) -> Option<Duration> {
+        self.lateness
+    }
 }
 
 /// Spec for a trigger mechanism.
@@ -324,10 +793,39 @@ impl Trigger {
 #[derive(Debug, Clone)]
 enum TriggerMechanismSpec {
     TimeInterval(time::Instant, time::Duration),
+    /// File descriptor and minimum interval between two polls.
+    FdReadable(RawFd, time::Duration),
+    Adaptive(AdaptiveSpec),
     #[allow(dead_code)]
     Future(fn() -> BoxFuture<'static, SourceTriggerOutput>),
 }
 
+/// Configuration of an adaptive trigger, see [`builder::adaptive`].
+#[derive(Debug, Clone)]
+struct AdaptiveSpec {
+    min_interval: Duration,
+    max_interval: Duration,
+    /// Relative change of the measurements that makes the polling faster.
+    threshold: f64,
+    /// Growth factor of the interval after a stable poll.
+    decay: f64,
+    /// Divide the measurements by the polling interval before comparing them.
+    normalize: bool,
+    flush_interval: Duration,
+    update_interval: Duration,
+}
+
+impl AdaptiveSpec {
+    /// Computes the numbers of rounds for the given polling interval.
+    fn config_for(&self, poll_interval: Duration) -> TriggerConfig {
+        let rounds = |d: Duration| ((d.as_nanos() / poll_interval.as_nanos().max(1)) as usize).max(1);
+        TriggerConfig {
+            flush_rounds: rounds(self.flush_interval),
+            update_rounds: rounds(self.update_interval),
+        }
+    }
+}
+
 /// The possible trigger mechanisms.
 enum TriggerMechanism {
     /// A trigger based on a precise time interval. This is much more
@@ -336,12 +834,22 @@ enum TriggerMechanism {
     ///
     /// The source is polled each time `interval.next().await` returns.
     #[cfg(target_os = "linux")]
-    Timerfd(tokio_timerfd::Interval),
+    Timerfd(tokio_timerfd::Interval, Schedule),
 
     /// A trigger based on [`tokio::time::sleep`].
     #[allow(dead_code)]
     TokioSleep(tokio::time::Instant, tokio::time::Duration),
 
+    /// A trigger based on the readiness of a file descriptor, monitored by epoll.
+    ///
+    /// The source is polled each time the file descriptor becomes readable, but at most once per interval.
+    #[cfg(unix)]
+    FdReadable(FdReadiness),
+
+    /// A trigger based on [`tokio::time::sleep`], with a polling interval that changes
+    /// according to the measurements.
+    Adaptive(AdaptiveTimer),
+
     /// A trigger based on an arbitrary [`Future`] that is returned on demand
     /// by a function `f`.
     ///
@@ -358,7 +866,13 @@ impl TryFrom<TriggerMechanismSpec> for TriggerMechanism {
                 // Use timerfd if possible, fallback to `tokio::time::sleep`.
                 #[cfg(target_os = "linux")]
                 {
-                    TriggerMechanism::Timerfd(tokio_timerfd::Interval::new(at, duration)?)
+                    let interval = tokio_timerfd::Interval::new(at, duration)?;
+                    // The timer fires immediately if the start time is in the past.
+                    let schedule = Schedule {
+                        next: at.max(time::Instant::now()),
+                        period: duration,
+                    };
+                    TriggerMechanism::Timerfd(interval, schedule)
                 }
 
                 #[cfg(not(target_os = "linux"))]
@@ -366,29 +880,300 @@ impl TryFrom<TriggerMechanismSpec> for TriggerMechanism {
                     TriggerMechanism::TokioSleep(at.into(), duration.into())
                 }
             }
+            TriggerMechanismSpec::FdReadable(fd, min_interval) => {
+                #[cfg(unix)]
+                {
+                    TriggerMechanism::FdReadable(FdReadiness::new(fd, min_interval)?)
+                }
+
+                #[cfg(not(unix))]
+                {
+                    let _ = (fd, min_interval);
+                    return Err(std::io::Error::new(
+                        std::io::ErrorKind::Unsupported,
+                        "file descriptor triggers are only available on Unix",
+                    ));
+                }
+            }
+            TriggerMechanismSpec::Adaptive(spec) => TriggerMechanism::Adaptive(AdaptiveTimer::new(spec)),
             TriggerMechanismSpec::Future(f) => TriggerMechanism::Future(f),
         })
     }
 }
 
+/// How often an aligned trigger links the monotonic clock to the wall clock again.
+const CLOCK_RESYNC_INTERVAL: Duration = Duration::from_secs(60);
+
+/// Maps the ticks of a periodic timer to the wall clock, for triggers that are aligned on it.
+///
+/// The monotonic clock and the wall clock are linked when the trigger is created,
+/// and again every [`CLOCK_RESYNC_INTERVAL`], because the wall clock can be adjusted (by NTP, for instance).
+/// Each tick is rounded to the nearest aligned time, which absorbs the small adjustments between two resyncs.
+struct AlignedClock {
+    period: u128,
+    phase: u128,
+    /// A point in time, on both clocks.
+    reference: (time::Instant, u128),
+}
+
+impl AlignedClock {
+    fn new(period: Duration, phase: Duration) -> Self {
+        Self {
+            period: period.as_nanos().max(1),
+            phase: phase.as_nanos(),
+            reference: now_on_both_clocks(),
+        }
+    }
+
+    /// Returns true if the clocks have not been linked since [`CLOCK_RESYNC_INTERVAL`] before `tick`.
+    fn needs_resync(&self, tick: time::Instant) -> bool {
+        tick.saturating_duration_since(self.reference.0) >= CLOCK_RESYNC_INTERVAL
+    }
+
+    /// Links the monotonic clock to the wall clock again.
+    ///
+    /// Returns how much the wall clock has drifted since the last link, in nanoseconds.
+    fn resync(&mut self) -> u128 {
+        let (now, wall_now) = now_on_both_clocks();
+        let drift = self.to_wall_nanos(now).abs_diff(wall_now);
+        self.reference = (now, wall_now);
+        drift
+    }
+
+    /// Returns the maximum drift, in nanoseconds, above which the timer must be realigned.
+    ///
+    /// Below this drift, the ticks are still close enough to the aligned times to be rounded to them.
+    fn max_drift(&self) -> u128 {
+        (self.period / 4).min(Duration::from_millis(1).as_nanos())
+    }
+
+    /// Returns the first aligned tick at or after `start`.
+    fn first_tick(&self, start: time::Instant) -> time::Instant {
+        let wall_start = self.to_wall_nanos(start);
+        let since_phase = wall_start.saturating_sub(self.phase);
+        let k = since_phase.div_ceil(self.period);
+        let tick = k * self.period + self.phase;
+        start + nanos_to_duration(tick - wall_start)
+    }
+
+    /// Returns the aligned wall-clock time of a tick.
+    fn wall_clock(&self, tick: time::Instant) -> time::SystemTime {
+        let wall = self.to_wall_nanos(tick).saturating_sub(self.phase);
+        let k = (wall + self.period / 2) / self.period;
+        time::UNIX_EPOCH + nanos_to_duration(k * self.period + self.phase)
+    }
+
+    fn to_wall_nanos(&self, t: time::Instant) -> u128 {
+        let (ref_instant, ref_wall) = self.reference;
+        match t.checked_duration_since(ref_instant) {
+            Some(after) => ref_wall + after.as_nanos(),
+            None => ref_wall.saturating_sub(ref_instant.duration_since(t).as_nanos()),
+        }
+    }
+}
+
+/// Returns the current time on the monotonic clock, and on the wall clock (in nanoseconds since the Unix epoch).
+fn now_on_both_clocks() -> (time::Instant, u128) {
+    let now = time::Instant::now();
+    let wall_now = time::SystemTime::now()
+        .duration_since(time::UNIX_EPOCH)
+        .unwrap_or_default()
+        .as_nanos();
+    (now, wall_now)
+}
+
+fn nanos_to_duration(nanos: u128) -> Duration {
+    Duration::new((nanos / 1_000_000_000) as u64, (nanos % 1_000_000_000) as u32)
+}
+
+/// The expected ticks of a periodic timer.
+struct Schedule {
+    next: time::Instant,
+    period: Duration,
+}
+
+impl Schedule {
+    /// Returns the tick that has just fired, and moves to the next one.
+    ///
+    /// The timer does not fire for the ticks that it has missed, the next tick is the first one after `now`.
+    fn advance(&mut self, now: time::Instant) -> time::Instant {
+        let fired = self.next;
+        let late_periods = now.saturating_duration_since(fired).as_nanos() / self.period.as_nanos().max(1);
+        let skipped = u32::try_from(late_periods + 1).unwrap_or(u32::MAX);
+        self.next = fired + self.period.saturating_mul(skipped);
+        fired
+    }
+}
+
+/// A timer whose interval adapts to the variability of the measurements.
+struct AdaptiveTimer {
+    spec: AdaptiveSpec,
+    schedule: Schedule,
+    /// Measured signal at the previous poll.
+    previous: Option<f64>,
+}
+
+impl AdaptiveTimer {
+    fn new(spec: AdaptiveSpec) -> Self {
+        // Start slowly, the sources are expected to be stable most of the time.
+        let period = spec.max_interval;
+        Self {
+            spec,
+            schedule: Schedule {
+                next: time::Instant::now() + period,
+                period,
+            },
+            previous: None,
+        }
+    }
+
+    async fn next(&mut self) -> time::Instant {
+        tokio::time::sleep_until(self.schedule.next.into()).await;
+        self.schedule.advance(time::Instant::now())
+    }
+
+    /// Updates the polling interval according to the measurements of the last poll.
+    ///
+    /// Returns the new interval if it has changed.
+    fn observe<'a>(&mut self, points: impl Iterator<Item = &'a MeasurementPoint>) -> Option<Duration> {
+        let mut sum = 0.0;
+        let mut n = 0;
+        for p in points {
+            sum += match p.value {
+                WrappedMeasurementValue::F64(v) => v,
+                WrappedMeasurementValue::U64(v) => v as f64,
+            };
+            n += 1;
+        }
+        if n == 0 {
+            return None;
+        }
+        let interval = self.schedule.period;
+        let signal = if self.spec.normalize {
+            sum / interval.as_secs_f64()
+        } else {
+            sum
+        };
+        let previous = self.previous.replace(signal)?;
+
+        let change = (signal - previous).abs() / previous.abs().max(f64::MIN_POSITIVE);
+        let new_interval = if change > self.spec.threshold {
+            self.spec.min_interval
+        } else {
+            interval.mul_f64(self.spec.decay).min(self.spec.max_interval)
+        };
+        if new_interval == interval {
+            return None;
+        }
+        self.schedule = Schedule {
+            next: time::Instant::now() + new_interval,
+            period: new_interval,
+        };
+        Some(new_interval)
+    }
+}
+
+/// Readiness of a file descriptor, with optional coalescing of the events.
+#[cfg(unix)]
+struct FdReadiness {
+    /// Duplicate of the file descriptor of the source.
+    ///
+    /// The epoll registration is tied to this duplicate, so that the same file descriptor
+    /// can be watched by a new trigger before the old one is dropped (e.g. on `SetTrigger`).
+    fd: tokio::io::unix::AsyncFd<OwnedFd>,
+    min_interval: Duration,
+    last_fired: Option<tokio::time::Instant>,
+}
+
+#[cfg(unix)]
+impl FdReadiness {
+    fn new(fd: RawFd, min_interval: Duration) -> Result<Self, std::io::Error> {
+        // SAFETY: the file descriptor must stay open as long as the trigger is used, see `builder::fd_readable`.
+        let fd = unsafe { BorrowedFd::borrow_raw(fd) }.try_clone_to_owned()?;
+        Ok(Self {
+            fd: tokio::io::unix::AsyncFd::with_interest(fd, tokio::io::Interest::READABLE)?,
+            min_interval,
+            last_fired: None,
+        })
+    }
+
+    /// Waits until the file descriptor is readable, and at least `min_interval` after the previous tick.
+    async fn next(&mut self) -> Result<(), std::io::Error> {
+        if let Some(last) = self.last_fired {
+            // Coalesce the events that occur during the interval.
+            tokio::time::sleep_until(last + self.min_interval).await;
+        }
+        // epoll is used in edge-triggered mode: if the source has not consumed all the data,
+        // no new event would come. Check the actual state of the file descriptor first.
+        while !self.is_readable_now()? {
+            let mut guard = self.fd.readable().await?;
+            guard.clear_ready();
+        }
+        self.last_fired = Some(tokio::time::Instant::now());
+        Ok(())
+    }
+
+    /// Returns true if the file descriptor has data to read.
+    ///
+    /// Returns an error, which stops the source, if the file descriptor is invalid, has an error,
+    /// or has been closed by the other side and has nothing left to read.
+    fn is_readable_now(&self) -> Result<bool, std::io::Error> {
+        let mut pollfd = libc::pollfd {
+            fd: self.fd.as_raw_fd(),
+            events: libc::POLLIN,
+            revents: 0,
+        };
+        while unsafe { libc::poll(&mut pollfd, 1, 0) } == -1 {
+            let err = std::io::Error::last_os_error();
+            if err.kind() != std::io::ErrorKind::Interrupted {
+                return Err(err);
+            }
+        }
+        let revents = pollfd.revents;
+        let broken = |reason: &str| Err(std::io::Error::new(std::io::ErrorKind::BrokenPipe, reason.to_owned()));
+        if revents & libc::POLLNVAL != 0 {
+            broken("the file descriptor of the trigger is not open")
+        } else if revents & libc::POLLERR != 0 {
+            broken("error on the file descriptor of the trigger")
+        } else if revents & libc::POLLIN != 0 {
+            // After a hang up, the remaining data can still be read.
+            Ok(true)
+        } else if revents & libc::POLLHUP != 0 {
+            broken("the file descriptor of the trigger has been closed by the other side")
+        } else {
+            Ok(false)
+        }
+    }
+}
+
 impl TriggerMechanism {
-    pub async fn next(&mut self) -> Result<(), std::io::Error> {
+    /// Waits for the next tick, and returns the time at which it was scheduled, if the mechanism follows a schedule.
+    pub async fn next(&mut self) -> Result<Option<time::Instant>, std::io::Error> {
         use tokio_stream::StreamExt;
 
         match self {
             #[cfg(target_os = "linux")]
-            TriggerMechanism::Timerfd(interval) => {
+            TriggerMechanism::Timerfd(interval, schedule) => {
                 interval.next().await.unwrap()?;
-                Ok(())
+                Ok(Some(schedule.advance(time::Instant::now())))
             }
             TriggerMechanism::TokioSleep(start, period) => {
                 let start = *start;
                 let now = tokio::time::Instant::now();
                 let deadline = if start > now { start } else { now + *period };
                 tokio::time::sleep_until(deadline).await;
-                Ok(())
+                Ok(Some(deadline.into_std()))
+            }
+            #[cfg(unix)]
+            TriggerMechanism::FdReadable(readiness) => {
+                readiness.next().await?;
+                Ok(None)
+            }
+            TriggerMechanism::Adaptive(timer) => Ok(Some(timer.next().await)),
+            TriggerMechanism::Future(f) => {
+                f().await?;
+                Ok(None)
             }
-            TriggerMechanism::Future(f) => f().await,
         }
     }
 }
@@ -397,8 +1182,11 @@ impl fmt::Debug for TriggerMechanism {
     fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
         match self {
             #[cfg(target_os = "linux")]
-            Self::Timerfd(_) => f.write_str("Timerfd trigger"),
+            Self::Timerfd(_, _) => f.write_str("Timerfd trigger"),
             Self::TokioSleep(_, _) => f.write_str("TokioSleep trigger"),
+            #[cfg(unix)]
+            Self::FdReadable(readiness) => write!(f, "FdReadable trigger on fd {}", readiness.fd.as_raw_fd()),
+            Self::Adaptive(timer) => write!(f, "Adaptive trigger every {:?}", timer.schedule.period),
             Self::Future(_) => f.write_str("Future trigger"),
         }
     }
@@ -408,7 +1196,23 @@ impl fmt::Debug for TriggerMechanism {
 mod tests {
     use std::time::Duration;
 
-    use super::{builder, TriggerConstraints, TriggerMechanismSpec};
+    use super::{builder, Schedule, TriggerConstraints, TriggerMechanismSpec};
+    use std::time::Instant;
+
+    #[test]
+    fn schedule_skips_missed_ticks() {
+        let start = Instant::now();
+        let period = Duration::from_millis(10);
+        let mut schedule = Schedule { next: start, period };
+
+        // on time
+        assert_eq!(start, schedule.advance(start + Duration::from_millis(1)));
+        assert_eq!(start + period, schedule.next);
+
+        // 2.5 periods late: the missed ticks are skipped
+        assert_eq!(start + period, schedule.advance(start + Duration::from_millis(35)));
+        assert_eq!(start + period * 4, schedule.next);
+    }
 
     #[test]
     fn trigger_auto_config() {
@@ -511,4 +1315,200 @@ mod tests {
         assert_eq!(trigger.config.flush_rounds, 5);
         assert_eq!(trigger.config.update_rounds, 1);
     }
+
+    #[test]
+    fn trigger_groups() {
+        let interval = Duration::from_secs(1);
+        let a = builder::time_interval(interval).grouped().build().unwrap();
+        let b = builder::time_interval(interval)
+            .starting_at(Instant::now() + interval)
+            .grouped()
+            .build()
+            .unwrap();
+        assert!(a.group_key().is_some());
+        assert_eq!(a.group_key(), b.group_key(), "the start time must not prevent grouping");
+
+        let not_grouped = builder::time_interval(interval).build().unwrap();
+        assert_eq!(None, not_grouped.group_key());
+
+        let other_flush = builder::time_interval(interval)
+            .flush_interval(interval * 2)
+            .grouped()
+            .build()
+            .unwrap();
+        assert_ne!(a.group_key(), other_flush.group_key());
+
+        let interruptible = builder::time_interval(interval)
+            .update_interval(interval / 2)
+            .grouped()
+            .build()
+            .unwrap();
+        assert_eq!(None, interruptible.group_key());
+    }
+
+    #[test]
+    fn aligned_clock() {
+        use super::{AlignedClock, CLOCK_RESYNC_INTERVAL};
+        use std::time::UNIX_EPOCH;
+
+        let period = Duration::from_millis(250);
+        let phase = Duration::from_millis(10);
+        let clock = AlignedClock::new(period, phase);
+        let wall_nanos = |t| clock.wall_clock(t).duration_since(UNIX_EPOCH).unwrap().as_nanos();
+
+        let start = Instant::now();
+        let first = clock.first_tick(start);
+        assert!(first >= start && first < start + period);
+        assert_eq!(phase.as_nanos(), wall_nanos(first) % period.as_nanos());
+
+        // the ticks are rounded to the nearest aligned time
+        let late = first + period + Duration::from_millis(3);
+        assert_eq!(wall_nanos(first) + period.as_nanos(), wall_nanos(late));
+        let early = first + period * 2 - Duration::from_millis(3);
+        assert_eq!(wall_nanos(first) + 2 * period.as_nanos(), wall_nanos(early));
+
+        // the wall clock is adjusted: the drift is measured when the clocks are linked again
+        let mut clock = AlignedClock::new(period, phase);
+        assert!(!clock.needs_resync(Instant::now()));
+        assert!(clock.needs_resync(Instant::now() + CLOCK_RESYNC_INTERVAL));
+        clock.reference.1 -= Duration::from_millis(100).as_nanos();
+        assert!(clock.resync() > clock.max_drift());
+        assert!(clock.resync() < clock.max_drift());
+        let realigned = clock.wall_clock(clock.first_tick(Instant::now()));
+        let realigned = realigned.duration_since(UNIX_EPOCH).unwrap().as_nanos();
+        assert_eq!(phase.as_nanos(), realigned % period.as_nanos());
+
+        assert!(builder::time_interval(period).phase(period).build().is_err());
+        let aligned = builder::time_interval(period).aligned().grouped().build().unwrap();
+        let not_aligned = builder::time_interval(period).grouped().build().unwrap();
+        assert_ne!(aligned.group_key(), not_aligned.group_key());
+    }
+
+    #[tokio::test]
+    async fn aligned_triggers_have_identical_timestamps() {
+        use super::Trigger;
+        use std::time::UNIX_EPOCH;
+
+        let period = Duration::from_millis(20);
+        let spec = builder::time_interval(period).aligned().build().unwrap();
+        let mut a = Trigger::without_signal(spec.clone()).unwrap().unwrap();
+        let mut b = Trigger::without_signal(spec).unwrap().unwrap();
+        for _ in 0..3 {
+            let (ra, rb) = tokio::join!(a.next(), b.next());
+            ra.unwrap();
+            rb.unwrap();
+            let (ta, tb) = (a.tick_timestamp().unwrap(), b.tick_timestamp().unwrap());
+            assert_eq!(ta, tb);
+            let nanos = std::time::SystemTime::from(ta)
+                .duration_since(UNIX_EPOCH)
+                .unwrap()
+                .as_nanos();
+            assert_eq!(0, nanos % period.as_nanos());
+        }
+    }
+
+    #[test]
+    fn adaptive_interval() {
+        use super::{AdaptiveTimer, TriggerMechanismSpec};
+        use crate::measurement::{MeasurementPoint, Timestamp, WrappedMeasurementValue};
+        use crate::metrics::RawMetricId;
+        use crate::resources::{ResourceConsumer, ResourceId};
+
+        let point = |value: f64| {
+            MeasurementPoint::new_untyped(
+                Timestamp::now(),
+                RawMetricId(0),
+                ResourceId::LOCAL_MACHINE,
+                ResourceConsumer::LocalMachine,
+                WrappedMeasurementValue::F64(value),
+            )
+        };
+        let (min, max) = (Duration::from_millis(1), Duration::from_millis(100));
+        let spec = builder::adaptive(min, max)
+            .threshold(0.5)
+            .decay(2.0)
+            .flush_interval(Duration::from_millis(100))
+            .build()
+            .unwrap();
+        assert_eq!(1, spec.config.flush_rounds);
+        assert!(spec.can_stretch());
+        let TriggerMechanismSpec::Adaptive(adaptive) = spec.mechanism else {
+            panic!("wrong mechanism")
+        };
+        let mut timer = AdaptiveTimer::new(adaptive.clone());
+
+        // stable
+        assert_eq!(None, timer.observe([point(10.0)].iter()));
+        assert_eq!(None, timer.observe([point(11.0)].iter()));
+        assert_eq!(None, timer.observe([].iter()));
+
+        // burst: poll as fast as possible, flush less often
+        assert_eq!(Some(min), timer.observe([point(30.0)].iter()));
+        assert_eq!(100, adaptive.config_for(min).flush_rounds);
+
+        // stable again: the interval grows back to the maximum
+        let mut intervals = Vec::new();
+        while let Some(interval) = timer.observe([point(30.0)].iter()) {
+            intervals.push(interval.as_millis());
+        }
+        assert_eq!(vec![2, 4, 8, 16, 32, 64, 100], intervals);
+
+        assert!(builder::adaptive(max, min).build().is_err());
+        assert!(builder::adaptive(min, max).decay(1.0).build().is_err());
+        assert!(builder::adaptive(min, max).threshold(0.0).build().is_err());
+    }
+
+    #[tokio::test]
+    async fn fd_readable() {
+        use super::TriggerMechanism;
+        use std::os::fd::{AsRawFd, FromRawFd, OwnedFd};
+        use tokio::time::timeout;
+
+        let mut fds = [0; 2];
+        assert_eq!(0, unsafe { libc::pipe(fds.as_mut_ptr()) });
+        let (read_end, write_end) = unsafe { (OwnedFd::from_raw_fd(fds[0]), OwnedFd::from_raw_fd(fds[1])) };
+        let write = |data: &[u8]| unsafe { libc::write(write_end.as_raw_fd(), data.as_ptr().cast(), data.len()) };
+        let read_all = || {
+            let mut buf = [0u8; 64];
+            unsafe { libc::read(read_end.as_raw_fd(), buf.as_mut_ptr().cast(), buf.len()) }
+        };
+
+        let min_interval = Duration::from_millis(50);
+        let spec = builder::fd_readable(read_end.as_raw_fd())
+            .coalesce(min_interval)
+            .build()
+            .unwrap();
+        assert!(spec.interruptible);
+        assert_eq!(None, spec.group_key());
+        let mut trigger = TriggerMechanism::try_from(spec.mechanism).unwrap();
+
+        // nothing to read: the trigger must wait
+        let idle = timeout(Duration::from_millis(20), trigger.next()).await;
+        assert!(idle.is_err(), "the trigger must not fire when the fd is not readable");
+
+        // data available: the trigger fires
+        write(b"event");
+        timeout(Duration::from_secs(1), trigger.next()).await.unwrap().unwrap();
+        let fired = Instant::now();
+
+        // the data has not been consumed, but the next tick is delayed by the coalescing interval
+        write(b"event");
+        timeout(Duration::from_secs(1), trigger.next()).await.unwrap().unwrap();
+        assert!(fired.elapsed() >= min_interval);
+
+        // all the data has been consumed: the trigger waits for new data
+        read_all();
+        let idle = timeout(min_interval * 2, trigger.next()).await;
+        assert!(idle.is_err(), "the trigger must not fire after the data is consumed");
+
+        // closed by the other side: the remaining data can be read, then the trigger fails
+        write(b"event");
+        drop(write_end);
+        timeout(Duration::from_secs(1), trigger.next()).await.unwrap().unwrap();
+        read_all();
+        let closed = timeout(Duration::from_secs(1), trigger.next()).await.unwrap();
+        assert!(closed.is_err(), "the trigger must fail once the fd is closed");
+
+        assert!(builder::fd_readable(-1).build().is_err());
+    }
 }
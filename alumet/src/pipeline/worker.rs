@@ -0,0 +1,421 @@
+//! Output workers.
+//!
+//! [`Output::write`] is blocking, it cannot run on the async tasks of the pipeline.
+//! Each output gets a dedicated OS thread, which receives the measurements through a bounded queue.
+//! The thread lives as long as the output, which gives a predictable latency and keeps the caches warm
+//! for the writers of the output.
+
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::thread::JoinHandle;
+use std::time::Instant;
+
+use anyhow::{anyhow, Context};
+use tokio::sync::{mpsc, oneshot};
+
+use crate::measurement::MeasurementBuffer;
+use crate::metrics::SharedMetricRegistry;
+
+use super::queue::OverflowPolicy;
+use super::retry::{RetryConfig, RetryQueue};
+use super::telemetry::ElementStats;
+use super::{threading, Output, OutputContext, WriteError};
+
+/// Default number of measurement buffers that can wait in the queue of each output.
+pub const DEFAULT_OUTPUT_QUEUE_CAPACITY: usize = 32;
+
+/// Number of measurement buffers that can wait between the task of an output and its thread.
+///
+/// The real queue of the output is managed by its task (see [`OverflowPolicy`]), the thread only needs
+/// a small handoff to always have the next buffer ready.
+const THREAD_HANDOFF_CAPACITY: usize = 2;
+
+/// Default maximum number of writes in flight for each [`AsyncOutput`](super::AsyncOutput).
+pub const DEFAULT_MAX_IN_FLIGHT_WRITES: usize = 4;
+
+/// Configures how the outputs run.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct OutputWorkerConfig {
+    /// Maximum number of measurement buffers that can wait in the queue of each output.
+    ///
+    /// Each output has its own queue: a slow output does not slow down the other outputs.
+    /// When the queue of an output is full, the `overflow` policy applies.
+    pub queue_capacity: usize,
+
+    /// What to do when the queue of an output is full.
+    pub overflow: OverflowPolicy,
+
+    /// Pins the output threads to these CPUs (one CPU per output, in a round-robin fashion).
+    ///
+    /// If empty, the threads are not pinned and the OS scheduler chooses where they run.
+    pub cpus: Vec<usize>,
+
+    /// Maximum number of writes in flight for each async output.
+    ///
+    /// When the limit is reached, the output waits for its oldest write to finish before starting a new one.
+    pub max_in_flight: usize,
+
+    /// How to retry the writes that have failed with [`WriteError::CanRetry`].
+    pub retry: RetryConfig,
+}
+
+impl Default for OutputWorkerConfig {
+    fn default() -> Self {
+        Self {
+            queue_capacity: DEFAULT_OUTPUT_QUEUE_CAPACITY,
+            overflow: OverflowPolicy::default(),
+            cpus: Vec::new(),
+            max_in_flight: DEFAULT_MAX_IN_FLIGHT_WRITES,
+            retry: RetryConfig::default(),
+        }
+    }
+}
+
+/// Settings of an output, see [`OutputWorkerConfig`].
+pub(crate) struct OutputWorkerSettings {
+    pub queue_capacity: usize,
+    pub overflow: OverflowPolicy,
+    pub cpu: Option<usize>,
+    pub max_in_flight: usize,
+    pub retry: RetryConfig,
+    pub queue_depth: QueueDepth,
+    pub stats: Arc<ElementStats>,
+}
+
+/// Number of measurement buffers waiting in the queue of an output.
+#[derive(Clone, Default)]
+pub(crate) struct QueueDepth(Arc<AtomicUsize>);
+
+impl QueueDepth {
+    pub fn get(&self) -> usize {
+        self.0.load(Ordering::Relaxed)
+    }
+
+    pub(super) fn increment(&self) {
+        self.0.fetch_add(1, Ordering::Relaxed);
+    }
+
+    pub(super) fn decrement(&self) {
+        self.0.fetch_sub(1, Ordering::Relaxed);
+    }
+
+    pub(super) fn add(&self, n: usize) {
+        self.0.fetch_add(n, Ordering::Relaxed);
+    }
+
+    pub(super) fn sub(&self, n: usize) {
+        self.0.fetch_sub(n, Ordering::Relaxed);
+    }
+}
+
+/// The thread of an output, and the sending half of its queue.
+pub(crate) struct OutputWorker {
+    name: String,
+    tx: Option<mpsc::Sender<Arc<MeasurementBuffer>>>,
+    depth: QueueDepth,
+    result: oneshot::Receiver<anyhow::Result<()>>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl OutputWorker {
+    /// Starts a new thread that writes the measurements to the output.
+    ///
+    /// Must be called from a tokio runtime, which is used to wait for the retries.
+    pub fn spawn(
+        name: String,
+        mut output: Box<dyn Output>,
+        mut ctx: OutputContext,
+        metrics: Arc<SharedMetricRegistry>,
+        settings: OutputWorkerSettings,
+    ) -> std::io::Result<Self> {
+        let (tx, mut rx) = mpsc::channel::<Arc<MeasurementBuffer>>(THREAD_HANDOFF_CAPACITY);
+        let (result_tx, result_rx) = oneshot::channel();
+        let rt = tokio::runtime::Handle::current();
+        let thread_name = name.clone();
+        let depth = settings.queue_depth;
+        let thread_depth = depth.clone();
+        let thread = std::thread::Builder::new()
+            .name(format!("output-{name}"))
+            .spawn(move || {
+                let name = thread_name;
+                if let Some(cpu) = settings.cpu {
+                    if let Err(e) = threading::pin_current_thread(cpu) {
+                        log::warn!("Could not pin the thread of output {name} to CPU {cpu}: {e}");
+                    }
+                }
+                let mut retry = RetryQueue::open(&settings.retry, &name);
+                let mut metrics_version = metrics.version();
+                let res = loop {
+                    // Wait for new measurements, or for the next retry.
+                    let received = match retry.next_attempt() {
+                        None => rx.blocking_recv(),
+                        Some(deadline) => {
+                            let wait = async { tokio::time::timeout_at(deadline, rx.recv()).await };
+                            match rt.block_on(wait) {
+                                Ok(received) => received,
+                                Err(_) => {
+                                    // Metrics may have been registered since the last write, which is rare: checking the version is enough.
+                                    refresh_metrics(&mut ctx, &metrics, &mut metrics_version);
+                                    match retry_oldest(&mut retry, output.as_mut(), &ctx, &name, &settings.stats) {
+                                        Ok(()) => continue,
+                                        Err(e) => break Err(e),
+                                    }
+                                }
+                            }
+                        }
+                    };
+                    let Some(measurements) = received else {
+                        // the queue has been closed and all the measurements have been written
+                        break Ok(());
+                    };
+                    thread_depth.decrement();
+                    refresh_metrics(&mut ctx, &metrics, &mut metrics_version);
+
+                    // Don't write the new measurements before the ones that have failed.
+                    if !retry.is_empty() {
+                        retry.push(measurements, &ctx.metrics);
+                        continue;
+                    }
+                    let write_start = Instant::now();
+                    let res = output.write(&measurements, &ctx);
+                    settings.stats.record(write_start.elapsed(), measurements.len());
+                    match res {
+                        Ok(()) => (),
+                        Err(WriteError::CanRetry(e)) if retry.is_enabled() => {
+                            log::error!("Non-fatal error in output {name} (the measurements will be written later): {e:#}");
+                            retry.push(measurements, &ctx.metrics);
+                        }
+                        Err(WriteError::CanRetry(e)) => {
+                            log::error!("Non-fatal error in output {name} (retries are disabled, the measurements are lost): {e:#}");
+                        }
+                        Err(WriteError::Fatal(e)) => {
+                            log::error!("Fatal error in output {name} (it will stop running): {e:?}");
+                            break Err(e.context(format!("fatal error in output {name}")));
+                        }
+                    }
+                };
+                retry.persist(&ctx.metrics);
+                // If the receiver has been dropped, the pipeline is not interested in the result anymore.
+                let _ = result_tx.send(res);
+            })?;
+        Ok(Self {
+            name,
+            tx: Some(tx),
+            depth,
+            result: result_rx,
+            thread: Some(thread),
+        })
+    }
+
+    /// Gives the measurements to the thread, waiting for it to be ready if needed.
+    ///
+    /// Returns an error if the output has stopped because of an error.
+    /// This method is cancel safe: if it is cancelled, the measurements have not been given to the thread.
+    pub async fn write(&mut self, measurements: Arc<MeasurementBuffer>) -> anyhow::Result<()> {
+        let tx = self.tx.as_ref().expect("the queue is only closed by stop()");
+        let Ok(permit) = tx.reserve().await else {
+            // the thread has stopped early, find out why
+            return Err(self.failed().await);
+        };
+        self.depth.increment();
+        permit.send(measurements);
+        Ok(())
+    }
+
+    /// Waits for the thread to stop on its own, which only happens if the output fails.
+    pub async fn failed(&mut self) -> anyhow::Error {
+        match (&mut self.result).await {
+            Ok(Err(e)) => e,
+            Ok(Ok(())) => anyhow!("output {} stopped unexpectedly", self.name),
+            Err(_) => self
+                .join()
+                .await
+                .err()
+                .unwrap_or_else(|| anyhow!("output {} stopped unexpectedly", self.name)),
+        }
+    }
+
+    /// Writes the measurements that remain in the queue, and stops the thread.
+    pub async fn stop(mut self) -> anyhow::Result<()> {
+        self.tx = None;
+        match (&mut self.result).await {
+            Ok(res) => {
+                self.join().await?;
+                res
+            }
+            Err(_) => self.join().await,
+        }
+    }
+
+    /// Waits for the thread to terminate.
+    async fn join(&mut self) -> anyhow::Result<()> {
+        let Some(thread) = self.thread.take() else {
+            return Ok(());
+        };
+        let name = self.name.clone();
+        tokio::task::spawn_blocking(move || thread.join())
+            .await
+            .context("failed to wait for the output thread")?
+            .map_err(|_| anyhow!("The thread of output {name} panicked, there is a bug somewhere!"))
+    }
+}
+
+/// Replaces the snapshot of the metric registry if new metrics have been registered.
+pub(super) fn refresh_metrics(ctx: &mut OutputContext, metrics: &SharedMetricRegistry, version: &mut u64) {
+    let current = metrics.version();
+    if current != *version {
+        ctx.metrics = metrics.snapshot();
+        *version = current;
+    }
+}
+
+/// Writes the oldest measurements of the retry queue again.
+fn retry_oldest(
+    retry: &mut RetryQueue,
+    output: &mut dyn Output,
+    ctx: &OutputContext,
+    name: &str,
+    stats: &ElementStats,
+) -> anyhow::Result<()> {
+    let Some(measurements) = retry.front(&ctx.metrics) else {
+        return Ok(());
+    };
+    let write_start = Instant::now();
+    let res = output.write(&measurements, ctx);
+    stats.record(write_start.elapsed(), measurements.len());
+    match res {
+        Ok(()) => retry.pop_front(),
+        Err(WriteError::CanRetry(e)) => {
+            log::warn!("Output {name} failed again to write the measurements (will retry later): {e:#}");
+            retry.failed();
+        }
+        Err(WriteError::Fatal(e)) => {
+            log::error!("Fatal error in output {name} (it will stop running): {e:?}");
+            return Err(e.context(format!("fatal error in output {name}")));
+        }
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::atomic::{AtomicUsize, Ordering};
+    use std::sync::{Arc, Mutex};
+    use std::time::Duration;
+
+    use anyhow::anyhow;
+
+    use crate::measurement::MeasurementBuffer;
+    use crate::metrics::{MetricRegistry, RawMetricId, SharedMetricRegistry};
+    use crate::pipeline::queue::OverflowPolicy;
+    use crate::pipeline::retry::RetryConfig;
+    use crate::pipeline::testing;
+    use crate::pipeline::{Output, OutputContext, WriteError};
+    use crate::resources::ResourceRegistry;
+
+    use super::{OutputWorker, OutputWorkerSettings, QueueDepth};
+
+    struct CountingOutput {
+        writes: Arc<AtomicUsize>,
+        fail_after: usize,
+    }
+
+    impl Output for CountingOutput {
+        fn write(&mut self, _measurements: &MeasurementBuffer, _ctx: &OutputContext) -> Result<(), WriteError> {
+            let n = self.writes.fetch_add(1, Ordering::Relaxed) + 1;
+            if n > self.fail_after {
+                return Err(WriteError::Fatal(anyhow!("too many writes")));
+            }
+            Ok(())
+        }
+    }
+
+    /// Fails to write the first measurements, then writes everything.
+    struct FlakyOutput {
+        failures: usize,
+        written: Arc<Mutex<Vec<usize>>>,
+    }
+
+    impl Output for FlakyOutput {
+        fn write(&mut self, measurements: &MeasurementBuffer, _ctx: &OutputContext) -> Result<(), WriteError> {
+            if self.failures > 0 {
+                self.failures -= 1;
+                return Err(WriteError::CanRetry(anyhow!("not now")));
+            }
+            self.written.lock().unwrap().push(measurements.len());
+            Ok(())
+        }
+    }
+
+    fn spawn_output(output: Box<dyn Output>, retry: RetryConfig) -> OutputWorker {
+        let metrics = Arc::new(SharedMetricRegistry::new(MetricRegistry::new()));
+        let ctx = OutputContext {
+            metrics: metrics.snapshot(),
+            resources: Arc::new(ResourceRegistry::new()),
+        };
+        let settings = OutputWorkerSettings {
+            queue_capacity: 4,
+            overflow: OverflowPolicy::default(),
+            cpu: None,
+            max_in_flight: 1,
+            retry,
+            queue_depth: QueueDepth::default(),
+            stats: Default::default(),
+        };
+        OutputWorker::spawn(String::from("test"), output, ctx, metrics, settings).unwrap()
+    }
+
+    fn spawn(fail_after: usize) -> (OutputWorker, Arc<AtomicUsize>) {
+        let writes = Arc::new(AtomicUsize::new(0));
+        let output = Box::new(CountingOutput {
+            writes: writes.clone(),
+            fail_after,
+        });
+        (spawn_output(output, RetryConfig::default()), writes)
+    }
+
+    fn buffer(n: usize) -> Arc<MeasurementBuffer> {
+        testing::buffer(RawMetricId(0), n)
+    }
+
+    #[tokio::test(flavor = "multi_thread")]
+    async fn write_everything_before_stopping() {
+        let (mut worker, writes) = spawn(usize::MAX);
+        for _ in 0..10 {
+            worker.write(Arc::new(MeasurementBuffer::new())).await.unwrap();
+        }
+        worker.stop().await.unwrap();
+        assert_eq!(10, writes.load(Ordering::Relaxed));
+    }
+
+    #[tokio::test(flavor = "multi_thread")]
+    async fn report_fatal_error() {
+        let (mut worker, _writes) = spawn(2);
+        for _ in 0..3 {
+            worker.write(Arc::new(MeasurementBuffer::new())).await.unwrap();
+        }
+        let err = worker.failed().await;
+        assert!(format!("{err:#}").contains("too many writes"));
+    }
+
+    #[tokio::test(flavor = "multi_thread")]
+    async fn retry_in_order() {
+        let written = Arc::new(Mutex::new(Vec::new()));
+        let output = Box::new(FlakyOutput {
+            failures: 3,
+            written: written.clone(),
+        });
+        let retry = RetryConfig {
+            initial_backoff: Duration::from_millis(5),
+            ..Default::default()
+        };
+        let mut worker = spawn_output(output, retry);
+        for n in 1..=5 {
+            worker.write(buffer(n)).await.unwrap();
+        }
+        // wait for the retries
+        tokio::time::sleep(Duration::from_millis(200)).await;
+        worker.stop().await.unwrap();
+        assert_eq!(vec![1, 2, 3, 4, 5], *written.lock().unwrap());
+    }
+}
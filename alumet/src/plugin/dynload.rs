@@ -39,7 +39,10 @@ impl Plugin for DylibPlugin {
     }
 
     fn start(&mut self, alumet: &mut AlumetStart) -> anyhow::Result<()> {
-        (self.start_fn)(self.instance, alumet); // TODO error handling for ffi
+        // the resources that the plugin interns while it starts are shared with the rest of the pipeline
+        let resources = alumet.resources();
+        // TODO error handling for ffi
+        ffi::resources::with_pipeline_resources(resources, || (self.start_fn)(self.instance, alumet));
         Ok(())
     }
 
@@ -83,18 +83,23 @@
 //!
 //! WIP
 //!
+use std::borrow::Cow;
 use std::future::Future;
 use std::marker::PhantomData;
+use std::sync::Arc;
 
 use tokio_util::sync::CancellationToken;
 
-use crate::measurement::{MeasurementBuffer, MeasurementType, WrappedMeasurementType};
+use crate::measurement::{AttributeKey, MeasurementBuffer, MeasurementType, WrappedMeasurementType};
 use crate::metrics::{Metric, MetricCreationError, RawMetricId, TypedMetricId};
-use crate::pipeline::builder::{AutonomousSourceBuilder, ManagedSourceBuilder, OutputBuilder, TransformBuilder};
+use crate::pipeline::builder::{
+    AutonomousSourceBuilder, ManagedSourceBuilder, OutputBuilder, OutputKind, TransformBuilder,
+};
 use crate::pipeline::runtime::{IdlePipeline, RunningPipeline};
 use crate::pipeline::trigger::TriggerSpec;
 use crate::pipeline::{builder::PendingPipelineContext, builder::PipelineBuilder};
-use crate::pipeline::{Output, Source, Transform};
+use crate::pipeline::{AsyncOutput, Output, Source, Transform};
+use crate::resources::ResourceRegistry;
 use crate::units::PrefixedUnit;
 
 use self::rust::AlumetPlugin;
@@ -273,6 +278,23 @@ impl<'a> AlumetStart<'a> {
         self.pipeline_builder.metrics.register(m)
     }
 
+    /// Registers an attribute key, to be used with [`MeasurementPoint::with_attr`](crate::measurement::MeasurementPoint::with_attr).
+    ///
+    /// Unlike metrics, attribute keys can be shared between plugins:
+    /// if the key already exists, it is returned.
+    pub fn create_attribute_key(&mut self, name: impl Into<Cow<'static, str>>) -> AttributeKey {
+        AttributeKey::new(name)
+    }
+
+    /// Returns the registry of the resources and consumers of the pipeline.
+    ///
+    /// Sources should intern their resources and consumers once, when they are created,
+    /// and clone the ids when they produce measurement points.
+    /// The registry can be kept to intern new resources while the pipeline is running.
+    pub fn resources(&self) -> Arc<ResourceRegistry> {
+        self.pipeline_builder.resources.clone()
+    }
+
     /// Adds a measurement source to the Alumet pipeline.
     pub fn add_source(&mut self, source: Box<dyn Source>, trigger: TriggerSpec) {
         let plugin = self.current_plugin_name().to_owned();
@@ -288,6 +310,24 @@ impl<'a> AlumetStart<'a> {
         })
     }
 
+    /// Adds a measurement source to the Alumet pipeline, with a name chosen by the plugin.
+    ///
+    /// Unlike the sources added by [`add_source`](Self::add_source), a named source can be removed
+    /// while the pipeline is running, with [`ControlHandle::remove_source`](crate::pipeline::runtime::ControlHandle::remove_source).
+    pub fn add_named_source(&mut self, source_name: &str, source: Box<dyn Source>, trigger: TriggerSpec) {
+        let plugin = self.current_plugin_name().to_owned();
+        let name = self
+            .pipeline_builder
+            .namegen
+            .deduplicate(format!("{plugin}/{source_name}"), false);
+        self.pipeline_builder.sources.push(ManagedSourceBuilder {
+            name,
+            plugin,
+            trigger,
+            build: Box::new(|_| source),
+        })
+    }
+
     /// Adds the builder of a measurement source to the Alumet pipeline.
     ///
     /// Unlike [`add_source`](Self::add_source), the source is not created immediately but during the construction
@@ -328,6 +368,7 @@ impl<'a> AlumetStart<'a> {
     /// ```no_run
     /// use std::time::SystemTime;
     /// use alumet::measurement::{MeasurementBuffer, MeasurementPoint, Timestamp};
+    /// use alumet::resources::{ConsumerId, ResourceId};
     /// use alumet::units::Unit;
     /// # use alumet::plugin::AlumetStart;
     ///
@@ -339,8 +380,8 @@ impl<'a> AlumetStart<'a> {
     ///         let mut buf = MeasurementBuffer::new();
     ///         while !cancel_token.is_cancelled() {
     ///             let timestamp = Timestamp::now();
-    ///             let resource = todo!();
-    ///             let consumer = todo!();
+    ///             let resource: ResourceId = todo!();
+    ///             let consumer: ConsumerId = todo!();
     ///             let value = todo!();
     ///             let measurement = MeasurementPoint::new(
     ///                 timestamp,
@@ -388,6 +429,29 @@ impl<'a> AlumetStart<'a> {
         });
     }
 
+    /// Adds the builder of a transform to the Alumet pipeline.
+    ///
+    /// Unlike [`add_transform`](Self::add_transform), the transform is not created immediately but during the
+    /// construction of the measurement pipeline. This allows to use some information about the pipeline while
+    /// creating the transform.
+    ///
+    /// In general, you should prefer to use [`add_transform`](Self::add_transform) if possible.
+    pub fn add_transform_builder<F: FnOnce(&PendingPipelineContext) -> Box<dyn Transform> + 'static>(
+        &mut self,
+        transform_builder: F,
+    ) {
+        let plugin = self.current_plugin_name().to_owned();
+        let name = self
+            .pipeline_builder
+            .namegen
+            .deduplicate(format!("{plugin}/transform"), true);
+        self.pipeline_builder.transforms.push(TransformBuilder {
+            name,
+            plugin,
+            build: Box::new(transform_builder),
+        });
+    }
+
     /// Adds an output to the Alumet pipeline.
     pub fn add_output(&mut self, output: Box<dyn Output>) {
         let plugin = self.current_plugin_name().to_owned();
@@ -398,7 +462,7 @@ impl<'a> AlumetStart<'a> {
         self.pipeline_builder.outputs.push(OutputBuilder {
             name,
             plugin,
-            build: Box::new(|_| Ok(output)),
+            build: Box::new(|_| Ok(OutputKind::Blocking(output))),
         })
     }
 
@@ -422,7 +486,46 @@ impl<'a> AlumetStart<'a> {
         self.pipeline_builder.outputs.push(OutputBuilder {
             name,
             plugin,
-            build: Box::new(output_builder),
+            build: Box::new(|ctx| Ok(OutputKind::Blocking(output_builder(ctx)?))),
+        })
+    }
+
+    /// Adds an async output to the Alumet pipeline.
+    ///
+    /// An [`AsyncOutput`] is driven by the async runtime of the pipeline instead of a dedicated thread,
+    /// and can have several writes in flight. Use it for outputs that send measurements over the network.
+    pub fn add_async_output(&mut self, output: Box<dyn AsyncOutput>) {
+        let plugin = self.current_plugin_name().to_owned();
+        let name = self
+            .pipeline_builder
+            .namegen
+            .deduplicate(format!("{plugin}/output"), true);
+        self.pipeline_builder.outputs.push(OutputBuilder {
+            name,
+            plugin,
+            build: Box::new(|_| Ok(OutputKind::Async(output))),
+        })
+    }
+
+    /// Adds the builder of an async output to the Alumet pipeline.
+    ///
+    /// This is the async counterpart of [`add_output_builder`](Self::add_output_builder).
+    /// The output runs on the runtime given by [`PendingPipelineContext::async_runtime_handle`].
+    pub fn add_async_output_builder<
+        F: FnOnce(&PendingPipelineContext) -> anyhow::Result<Box<dyn AsyncOutput>> + 'static,
+    >(
+        &mut self,
+        output_builder: F,
+    ) {
+        let plugin = self.current_plugin_name().to_owned();
+        let name = self
+            .pipeline_builder
+            .namegen
+            .deduplicate(format!("{plugin}/output"), true);
+        self.pipeline_builder.outputs.push(OutputBuilder {
+            name,
+            plugin,
+            build: Box::new(|ctx| Ok(OutputKind::Async(output_builder(ctx)?))),
         })
     }
 }
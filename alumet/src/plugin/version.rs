@@ -146,4 +146,12 @@ mod tests {
         assert!(!base.can_load(&Version::parse("1.2.0").unwrap()));
         assert!(!base.can_load(&Version::parse("1.1.7").unwrap()));
     }
+
+    #[test]
+    pub fn rejects_plugins_built_for_the_previous_abi() {
+        // The C ABI changed in 0.5.0 (callback signatures, return types), the plugins built for 0.4 must be rebuilt.
+        let current = Version::alumet();
+        assert!(!current.can_load(&Version::parse("0.4.0").unwrap()));
+        assert!(!current.can_load(&Version::parse("0.4.1").unwrap()));
+    }
 }
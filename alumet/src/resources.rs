@@ -31,17 +31,47 @@
 //! );
 //! ```
 //!
-//! Unlike metrics and units, resources are not registered in a global registry,
-//! but created each time they are needed.
+//!
+//! ## Resource registry
+//!
+//! A measurement point does not store the resource and the consumer themselves, but a small
+//! reference-counted handle ([`ResourceId`] and [`ConsumerId`]). Despite their names, these handles are not
+//! plain identifiers: cloning or dropping one is an atomic operation on the reference count.
+//! Creating a point with a `Resource` (like above) allocates a new handle, which is freed with the last point
+//! that uses it.
+//! Sources that produce many points for the same resources should create the handles once, at startup,
+//! with the [`ResourceRegistry`] of the pipeline, which shares the handles of equal resources:
+//! ```no_run
+//! use alumet::plugin::AlumetStart;
+//! use alumet::resources::{ConsumerId, Resource, ResourceConsumer, ResourceId};
+//!
+//! # let alumet: &mut AlumetStart = todo!();
+//! let registry = alumet.resources();
+//! let resource: ResourceId = registry.intern_resource(Resource::CpuPackage { id: 0 });
+//! let consumer: ConsumerId = registry.intern_consumer(ResourceConsumer::LocalMachine);
+//! // `resource.clone()` and `consumer.clone()` can now be passed to MeasurementPoint::new without any allocation.
+//!
+//! // Outputs can get the resource back, without locking anything.
+//! assert_eq!(resource.resolve(), &Resource::CpuPackage { id: 0 });
+//! ```
 
-use std::{borrow::Cow, fmt};
+use std::{
+    borrow::Cow,
+    collections::HashMap,
+    fmt,
+    hash::{BuildHasher, Hash, Hasher},
+    ptr::NonNull,
+    sync::{Arc, RwLock, Weak},
+};
+
+use fxhash::FxBuildHasher;
 
 /// Alias to a static cow. It helps to avoid the allocation of Strings.
 pub type StrCow = Cow<'static, str>;
 
 /// Hardware or software entity for which metrics can be gathered.
 #[non_exhaustive]
-#[derive(Debug, Clone, PartialEq, Eq)]
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
 #[repr(C)]
 pub enum Resource {
     /// The whole local machine, for instance the whole physical server.
@@ -60,7 +90,7 @@ pub enum Resource {
 
 /// Consumer of a [`resource`](Resource).
 #[non_exhaustive]
-#[derive(Debug, Clone, PartialEq, Eq)]
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
 #[repr(C)]
 pub enum ResourceConsumer {
     /// The whole local machine.
@@ -241,3 +271,388 @@ impl<'a> fmt::Display for LazyDisplayable<'a> {
         }
     }
 }
+
+// ====== Registry ======
+
+/// Shared, reference-counted handle to a [`Resource`].
+///
+/// This is not a plain identifier, but a pointer that owns a reference to the resource, like an [`Arc`].
+/// A handle is as small as a pointer and cloning it does not copy the resource, which makes it cheap to attach
+/// the same resource to many measurement points. Cloning and dropping a handle are atomic operations on
+/// the reference count: borrow it when possible. The resource is freed when its last handle is dropped,
+/// for instance when the source that measures it has been removed and its points have been written.
+///
+/// [`Resource::LocalMachine`] is not allocated at all, see [`ResourceId::LOCAL_MACHINE`].
+#[repr(C)]
+pub struct ResourceId(Handle<Resource>);
+
+/// Shared, reference-counted handle to a [`ResourceConsumer`].
+///
+/// See [`ResourceId`].
+#[repr(C)]
+pub struct ConsumerId(Handle<ResourceConsumer>);
+
+static LOCAL_MACHINE_RESOURCE: Resource = Resource::LocalMachine;
+static LOCAL_MACHINE_CONSUMER: ResourceConsumer = ResourceConsumer::LocalMachine;
+
+impl ResourceId {
+    /// Handle of [`Resource::LocalMachine`], which does not need to be allocated.
+    pub const LOCAL_MACHINE: ResourceId = ResourceId(Handle::NONE);
+
+    /// Returns the resource that this handle points to.
+    ///
+    /// This only follows a pointer: no lock is taken.
+    pub fn resolve(&self) -> &Resource {
+        self.0.get().unwrap_or(&LOCAL_MACHINE_RESOURCE)
+    }
+}
+
+impl ConsumerId {
+    /// Handle of [`ResourceConsumer::LocalMachine`], which does not need to be allocated.
+    pub const LOCAL_MACHINE: ConsumerId = ConsumerId(Handle::NONE);
+
+    /// Returns the consumer that this handle points to.
+    ///
+    /// This only follows a pointer: no lock is taken.
+    pub fn resolve(&self) -> &ResourceConsumer {
+        self.0.get().unwrap_or(&LOCAL_MACHINE_CONSUMER)
+    }
+}
+
+impl From<Resource> for ResourceId {
+    /// Moves the resource to a new handle.
+    ///
+    /// Use [`ResourceRegistry::intern_resource`] to reuse the handle of an equal resource instead.
+    fn from(value: Resource) -> Self {
+        match value {
+            Resource::LocalMachine => ResourceId::LOCAL_MACHINE,
+            r => ResourceId(Handle::new(Arc::new(r))),
+        }
+    }
+}
+
+impl From<ResourceConsumer> for ConsumerId {
+    /// Moves the consumer to a new handle.
+    ///
+    /// Use [`ResourceRegistry::intern_consumer`] to reuse the handle of an equal consumer instead.
+    fn from(value: ResourceConsumer) -> Self {
+        match value {
+            ResourceConsumer::LocalMachine => ConsumerId::LOCAL_MACHINE,
+            c => ConsumerId(Handle::new(Arc::new(c))),
+        }
+    }
+}
+
+macro_rules! impl_handle_traits {
+    ($id:ty) => {
+        impl Clone for $id {
+            fn clone(&self) -> Self {
+                Self(self.0.clone())
+            }
+        }
+
+        impl PartialEq for $id {
+            fn eq(&self, other: &Self) -> bool {
+                self.0.ptr_eq(&other.0) || self.resolve() == other.resolve()
+            }
+        }
+
+        impl Eq for $id {}
+
+        impl Hash for $id {
+            fn hash<H: Hasher>(&self, state: &mut H) {
+                self.resolve().hash(state)
+            }
+        }
+
+        impl fmt::Debug for $id {
+            fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+                f.debug_tuple(stringify!($id)).field(self.resolve()).finish()
+            }
+        }
+    };
+}
+
+impl_handle_traits!(ResourceId);
+impl_handle_traits!(ConsumerId);
+
+/// Nullable pointer obtained from [`Arc::into_raw`], which owns one strong reference.
+///
+/// Unlike `Option<Arc<T>>`, it has a stable representation that can be handed to C plugins.
+#[repr(transparent)]
+struct Handle<T>(Option<NonNull<T>>);
+
+// SAFETY: a Handle behaves like an Arc
+unsafe impl<T: Send + Sync> Send for Handle<T> {}
+unsafe impl<T: Send + Sync> Sync for Handle<T> {}
+
+impl<T> Handle<T> {
+    const NONE: Handle<T> = Handle(None);
+
+    fn new(value: Arc<T>) -> Self {
+        // SAFETY: Arc::into_raw never returns null
+        Handle(Some(unsafe { NonNull::new_unchecked(Arc::into_raw(value) as *mut T) }))
+    }
+
+    fn get(&self) -> Option<&T> {
+        // SAFETY: the strong reference owned by the handle keeps the value alive
+        self.0.map(|p| unsafe { &*p.as_ptr() })
+    }
+
+    fn ptr_eq(&self, other: &Handle<T>) -> bool {
+        self.0 == other.0
+    }
+
+    #[cfg(test)]
+    fn downgrade(&self) -> Option<Weak<T>> {
+        self.0.map(|p| {
+            // SAFETY: borrow the Arc without releasing the reference of the handle
+            let arc = std::mem::ManuallyDrop::new(unsafe { Arc::from_raw(p.as_ptr()) });
+            Arc::downgrade(&arc)
+        })
+    }
+}
+
+impl<T> Clone for Handle<T> {
+    fn clone(&self) -> Self {
+        if let Some(p) = self.0 {
+            // SAFETY: the pointer comes from Arc::into_raw and the value is alive
+            unsafe { Arc::increment_strong_count(p.as_ptr()) };
+        }
+        Handle(self.0)
+    }
+}
+
+impl<T> Drop for Handle<T> {
+    fn drop(&mut self) {
+        if let Some(p) = self.0 {
+            // SAFETY: the pointer comes from Arc::into_raw, and the handle owns one strong reference
+            unsafe { Arc::decrement_strong_count(p.as_ptr()) };
+        }
+    }
+}
+
+/// Deduplicates resources and consumers, so that equal values share the same allocation.
+///
+/// Each pipeline has its own registry, that sources can obtain with [`AlumetStart::resources`](crate::plugin::AlumetStart::resources),
+/// and outputs with [`OutputContext::resources`](crate::pipeline::OutputContext::resources).
+/// The registry does not keep the values alive: they are freed when their last [`ResourceId`] or [`ConsumerId`]
+/// is dropped, and the registry forgets about them.
+///
+/// Interning takes a lock, it should be done once, when creating the source.
+/// Resolving a handle does not involve the registry, see [`ResourceId::resolve`].
+pub struct ResourceRegistry {
+    resources: WeakSet<Resource>,
+    consumers: WeakSet<ResourceConsumer>,
+}
+
+impl ResourceRegistry {
+    pub fn new() -> Self {
+        Self {
+            resources: WeakSet::new(),
+            consumers: WeakSet::new(),
+        }
+    }
+
+    /// Interns a resource and returns a handle to it.
+    ///
+    /// If an equal resource is still alive, returns a new handle to it.
+    pub fn intern_resource(&self, resource: Resource) -> ResourceId {
+        match resource {
+            Resource::LocalMachine => ResourceId::LOCAL_MACHINE,
+            r => ResourceId(self.resources.intern(r)),
+        }
+    }
+
+    /// Interns a consumer and returns a handle to it.
+    ///
+    /// If an equal consumer is still alive, returns a new handle to it.
+    pub fn intern_consumer(&self, consumer: ResourceConsumer) -> ConsumerId {
+        match consumer {
+            ResourceConsumer::LocalMachine => ConsumerId::LOCAL_MACHINE,
+            c => ConsumerId(self.consumers.intern(c)),
+        }
+    }
+
+    /// Returns the resource that the handle points to.
+    pub fn resource<'a>(&self, id: &'a ResourceId) -> &'a Resource {
+        id.resolve()
+    }
+
+    /// Returns the consumer that the handle points to.
+    pub fn consumer<'a>(&self, id: &'a ConsumerId) -> &'a ResourceConsumer {
+        id.resolve()
+    }
+
+    /// Returns the number of interned resources that are still alive.
+    pub fn resources_len(&self) -> usize {
+        self.resources.len()
+    }
+
+    /// Returns the number of interned consumers that are still alive.
+    pub fn consumers_len(&self) -> usize {
+        self.consumers.len()
+    }
+}
+
+impl Default for ResourceRegistry {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// Set of weak references to values, indexed by the hash of the values.
+struct WeakSet<T> {
+    inner: RwLock<WeakSetData<T>>,
+}
+
+struct WeakSetData<T> {
+    entries: HashMap<u64, Vec<Weak<T>>, FxBuildHasher>,
+    /// Number of entries above which the dead references are removed.
+    cleanup_threshold: usize,
+}
+
+/// Minimum value of [`WeakSetData::cleanup_threshold`].
+const MIN_CLEANUP_THRESHOLD: usize = 64;
+
+impl<T: Eq + Hash> WeakSet<T> {
+    fn new() -> Self {
+        Self {
+            inner: RwLock::new(WeakSetData {
+                entries: HashMap::default(),
+                cleanup_threshold: MIN_CLEANUP_THRESHOLD,
+            }),
+        }
+    }
+
+    fn intern(&self, value: T) -> Handle<T> {
+        let hash = FxBuildHasher::default().hash_one(&value);
+        // fast path: the value is alive
+        if let Some(existing) = self.inner.read().unwrap().find(hash, &value) {
+            return existing;
+        }
+        let mut data = self.inner.write().unwrap();
+        if let Some(existing) = data.find(hash, &value) {
+            // interned by another thread in the meantime
+            return existing;
+        }
+        if data.entries.len() >= data.cleanup_threshold {
+            data.remove_dead();
+        }
+        let value = Arc::new(value);
+        data.entries.entry(hash).or_default().push(Arc::downgrade(&value));
+        Handle::new(value)
+    }
+
+    fn len(&self) -> usize {
+        let data = self.inner.read().unwrap();
+        data.entries.values().flatten().filter(|w| w.strong_count() > 0).count()
+    }
+}
+
+impl<T: Eq> WeakSetData<T> {
+    fn find(&self, hash: u64, value: &T) -> Option<Handle<T>> {
+        self.entries
+            .get(&hash)?
+            .iter()
+            .filter_map(Weak::upgrade)
+            .find(|v| **v == *value)
+            .map(Handle::new)
+    }
+
+    /// Forgets the values that have been freed.
+    fn remove_dead(&mut self) {
+        self.entries.retain(|_, weaks| {
+            weaks.retain(|w| w.strong_count() > 0);
+            !weaks.is_empty()
+        });
+        self.cleanup_threshold = (self.entries.len() * 2).max(MIN_CLEANUP_THRESHOLD);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::sync::Arc;
+
+    use super::{ConsumerId, Resource, ResourceConsumer, ResourceId, ResourceRegistry};
+
+    #[test]
+    fn interning() {
+        let registry = ResourceRegistry::new();
+        let a = registry.intern_resource(Resource::Gpu {
+            bus_id: "0000:01:00.0".into(),
+        });
+        let b = registry.intern_resource(Resource::Gpu {
+            bus_id: String::from("0000:01:00.0").into(),
+        });
+        let c = registry.intern_resource(Resource::Gpu {
+            bus_id: "0000:02:00.0".into(),
+        });
+        assert_eq!(a, b);
+        assert!(std::ptr::eq(a.resolve(), b.resolve()));
+        assert_ne!(a, c);
+        assert_eq!(
+            &Resource::Gpu {
+                bus_id: "0000:02:00.0".into()
+            },
+            registry.resource(&c)
+        );
+        // handles created without the registry are equal to the interned ones, but not shared
+        let d = ResourceId::from(Resource::Gpu {
+            bus_id: "0000:01:00.0".into(),
+        });
+        assert_eq!(a, d);
+        assert!(!std::ptr::eq(a.resolve(), d.resolve()));
+
+        let p = registry.intern_consumer(ResourceConsumer::ControlGroup { path: "/a/b".into() });
+        assert_eq!(
+            p,
+            ConsumerId::from(ResourceConsumer::ControlGroup { path: "/a/b".into() })
+        );
+        assert_eq!("cgroup", p.resolve().kind());
+        assert_eq!("/a/b", p.resolve().id_display().to_string());
+
+        assert_eq!(&Resource::LocalMachine, ResourceId::LOCAL_MACHINE.resolve());
+        assert_eq!(&ResourceConsumer::LocalMachine, ConsumerId::LOCAL_MACHINE.resolve());
+        assert_eq!(
+            ResourceId::LOCAL_MACHINE,
+            registry.intern_resource(Resource::LocalMachine)
+        );
+        assert_eq!(2, registry.resources_len());
+        assert_eq!(1, registry.consumers_len());
+    }
+
+    #[test]
+    fn freed_when_unused() {
+        let registry = ResourceRegistry::new();
+        let a = registry.intern_resource(Resource::CpuCore { id: 1 });
+        let a2 = a.clone();
+        let weak = a.0.downgrade().unwrap();
+        assert_eq!(2, weak.strong_count());
+        drop(a);
+        assert_eq!(1, registry.resources_len());
+        drop(a2);
+        assert!(weak.upgrade().is_none());
+        assert_eq!(0, registry.resources_len());
+
+        // a freed resource is allocated again
+        let b = registry.intern_resource(Resource::CpuCore { id: 1 });
+        assert_eq!(&Resource::CpuCore { id: 1 }, b.resolve());
+
+        // the dead entries are removed when the registry grows
+        for i in 0..1000 {
+            registry.intern_consumer(ResourceConsumer::Process { pid: i });
+        }
+        assert_eq!(0, registry.consumers_len());
+        assert!(registry.consumers.inner.read().unwrap().entries.len() < 200);
+
+        // the handles can be shared between threads
+        let c = registry.intern_consumer(ResourceConsumer::Process { pid: 1 });
+        let registry = Arc::new(registry);
+        std::thread::spawn(move || {
+            assert_eq!(c, registry.intern_consumer(ResourceConsumer::Process { pid: 1 }));
+        })
+        .join()
+        .unwrap();
+    }
+}
@@ -138,8 +138,9 @@ impl Output for TestOutput {
     fn write(&mut self, measurements: &MeasurementBuffer, ctx: &OutputContext) -> Result<(), WriteError> {
         for m in measurements.iter() {
             let ts = &m.timestamp;
-            let res_kind = m.resource.kind();
-            let res_id = m.resource.id_display();
+            let resource = ctx.resources.resource(&m.resource);
+            let res_kind = resource.kind();
+            let res_id = resource.id_display();
             let name = m.metric.name(ctx);
             let value = &m.value;
             println!(">> {ts:?} on {res_kind} {res_id} :{name} = {value:?}");
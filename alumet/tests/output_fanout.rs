@@ -0,0 +1,231 @@
+//! Benchmark of the fan-out from the transform step to the outputs.
+//!
+//! Every flush is written to all the outputs. This test runs the same source with
+//! an increasing number of outputs and checks that the measurement buffer is shared
+//! between them (no copy per output). A counting allocator measures the memory that
+//! is allocated for each flush, which must not grow with the number of outputs.
+//!
+//! Run with `cargo test --test output_fanout -- --nocapture` to see the results.
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant, SystemTime};
+
+use alumet::measurement::{
+    MeasurementAccumulator, MeasurementBuffer, MeasurementPoint, Timestamp, WrappedMeasurementValue,
+};
+use alumet::metrics::TypedMetricId;
+use alumet::pipeline::builder::PipelineBuilder;
+use alumet::pipeline::{trigger, Output, OutputContext, PollError, Source, WriteError};
+use alumet::plugin::AlumetStart;
+use alumet::resources::{Resource, ResourceConsumer};
+use alumet::units::Unit;
+
+const POINTS_PER_FLUSH: usize = 5_000;
+const POLL_INTERVAL: Duration = Duration::from_millis(10);
+const WARMUP_DURATION: Duration = Duration::from_millis(100);
+const RUN_DURATION: Duration = Duration::from_millis(300);
+
+/// Counts the allocations of the whole process.
+struct CountingAllocator;
+
+static ALLOCATIONS: AtomicU64 = AtomicU64::new(0);
+static ALLOCATED_BYTES: AtomicU64 = AtomicU64::new(0);
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        ALLOCATED_BYTES.fetch_add(layout.size() as u64, Ordering::Relaxed);
+        System.alloc(layout)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        ALLOCATED_BYTES.fetch_add(new_size.saturating_sub(layout.size()) as u64, Ordering::Relaxed);
+        System.realloc(ptr, layout, new_size)
+    }
+}
+
+#[global_allocator]
+static GLOBAL: CountingAllocator = CountingAllocator;
+
+#[test]
+fn fanout_shares_buffers() {
+    println!("outputs | flushes | allocs per flush | memory per flush | avg. write time | avg. delivery time");
+    let buffer_bytes = (POINTS_PER_FLUSH * std::mem::size_of::<MeasurementPoint>()) as f64;
+    for n_outputs in [1, 2, 4, 8] {
+        let run = run_pipeline(n_outputs);
+        let writes = &run.writes;
+
+        // Group the writes by flush, the value of the first point is the index of the flush.
+        let mut by_flush: HashMap<u64, Vec<&Write>> = HashMap::new();
+        for w in writes {
+            by_flush.entry(w.flush).or_default().push(w);
+        }
+        assert!(!by_flush.is_empty(), "no measurement has been written");
+
+        for (flush, writes) in &by_flush {
+            // Every output must see the same buffer.
+            let mut buffers: Vec<usize> = writes.iter().map(|w| w.buffer_addr).collect();
+            buffers.sort_unstable();
+            buffers.dedup();
+            assert_eq!(
+                buffers.len(),
+                1,
+                "flush {flush}: the outputs received different copies of the measurements"
+            );
+        }
+
+        let n_flushes = run.measured_flushes;
+        assert!(n_flushes > 0, "no flush during the measurement window");
+        let allocs_per_flush = run.allocations as f64 / n_flushes as f64;
+        let bytes_per_flush = run.allocated_bytes as f64 / n_flushes as f64;
+        let avg_write = writes.iter().map(|w| w.write_time).sum::<Duration>() / writes.len() as u32;
+        let avg_delivery = writes.iter().map(|w| w.delivery_time).sum::<Duration>() / writes.len() as u32;
+        println!(
+            "{n_outputs:>7} | {n_flushes:>7} | {allocs_per_flush:>16.1} | {:>12.1} KiB | {avg_write:>15?} | {avg_delivery:?}",
+            bytes_per_flush / 1024.0
+        );
+
+        // A copy of the buffer per output would allocate at least one buffer per output and per flush.
+        assert!(
+            bytes_per_flush < buffer_bytes / 2.0,
+            "{n_outputs} outputs allocate {bytes_per_flush:.0} bytes per flush, a copy of the buffer is {buffer_bytes:.0} bytes"
+        );
+    }
+}
+
+/// The result of a run of the pipeline.
+struct Run {
+    /// The writes done by the outputs.
+    writes: Vec<Write>,
+    /// Number of flushes done in the measurement window (after the warmup).
+    measured_flushes: u64,
+    /// Number of allocations in the measurement window.
+    allocations: u64,
+    /// Number of bytes allocated in the measurement window.
+    allocated_bytes: u64,
+}
+
+/// Runs a pipeline with one source and `n_outputs` outputs, and measures the allocations after a warmup.
+fn run_pipeline(n_outputs: usize) -> Run {
+    let writes = Arc::new(Mutex::new(Vec::new()));
+
+    let mut pipeline_builder = PipelineBuilder::new();
+    let mut alumet = AlumetStart::new(&mut pipeline_builder, String::from("fanout"));
+    let metric = alumet
+        .create_metric::<u64>(
+            "fanout_points",
+            Unit::Unity,
+            "Points generated for the fan-out benchmark.",
+        )
+        .unwrap();
+    let trigger = trigger::builder::time_interval(POLL_INTERVAL).build().unwrap();
+    alumet.add_source(Box::new(BenchSource { metric, n_polls: 0 }), trigger);
+    for _ in 0..n_outputs {
+        alumet.add_output(Box::new(BenchOutput { writes: writes.clone() }));
+    }
+
+    let mut pipeline = pipeline_builder.build().expect("pipeline should build").start();
+
+    // Ignore the allocations done while the pipeline starts.
+    std::thread::sleep(WARMUP_DURATION);
+    let first_flush = last_flush(&writes);
+    let allocations = ALLOCATIONS.load(Ordering::Relaxed);
+    let allocated_bytes = ALLOCATED_BYTES.load(Ordering::Relaxed);
+
+    std::thread::sleep(RUN_DURATION);
+    let measured_flushes = last_flush(&writes) - first_flush;
+    let allocations = ALLOCATIONS.load(Ordering::Relaxed) - allocations;
+    let allocated_bytes = ALLOCATED_BYTES.load(Ordering::Relaxed) - allocated_bytes;
+
+    pipeline.control_handle().shutdown();
+    pipeline.wait_for_shutdown().unwrap();
+
+    let writes = writes.lock().unwrap().clone();
+    Run {
+        writes,
+        measured_flushes,
+        allocations,
+        allocated_bytes,
+    }
+}
+
+/// Returns the index of the last flush that has been written.
+fn last_flush(writes: &Mutex<Vec<Write>>) -> u64 {
+    writes.lock().unwrap().iter().map(|w| w.flush).max().unwrap_or(0)
+}
+
+struct BenchSource {
+    metric: TypedMetricId<u64>,
+    n_polls: u64,
+}
+
+impl Source for BenchSource {
+    fn poll(&mut self, acc: &mut MeasurementAccumulator, timestamp: Timestamp) -> Result<(), PollError> {
+        self.n_polls += 1;
+        for i in 0..POINTS_PER_FLUSH {
+            let value = if i == 0 { self.n_polls } else { i as u64 };
+            acc.push(
+                MeasurementPoint::new(
+                    timestamp,
+                    self.metric,
+                    Resource::CpuCore { id: i as u32 },
+                    ResourceConsumer::LocalMachine,
+                    value,
+                )
+                .with_attr("bench", "fanout"),
+            );
+        }
+        Ok(())
+    }
+}
+
+#[derive(Clone)]
+struct Write {
+    flush: u64,
+    buffer_addr: usize,
+    write_time: Duration,
+    delivery_time: Duration,
+}
+
+struct BenchOutput {
+    writes: Arc<Mutex<Vec<Write>>>,
+}
+
+impl Output for BenchOutput {
+    fn write(&mut self, measurements: &MeasurementBuffer, _ctx: &OutputContext) -> Result<(), WriteError> {
+        let t0 = Instant::now();
+        let first = measurements.iter().next().expect("the buffer should not be empty");
+        let flush = match first.value {
+            WrappedMeasurementValue::U64(n) => n,
+            WrappedMeasurementValue::F64(_) => panic!("unexpected value type"),
+        };
+        // Read every point, like a real output would do.
+        let sum: u64 = measurements
+            .iter()
+            .map(|p| match p.value {
+                WrappedMeasurementValue::U64(n) => n,
+                WrappedMeasurementValue::F64(x) => x as u64,
+            })
+            .sum();
+        std::hint::black_box(sum);
+        let delivery_time = SystemTime::now()
+            .duration_since(SystemTime::from(first.timestamp))
+            .unwrap_or_default();
+        let write_time = t0.elapsed();
+        self.writes.lock().unwrap().push(Write {
+            flush,
+            buffer_addr: measurements as *const MeasurementBuffer as usize,
+            write_time,
+            delivery_time,
+        });
+        Ok(())
+    }
+}
@@ -0,0 +1,106 @@
+//! Each output has its own queue: a slow output must not slow down the other outputs.
+//!
+//! Run with `cargo test --test output_queues -- --nocapture` to see the results.
+
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::time::Duration;
+
+use alumet::measurement::{MeasurementAccumulator, MeasurementBuffer, MeasurementPoint, Timestamp};
+use alumet::metrics::TypedMetricId;
+use alumet::pipeline::builder::PipelineBuilder;
+use alumet::pipeline::{trigger, Output, OutputContext, PollError, Source, WriteError};
+use alumet::plugin::AlumetStart;
+use alumet::resources::{Resource, ResourceConsumer};
+use alumet::units::Unit;
+
+const POLL_INTERVAL: Duration = Duration::from_millis(2);
+const SLOW_WRITE: Duration = Duration::from_millis(20);
+const RUN_DURATION: Duration = Duration::from_millis(300);
+
+#[test]
+fn slow_output_does_not_slow_down_others() {
+    let polled = Arc::new(AtomicUsize::new(0));
+    let fast_points = Arc::new(AtomicUsize::new(0));
+    let slow_points = Arc::new(AtomicUsize::new(0));
+
+    let mut pipeline_builder = PipelineBuilder::new();
+    let mut alumet = AlumetStart::new(&mut pipeline_builder, String::from("queues"));
+    let metric = alumet
+        .create_metric::<u64>(
+            "queued_points",
+            Unit::Unity,
+            "Points generated for the output queues test.",
+        )
+        .unwrap();
+    let trigger = trigger::builder::time_interval(POLL_INTERVAL).build().unwrap();
+    alumet.add_source(
+        Box::new(CountingSource {
+            metric,
+            polled: polled.clone(),
+        }),
+        trigger,
+    );
+    alumet.add_output(Box::new(CountingOutput {
+        points: slow_points.clone(),
+        delay: SLOW_WRITE,
+    }));
+    alumet.add_output(Box::new(CountingOutput {
+        points: fast_points.clone(),
+        delay: Duration::ZERO,
+    }));
+
+    let mut pipeline = pipeline_builder.build().expect("pipeline should build").start();
+    std::thread::sleep(RUN_DURATION);
+    // The fast output keeps up with the source, no matter how late the slow output is.
+    let fast_while_running = fast_points.load(Ordering::Relaxed);
+    let slow_while_running = slow_points.load(Ordering::Relaxed);
+    pipeline.control_handle().shutdown();
+    pipeline.wait_for_shutdown().unwrap();
+
+    let polled = polled.load(Ordering::Relaxed);
+    let fast = fast_points.load(Ordering::Relaxed);
+    let slow = slow_points.load(Ordering::Relaxed);
+    println!("polled: {polled}, fast output: {fast} ({fast_while_running} before shutdown), slow output: {slow} ({slow_while_running} before shutdown)");
+    assert_eq!(polled, fast, "the fast output must receive every point");
+    assert!(
+        slow < polled,
+        "the slow output should have dropped its oldest measurements"
+    );
+    assert!(
+        fast_while_running > slow_while_running * 2,
+        "the fast output must not wait for the slow one"
+    );
+}
+
+struct CountingSource {
+    metric: TypedMetricId<u64>,
+    polled: Arc<AtomicUsize>,
+}
+
+impl Source for CountingSource {
+    fn poll(&mut self, acc: &mut MeasurementAccumulator, timestamp: Timestamp) -> Result<(), PollError> {
+        let n = self.polled.fetch_add(1, Ordering::Relaxed);
+        acc.push(MeasurementPoint::new(
+            timestamp,
+            self.metric,
+            Resource::LocalMachine,
+            ResourceConsumer::LocalMachine,
+            n as u64,
+        ));
+        Ok(())
+    }
+}
+
+struct CountingOutput {
+    points: Arc<AtomicUsize>,
+    delay: Duration,
+}
+
+impl Output for CountingOutput {
+    fn write(&mut self, measurements: &MeasurementBuffer, _ctx: &OutputContext) -> Result<(), WriteError> {
+        std::thread::sleep(self.delay);
+        self.points.fetch_add(measurements.len(), Ordering::Relaxed);
+        Ok(())
+    }
+}
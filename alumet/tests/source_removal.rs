@@ -0,0 +1,196 @@
+//! Removal of sources while the pipeline is running.
+
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::time::Duration;
+
+use alumet::measurement::{MeasurementAccumulator, MeasurementBuffer, MeasurementPoint, Timestamp};
+use alumet::metrics::TypedMetricId;
+use alumet::pipeline::builder::PipelineBuilder;
+use alumet::pipeline::{trigger, Output, OutputContext, PollError, Source, WriteError};
+use alumet::plugin::AlumetStart;
+use alumet::resources::{Resource, ResourceConsumer};
+use alumet::units::Unit;
+
+const POLL_INTERVAL: Duration = Duration::from_millis(5);
+const CHURN: usize = 50;
+
+#[test]
+fn removed_sources_are_dropped() {
+    let alive = Arc::new(AtomicUsize::new(0));
+    let polls = Arc::new(AtomicUsize::new(0));
+    let source = |metric| {
+        alive.fetch_add(1, Ordering::Relaxed);
+        Box::new(CountingSource {
+            metric,
+            alive: alive.clone(),
+            polls: polls.clone(),
+        })
+    };
+
+    let mut pipeline_builder = PipelineBuilder::new();
+    let mut alumet = AlumetStart::new(&mut pipeline_builder, String::from("churn"));
+    let metric = alumet
+        .create_metric::<u64>(
+            "churn_points",
+            Unit::Unity,
+            "Points generated by the removable sources.",
+        )
+        .unwrap();
+    let grouped = trigger::builder::time_interval(POLL_INTERVAL)
+        .grouped()
+        .build()
+        .unwrap();
+    let single = trigger::builder::time_interval(POLL_INTERVAL).build().unwrap();
+    alumet.add_named_source("grouped", source(metric), grouped.clone());
+    alumet.add_named_source("single", source(metric), single.clone());
+    alumet.add_source(source(metric), single.clone());
+    alumet.add_output(Box::new(NullOutput));
+
+    let pipeline = pipeline_builder.build().expect("pipeline should build");
+    let mut pipeline = pipeline.start();
+    let handle = pipeline.control_handle();
+
+    // Add and remove many sources, like the pods of a busy cluster.
+    for i in 0..CHURN {
+        let trigger = if i % 2 == 0 { grouped.clone() } else { single.clone() };
+        handle.add_source(String::from("churn"), format!("pod-{i}"), source(metric), trigger);
+        std::thread::sleep(Duration::from_millis(1));
+        handle.remove_source(String::from("churn"), format!("pod-{i}")).unwrap();
+    }
+    handle
+        .remove_source(String::from("churn"), String::from("grouped"))
+        .unwrap();
+    handle
+        .remove_source(String::from("churn"), String::from("single"))
+        .unwrap();
+    std::thread::sleep(Duration::from_millis(100));
+
+    // Only the unnamed source is left.
+    assert_eq!(1, alive.load(Ordering::Relaxed));
+    assert_eq!(1, pipeline.source_timings().len());
+
+    // The remaining source can be removed with all the sources of its plugin.
+    handle.remove_plugin_sources(String::from("churn")).unwrap();
+    std::thread::sleep(Duration::from_millis(100));
+    assert_eq!(0, alive.load(Ordering::Relaxed));
+    assert!(pipeline.source_timings().is_empty());
+
+    // No source is polled anymore.
+    let n_polls = polls.load(Ordering::Relaxed);
+    std::thread::sleep(POLL_INTERVAL * 4);
+    assert_eq!(n_polls, polls.load(Ordering::Relaxed));
+
+    handle.shutdown();
+    pipeline.wait_for_shutdown().unwrap();
+
+    // Removing a source after the shutdown is an error, not a panic.
+    assert!(handle
+        .remove_source(String::from("churn"), String::from("pod-0"))
+        .is_err());
+}
+
+#[test]
+fn runtime_sources_get_unique_names() {
+    let polls = Arc::new(AtomicUsize::new(0));
+    let source = |metric, alive: &Arc<AtomicUsize>| {
+        alive.fetch_add(1, Ordering::Relaxed);
+        Box::new(CountingSource {
+            metric,
+            alive: alive.clone(),
+            polls: polls.clone(),
+        })
+    };
+    let (at_startup, at_runtime, re_added) = Default::default();
+
+    let mut pipeline_builder = PipelineBuilder::new();
+    let mut alumet = AlumetStart::new(&mut pipeline_builder, String::from("names"));
+    let metric = alumet
+        .create_metric::<u64>("names_points", Unit::Unity, "Points generated by the sources.")
+        .unwrap();
+    let trigger = trigger::builder::time_interval(POLL_INTERVAL).build().unwrap();
+    alumet.add_named_source("pod", source(metric, &at_startup), trigger.clone());
+    alumet.add_output(Box::new(NullOutput));
+
+    let mut pipeline = pipeline_builder.build().expect("pipeline should build").start();
+    let handle = pipeline.control_handle();
+    let names = || {
+        let mut names: Vec<_> = pipeline.source_timings().into_iter().map(|s| s.name).collect();
+        names.sort();
+        names
+    };
+
+    // The name of the startup source is taken: the new source gets another one.
+    handle.add_source(
+        String::from("names"),
+        String::from("pod"),
+        source(metric, &at_runtime),
+        trigger.clone(),
+    );
+    std::thread::sleep(Duration::from_millis(50));
+    assert_eq!(vec!["names/pod", "names/pod-1"], names());
+
+    // Only the startup source is removed, and its name can be given again.
+    handle
+        .remove_source(String::from("names"), String::from("pod"))
+        .unwrap();
+    std::thread::sleep(Duration::from_millis(50));
+    assert_eq!(
+        (0, 1),
+        (at_startup.load(Ordering::Relaxed), at_runtime.load(Ordering::Relaxed))
+    );
+    handle.add_source(
+        String::from("names"),
+        String::from("pod"),
+        source(metric, &re_added),
+        trigger,
+    );
+    std::thread::sleep(Duration::from_millis(50));
+    assert_eq!(vec!["names/pod", "names/pod-1"], names());
+
+    handle
+        .remove_source(String::from("names"), String::from("pod"))
+        .unwrap();
+    std::thread::sleep(Duration::from_millis(50));
+    assert_eq!(
+        (1, 0),
+        (at_runtime.load(Ordering::Relaxed), re_added.load(Ordering::Relaxed))
+    );
+
+    handle.shutdown();
+    pipeline.wait_for_shutdown().unwrap();
+}
+
+struct CountingSource {
+    metric: TypedMetricId<u64>,
+    alive: Arc<AtomicUsize>,
+    polls: Arc<AtomicUsize>,
+}
+
+impl Source for CountingSource {
+    fn poll(&mut self, acc: &mut MeasurementAccumulator, timestamp: Timestamp) -> Result<(), PollError> {
+        self.polls.fetch_add(1, Ordering::Relaxed);
+        acc.push(MeasurementPoint::new(
+            timestamp,
+            self.metric,
+            Resource::LocalMachine,
+            ResourceConsumer::LocalMachine,
+            1,
+        ));
+        Ok(())
+    }
+}
+
+impl Drop for CountingSource {
+    fn drop(&mut self) {
+        self.alive.fetch_sub(1, Ordering::Relaxed);
+    }
+}
+
+struct NullOutput;
+
+impl Output for NullOutput {
+    fn write(&mut self, _measurements: &MeasurementBuffer, _ctx: &OutputContext) -> Result<(), WriteError> {
+        Ok(())
+    }
+}
@@ -0,0 +1,154 @@
+//! Benchmark of the trigger groups.
+//!
+//! Runs many small sources with the same polling interval, first with one timer per source,
+//! then in a single trigger group, and compares the number of timer wakeups, of flushes and the CPU time.
+//!
+//! Run with `cargo test --release --test trigger_groups -- --nocapture` to see the results.
+
+use std::collections::HashSet;
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, SystemTime};
+
+use alumet::measurement::{MeasurementAccumulator, MeasurementBuffer, MeasurementPoint, Timestamp};
+use alumet::metrics::TypedMetricId;
+use alumet::pipeline::builder::PipelineBuilder;
+use alumet::pipeline::{trigger, Output, OutputContext, PollError, Source, WriteError};
+use alumet::plugin::AlumetStart;
+use alumet::resources::{Resource, ResourceConsumer};
+use alumet::units::Unit;
+
+const N_SOURCES: u32 = 1000;
+const POLL_INTERVAL: Duration = Duration::from_millis(10);
+const RUN_DURATION: Duration = Duration::from_millis(500);
+
+#[test]
+fn trigger_groups_reduce_wakeups() {
+    println!("mode     | sources | wakeups | flushes | points | CPU time | voluntary ctx switches");
+    let individual = run_pipeline(false);
+    individual.print("separate");
+    let grouped = run_pipeline(true);
+    grouped.print("grouped");
+
+    assert_eq!(N_SOURCES as usize, grouped.sources, "every source of the group must be polled");
+    assert!(
+        grouped.wakeups < individual.wakeups,
+        "grouping the sources must reduce the number of wakeups"
+    );
+    assert!(grouped.flushes < individual.flushes, "grouping the sources must reduce the number of flushes");
+}
+
+#[derive(Default)]
+struct Report {
+    /// Number of distinct polling timestamps, one per timer wakeup.
+    wakeups: usize,
+    /// Number of buffers written to the output.
+    flushes: usize,
+    points: usize,
+    /// Number of sources that have been polled.
+    sources: usize,
+    cpu_time: Duration,
+    ctx_switches: i64,
+}
+
+impl Report {
+    fn print(&self, mode: &str) {
+        println!(
+            "{mode:<8} | {N_SOURCES:>7} | {:>7} | {:>7} | {:>6} | {:>8.1?} | {:>7}",
+            self.wakeups, self.flushes, self.points, self.cpu_time, self.ctx_switches
+        );
+    }
+}
+
+#[derive(Default)]
+struct Collected {
+    timestamps: HashSet<SystemTime>,
+    sources: HashSet<u64>,
+    flushes: usize,
+    points: usize,
+}
+
+/// Runs a pipeline with `N_SOURCES` sources, grouped or not.
+fn run_pipeline(grouped: bool) -> Report {
+    let collected = Arc::new(Mutex::new(Collected::default()));
+
+    let mut pipeline_builder = PipelineBuilder::new();
+    let mut alumet = AlumetStart::new(&mut pipeline_builder, String::from("groups"));
+    let metric = alumet
+        .create_metric::<u64>("group_points", Unit::Unity, "Points generated for the trigger group benchmark.")
+        .unwrap();
+    for id in 0..N_SOURCES {
+        let mut trigger = trigger::builder::time_interval(POLL_INTERVAL);
+        if grouped {
+            trigger = trigger.grouped();
+        }
+        alumet.add_source(Box::new(BenchSource { metric, id }), trigger.build().unwrap());
+    }
+    alumet.add_output(Box::new(BenchOutput {
+        collected: collected.clone(),
+    }));
+
+    let pipeline = pipeline_builder.build().expect("pipeline should build");
+    let usage_before = resource_usage();
+    let mut pipeline = pipeline.start();
+    std::thread::sleep(RUN_DURATION);
+    pipeline.control_handle().shutdown();
+    pipeline.wait_for_shutdown().unwrap();
+    let usage_after = resource_usage();
+
+    let collected = collected.lock().unwrap();
+    Report {
+        wakeups: collected.timestamps.len(),
+        flushes: collected.flushes,
+        points: collected.points,
+        sources: collected.sources.len(),
+        cpu_time: usage_after.0 - usage_before.0,
+        ctx_switches: usage_after.1 - usage_before.1,
+    }
+}
+
+/// Returns the CPU time (user + system) and the number of voluntary context switches of the process.
+fn resource_usage() -> (Duration, i64) {
+    let mut usage: libc::rusage = unsafe { std::mem::zeroed() };
+    let res = unsafe { libc::getrusage(libc::RUSAGE_SELF, &mut usage) };
+    assert_eq!(0, res, "getrusage failed");
+    let to_duration = |t: libc::timeval| Duration::new(t.tv_sec as u64, t.tv_usec as u32 * 1000);
+    let cpu_time = to_duration(usage.ru_utime) + to_duration(usage.ru_stime);
+    (cpu_time, usage.ru_nvcsw as i64)
+}
+
+struct BenchSource {
+    metric: TypedMetricId<u64>,
+    id: u32,
+}
+
+impl Source for BenchSource {
+    fn poll(&mut self, acc: &mut MeasurementAccumulator, timestamp: Timestamp) -> Result<(), PollError> {
+        acc.push(MeasurementPoint::new(
+            timestamp,
+            self.metric,
+            Resource::CpuCore { id: self.id },
+            ResourceConsumer::LocalMachine,
+            self.id as u64,
+        ));
+        Ok(())
+    }
+}
+
+struct BenchOutput {
+    collected: Arc<Mutex<Collected>>,
+}
+
+impl Output for BenchOutput {
+    fn write(&mut self, measurements: &MeasurementBuffer, _ctx: &OutputContext) -> Result<(), WriteError> {
+        let mut collected = self.collected.lock().unwrap();
+        collected.flushes += 1;
+        collected.points += measurements.len();
+        for m in measurements.iter() {
+            collected.timestamps.insert(SystemTime::from(m.timestamp));
+            if let Resource::CpuCore { id } = m.resource.resolve() {
+                collected.sources.insert(*id as u64);
+            }
+        }
+        Ok(())
+    }
+}
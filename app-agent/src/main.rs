@@ -1,7 +1,16 @@
-use std::{process, time::Duration};
+use std::{path::PathBuf, process, time::Duration};
 
 use alumet::{
     agent::{static_plugins, Agent, AgentBuilder, AgentConfig},
+    pipeline::{
+        batch::BatchConfig,
+        overload::{self, OverloadPolicy},
+        placement::PlacementConfig,
+        queue::OverflowPolicy,
+        retry::RetryConfig,
+        telemetry::TelemetryConfig,
+        worker::OutputWorkerConfig,
+    },
     plugin::{
         event::{self, StartConsumerMeasurement},
         rust::InvalidConfig,
@@ -105,6 +114,11 @@ fn apply_config(agent: &mut Agent, global_config: &mut AgentConfig, cli_args: Cl
     // Apply the config file
     let app_config: AppConfig = global_config.take_app_config().try_into().unwrap();
     agent.sources_max_update_interval(app_config.max_update_interval);
+    agent.sources_overload_policy(app_config.overload.policy());
+    agent.transforms_batching(app_config.batching.into());
+    agent.output_workers(app_config.outputs.into());
+    agent.pipeline_telemetry(app_config.telemetry.into());
+    agent.pipeline_placement(app_config.placement.into());
 
     // Apply the CLI args (they override the file)
     if let Some(max_update_interval) = cli_args.max_update_interval {
@@ -117,12 +131,292 @@ fn apply_config(agent: &mut Agent, global_config: &mut AgentConfig, cli_args: Cl
 struct AppConfig {
     #[serde(with = "humantime_serde")]
     max_update_interval: Duration,
+
+    /// What to do when the measurement pipeline is overloaded.
+    #[serde(default)]
+    overload: OverloadConfig,
+
+    /// How the measurements are merged before going through the transforms.
+    #[serde(default)]
+    batching: BatchingConfig,
+
+    /// How the outputs run.
+    #[serde(default)]
+    outputs: OutputsConfig,
+
+    /// Measurement of the pipeline itself.
+    #[serde(default)]
+    telemetry: SelfTelemetryConfig,
+
+    /// CPUs on which the pipeline runs.
+    #[serde(default)]
+    placement: ThreadPlacementConfig,
 }
 
 impl Default for AppConfig {
     fn default() -> Self {
         Self {
             max_update_interval: Duration::from_millis(500),
+            overload: OverloadConfig::default(),
+            batching: BatchingConfig::default(),
+            outputs: OutputsConfig::default(),
+            telemetry: SelfTelemetryConfig::default(),
+            placement: ThreadPlacementConfig::default(),
+        }
+    }
+}
+
+/// Configuration of the batching of the measurements in the transform step.
+#[derive(Deserialize, Serialize)]
+struct BatchingConfig {
+    /// Maximum number of measurement points in a batch (0 disables the batching).
+    max_points: usize,
+    /// Maximum time to wait for more measurements before processing an incomplete batch.
+    #[serde(with = "humantime_serde")]
+    max_delay: Duration,
+}
+
+impl Default for BatchingConfig {
+    fn default() -> Self {
+        let default = BatchConfig::default();
+        Self {
+            max_points: default.max_points,
+            max_delay: default.max_delay,
+        }
+    }
+}
+
+impl From<BatchingConfig> for BatchConfig {
+    fn from(value: BatchingConfig) -> Self {
+        BatchConfig {
+            max_points: value.max_points,
+            max_delay: value.max_delay,
+        }
+    }
+}
+
+/// Configuration of the outputs.
+#[derive(Deserialize, Serialize)]
+struct OutputsConfig {
+    /// Maximum number of measurement buffers waiting in the queue of each output.
+    queue_capacity: usize,
+    /// What to do when the queue of an output is full: "drop-oldest", "drop-newest", "block" or "spill".
+    #[serde(default)]
+    overflow: OverflowPolicyKind,
+    /// Directory where the queues are spilled (for the "spill" policy).
+    #[serde(default)]
+    spill_directory: Option<PathBuf>,
+    /// Maximum number of bytes spilled to the disk, for each output (for the "spill" policy).
+    #[serde(default = "default_max_spill_bytes")]
+    max_spill_bytes: u64,
+    /// Pins the output threads to these CPUs (empty means no pinning).
+    cpus: Vec<usize>,
+    /// Maximum number of writes in flight for each async output.
+    max_in_flight: usize,
+    /// Retry of the failed writes.
+    #[serde(default)]
+    retry: RetryQueueConfig,
+}
+
+impl Default for OutputsConfig {
+    fn default() -> Self {
+        let default = OutputWorkerConfig::default();
+        Self {
+            queue_capacity: default.queue_capacity,
+            overflow: OverflowPolicyKind::default(),
+            spill_directory: None,
+            max_spill_bytes: default_max_spill_bytes(),
+            cpus: default.cpus,
+            max_in_flight: default.max_in_flight,
+            retry: RetryQueueConfig::default(),
+        }
+    }
+}
+
+fn default_max_spill_bytes() -> u64 {
+    256 * 1024 * 1024
+}
+
+#[derive(Deserialize, Serialize, Default)]
+#[serde(rename_all = "kebab-case")]
+enum OverflowPolicyKind {
+    #[default]
+    DropOldest,
+    DropNewest,
+    Block,
+    Spill,
+}
+
+impl OutputsConfig {
+    fn overflow_policy(&self) -> OverflowPolicy {
+        match (&self.overflow, &self.spill_directory) {
+            (OverflowPolicyKind::DropOldest, _) => OverflowPolicy::DropOldest,
+            (OverflowPolicyKind::DropNewest, _) => OverflowPolicy::DropNewest,
+            (OverflowPolicyKind::Block, _) => OverflowPolicy::Block,
+            (OverflowPolicyKind::Spill, Some(dir)) => OverflowPolicy::Spill {
+                directory: dir.clone(),
+                max_disk_bytes: self.max_spill_bytes,
+            },
+            (OverflowPolicyKind::Spill, None) => {
+                log::warn!("No spill_directory for the \"spill\" overflow policy of the outputs, using \"drop-oldest\" instead.");
+                OverflowPolicy::DropOldest
+            }
+        }
+    }
+}
+
+impl From<OutputsConfig> for OutputWorkerConfig {
+    fn from(value: OutputsConfig) -> Self {
+        OutputWorkerConfig {
+            overflow: value.overflow_policy(),
+            queue_capacity: value.queue_capacity,
+            cpus: value.cpus,
+            max_in_flight: value.max_in_flight,
+            retry: value.retry.into(),
+        }
+    }
+}
+
+/// Configuration of the retry queue of each output.
+#[derive(Deserialize, Serialize)]
+struct RetryQueueConfig {
+    /// Maximum number of measurement buffers kept in memory (0 disables the retries).
+    max_memory_buffers: usize,
+    /// Directory where the failed writes are saved, to survive restarts (unset means memory only).
+    directory: Option<PathBuf>,
+    /// Maximum number of bytes on the disk, for each output.
+    max_disk_bytes: u64,
+    #[serde(with = "humantime_serde")]
+    initial_backoff: Duration,
+    #[serde(with = "humantime_serde")]
+    max_backoff: Duration,
+}
+
+impl Default for RetryQueueConfig {
+    fn default() -> Self {
+        let default = RetryConfig::default();
+        Self {
+            max_memory_buffers: default.max_memory_buffers,
+            directory: default.directory,
+            max_disk_bytes: default.max_disk_bytes,
+            initial_backoff: default.initial_backoff,
+            max_backoff: default.max_backoff,
+        }
+    }
+}
+
+impl From<RetryQueueConfig> for RetryConfig {
+    fn from(value: RetryQueueConfig) -> Self {
+        RetryConfig {
+            max_memory_buffers: value.max_memory_buffers,
+            directory: value.directory,
+            max_disk_bytes: value.max_disk_bytes,
+            initial_backoff: value.initial_backoff,
+            max_backoff: value.max_backoff,
+        }
+    }
+}
+
+/// Configuration of the self-telemetry of the pipeline.
+#[derive(Deserialize, Serialize)]
+struct SelfTelemetryConfig {
+    enabled: bool,
+    #[serde(with = "humantime_serde")]
+    poll_interval: Duration,
+}
+
+impl Default for SelfTelemetryConfig {
+    fn default() -> Self {
+        let default = TelemetryConfig::default();
+        Self {
+            enabled: default.enabled,
+            poll_interval: default.poll_interval,
+        }
+    }
+}
+
+impl From<SelfTelemetryConfig> for TelemetryConfig {
+    fn from(value: SelfTelemetryConfig) -> Self {
+        TelemetryConfig {
+            enabled: value.enabled,
+            poll_interval: value.poll_interval,
+        }
+    }
+}
+
+/// Configuration of the placement of the pipeline threads on the CPUs.
+#[derive(Deserialize, Serialize, Default)]
+struct ThreadPlacementConfig {
+    /// Pins the threads of the sources and transforms to these CPUs (empty means no pinning).
+    normal_cpus: Vec<usize>,
+    /// Pins the threads of the "realtime priority" sources to these CPUs (empty means no pinning).
+    priority_cpus: Vec<usize>,
+    /// Runs the sources that measure a single CPU package (like RAPL) on the CPUs of this package.
+    package_local_sources: bool,
+}
+
+impl From<ThreadPlacementConfig> for PlacementConfig {
+    fn from(value: ThreadPlacementConfig) -> Self {
+        PlacementConfig {
+            normal_cpus: value.normal_cpus,
+            priority_cpus: value.priority_cpus,
+            package_local_sources: value.package_local_sources,
+        }
+    }
+}
+
+/// Configuration of the overload policy of the sources.
+#[derive(Deserialize, Serialize)]
+struct OverloadConfig {
+    /// One of "accumulate", "drop-oldest" or "slow-down".
+    #[serde(default)]
+    policy: OverloadPolicyKind,
+    /// Memory budget of the buffer of each source, in bytes.
+    #[serde(default = "default_max_buffer_bytes")]
+    max_buffer_bytes: usize,
+    /// Maximum stretching factor of the polling interval (for the "slow-down" policy).
+    #[serde(default = "default_max_slowdown_factor")]
+    max_slowdown_factor: u32,
+}
+
+fn default_max_buffer_bytes() -> usize {
+    overload::DEFAULT_MAX_BUFFER_BYTES
+}
+
+fn default_max_slowdown_factor() -> u32 {
+    overload::DEFAULT_MAX_SLOWDOWN_FACTOR
+}
+
+#[derive(Deserialize, Serialize, Default)]
+#[serde(rename_all = "kebab-case")]
+enum OverloadPolicyKind {
+    #[default]
+    Accumulate,
+    DropOldest,
+    SlowDown,
+}
+
+impl OverloadConfig {
+    fn policy(&self) -> OverloadPolicy {
+        match self.policy {
+            OverloadPolicyKind::Accumulate => OverloadPolicy::Accumulate {
+                max_bytes: self.max_buffer_bytes,
+            },
+            OverloadPolicyKind::DropOldest => OverloadPolicy::DropOldest,
+            OverloadPolicyKind::SlowDown => OverloadPolicy::SlowDown {
+                max_bytes: self.max_buffer_bytes,
+                max_factor: self.max_slowdown_factor,
+            },
+        }
+    }
+}
+
+impl Default for OverloadConfig {
+    fn default() -> Self {
+        Self {
+            policy: OverloadPolicyKind::default(),
+            max_buffer_bytes: default_max_buffer_bytes(),
+            max_slowdown_factor: default_max_slowdown_factor(),
         }
     }
 }
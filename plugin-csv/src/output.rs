@@ -1,12 +1,12 @@
 use std::{
-    collections::HashSet,
+    collections::HashMap,
     fs::File,
     io::{self, BufWriter, Write},
     path::Path,
     time::SystemTime,
 };
 
-use alumet::measurement::MeasurementBuffer;
+use alumet::measurement::{AttributeKey, MeasurementBuffer};
 use alumet::{measurement::WrappedMeasurementValue, pipeline::OutputContext};
 use anyhow::Context;
 use time::format_description::well_known::Rfc3339;
@@ -17,7 +17,10 @@ use crate::csv::CsvHelper;
 pub struct CsvOutput {
     /// The attributes that we have written to the header.
     /// None if the header has not been written yet.
-    attributes_in_header: Option<HashSet<String>>,
+    attributes_in_header: Option<HeaderAttributes>,
+
+    /// Names of the attributes that are not in the header, to avoid looking them up for each point.
+    late_attribute_names: HashMap<AttributeKey, &'static str>,
 
     /// parameter: do we flush after each write(measurements)?
     force_flush: bool,
@@ -46,6 +49,7 @@ impl CsvOutput {
         let helper = CsvHelper::new(delimiter, escaped_quote);
         Ok(Self {
             attributes_in_header: None,
+            late_attribute_names: HashMap::new(),
             force_flush,
             append_unit_to_metric_name,
             use_unit_display_name,
@@ -55,12 +59,38 @@ impl CsvOutput {
     }
 }
 
-fn collect_attribute_keys(buf: &MeasurementBuffer) -> HashSet<String> {
-    let mut res = HashSet::new();
-    for m in buf.iter() {
-        res.extend(m.attributes_keys().map(|k| k.to_owned()));
+/// The attribute columns of the CSV header.
+struct HeaderAttributes {
+    /// The names of the columns, sorted alphabetically.
+    names: Vec<&'static str>,
+    /// The column of each key, sorted by key like the attributes of the points,
+    /// which allows to place the attributes of a point in one pass.
+    columns_by_key: Vec<(AttributeKey, usize)>,
+}
+
+impl HeaderAttributes {
+    /// Collects the attributes that are present in the measurements.
+    fn collect(buf: &MeasurementBuffer) -> Self {
+        let mut keys = Vec::new();
+        for m in buf.iter() {
+            keys.extend(m.attributes_by_key().map(|(k, _)| k));
+        }
+        keys.sort_unstable();
+        keys.dedup();
+
+        // The ids of the keys depend on the order in which they have been created:
+        // sort the columns by name, and look up each name only once.
+        let mut named: Vec<(&'static str, AttributeKey)> = keys.iter().map(|k| (k.name(), *k)).collect();
+        named.sort_unstable();
+        let names = named.iter().map(|(name, _)| *name).collect();
+        let mut columns_by_key: Vec<(AttributeKey, usize)> = named
+            .iter()
+            .enumerate()
+            .map(|(column, (_, key))| (*key, column))
+            .collect();
+        columns_by_key.sort_unstable();
+        Self { names, columns_by_key }
     }
-    res
 }
 
 impl alumet::pipeline::Output for CsvOutput {
@@ -71,13 +101,10 @@ impl alumet::pipeline::Output for CsvOutput {
     ) -> Result<(), alumet::pipeline::WriteError> {
         if self.attributes_in_header.is_none() && measurements.len() > 0 {
             // Collect the attributes that are present in the measurements.
-            // Then, sort the keys to ensure a consistent order between calls to `CsvOutput::write`.
-            let attr_keys = collect_attribute_keys(measurements);
-            let mut attr_keys_sorted: Vec<&str> = attr_keys.iter().map(|s| s.as_str()).collect::<Vec<_>>();
-            attr_keys_sorted.sort();
+            let attributes = HeaderAttributes::collect(measurements);
 
             // Build the CSV header
-            let mut header = Vec::with_capacity(8 + attr_keys_sorted.len());
+            let mut header = Vec::with_capacity(8 + attributes.names.len());
             header.extend(&[
                 "metric",
                 "timestamp",
@@ -87,12 +114,12 @@ impl alumet::pipeline::Output for CsvOutput {
                 "consumer_kind",
                 "consumer_id",
             ]);
-            header.extend(attr_keys_sorted);
+            header.extend(&attributes.names);
             header.push("__late_attributes");
 
             self.csv_helper.writeln(&mut self.writer, header)?;
 
-            self.attributes_in_header = Some(attr_keys);
+            self.attributes_in_header = Some(attributes);
         }
 
         for m in measurements.iter() {
@@ -125,10 +152,12 @@ impl alumet::pipeline::Output for CsvOutput {
                 WrappedMeasurementValue::F64(x) => x.to_string(),
                 WrappedMeasurementValue::U64(x) => x.to_string(),
             };
-            let resource_kind = m.resource.kind().to_owned();
-            let resource_id = m.resource.id_display().to_string();
-            let consumer_kind = m.consumer.kind().to_owned();
-            let consumer_id = m.consumer.id_display().to_string();
+            let resource = ctx.resources.resource(&m.resource);
+            let consumer = ctx.resources.consumer(&m.consumer);
+            let resource_kind = resource.kind().to_owned();
+            let resource_id = resource.id_display().to_string();
+            let consumer_kind = consumer.kind().to_owned();
+            let consumer_id = consumer.id_display().to_string();
 
             // Start to build the record
             let mut record = vec![
@@ -141,18 +170,19 @@ impl alumet::pipeline::Output for CsvOutput {
                 consumer_id,
             ];
 
-            // Sort the attributes by key
-            let mut attr_sorted = m.attributes().collect::<Vec<_>>();
-            attr_sorted.sort_by_key(|(k, _)| *k);
-
             // Handle known as well as new attributes.
+            // The attributes of the point are sorted by key, like `columns_by_key`.
+            // The attributes of the header that are missing in this point are written as empty values.
+            let header = self.attributes_in_header.as_ref().unwrap();
+            let first_column = record.len();
+            record.resize(first_column + header.names.len(), String::new());
+            let mut header_keys = header.columns_by_key.iter().peekable();
             let mut late_attrs: String = String::new();
-            let mut known_attrs = 0;
-            for (key, value) in attr_sorted {
-                if self.attributes_in_header.as_ref().unwrap().contains(key) {
-                    // known attribute, write in the same order as the header (thanks to the sort)
-                    record.push(value.to_string());
-                    known_attrs += 1;
+            for (key, value) in m.attributes_by_key() {
+                while header_keys.next_if(|(k, _)| *k < key).is_some() {}
+                if let Some((_, column)) = header_keys.next_if(|(k, _)| *k == key) {
+                    // known attribute, write it in its column
+                    record[first_column + column] = value.to_string();
                 } else {
                     // unknown attribute, add to the column `__late_attributes`
                     use std::fmt::Write;
@@ -160,17 +190,15 @@ impl alumet::pipeline::Output for CsvOutput {
                     if !late_attrs.is_empty() {
                         late_attrs.push_str(", ");
                     }
+                    let name = self.late_attribute_names.entry(key).or_insert_with(|| key.name());
                     write!(
                         late_attrs,
                         "{}={}",
-                        escape_late_attribute(key),
+                        escape_late_attribute(name),
                         escape_late_attribute(&value.to_string())
                     )?;
                 }
             }
-            // Add missing attributes as empty values
-            let missing_attributes = self.attributes_in_header.as_ref().unwrap().len() - known_attrs;
-            record.extend(vec![String::from(""); missing_attributes]);
 
             // Push the late attributes as one value
             record.push(late_attrs);
@@ -189,3 +217,44 @@ impl alumet::pipeline::Output for CsvOutput {
 fn escape_late_attribute(s: &str) -> String {
     s.replace('=', "\\=")
 }
+
+#[cfg(test)]
+mod tests {
+    use alumet::{
+        measurement::{
+            AttributeKey, AttributeValue, MeasurementBuffer, MeasurementPoint, Timestamp, WrappedMeasurementValue,
+        },
+        metrics::RawMetricId,
+        resources::{Resource, ResourceConsumer},
+    };
+
+    use super::HeaderAttributes;
+
+    #[test]
+    fn header_sorted_by_name() {
+        // create the keys in the reverse order of their names
+        let z = AttributeKey::new("test_csv_header_z");
+        let a = AttributeKey::new("test_csv_header_a");
+        let m = AttributeKey::new("test_csv_header_m");
+        let point = |attrs: Vec<(AttributeKey, AttributeValue)>| {
+            MeasurementPoint::new_untyped(
+                Timestamp::now(),
+                RawMetricId::from_u64(0),
+                Resource::LocalMachine,
+                ResourceConsumer::LocalMachine,
+                WrappedMeasurementValue::U64(0),
+            )
+            .with_attr_vec(attrs)
+        };
+        let mut buf = MeasurementBuffer::new();
+        buf.push(point(vec![(z, AttributeValue::U64(1)), (a, AttributeValue::U64(2))]));
+        buf.push(point(vec![(m, AttributeValue::U64(3))]));
+
+        let header = HeaderAttributes::collect(&buf);
+        assert_eq!(
+            vec!["test_csv_header_a", "test_csv_header_m", "test_csv_header_z"],
+            header.names
+        );
+        assert_eq!(vec![(z, 2), (a, 0), (m, 1)], header.columns_by_key);
+    }
+}
@@ -1,8 +1,9 @@
 use std::collections::HashSet;
+use std::sync::Arc;
 
 use alumet::{
-    measurement::{AttributeValue, WrappedMeasurementValue},
-    pipeline::Output,
+    measurement::{AttributeValue, MeasurementBuffer, WrappedMeasurementValue},
+    pipeline::{AsyncOutput, OutputContext, WriteFuture},
     plugin::rust::{deserialize_config, serialize_config, AlumetPlugin},
 };
 use anyhow::Context;
@@ -51,8 +52,8 @@ impl AlumetPlugin for InfluxDbPlugin {
         log::info!("Test successfull.");
 
         // Create the output.
-        alumet.add_output(Box::new(InfluxDbOutput {
-            client: influx_client,
+        alumet.add_async_output(Box::new(InfluxDbOutput {
+            client: Arc::new(influx_client),
             org: config.org,
             bucket: config.bucket,
             attributes_as: config.attributes_as,
@@ -68,7 +69,8 @@ impl AlumetPlugin for InfluxDbPlugin {
 }
 
 struct InfluxDbOutput {
-    client: influxdb2::Client,
+    /// Shared by the writes in flight.
+    client: Arc<influxdb2::Client>,
     org: String,
     bucket: String,
     attributes_as: AttributeAs,
@@ -76,23 +78,21 @@ struct InfluxDbOutput {
     attributes_as_fields: HashSet<String>,
 }
 
-impl Output for InfluxDbOutput {
-    fn write(
-        &mut self,
-        measurements: &alumet::measurement::MeasurementBuffer,
-        ctx: &alumet::pipeline::OutputContext,
-    ) -> Result<(), alumet::pipeline::WriteError> {
+impl AsyncOutput for InfluxDbOutput {
+    fn write(&mut self, measurements: Arc<MeasurementBuffer>, ctx: &OutputContext) -> WriteFuture {
         // Build the data to send to InfluxDB.
         let mut builder = LineProtocolData::builder();
-        for m in measurements {
+        for m in measurements.iter() {
             let metric = ctx.metrics.with_id(&m.metric).unwrap();
             builder.measurement(&metric.name);
 
             // Resources and consumers are translated to tags.
-            builder.tag("resource_kind", m.resource.kind());
-            builder.tag("resource_id", &m.resource.id_string().unwrap_or_default());
-            builder.tag("resource_consumer_kind", m.consumer.kind());
-            builder.tag("resource_consumer_id", &m.consumer.id_string().unwrap_or_default());
+            let resource = ctx.resources.resource(&m.resource);
+            let consumer = ctx.resources.consumer(&m.consumer);
+            builder.tag("resource_kind", resource.kind());
+            builder.tag("resource_id", &resource.id_string().unwrap_or_default());
+            builder.tag("resource_consumer_kind", consumer.kind());
+            builder.tag("resource_consumer_id", &consumer.id_string().unwrap_or_default());
 
             // Alumet attributes are translated to fields, or tags, depending on the configuration.
             // Some tag keys and field keys are reserved by Alumet and will trigger a renaming.
@@ -157,12 +157,17 @@ impl Output for InfluxDbOutput {
         let data = builder.build();
         log::debug!("Line protocol data: {data:?}");
 
-        // Do the writing on the tokio Runtime.
-        let handle = tokio::runtime::Handle::current();
-        handle
-            .block_on(self.client.write(&self.org, &self.bucket, data))
-            .context("failed to write measurements to InfluxDB")?;
-        Ok(())
+        // Send the data in the background, the pipeline can prepare the next writes in the meantime.
+        let client = self.client.clone();
+        let org = self.org.clone();
+        let bucket = self.bucket.clone();
+        Box::pin(async move {
+            client
+                .write(&org, &bucket, data)
+                .await
+                .context("failed to write measurements to InfluxDB")?;
+            Ok(())
+        })
     }
 }
 
@@ -5,7 +5,7 @@ use alumet::{
         util::{CounterDiff, CounterDiffUpdate},
         AlumetStart,
     },
-    resources::{Resource, ResourceConsumer},
+    resources::{ConsumerId, ResourceConsumer, ResourceId},
     units::{PrefixedUnit, Unit},
 };
 use anyhow::Result;
@@ -21,6 +21,9 @@ pub struct K8SProbe {
     pub time_used_tot: TypedMetricId<u64>,
     pub time_used_user_mode: TypedMetricId<u64>,
     pub time_used_system_mode: TypedMetricId<u64>,
+    /// The cgroup, created once to avoid rebuilding its path on every poll.
+    /// It is freed once the probe and its measurements are dropped.
+    pub consumer: ConsumerId,
 }
 
 #[derive(Clone)]
@@ -32,7 +35,11 @@ pub struct Metrics {
 
 impl K8SProbe {
     pub fn new(metric: Metrics, metric_file: CgroupV2MetricFile, counter_tot: CounterDiff, counter_sys: CounterDiff, counter_usr: CounterDiff) -> anyhow::Result<K8SProbe> {
+        let consumer = ResourceConsumer::ControlGroup {
+            path: metric_file.path.to_string_lossy().to_string().into(),
+        };
         return Ok(K8SProbe {
+            consumer: consumer.into(),
             cgroup_v2_metric_file: metric_file,
             time_tot: counter_tot,
             time_usr: counter_usr,
@@ -66,14 +73,12 @@ impl alumet::pipeline::Source for K8SProbe {
             CounterDiffUpdate::Difference(diff) => Some(diff),
             CounterDiffUpdate::CorrectedDifference(diff) => Some(diff),
         };
-        let consumer = ResourceConsumer::ControlGroup {
-            path: (self.cgroup_v2_metric_file.path.to_string_lossy().to_string().into()),
-        };
+        let consumer = &self.consumer;
         if let Some(value_tot) = diff_tot {
             let p_tot: MeasurementPoint = MeasurementPoint::new(
                 timestamp,
                 self.time_used_tot,
-                Resource::LocalMachine,
+                ResourceId::LOCAL_MACHINE,
                 consumer.clone(),
                 value_tot as u64,
             )
@@ -84,7 +89,7 @@ impl alumet::pipeline::Source for K8SProbe {
             let p_usr: MeasurementPoint = MeasurementPoint::new(
                 timestamp,
                 self.time_used_user_mode,
-                Resource::LocalMachine,
+                ResourceId::LOCAL_MACHINE,
                 consumer.clone(),
                 value_usr as u64,
             )
@@ -95,7 +100,7 @@ impl alumet::pipeline::Source for K8SProbe {
             let p_sys: MeasurementPoint = MeasurementPoint::new(
                 timestamp,
                 self.time_used_system_mode,
-                Resource::LocalMachine,
+                ResourceId::LOCAL_MACHINE,
                 consumer.clone(),
                 value_sys as u64,
             )
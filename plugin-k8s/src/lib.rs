@@ -9,7 +9,11 @@ use anyhow::Context;
 use k8s_probe::Metrics;
 use notify::{Event, EventHandler, EventKind, RecommendedWatcher, RecursiveMode, Watcher};
 use serde::{Deserialize, Serialize};
-use std::{fs::File, path::PathBuf, time::Duration};
+use std::{
+    fs::File,
+    path::{Path, PathBuf},
+    time::Duration,
+};
 
 mod cgroup_v2;
 mod k8s_probe;
@@ -32,6 +36,9 @@ struct Config {
     /// Initial interval between two cgroup measurements.
     #[serde(with = "humantime_serde")]
     poll_interval: Duration,
+    /// Set to true to align the measurements on the wall clock, on multiples of `poll_interval`.
+    #[serde(default)]
+    align_ticks: bool,
 }
 
 impl AlumetPlugin for K8sPlugin {
@@ -68,8 +75,11 @@ impl AlumetPlugin for K8sPlugin {
             let counter_tmp_tot: CounterDiff = CounterDiff::with_max_value(CGROUP_MAX_TIME_COUNTER);
             let counter_tmp_usr: CounterDiff = CounterDiff::with_max_value(CGROUP_MAX_TIME_COUNTER);
             let counter_tmp_sys: CounterDiff = CounterDiff::with_max_value(CGROUP_MAX_TIME_COUNTER);
+            // Named after the cgroup directory of the pod, like the sources added by the PodDetector,
+            // so that it can be removed when the pod disappears.
+            let source_name = directory_name(&metric_file.path)?;
             let probe = K8SProbe::new(metrics.clone(), metric_file, counter_tmp_tot, counter_tmp_sys, counter_tmp_usr)?;
-            alumet.add_source(Box::new(probe), TriggerSpec::at_interval(self.config.poll_interval));
+            alumet.add_named_source(&source_name, Box::new(probe), pod_trigger(self.config.poll_interval, self.config.align_ticks));
         }
 
         return Ok(());
@@ -86,11 +96,14 @@ impl AlumetPlugin for K8sPlugin {
         // let metrics = self.metrics.clone().unwrap();
         let metrics = self.metrics.clone().unwrap();
         let poll_interval = self.config.poll_interval;
+        let align_ticks = self.config.align_ticks;
         struct PodDetector {
+            root: PathBuf,
             plugin_name: String,
             metrics: Metrics,
             control_handle: ControlHandle,
             poll_interval: Duration,
+            align_ticks: bool,
         }
 
         impl EventHandler for PodDetector {
@@ -99,13 +112,30 @@ impl AlumetPlugin for K8sPlugin {
                 // Handle_Event: Ok(Event { kind: Create(Folder), paths: ["/sys/fs/cgroup/kubepods.slice/kubepods-besteffort.slice/TESTTTTT"], attr:tracker: None, attr:flag: None, attr:info: None, attr:source: None })
                 // Handle_Event: Ok(Event { kind: Remove(Folder), paths: ["/sys/fs/cgroup/kubepods.slice/kubepods-besteffort.slice/TESTTTTT"], attr:tracker: None, attr:flag: None, attr:info: None, attr:source: None })
                 log::debug!("Handle event function");
+                if let Ok(Event {
+                    kind: EventKind::Remove(notify::event::RemoveKind::Folder),
+                    paths,
+                    ..
+                }) = &event
+                {
+                    // The pod has disappeared: stop polling its cgroup, and free the source.
+                    // The watcher is recursive, ignore the removal of the cgroups inside the pods.
+                    for path in paths.iter().filter(|p| is_pod_directory(&self.root, p)) {
+                        if let Some(pod_name) = path.file_name().and_then(|n| n.to_str()) {
+                            // This can fail if a pod disappears while Alumet shuts down, which is fine.
+                            if let Err(e) = self.control_handle.remove_source(self.plugin_name.clone(), pod_name.to_owned()) {
+                                log::warn!("Cannot remove the source of pod {pod_name}: {e:#}");
+                            }
+                        }
+                    }
+                }
                 if let Ok(Event {
                     kind: EventKind::Create(notify::event::CreateKind::Folder),
                     paths,
                     ..
                 }) = event
                 {
-                    for path in paths {
+                    for path in paths.into_iter().filter(|p| is_pod_directory(&self.root, p)) {
                         if let Some(pod_name) = path.file_name() {
                             let pod_name = pod_name.to_str().unwrap();
                             // We open a File Descriptor to the newly created file
@@ -124,7 +154,7 @@ impl AlumetPlugin for K8sPlugin {
                             let probe: K8SProbe = K8SProbe::new(self.metrics.clone(), metric_file, counter_tmp_tot, counter_tmp_sys, counter_tmp_usr).unwrap();
                             
                             // Add the probe to the sources
-                            self.control_handle.add_source(self.plugin_name.clone(), pod_name.to_string(), Box::new(probe), TriggerSpec::at_interval(self.poll_interval));
+                            self.control_handle.add_source(self.plugin_name.clone(), pod_name.to_string(), Box::new(probe), pod_trigger(self.poll_interval, self.align_ticks));
                         }
 
                     }
@@ -132,10 +162,12 @@ impl AlumetPlugin for K8sPlugin {
             }
         }
         let handler = PodDetector {
+            root: self.config.path.clone(),
             plugin_name: plugin_name,
             metrics: metrics,
             control_handle: control_handle,
             poll_interval: poll_interval,
+            align_ticks: align_ticks,
         };
 
         let mut watcher = notify::recommended_watcher(handler)?;
@@ -149,12 +181,72 @@ impl AlumetPlugin for K8sPlugin {
 
 }
 
+/// Returns the name of the cgroup directory of a pod.
+fn directory_name(pod_dir: &Path) -> anyhow::Result<String> {
+    pod_dir
+        .file_name()
+        .and_then(|name| name.to_str())
+        .map(ToOwned::to_owned)
+        .with_context(|| format!("invalid pod directory: {}", pod_dir.display()))
+}
+
+/// Returns true if `dir` is the cgroup of a pod, like the ones listed at startup:
+/// a directory of the `root`, or of a `*.slice` directory of the `root`.
+fn is_pod_directory(root: &Path, dir: &Path) -> bool {
+    match dir.parent() {
+        Some(parent) if parent == root => true,
+        Some(parent) => {
+            parent.parent() == Some(root)
+                && parent
+                    .file_name()
+                    .and_then(|name| name.to_str())
+                    .is_some_and(|name| name.ends_with(".slice"))
+        }
+        None => false,
+    }
+}
+
+/// Returns the trigger of a pod source.
+///
+/// There is one source per pod, they are grouped to be polled from a single timer.
+/// If `aligned` is true, the ticks are aligned on the wall clock, so that the measurements of the pods
+/// can be joined with the measurements of other aligned sources, such as RAPL.
+fn pod_trigger(poll_interval: Duration, aligned: bool) -> TriggerSpec {
+    let mut builder = TriggerSpec::builder(poll_interval).grouped();
+    if aligned {
+        builder = builder.aligned();
+    }
+    builder.build().unwrap()
+}
+
 impl Default for Config {
     fn default() -> Self {
         let root_path = PathBuf::from("/sys/fs/cgroup/kubepods.slice/");
         Self {
             path: root_path,
             poll_interval: Duration::from_secs(1), // 1Hz
+            align_ticks: false,
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use std::path::Path;
+
+    use super::is_pod_directory;
+
+    #[test]
+    fn pod_directories() {
+        let root = Path::new("/sys/fs/cgroup/kubepods.slice/");
+        let pod = "kubepods-pod42.slice";
+        assert!(is_pod_directory(root, &root.join(pod)));
+        assert!(is_pod_directory(root, &root.join("kubepods-besteffort.slice").join(pod)));
+        // cgroups of the containers, inside the pods
+        assert!(!is_pod_directory(
+            root,
+            &root.join("kubepods-besteffort.slice").join(pod).join("cri-containerd-abc.scope")
+        ));
+        assert!(!is_pod_directory(root, Path::new("/sys/fs/cgroup")));
+    }
+}
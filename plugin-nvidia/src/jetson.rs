@@ -6,11 +6,11 @@ use std::{
 };
 
 use alumet::{
-    measurement::{AttributeValue, MeasurementAccumulator, MeasurementPoint, Timestamp},
+    measurement::{AttributeKey, AttributeValue, MeasurementAccumulator, MeasurementPoint, Timestamp},
     metrics::TypedMetricId,
     pipeline::PollError,
     plugin::AlumetStart,
-    resources::{Resource, ResourceConsumer},
+    resources::{ConsumerId, ResourceId},
     units::{PrefixedUnit, Unit},
 };
 use anyhow::{anyhow, Context};
@@ -46,18 +46,29 @@ pub struct InaRailMetric {
 /// Measurement source that queries the embedded INA3221 sensor of a Jetson device.
 pub struct JetsonInaSource {
     opened_sensors: Vec<OpenedInaSensor>,
+    keys: InaAttributeKeys,
+}
+
+/// Keys of the attributes attached to each measurement.
+struct InaAttributeKeys {
+    sensor: AttributeKey,
+    channel_label: AttributeKey,
+    channel_description: AttributeKey,
 }
 
 /// A sensor that has been "opened" for reading.
+///
+/// The strings are leaked when the sensor is opened, to be used as attribute values without copying them.
+/// This is fine because the sensors are opened once, when the plugin starts.
 pub struct OpenedInaSensor {
-    i2c_id: String,
+    i2c_id: &'static str,
     channels: Vec<OpenedInaChannel>,
 }
 
 /// A channel that has been "opened" for reading.
 pub struct OpenedInaChannel {
-    label: String,
-    description: String,
+    label: &'static str,
+    description: &'static str,
     metrics: Vec<OpenedInaMetric>,
 }
 
@@ -67,7 +78,7 @@ pub struct OpenedInaMetric {
     /// The INA sensors provides integer values.
     metric_id: TypedMetricId<u64>,
     /// Id of the "resource" corresponding to the INA sensor.
-    resource_id: Resource,
+    resource_id: ResourceId,
     /// The virtual file in the sysfs, opened for reading.
     file: File,
 }
@@ -99,24 +110,29 @@ impl JetsonInaSource {
                             .with_context(|| format!("Could not open virtual file {}", m.path.display()))?;
                         Ok(OpenedInaMetric {
                             metric_id,
-                            resource_id: Resource::LocalMachine,
+                            resource_id: ResourceId::LOCAL_MACHINE,
                             file,
                         })
                     })
                     .collect();
                 let opened_chan = OpenedInaChannel {
-                    label: channel.label,
-                    description: channel.description.unwrap_or(String::from("")),
+                    label: channel.label.leak(),
+                    description: channel.description.map(|d| &*d.leak()).unwrap_or(""),
                     metrics: metrics?,
                 };
                 sensor_opened_channels.push(opened_chan);
             }
             opened_sensors.push(OpenedInaSensor {
-                i2c_id: sensor.i2c_id,
+                i2c_id: sensor.i2c_id.leak(),
                 channels: sensor_opened_channels,
             })
         }
-        Ok(JetsonInaSource { opened_sensors })
+        let keys = InaAttributeKeys {
+            sensor: alumet.create_attribute_key("jetson_ina_sensor"),
+            channel_label: alumet.create_attribute_key("jetson_ina_channel_label"),
+            channel_description: alumet.create_attribute_key("jetson_ina_channel_description"),
+        };
+        Ok(JetsonInaSource { opened_sensors, keys })
     }
 }
 
@@ -139,15 +155,12 @@ impl alumet::pipeline::Source for JetsonInaSource {
                         .with_context(|| format!("failed to parse {:?}: '{content}", m.file))?;
 
                     // store the value and clear the buffer
-                    let consumer = ResourceConsumer::LocalMachine;
+                    let consumer = ConsumerId::LOCAL_MACHINE;
                     measurements.push(
                         MeasurementPoint::new(timestamp, m.metric_id, m.resource_id.clone(), consumer, value)
-                            .with_attr("jetson_ina_sensor", AttributeValue::String(sensor.i2c_id.clone()))
-                            .with_attr("jetson_ina_channel_label", AttributeValue::String(chan.label.clone()))
-                            .with_attr(
-                                "jetson_ina_channel_description",
-                                AttributeValue::String(chan.description.clone()),
-                            ),
+                            .with_attr(self.keys.sensor, AttributeValue::Str(sensor.i2c_id))
+                            .with_attr(self.keys.channel_label, AttributeValue::Str(chan.label))
+                            .with_attr(self.keys.channel_description, AttributeValue::Str(chan.description)),
                     );
                     reading_buf.clear();
                 }
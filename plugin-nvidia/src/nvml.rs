@@ -3,7 +3,7 @@ use std::sync::Arc;
 
 use alumet::measurement::Timestamp;
 use alumet::metrics::MetricCreationError;
-use alumet::resources::ResourceConsumer;
+use alumet::resources::ConsumerId;
 use alumet::units::PrefixedUnit;
 use alumet::{
     measurement::{MeasurementAccumulator, MeasurementPoint},
@@ -11,7 +11,7 @@ use alumet::{
     pipeline::PollError,
     plugin::util::{CounterDiff, CounterDiffUpdate},
     plugin::AlumetStart,
-    resources::Resource,
+    resources::{Resource, ResourceId},
     units::Unit,
 };
 use anyhow::Context;
@@ -52,7 +52,7 @@ pub struct NvmlSource {
     /// Alumet metrics IDs.
     metrics: Metrics,
     /// Alumet resource ID.
-    resource: Resource,
+    resource: ResourceId,
 }
 
 // The pointer `nvmlDevice_t` returned by NVML can be sent between threads.
@@ -66,7 +66,7 @@ impl NvmlSource {
             energy_counter: CounterDiff::with_max_value(u64::MAX),
             device,
             metrics,
-            resource: Resource::Gpu { bus_id },
+            resource: Resource::Gpu { bus_id }.into(),
         })
     }
 }
@@ -77,7 +77,7 @@ impl alumet::pipeline::Source for NvmlSource {
         let device = self.device.as_wrapper();
 
         // no consumer, we just monitor the device here
-        let consumer = ResourceConsumer::LocalMachine;
+        let consumer = ConsumerId::LOCAL_MACHINE;
 
         if features.total_energy_consumption {
             // the difference in milliJoules
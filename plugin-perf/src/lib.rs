@@ -70,6 +70,7 @@ impl AlumetPlugin for PerfPlugin {
             hardware_metrics: Vec::new(),
             software_metrics: Vec::new(),
             cache_metrics: Vec::new(),
+            align_ticks: config.align_ticks,
         };
         Ok(Box::new(PerfPlugin {
             config: Arc::new(Mutex::new(config)),
@@ -155,11 +156,15 @@ impl AlumetPlugin for PerfPlugin {
                     let source = builder.build()?;
 
                     // Add the source to Alumet's pipeline.
+                    let mut trigger = TriggerSpec::builder(Duration::from_secs(1)); // TODO config
+                    if config.align_ticks {
+                        trigger = trigger.aligned();
+                    }
                     control_handle.add_source(
                         plugin_name.clone(),
                         source_name,
                         Box::new(source),
-                        TriggerSpec::at_interval(Duration::from_secs(1)), // TODO config
+                        trigger.build().unwrap(),
                     );
                     log::debug!("New source has started.");
                 }
@@ -179,6 +184,9 @@ struct Config {
     hardware_events: Vec<String>,
     software_events: Vec<String>,
     cache_events: Vec<String>,
+    /// Set to true to align the measurements on the wall clock, on multiples of the polling interval.
+    #[serde(default)]
+    align_ticks: bool,
 }
 
 impl Default for Config {
@@ -191,6 +199,7 @@ impl Default for Config {
             ],
             software_events: vec![],
             cache_events: vec!["LL_READ_MISS".to_owned()],
+            align_ticks: false,
         }
     }
 }
@@ -203,4 +212,5 @@ struct ParsedConfig {
     hardware_metrics: Vec<TypedMetricId<u64>>,
     software_metrics: Vec<TypedMetricId<u64>>,
     cache_metrics: Vec<TypedMetricId<u64>>,
+    align_ticks: bool,
 }
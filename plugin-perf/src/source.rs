@@ -5,7 +5,7 @@ use alumet::{
     measurement::{MeasurementAccumulator, MeasurementPoint, Timestamp},
     metrics::TypedMetricId,
     pipeline::{PollError, Source},
-    resources::{Resource, ResourceConsumer},
+    resources::{ConsumerId, ResourceConsumer, ResourceId},
 };
 use anyhow::Context;
 use itertools::Itertools;
@@ -31,8 +31,8 @@ pub struct PerfEventSource {
 
 struct EventGroup {
     perf_group: perf_event::Group,
-    observed_resource: Resource,
-    observed_consumer: ResourceConsumer,
+    observed_resource: ResourceId,
+    observed_consumer: ConsumerId,
     cpu_id: Option<u32>,
     counters: Vec<(perf_event::Counter, TypedMetricId<u64>)>,
 }
@@ -127,10 +127,11 @@ impl PerfEventSourceBuilder {
                     // add metadata
                     let group_with_info = EventGroup {
                         perf_group,
-                        observed_resource: Resource::LocalMachine,
+                        observed_resource: ResourceId::LOCAL_MACHINE,
                         observed_consumer: ResourceConsumer::Process {
                             pid: u32::try_from(*pid).unwrap(),
-                        },
+                        }
+                        .into(),
                         cpu_id: None,
                         counters: vec![(counter, alumet_metric)],
                     };
@@ -143,6 +144,10 @@ impl PerfEventSourceBuilder {
 
                     // build one group per cpu
                     let mut groups = Vec::new();
+                    let consumer: ConsumerId = ResourceConsumer::ControlGroup {
+                        path: path.to_owned().into(),
+                    }
+                    .into();
                     for cpu_id in &self.online_cpus {
                         let cpu_id = *cpu_id as usize;
 
@@ -164,10 +169,8 @@ impl PerfEventSourceBuilder {
 
                         let group_with_info = EventGroup {
                             perf_group,
-                            observed_resource: Resource::LocalMachine,
-                            observed_consumer: ResourceConsumer::ControlGroup {
-                                path: path.to_owned().into(),
-                            },
+                            observed_resource: ResourceId::LOCAL_MACHINE,
+                            observed_consumer: consumer.clone(),
                             cpu_id: None,
                             counters: vec![(counter, alumet_metric)],
                         };
@@ -194,7 +197,9 @@ impl PerfEventSourceBuilder {
                 let counter = group.perf_group.add(&event_builder).with_context(|| {
                     format!(
                         "existing perf_group.add(event_builder), group resource={:?}, consumer={:?}, cpu={:?}",
-                        group.observed_resource, group.observed_consumer, group.cpu_id
+                        group.observed_resource.resolve(),
+                        group.observed_consumer.resolve(),
+                        group.cpu_id
                     )
                 })?;
                 group.counters.push((counter, alumet_metric))
@@ -210,7 +215,10 @@ impl PerfEventSourceBuilder {
                 .iter()
                 .map(|g| format!(
                     "{{resource: {:?}, consumer: {:?}, cpu: {:?}, events: {:?}}}",
-                    g.observed_resource, g.observed_consumer, g.cpu_id, g.counters
+                    g.observed_resource.resolve(),
+                    g.observed_consumer.resolve(),
+                    g.cpu_id,
+                    g.counters
                 ))
                 .join(", ")
         );
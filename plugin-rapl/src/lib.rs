@@ -1,4 +1,4 @@
-use std::{path::PathBuf, time::Duration};
+use std::{collections::BTreeMap, path::PathBuf, time::Duration};
 
 use alumet::{
     pipeline::{trigger, Source},
@@ -137,8 +137,8 @@ impl AlumetPlugin for RaplPlugin {
             "Energy consumed since the previous measurement, as reported by RAPL.",
         )?;
 
-        // Create the measurement source.
-        let source = match (use_perf, use_powercap) {
+        // Create the measurement sources, one per CPU package.
+        let sources = match (use_perf, use_powercap) {
             (true, true) => {
                 // prefer perf_events, fallback to powercap if it fails
                 setup_perf_events_probe_or_fallback(metric, &available_domains)?
@@ -161,13 +161,21 @@ impl AlumetPlugin for RaplPlugin {
             }
         };
 
-        // Configure the source and add it to Alumet
-        let trigger = trigger::builder::time_interval(self.config.poll_interval)
-            .flush_interval(self.config.flush_interval)
-            .update_interval(self.config.flush_interval)
-            .build()
-            .unwrap();
-        alumet.add_source(source, trigger);
+        // Configure the sources and add them to Alumet
+        for (package, source) in sources {
+            let mut trigger = trigger::builder::time_interval(self.config.poll_interval)
+                .flush_interval(self.config.flush_interval)
+                .update_interval(self.config.flush_interval);
+            if self.config.align_ticks {
+                // The measurements can be joined with the ones of the other aligned sources.
+                trigger = trigger.aligned();
+            }
+            if let Some(package) = package {
+                // The counters are read on a CPU of the package, the source can run there.
+                trigger = trigger.on_package(package);
+            }
+            alumet.add_source(source, trigger.build().unwrap());
+        }
         Ok(())
     }
 
@@ -176,10 +184,13 @@ impl AlumetPlugin for RaplPlugin {
     }
 }
 
+/// Measurement sources, each one with the CPU package that it measures (if it measures a single one).
+type PackageSources = Vec<(Option<u32>, Box<dyn Source>)>;
+
 fn setup_perf_events_probe_or_fallback(
     metric: alumet::metrics::TypedMetricId<f64>,
     available_domains: &SafeSubset,
-) -> anyhow::Result<Box<dyn Source>> {
+) -> anyhow::Result<PackageSources> {
     setup_perf_events_probe(metric, available_domains).or_else(|_| {
         log::warn!("I will fallback to the powercap sysfs, but perf_events is more efficient (see https://hal.science/hal-04420527).");
         setup_powercap_probe(metric, available_domains)
@@ -189,7 +200,7 @@ fn setup_perf_events_probe_or_fallback(
 fn setup_perf_events_probe(
     metric: alumet::metrics::TypedMetricId<f64>,
     available_domains: &SafeSubset,
-) -> Result<Box<dyn Source>, anyhow::Error> {
+) -> Result<PackageSources, anyhow::Error> {
     fn resolve_application_path() -> std::io::Result<PathBuf> {
         std::env::current_exe()?.canonicalize()
     }
@@ -203,18 +214,25 @@ fn setup_perf_events_probe(
     let n_cpu_cores = all_cpus.len();
     log::debug!("{n_sockets}/{n_cpu_cores} monitorable CPU (cores) found: {socket_cpus:?}");
 
-    // Build the right combination of perf events.
-    let mut events_on_cpus = Vec::new();
+    // Build the right combination of perf events, grouped by socket.
+    let mut events_on_cpus: BTreeMap<u32, Vec<_>> = BTreeMap::new();
     for event in &available_domains.perf_events {
         for cpu in &socket_cpus {
-            events_on_cpus.push((event, cpu));
+            events_on_cpus.entry(cpu.socket).or_default().push((event, cpu));
         }
     }
     log::debug!("Events to read: {events_on_cpus:?}");
 
-    // Try to create the source
-    match PerfEventProbe::new(metric, &events_on_cpus) {
-        Ok(perf_event_probe) => Ok(Box::new(perf_event_probe)),
+    // Try to create the sources
+    let probes: anyhow::Result<PackageSources> = events_on_cpus
+        .into_iter()
+        .map(|(socket, events)| {
+            let probe = PerfEventProbe::new(metric, &events)?;
+            Ok((Some(socket), Box::new(probe) as Box<dyn Source>))
+        })
+        .collect();
+    match probes {
+        Ok(probes) => Ok(probes),
         Err(e) => {
             // perf_events failed, log an error and try powercap instead
             log::warn!("I could not use perf_events to read RAPL energy counters: {e}");
@@ -247,9 +265,21 @@ fn setup_perf_events_probe(
 fn setup_powercap_probe(
     metric: alumet::metrics::TypedMetricId<f64>,
     available_domains: &SafeSubset,
-) -> anyhow::Result<Box<dyn Source>> {
-    match PowercapProbe::new(metric, &available_domains.power_zones) {
-        Ok(powercap_probe) => Ok(Box::new(powercap_probe)),
+) -> anyhow::Result<PackageSources> {
+    // Group the zones by socket, psys has no socket.
+    let mut zones_by_socket: BTreeMap<Option<u32>, Vec<_>> = BTreeMap::new();
+    for zone in &available_domains.power_zones {
+        zones_by_socket.entry(zone.socket_id).or_default().push(zone.clone());
+    }
+    let probes: anyhow::Result<PackageSources> = zones_by_socket
+        .into_iter()
+        .map(|(socket, zones)| {
+            let probe = PowercapProbe::new(metric, &zones)?;
+            Ok((socket, Box::new(probe) as Box<dyn Source>))
+        })
+        .collect();
+    match probes {
+        Ok(probes) => Ok(probes),
         Err(e) => {
             let msg = indoc! {"
                 I could not use the powercap sysfs to read RAPL energy counters.
@@ -277,6 +307,10 @@ struct Config {
 
     /// Set to true to disable perf_events and always use the powercap sysfs.
     no_perf_events: bool,
+
+    /// Set to true to align the measurements on the wall clock, on multiples of `poll_interval`.
+    #[serde(default)]
+    align_ticks: bool,
 }
 
 impl Default for Config {
@@ -285,6 +319,7 @@ impl Default for Config {
             poll_interval: Duration::from_secs(1), // 1Hz
             flush_interval: Duration::from_secs(5),
             no_perf_events: false, // prefer perf_events
+            align_ticks: false,
         }
     }
 }
@@ -2,7 +2,7 @@ use alumet::{
     measurement::{MeasurementAccumulator, MeasurementPoint, Timestamp},
     metrics::TypedMetricId,
     plugin::util::{CounterDiff, CounterDiffUpdate},
-    resources::{Resource, ResourceConsumer},
+    resources::{ConsumerId, ResourceId},
 };
 use anyhow::{Context, Result};
 use perf_event_open_sys as sys;
@@ -173,7 +173,7 @@ struct OpenedPowerEvent {
     fd: File,
     scale: f64,
     domain: RaplDomainType,
-    resource: Resource,
+    resource: ResourceId,
     counter: CounterDiff,
 }
 
@@ -194,7 +194,7 @@ impl PerfEventProbe {
                 fd,
                 scale,
                 domain: event.domain,
-                resource: event.domain.to_resource(*socket),
+                resource: event.domain.to_resource(*socket).into(),
                 counter,
             };
             opened.push(opened_event)
@@ -226,7 +226,7 @@ impl alumet::pipeline::Source for PerfEventProbe {
             if let Some(value) = diff {
                 // convert to joules and push
                 let joules = (value as f64) * evt.scale;
-                let consumer = ResourceConsumer::LocalMachine;
+                let consumer = ConsumerId::LOCAL_MACHINE;
                 measurements.push(
                     MeasurementPoint::new(timestamp, self.metric, evt.resource.clone(), consumer, joules)
                         .with_attr("domain", evt.domain.as_str()),
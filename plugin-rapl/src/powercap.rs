@@ -10,10 +10,10 @@ use std::{
 
 use alumet::metrics::TypedMetricId;
 use alumet::plugin::util::{CounterDiff, CounterDiffUpdate};
-use alumet::resources::Resource;
+use alumet::resources::ResourceId;
 use alumet::{
     measurement::{AttributeValue, MeasurementAccumulator, MeasurementPoint, Timestamp},
-    resources::ResourceConsumer,
+    resources::ConsumerId,
 };
 use anyhow::{anyhow, Context};
 
@@ -164,7 +164,7 @@ struct OpenedZone {
     file: File,
     domain: RaplDomainType,
     /// The corresponding ResourceId
-    resource: Resource,
+    resource: ResourceId,
     /// Overflow-correcting counter, to compute the energy consumption difference.
     counter: CounterDiff,
 }
@@ -202,7 +202,7 @@ impl PowercapProbe {
             let opened_zone = OpenedZone {
                 file,
                 domain: zone.domain,
-                resource: zone.domain.to_resource(socket),
+                resource: zone.domain.to_resource(socket).into(),
                 counter,
             };
             opened.push(opened_zone);
@@ -247,7 +247,7 @@ impl alumet::pipeline::Source for PowercapProbe {
             };
             if let Some(value) = diff {
                 let joules = (value as f64) * POWERCAP_ENERGY_UNIT;
-                let consumer = ResourceConsumer::LocalMachine;
+                let consumer = ConsumerId::LOCAL_MACHINE;
                 measurements.push(
                     MeasurementPoint::new(timestamp, self.metric, zone.resource.clone(), consumer, joules)
                         .with_attr("domain", AttributeValue::String(zone.domain.to_string())),
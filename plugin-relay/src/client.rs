@@ -1,4 +1,5 @@
 use std::collections::HashMap;
+use std::future::Future;
 use std::sync::{Arc, Mutex};
 use std::time::{SystemTime, UNIX_EPOCH};
 
@@ -9,7 +10,7 @@ use alumet::measurement::{
     AttributeValue, MeasurementBuffer, MeasurementPoint, WrappedMeasurementType, WrappedMeasurementValue,
 };
 use alumet::pipeline::runtime::IdlePipeline;
-use alumet::pipeline::OutputContext;
+use alumet::pipeline::{AsyncOutput, OutputContext, WriteFuture};
 use alumet::plugin::rust::{deserialize_config, serialize_config, AlumetPlugin};
 use alumet::plugin::ConfigTable;
 use anyhow::Context;
@@ -88,7 +89,7 @@ impl AlumetPlugin for RelayClientPlugin {
         let metric_ids = self.metric_ids.clone();
 
         // The output cannot be created right now: we need the tokio Runtime (see below).
-        alumet.add_output_builder(move |pipeline| {
+        alumet.add_async_output_builder(move |pipeline| {
             log::info!("Connecting to gRPC server {collector_uri}...");
 
             // Connect to gRPC server, using the tokio runtime in which Alumet will trigger the output.
@@ -144,21 +145,14 @@ struct RelayOutput {
     client: RelayClient,
 }
 
-impl alumet::pipeline::Output for RelayOutput {
-    fn write(
-        &mut self,
-        measurements: &MeasurementBuffer,
-        _ctx: &OutputContext,
-    ) -> Result<(), alumet::pipeline::WriteError> {
-        // Acquire the client.
-        let client = &mut self.client;
-        // Get a handle to the current tokio runtime. This works because Alumet outputs are executed inside of a tokio runtime.
-        let handle = tokio::runtime::Handle::current();
-        // Execute send_measurements in a blocking way (wait for it to finish).
-        handle
-            .block_on(client.send_measurements(measurements))
-            .context("error in send_measurements")?;
-        Ok(())
+impl AsyncOutput for RelayOutput {
+    fn write(&mut self, measurements: Arc<MeasurementBuffer>, _ctx: &OutputContext) -> WriteFuture {
+        // The request is sent on the runtime of the pipeline, which is the one of the gRPC client.
+        let request = self.client.send_measurements(&measurements);
+        Box::pin(async move {
+            request.await.context("error in send_measurements")?;
+            Ok(())
+        })
     }
 }
 
@@ -169,7 +163,13 @@ struct RelayClient {
 }
 
 impl RelayClient {
-    async fn send_measurements(&mut self, measurements: &MeasurementBuffer) -> anyhow::Result<()> {
+    /// Sends the measurements to the server.
+    ///
+    /// The returned future does not borrow the client, several requests can be in flight at the same time.
+    fn send_measurements(
+        &self,
+        measurements: &MeasurementBuffer,
+    ) -> impl Future<Output = anyhow::Result<()>> + Send + 'static {
         fn convert_alumet_to_protobuf(
             m: &MeasurementPoint,
             metric_ids: &mut HashMap<u64, u64>,
@@ -193,13 +193,14 @@ impl RelayClient {
             };
 
             // convert resource and consumer
+            let (resource, consumer) = (m.resource.resolve(), m.consumer.resolve());
             let resource = protocol::Resource {
-                kind: m.resource.kind().to_owned(),
-                id: m.resource.id_string(),
+                kind: resource.kind().to_owned(),
+                id: resource.id_string(),
             };
             let consumer = protocol::ResourceConsumer {
-                kind: m.consumer.kind().to_owned(),
-                id: m.consumer.id_string(),
+                kind: consumer.kind().to_owned(),
+                id: consumer.id_string(),
             };
 
             // convert attributes
@@ -235,19 +236,24 @@ impl RelayClient {
             .map(|point| convert_alumet_to_protobuf(point, &mut metric_ids))
             .collect();
 
-        log::debug!("Sending gRPC request with {} measurement points", points.len());
-        let request = tonic::Request::new(protocol::MeasurementBuffer { points });
-        let response = self.grpc_client.ingest_measurements(request).await?;
+        // Cloning the client is cheap: the clones share the same connection.
+        let mut grpc_client = self.grpc_client.clone();
+        async move {
+            log::debug!("Sending gRPC request with {} measurement points", points.len());
+            let request = tonic::Request::new(protocol::MeasurementBuffer { points });
+            let response = grpc_client.ingest_measurements(request).await?;
 
-        log::trace!("RESPONSE={:?}", response);
-        // TODO handle the response
+            log::trace!("RESPONSE={:?}", response);
+            // TODO handle the response
 
-        Ok(())
+            Ok(())
+        }
     }
 
     async fn register_metrics(&mut self, pipeline: &IdlePipeline) -> anyhow::Result<()> {
         let definitions: Vec<protocol::metric_definitions::MetricDef> = pipeline
-            .metric_iter()
+            .metrics()
+            .iter()
             .map(|(id, metric)| protocol::metric_definitions::MetricDef {
                 id_for_agent: id.as_u64(),
                 name: metric.name.clone(),
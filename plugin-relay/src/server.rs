@@ -1,11 +1,14 @@
 use std::{
+    collections::HashMap,
     net::{Ipv4Addr, Ipv6Addr, SocketAddr, SocketAddrV4, SocketAddrV6},
+    sync::Arc,
     time::{Duration, UNIX_EPOCH},
 };
 
 use alumet::{
     measurement::{
-        AttributeValue, MeasurementBuffer, MeasurementPoint, Timestamp, WrappedMeasurementType, WrappedMeasurementValue,
+        AttributeKey, AttributeValue, MeasurementBuffer, MeasurementPoint, Timestamp, WrappedMeasurementType,
+        WrappedMeasurementValue,
     },
     metrics::{Metric, RawMetricId},
     pipeline::builder::LateRegistrationHandle,
@@ -13,7 +16,7 @@ use alumet::{
         rust::{deserialize_config, serialize_config, AlumetPlugin},
         AlumetStart, ConfigTable,
     },
-    resources::{InvalidConsumerError, InvalidResourceError, Resource, ResourceConsumer},
+    resources::{InvalidConsumerError, InvalidResourceError, Resource, ResourceConsumer, ResourceRegistry},
     units::{PrefixedUnit, Unit},
 };
 use anyhow::Context;
@@ -85,7 +88,11 @@ impl AlumetPlugin for RelayServerPlugin {
         log::info!("Starting gRPC server with on socket {addr}");
         alumet.add_autonomous_source(move |p, cancel_token, out_tx| {
             let late_reg = tokio::sync::Mutex::new(p.late_registration_handle());
-            let collector = GrpcMetricCollector { out_tx, late_reg };
+            let collector = GrpcMetricCollector {
+                out_tx,
+                late_reg,
+                resources: p.resources().clone(),
+            };
             async move {
                 Server::builder()
                     .add_service(MetricCollectorServer::new(collector))
@@ -106,6 +113,8 @@ impl AlumetPlugin for RelayServerPlugin {
 pub struct GrpcMetricCollector {
     out_tx: tokio::sync::mpsc::Sender<MeasurementBuffer>,
     late_reg: tokio::sync::Mutex<LateRegistrationHandle>,
+    /// Shares the resources and consumers of the received points with the rest of the pipeline.
+    resources: Arc<ResourceRegistry>,
 }
 
 #[tonic::async_trait]
@@ -116,25 +125,46 @@ impl MetricCollector for GrpcMetricCollector {
     ) -> Result<Response<Empty>, Status> {
         // TODO proper error handling
 
+        // Intern each distinct resource and consumer once per request: the points of a client
+        // are usually about a few resources, and interning takes a lock.
+        let mut resources = HashMap::new();
+        let mut consumers = HashMap::new();
+
         // Transform gRPC structures into ALUMET data points.
         let measurements: Vec<MeasurementPoint> = request
             .into_inner()
             .points
             .into_iter()
-            .map(|m| {
+            .map(|m| -> Result<MeasurementPoint, Status> {
                 let timestamp = Timestamp::from(UNIX_EPOCH + Duration::new(m.timestamp_secs, m.timestamp_nanos));
                 let value = m.value.unwrap().into();
                 let resource = Resource::try_from(m.resource.unwrap()).unwrap();
+                let resource = resources
+                    .entry(resource)
+                    .or_insert_with_key(|r| self.resources.intern_resource(r.clone()))
+                    .clone();
                 let consumer = ResourceConsumer::try_from(m.consumer.unwrap()).unwrap();
-                let attributes: Vec<_> = m
+                let consumer = consumers
+                    .entry(consumer)
+                    .or_insert_with_key(|c| self.resources.intern_consumer(c.clone()))
+                    .clone();
+                // The keys come from the network, don't let the table of keys grow without bounds.
+                let attributes: Vec<(AttributeKey, AttributeValue)> = m
                     .attributes
                     .into_iter()
-                    .map(|attr| (attr.key, attr.value.unwrap().into()))
-                    .collect();
-                MeasurementPoint::new_untyped(timestamp, RawMetricId::from_u64(m.metric), resource, consumer, value)
-                    .with_attr_vec(attributes)
+                    .map(|attr| match AttributeKey::try_new(&attr.key) {
+                        Some(key) => Ok((key, attr.value.unwrap().into())),
+                        None => Err(Status::resource_exhausted(format!(
+                            "too many attribute keys, cannot register {}",
+                            attr.key
+                        ))),
+                    })
+                    .collect::<Result<_, _>>()?;
+                let metric = RawMetricId::from_u64(m.metric);
+                let point = MeasurementPoint::new_untyped(timestamp, metric, resource, consumer, value);
+                Ok(point.with_attr_vec(attributes))
             })
-            .collect();
+            .collect::<Result<_, _>>()?;
 
         // Send the measurements to the rest of the pipeline.
         self.out_tx.send(MeasurementBuffer::from(measurements)).await.unwrap();
@@ -9,11 +9,14 @@ use std::time::Duration;
 
 /// Parses a command from a string and executes it on the pipeline thanks to the ControlHandle.
 ///
+/// Returns the response of the command, if it has one.
+///
 /// ## Command Examples
 /// ```sh
 /// rapl:sources pause
 /// rapl:sources run
 /// rapl:sources trigger every 5s
+/// rapl:sources timings
 /// outputs pause
 /// ```
 ///
@@ -22,7 +25,7 @@ use std::time::Duration;
 /// ```bnf
 /// [plugin:]element command [options...]
 /// ```
-pub async fn parse_and_run(command: String, handle: &ControlHandle) -> anyhow::Result<()> {
+pub async fn parse_and_run(command: String, handle: &ControlHandle) -> anyhow::Result<Option<String>> {
     fn parse_source_command(args: &[&str]) -> anyhow::Result<SourceCmd> {
         match args {
             ["pause"] => Ok(SourceCmd::Pause),
@@ -77,6 +80,15 @@ pub async fn parse_and_run(command: String, handle: &ControlHandle) -> anyhow::R
     let parts: Vec<&str> = command.trim().split(' ').map(|s| s.trim()).collect();
     let scope: Vec<&str> = parts.first().context("missing scope")?.split(':').collect();
     let args: &[&str] = &parts[1..];
+    match (&scope[..], args) {
+        ([plugin_name, "source" | "sources"], ["timings"]) => {
+            return Ok(Some(format_timings(handle, Some(plugin_name))));
+        }
+        (["source" | "sources"], ["timings"]) => {
+            return Ok(Some(format_timings(handle, None)));
+        }
+        _ => (),
+    }
     match scope[..] {
         [plugin_name, element] => {
             let handle = handle.plugin(plugin_name);
@@ -93,7 +105,23 @@ pub async fn parse_and_run(command: String, handle: &ControlHandle) -> anyhow::R
             ))
         }
     };
-    Ok(())
+    Ok(None)
+}
+
+/// Formats the timing statistics of the running sources, one source per line.
+fn format_timings(handle: &ControlHandle, plugin: Option<&str>) -> String {
+    let mut res = String::new();
+    for t in handle.source_timings() {
+        if plugin.is_some_and(|p| p != t.plugin) {
+            continue;
+        }
+        let (l, p) = (t.lateness, t.poll_duration);
+        res.push_str(&format!(
+            "{}/{}: lateness p50={:?} p99={:?} p999={:?} max={:?} ({} ticks), poll p50={:?} p99={:?} p999={:?} max={:?} ({} polls)\n",
+            t.plugin, t.name, l.p50, l.p99, l.p999, l.max, l.count, p.p50, p.p99, p.p999, p.max, p.count
+        ));
+    }
+    res
 }
 
 /// Minimal duration parsing. Accepts inputs like `"2min"`, `"5s"`, `"5.17s"` and `"100ms"`.
@@ -90,12 +90,16 @@ async fn handle_socket_connection(
     _addr: SocketAddr,
     alumet_handle: &ControlHandle,
 ) -> anyhow::Result<()> {
-    use tokio::io::{AsyncBufReadExt, BufStream};
+    use tokio::io::{AsyncBufReadExt, AsyncWriteExt, BufStream};
 
     let buf = BufStream::new(stream);
     let mut lines = buf.lines();
     while let Some(line) = lines.next_line().await? {
-        command::parse_and_run(line, alumet_handle).await?;
+        if let Some(response) = command::parse_and_run(line, alumet_handle).await? {
+            let stream = lines.get_mut();
+            stream.write_all(response.as_bytes()).await?;
+            stream.flush().await?;
+        }
     }
     Ok(())
 }
@@ -1,7 +1,8 @@
 #include <inttypes.h>
 #include "output.h"
 
-void write_point(void *data, const MeasurementPoint *point);
+void write_point(const MeasurementPoint *point, const FfiOutputContext *ctx);
+void write_attributes(const MeasurementPoint *point);
 
 StdOutput *output_init() {
     return malloc(sizeof(StdOutput));
@@ -11,48 +12,73 @@ void output_drop(StdOutput *output) {
     free(output);
 }
 
-void output_write(StdOutput *output, const MeasurementBuffer *buffer, const FfiOutputContext *ctx) {
-    mbuffer_foreach(buffer, (void*)ctx, write_point);
+FfiStatus output_write(StdOutput *output, const MeasurementBuffer *buffer, const FfiOutputContext *ctx) {
+    // the points are stored contiguously, iterate on them without any callback
+    FfiBufferView view = mbuffer_view(buffer);
+    for (size_t i = 0; i < view.len; i++) {
+        const MeasurementPoint *point = (const MeasurementPoint *)((const char *)view.points + i * view.stride);
+        write_point(point, ctx);
+    }
+    return status_ok();
 }
 
-void write_point(void *data, const MeasurementPoint *point) {
-    const FfiOutputContext *ctx = data;
+void write_point(const MeasurementPoint *point, const FfiOutputContext *ctx) {
     FfiMeasurementValue value = mpoint_value(point);
     Timestamp t = mpoint_timestamp(point);
     AStr metric = metric_name(mpoint_metric(point), ctx);
 
-    AString resource_kind = mpoint_resource_kind(point);
-    AString resource_id = mpoint_resource_id(point);
-    AString consumer_kind = mpoint_consumer_kind(point);
-    AString consumer_id =   mpoint_consumer_id(point);
+    // borrowed strings: nothing to free, the numeric ids are formatted on the stack
+    char resource_id_buf[FFI_ID_BUFFER_LEN];
+    char consumer_id_buf[FFI_ID_BUFFER_LEN];
+    AStr resource_kind = mpoint_resource_kind_ref(point);
+    AStr resource_id = mpoint_resource_id_ref(point, resource_id_buf, sizeof(resource_id_buf));
+    AStr consumer_kind = mpoint_consumer_kind_ref(point);
+    AStr consumer_id = mpoint_consumer_id_ref(point, consumer_id_buf, sizeof(consumer_id_buf));
     RawMetricId metric_id = mpoint_metric(point);
 
+    printf("[%lu] on %.*s %.*s by %.*s %.*s, %.*s(id %lu) = ",
+        t.secs,
+        (int)resource_kind.len, resource_kind.ptr,
+        (int)resource_id.len, resource_id.ptr,
+        (int)consumer_kind.len, consumer_kind.ptr,
+        (int)consumer_id.len, consumer_id.ptr,
+        (int)metric.len, metric.ptr,
+        metric_id._0
+    );
     switch (value.tag) {
-        case FfiMeasurementValue_U64: {
-            printf("[%lu] on %.*s %.*s by %.*s %.*s, %.*s(id %lu) = %" PRIu64 "\n",
-                t.secs,
-                (int)resource_kind.len, resource_kind.ptr,
-                (int)resource_id.len, resource_id.ptr,
-                (int)consumer_kind.len, consumer_kind.ptr,
-                (int)consumer_id.len, consumer_id.ptr,
-                (int)metric.len, metric.ptr,
-                metric_id._0,
-                value.u64
-            );
-        }
-        break;
-        case FfiMeasurementValue_F64: {
-            printf("[%lu] on %.*s %.*s by %.*s %.*s, %.*s(id %lu) = %f\n",
-                t.secs,
-                (int)resource_kind.len, resource_kind.ptr,
-                (int)resource_id.len, resource_id.ptr,
-                (int)consumer_kind.len, consumer_kind.ptr,
-                (int)consumer_id.len, consumer_id.ptr,
-                (int)metric.len, metric.ptr,
-                metric_id._0,
-                value.f64
-            );
-        }
-        break;
+        case FfiMeasurementValue_U64:
+            printf("%" PRIu64, value.u64);
+            break;
+        case FfiMeasurementValue_F64:
+            printf("%f", value.f64);
+            break;
     };
+    write_attributes(point);
+    printf("\n");
+}
+
+void write_attributes(const MeasurementPoint *point) {
+    size_t n_attributes = mpoint_attributes_len(point);
+    FfiAttribute attr;
+    for (size_t i = 0; i < n_attributes && mpoint_attribute_at(point, i, &attr); i++) {
+        AStr key = attribute_key_name(attr.key);
+        printf("%s%.*s=", i == 0 ? " (" : ", ", (int)key.len, key.ptr);
+        switch (attr.value.tag) {
+            case FfiAttributeValue_U64:
+                printf("%" PRIu64, attr.value.u64);
+                break;
+            case FfiAttributeValue_F64:
+                printf("%f", attr.value.f64);
+                break;
+            case FfiAttributeValue_Boolean:
+                printf("%s", attr.value.boolean ? "true" : "false");
+                break;
+            case FfiAttributeValue_Str:
+                printf("%.*s", (int)attr.value.str.len, attr.value.str.ptr);
+                break;
+        };
+    }
+    if (n_attributes > 0) {
+        printf(")");
+    }
 }
@@ -9,6 +9,9 @@
 // Get the size of a file.
 static off_t file_size(const char *filename);
 
+// Returns a status that tells Alumet to poll the source again later, with a message about errno.
+static FfiStatus retry_errno(const char *action, const char *filename);
+
 /// @brief Creates a new PowercapSource.
 /// @param metric_id id of the metric to push the measurements to - should be obtained in plugin_start()
 /// @return the new source
@@ -21,6 +24,11 @@ PowercapSource *source_init(RawMetricId metric_id, AString custom_attribute) {
     // remmeber the metric id, so that we can push metrics to alumet in source_poll
     source->metric_id = metric_id;
 
+    // intern the attribute key, the resource and the consumer once, to build the points cheaply in source_poll
+    source->custom_attribute_key = attribute_key(astring_ref(custom_attribute));
+    source->resource = resource_intern(resource_new_cpu_package(0));
+    source->consumer = consumer_intern(consumer_new_local_machine());
+
     // open powercap sysfs file for package 0
     source->powercap_sysfs_file = "/sys/devices/virtual/powercap/intel-rapl/intel-rapl:0/energy_uj";
     source->powercap_sysfs_fd = fopen(source->powercap_sysfs_file, "r");
@@ -58,6 +66,8 @@ void source_drop(PowercapSource *source) {
         }
     }
     astring_free(source->custom_attribute);
+    resource_id_release(source->resource);
+    consumer_id_release(source->consumer);
     free(source);
 }
 
@@ -65,7 +75,8 @@ void source_drop(PowercapSource *source) {
 /// @param source the source to poll
 /// @param acc where to write the measurements to
 /// @param timestamp the current timestamp
-void source_poll(PowercapSource *source, MeasurementAccumulator *acc, Timestamp timestamp) {
+/// @return the status of the poll: a temporary error if the counter cannot be read
+FfiStatus source_poll(PowercapSource *source, MeasurementAccumulator *acc, Timestamp timestamp) {
     // The first argument of SourcePollFn is void*, but it's actually a pointer to the source struct,
     // so it's fine to use PowercapSource* directly.
     
@@ -79,11 +90,13 @@ void source_poll(PowercapSource *source, MeasurementAccumulator *acc, Timestamp
     // read the file into a buffer
     char *buffer = calloc(source->buf_size, 1);
     FILE *f = source->powercap_sysfs_fd;
-    size_t n_bytes_read = fread(buffer, 1, source->buf_size, f);
+    fread(buffer, 1, source->buf_size - 1, f);
     if (ferror(f)) {
-        fprintf(stderr, "Failed to read file '%s': %s\n", source->powercap_sysfs_file, strerror(errno));
-        return; // TODO propagate error
-    } else if ((n_bytes_read < source->buf_size) && feof(f)) {
+        FfiStatus status = retry_errno("read", source->powercap_sysfs_file);
+        clearerr(f);
+        rewind(f);
+        free(buffer);
+        return status;
     }
     rewind(f); // go back to the beginning
 
@@ -91,9 +104,9 @@ void source_poll(PowercapSource *source, MeasurementAccumulator *acc, Timestamp
     errno = 0;
     char *end;
     long long counter = strtoll(buffer, &end, 10);
+    free(buffer);
     if (errno != 0) {
-        fprintf(stderr, "Failed to parse file '%s' with content '%s': %s\n", source->powercap_sysfs_file, buffer, strerror(errno));
-        return; // TODO propagate error
+        return retry_errno("parse", source->powercap_sysfs_file);
     }
 
     // compute the different between the previous value of the counter
@@ -114,13 +127,21 @@ void source_poll(PowercapSource *source, MeasurementAccumulator *acc, Timestamp
 
     // create the measurement point
     create_measurement:
-    FfiResourceId resource = resource_new_cpu_package(0);
-    FfiConsumerId consumer = consumer_new_local_machine();
-    MeasurementPoint *p = mpoint_new_f64(timestamp, source->metric_id, resource, consumer, joules);
-    mpoint_attr_u64(p, astring_ref(source->custom_attribute), 1234);
+    FfiAttribute attributes[] = {
+        {.key = source->custom_attribute_key, .value = {.tag = FfiAttributeValue_U64, .u64 = 1234}},
+    };
+    FfiPointRecord points[] = {{
+        .value = {.tag = FfiMeasurementValue_F64, .f64 = joules},
+        .metric = source->metric_id,
+        .resource = source->resource,
+        .consumer = source->consumer,
+        .attributes_start = 0,
+        .attributes_len = 1,
+    }};
 
     // push the measurement to alumet
-    maccumulator_push(acc, p);
+    maccumulator_push_batch(acc, timestamp, points, 1, attributes, 1);
+    return status_ok();
 }
 
 off_t file_size(const char *filename) {
@@ -131,3 +152,10 @@ off_t file_size(const char *filename) {
     }
     return st.st_size;
 }
+
+FfiStatus retry_errno(const char *action, const char *filename) {
+    // status_retry copies the message, a buffer on the stack is fine
+    char message[256];
+    snprintf(message, sizeof(message), "Failed to %s file '%s': %s", action, filename, strerror(errno));
+    return status_retry(message);
+}
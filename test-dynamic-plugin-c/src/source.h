@@ -6,7 +6,10 @@
 
 typedef struct {
     AString custom_attribute;
+    AttributeKey custom_attribute_key; // interned key of the custom attribute
     RawMetricId metric_id; // id of the alumet metric
+    ResourceId resource; // interned resource (package 0), released in source_drop
+    ConsumerId consumer; // interned consumer (local machine), released in source_drop
     const char *powercap_sysfs_file;
     FILE *powercap_sysfs_fd;
     size_t buf_size;
@@ -15,6 +18,6 @@ typedef struct {
 
 PowercapSource *source_init(RawMetricId metric_id, AString custom_attribute);
 void source_drop(PowercapSource *source);
-void source_poll(PowercapSource *source, MeasurementAccumulator *acc, Timestamp timestamp);
+FfiStatus source_poll(PowercapSource *source, MeasurementAccumulator *acc, Timestamp timestamp);
 
 #endif
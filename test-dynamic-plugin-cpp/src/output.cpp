@@ -0,0 +1,72 @@
+#include <cinttypes>
+#include <cstdio>
+
+#include "output.hpp"
+
+static void write_attributes(alumet::PointRef point);
+
+static int len(std::string_view s) {
+    return static_cast<int>(s.size());
+}
+
+void StdOutput::write(alumet::BufferView points, const FfiOutputContext &ctx) {
+    for (alumet::PointRef point : points) {
+        FfiMeasurementValue value = point.value();
+        Timestamp t = point.timestamp();
+        RawMetricId metric_id = point.metric();
+        std::string_view metric = alumet::metric_name(metric_id, ctx);
+
+        // borrowed strings: nothing to free, the numeric ids are formatted on the stack
+        alumet::IdBuffer resource_id_buf, consumer_id_buf;
+        std::string_view resource_kind = point.resource_kind();
+        std::string_view resource_id = point.resource_id(resource_id_buf);
+        std::string_view consumer_kind = point.consumer_kind();
+        std::string_view consumer_id = point.consumer_id(consumer_id_buf);
+
+        std::printf("[%" PRIu64 "] on %.*s %.*s by %.*s %.*s, %.*s(id %zu) = ",
+            t.secs,
+            len(resource_kind), resource_kind.data(),
+            len(resource_id), resource_id.data(),
+            len(consumer_kind), consumer_kind.data(),
+            len(consumer_id), consumer_id.data(),
+            len(metric), metric.data(),
+            metric_id._0
+        );
+        switch (value.tag) {
+            case FfiMeasurementValue_U64:
+                std::printf("%" PRIu64, value.u64);
+                break;
+            case FfiMeasurementValue_F64:
+                std::printf("%f", value.f64);
+                break;
+        }
+        write_attributes(point);
+        std::printf("\n");
+    }
+}
+
+void write_attributes(alumet::PointRef point) {
+    const char *separator = " (";
+    for (FfiAttribute attr : point.attributes()) {
+        std::string_view key = alumet::attribute_name(attr.key);
+        std::printf("%s%.*s=", separator, len(key), key.data());
+        switch (attr.value.tag) {
+            case FfiAttributeValue_U64:
+                std::printf("%" PRIu64, attr.value.u64);
+                break;
+            case FfiAttributeValue_F64:
+                std::printf("%f", attr.value.f64);
+                break;
+            case FfiAttributeValue_Boolean:
+                std::printf("%s", attr.value.boolean ? "true" : "false");
+                break;
+            case FfiAttributeValue_Str:
+                std::printf("%.*s", (int)attr.value.str.len, attr.value.str.ptr);
+                break;
+        }
+        separator = ", ";
+    }
+    if (point.attributes().size() > 0) {
+        std::printf(")");
+    }
+}
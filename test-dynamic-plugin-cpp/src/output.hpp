@@ -0,0 +1,12 @@
+#ifndef __OUTPUT_HPP
+#define __OUTPUT_HPP
+
+#include <alumet.hpp>
+
+/// Prints the measurements to the standard output.
+class StdOutput {
+public:
+    void write(alumet::BufferView points, const FfiOutputContext &ctx);
+};
+
+#endif
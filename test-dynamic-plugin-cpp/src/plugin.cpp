@@ -0,0 +1,63 @@
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <memory>
+#include <alumet.hpp>
+
+#include "source.hpp"
+#include "output.hpp"
+
+using namespace std::chrono_literals;
+
+// The symbols that Alumet looks for must not be mangled.
+extern "C" {
+PLUGIN_API const char *PLUGIN_NAME = "test-dynamic-plugin-cpp";
+PLUGIN_API const char *PLUGIN_VERSION = "0.1.0";
+PLUGIN_API const char *ALUMET_VERSION = "0.5.0";
+}
+
+struct Plugin {
+    alumet::String custom_attribute;
+};
+
+extern "C" PLUGIN_API Plugin *plugin_init(const ConfigTable *config) {
+    std::string_view custom_attribute = alumet::config_string(config, "custom_attribute").value_or("null");
+    auto plugin = new Plugin{alumet::String(custom_attribute)};
+    std::printf("plugin = %p, custom_attribute = %.*s\n", (void *)plugin, (int)custom_attribute.size(), custom_attribute.data());
+    return plugin;
+}
+
+extern "C" PLUGIN_API void plugin_start(Plugin *plugin, AlumetStart *alumet) {
+    std::string_view custom_attribute = plugin->custom_attribute.view();
+    std::printf("plugin_start begins with plugin = %p, custom_attribute = %.*s\n", (void *)plugin, (int)custom_attribute.size(), custom_attribute.data());
+
+    try {
+        // create the source
+        auto rapl_pkg_metric = alumet::create_metric<double>(alumet, "rapl_pkg_consumption", FfiUnit_Joule, "Energy consumption of the RAPL domain `package`, since the previous measurement.");
+        auto source = std::make_unique<PowercapSource>(rapl_pkg_metric, custom_attribute);
+
+        // register the source
+        TimeDuration poll_interval = alumet::duration(1s);
+        TimeDuration flush_interval = poll_interval;
+        alumet::add_source(alumet, std::move(source), poll_interval, flush_interval);
+
+        // create and register the output
+        alumet::add_output(alumet, std::make_unique<StdOutput>());
+    } catch (const std::exception &e) {
+        // exceptions must not reach Alumet
+        std::fprintf(stderr, "plugin_start failed: %s\n", e.what());
+        return;
+    }
+
+    // ok!
+    std::printf("plugin_start finished successfully\n");
+}
+
+extern "C" PLUGIN_API void plugin_stop(Plugin *plugin) {
+    std::printf("plugin stopped\n");
+}
+
+extern "C" PLUGIN_API void plugin_drop(Plugin *plugin) {
+    std::printf("plugin Dropped\n");
+    delete plugin;
+}
@@ -0,0 +1,100 @@
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "source.hpp"
+
+// Get the size of a file.
+static off_t file_size(const char *filename);
+
+PowercapSource::PowercapSource(alumet::TypedMetric<double> metric, std::string_view custom_attribute)
+    : metric_(metric),
+      // intern the attribute key, the resource and the consumer once, to build the points cheaply in poll()
+      custom_attribute_(alumet::attribute_key(custom_attribute)),
+      resource_(alumet::intern(resource_new_cpu_package(0))),
+      consumer_(alumet::intern(consumer_new_local_machine())),
+      powercap_sysfs_file_("/sys/devices/virtual/powercap/intel-rapl/intel-rapl:0/energy_uj"),
+      buf_size_(0),
+      previous_counter_(-1) {
+    // open powercap sysfs file for package 0
+    powercap_sysfs_fd_ = std::fopen(powercap_sysfs_file_, "r");
+    if (!powercap_sysfs_fd_) {
+        if (std::getenv("CONTINUE_TEST_IF_NO_POWERCAP")) {
+            // RAPL powercap is not available on the machine, but proceed with dummy value to run the test.
+            std::fprintf(stderr, "Failed to open powercap sysfs but env var CONTINUE_TEST_IF_NO_POWERCAP is set, proceeding with dummy values.\n");
+            previous_counter_ = -2;
+            return;
+        }
+        std::fprintf(stderr, "Failed to open file '%s': %s\n", powercap_sysfs_file_, std::strerror(errno));
+    }
+
+    // determine buffer size
+    off_t max_size = file_size("/sys/devices/virtual/powercap/intel-rapl/intel-rapl:0/max_energy_range_uj");
+    if (max_size < 0) {
+        throw std::runtime_error("cannot determine the size of the powercap counter");
+    }
+    buf_size_ = max_size + 1; // +1 for the trailing zero that we'll add to the string
+}
+
+PowercapSource::~PowercapSource() {
+    if (powercap_sysfs_fd_ != nullptr && std::fclose(powercap_sysfs_fd_) != 0) {
+        std::fprintf(stderr, "Error in fclose(%s): %s\n", powercap_sysfs_file_, std::strerror(errno));
+    }
+}
+
+void PowercapSource::poll(alumet::Accumulator &acc, Timestamp timestamp) {
+    // if no powercap fd, return a dummy values (this is done on purpose to pass the test on machines without RAPL such as VMs)
+    double joules = 123.0;
+    if (powercap_sysfs_fd_) {
+        // read the file into a buffer
+        auto buffer = std::make_unique<char[]>(buf_size_);
+        FILE *f = powercap_sysfs_fd_;
+        std::fread(buffer.get(), 1, buf_size_ - 1, f);
+        if (std::ferror(f)) {
+            std::string message = std::string("failed to read ") + powercap_sysfs_file_ + ": " + std::strerror(errno);
+            std::clearerr(f);
+            std::rewind(f);
+            throw alumet::RetryError(message); // the next poll may work
+        }
+        std::rewind(f); // go back to the beginning
+
+        // parse the powercap counter
+        errno = 0;
+        long long counter = std::strtoll(buffer.get(), nullptr, 10);
+        if (errno != 0) {
+            throw alumet::RetryError(std::string("failed to parse ") + powercap_sysfs_file_ + ": " + std::strerror(errno));
+        }
+
+        // compute the different between the previous value of the counter
+        uint64_t consumed_energy_uj;
+        if (previous_counter_ == -1) {
+            consumed_energy_uj = (uint64_t)counter;
+        } else if (counter < previous_counter_) {
+            consumed_energy_uj = (uint64_t)(counter) - (uint64_t)(previous_counter_) + (uint64_t)(0xFFFFFFFFFFFFFFFF);
+        } else {
+            consumed_energy_uj = (uint64_t)(counter - previous_counter_);
+        }
+
+        // convert the counter to joules
+        joules = consumed_energy_uj * 0.0000001;
+    }
+
+    // create the measurement point and push it to alumet
+    const FfiAttribute attributes[] = {alumet::attribute(custom_attribute_, uint64_t{1234})};
+    const FfiPointRecord points[] = {metric_.record(joules, resource_.get(), consumer_.get(), 0, 1)};
+    acc.push_batch(timestamp, points, attributes);
+}
+
+off_t file_size(const char *filename) {
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        std::fprintf(stderr, "Cannot determine the size of file '%s': %s\n", filename, std::strerror(errno));
+        return -1;
+    }
+    return st.st_size;
+}
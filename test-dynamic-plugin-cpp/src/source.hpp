@@ -0,0 +1,34 @@
+#ifndef __SOURCE_HPP
+#define __SOURCE_HPP
+
+#include <cstdio>
+#include <string_view>
+#include <alumet.hpp>
+
+class PowercapSource {
+public:
+    /// @brief Creates a new PowercapSource.
+    /// @param metric metric to push the measurements to - should be obtained in plugin_start()
+    /// @param custom_attribute name of an attribute to add to the points (it's only there for testing purposes)
+    PowercapSource(alumet::TypedMetric<double> metric, std::string_view custom_attribute);
+    ~PowercapSource();
+
+    PowercapSource(const PowercapSource &) = delete;
+    PowercapSource &operator=(const PowercapSource &) = delete;
+
+    /// @brief Source.poll(acc, timestamp)
+    /// @throws alumet::RetryError if the counter cannot be read, Alumet will poll the source again
+    void poll(alumet::Accumulator &acc, Timestamp timestamp);
+
+private:
+    alumet::TypedMetric<double> metric_;
+    AttributeKey custom_attribute_;
+    alumet::Resource resource_;
+    alumet::Consumer consumer_;
+    const char *powercap_sysfs_file_;
+    FILE *powercap_sysfs_fd_;
+    size_t buf_size_;
+    long long previous_counter_; // -1 for None
+};
+
+#endif
@@ -0,0 +1,91 @@
+//! Compares the cost of the sources of several dynamic plugins, for instance the C and C++ test plugins.
+//!
+//! Usage: `bench_plugins <plugin.so>... > /dev/null`
+//!
+//! Each plugin is started alone, its sources are polled every 100µs for a few seconds,
+//! then the distribution of the duration of `poll` is printed on stderr.
+//! The outputs of the test plugins print every point on stdout, hence the redirection.
+
+use std::env;
+use std::path::Path;
+use std::time::Duration;
+
+use alumet::pipeline::builder::PipelineBuilder;
+use alumet::pipeline::runtime::SourceCmd;
+use alumet::pipeline::trigger;
+use alumet::plugin::dynload::{initialize, load_cdylib, plugin_subconfig};
+use alumet::plugin::AlumetStart;
+
+const POLL_INTERVAL: Duration = Duration::from_micros(100);
+const WARMUP: Duration = Duration::from_millis(500);
+const DURATION: Duration = Duration::from_secs(5);
+
+fn main() {
+    let plugin_files: Vec<String> = env::args().skip(1).collect();
+    if plugin_files.is_empty() {
+        eprintln!("usage: bench_plugins <plugin.so>...");
+        std::process::exit(1);
+    }
+    // the test plugins produce dummy values when RAPL is not available
+    env::set_var("CONTINUE_TEST_IF_NO_POWERCAP", "1");
+
+    eprintln!(
+        "{:<30} {:>10} {:>10} {:>10} {:>10} {:>10}",
+        "plugin", "polls", "p50", "p90", "p99", "max"
+    );
+    for file in plugin_files {
+        bench_plugin(Path::new(&file));
+    }
+}
+
+fn bench_plugin(plugin_file: &Path) {
+    let plugin_info = load_cdylib(plugin_file).expect("failed to load plugin");
+    let plugin_name = plugin_info.name.clone();
+
+    let mut global_config = toml::Table::new();
+    let mut plugin_config = toml::Table::new();
+    plugin_config.insert("custom_attribute".into(), "42".into());
+    global_config.insert(plugin_name.clone(), plugin_config.into());
+    let plugin_config = plugin_subconfig(&plugin_info, &mut global_config).expect("plugin subconfig should exist");
+    let mut plugin = initialize(plugin_info, plugin_config).expect("plugin instance should be created by init");
+
+    let mut pipeline_builder = PipelineBuilder::new();
+    let mut handle = AlumetStart::new(&mut pipeline_builder, plugin_name.clone());
+    plugin.start(&mut handle).expect("plugin should start fine");
+    let mut pipeline = pipeline_builder.build().expect("pipeline should build").start();
+
+    // poll much faster than the plugin asks for, to get enough samples
+    let control = pipeline.control_handle();
+    let fast_trigger = trigger::builder::time_interval(POLL_INTERVAL)
+        .build()
+        .expect("trigger should build");
+    control
+        .blocking_plugin(plugin_name.clone())
+        .control_sources(SourceCmd::SetTrigger(Some(fast_trigger)));
+    std::thread::sleep(WARMUP);
+    let before = pipeline.source_timings();
+    std::thread::sleep(DURATION);
+    let after = pipeline.source_timings();
+
+    for timing in after {
+        let previous_count = before
+            .iter()
+            .find(|t| t.name == timing.name)
+            .map(|t| t.poll_duration.count)
+            .unwrap_or(0);
+        let p = timing.poll_duration;
+        eprintln!(
+            "{:<30} {:>10} {:>10?} {:>10?} {:>10?} {:>10?}",
+            plugin_name,
+            p.count - previous_count,
+            p.p50,
+            p.p90,
+            p.p99,
+            p.max
+        );
+    }
+
+    control.shutdown();
+    pipeline.wait_for_shutdown().expect("pipeline should stop");
+    plugin.stop().expect("plugin should stop");
+}
@@ -1,10 +1,25 @@
 use pretty_assertions::assert_str_eq;
-use std::{path::Path, process::Command};
+use std::{
+    path::{Path, PathBuf},
+    process::Command,
+};
 
 #[test]
 fn test_plugin_c() {
+    let plugin_lib = build_plugin("../test-dynamic-plugin-c");
+    run_app_with_plugin(&plugin_lib, "test-dynamic-plugin-c", "0.1.0");
+}
+
+#[test]
+fn test_plugin_cpp() {
+    let plugin_lib = build_plugin("../test-dynamic-plugin-cpp");
+    run_app_with_plugin(&plugin_lib, "test-dynamic-plugin-cpp", "0.1.0");
+}
+
+/// Builds the plugin with `make`, and the test application with `cargo build`.
+fn build_plugin(relative_dir: &str) -> PathBuf {
     let crate_dir = Path::new(env!("CARGO_MANIFEST_DIR"));
-    let plugin_dir = crate_dir.join("../test-dynamic-plugin-c");
+    let plugin_dir = crate_dir.join(relative_dir);
     let plugin_lib = plugin_dir.join("target/plugin.so");
 
     println!("make...");
@@ -14,7 +29,7 @@ fn test_plugin_c() {
         .expect("Running `make` failed")
         .wait()
         .unwrap();
-    assert!(build_result.success(), "Building C plugin failed");
+    assert!(build_result.success(), "Building the plugin failed");
 
     println!("cargo build...");
     let build_result = Command::new("cargo")
@@ -24,9 +39,9 @@ fn test_plugin_c() {
         .expect("Running `make` failed")
         .wait()
         .unwrap();
-    assert!(build_result.success(), "Building C plugin failed");
+    assert!(build_result.success(), "Building the test application failed");
 
-    run_app_with_plugin(&plugin_lib, "test-dynamic-plugin-c", "0.1.0");
+    plugin_lib
 }
 
 fn run_app_with_plugin(plugin_lib: &Path, plugin_name: &str, plugin_version: &str) {